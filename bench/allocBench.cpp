@@ -0,0 +1,314 @@
+/**
+ * @file allocBench.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief 每个请求的堆分配次数：请求arena开启与关闭的对比
+ * @version 1.2
+ * @date 2024-11-24
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-24 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-26 <td>1.1     <td>antaresz    <td>加入/search与/feeds
+ * <tr><td>2024-11-30 <td>1.2     <td>antaresz    <td>HOMETOWN_COROUTINES时加测协程连接循环
+ * </table>
+ *
+ * 替换全局operator new统计分配次数与字节数。进程内启动httpsServer，路由与serverBench相同，
+ * 客户端直接用OpenSSL的阻塞接口和预先拼好的请求，测量期间自身不调用operator new，
+ * 于是差值都来自服务端。OpenSSL内部用malloc，不在统计范围内。
+ * 以HOMETOWN_COROUTINES编译时另测一轮协程驱动的连接(arena开启)，与回调链的arena一列对比。
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/ssl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "apiRoutes.hpp"
+#include "benchCert.hpp"
+#include "httpsServer.hpp"
+#include "logger.hpp"
+#include "memoryStore.hpp"
+#include "passwordHasher.hpp"
+#include "postManage.hpp"
+#include "tokenSigner.hpp"
+#include "userHandler.hpp"
+#include "workerPool.hpp"
+
+namespace {
+std::atomic<std::uint64_t> allocations{0};
+std::atomic<std::uint64_t> allocated_bytes{0};
+
+void* countedAlloc(std::size_t size, std::size_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (size == 0) {
+        size = 1;
+    }
+    return alignment <= alignof(std::max_align_t) ? std::malloc(size) : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+void* countedAllocOrThrow(std::size_t size, std::size_t alignment) {
+    void* p = countedAlloc(size, alignment);
+
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+}
+
+void* operator new(std::size_t size) { return countedAllocOrThrow(size, alignof(std::max_align_t)); }
+void* operator new[](std::size_t size) { return countedAllocOrThrow(size, alignof(std::max_align_t)); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return countedAllocOrThrow(size, static_cast<std::size_t>(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return countedAllocOrThrow(size, static_cast<std::size_t>(alignment)); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size, alignof(std::max_align_t)); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size, alignof(std::max_align_t)); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+namespace {
+const char* BENCH_PASSWORD = "hometown-bench";
+const std::size_t WARMUP_REQUESTS = 200;
+
+/**
+ * @brief 单个keep-alive连接上的阻塞TLS客户端，接收缓冲区固定大小
+ *
+ */
+class blockingClient {
+public:
+    blockingClient() : _ctx(SSL_CTX_new(TLS_client_method())) {}
+    ~blockingClient() {
+        if (_ssl) {
+            SSL_free(_ssl);
+        }
+        if (_fd >= 0) {
+            ::close(_fd);
+        }
+        SSL_CTX_free(_ctx);
+    }
+    blockingClient(const blockingClient&) = delete;
+    blockingClient& operator=(const blockingClient&) = delete;
+
+    bool connect(unsigned short port) {
+        sockaddr_in address{};
+        int one = 1;
+
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        _fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (_fd < 0 || ::connect(_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            return false;
+        }
+        ::setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        _ssl = SSL_new(_ctx);
+        SSL_set_fd(_ssl, _fd);
+        return SSL_connect(_ssl) == 1;
+    }
+    /**
+     * @brief 发送一个请求并读完响应
+     *
+     * @param request
+     * @return int 响应状态码，出错时为0
+     */
+    int roundTrip(std::string_view request) {
+        if (SSL_write(_ssl, request.data(), static_cast<int>(request.size())) != static_cast<int>(request.size())) {
+            return 0;
+        }
+
+        std::size_t used = 0;
+        std::size_t expected = 0;
+
+        while (expected == 0 || used < expected) {
+            int n = SSL_read(_ssl, _buffer + used, static_cast<int>(sizeof(_buffer) - used));
+
+            if (n <= 0) {
+                return 0;
+            }
+            used += static_cast<std::size_t>(n);
+            if (expected == 0) {
+                auto* header_end = static_cast<const char*>(memmem(_buffer, used, "\r\n\r\n", 4));
+                auto* length = header_end ? static_cast<const char*>(memmem(_buffer, header_end - _buffer, "Content-Length: ", 16)) : nullptr;
+
+                if (length) {
+                    expected = static_cast<std::size_t>(header_end + 4 - _buffer) + std::strtoul(length + 16, nullptr, 10);
+                }
+            }
+        }
+        return used > 12 ? std::atoi(_buffer + 9) : 0;
+    }
+
+private:
+    SSL_CTX* _ctx;
+    SSL* _ssl = nullptr;
+    int _fd = -1;
+    char _buffer[1 << 16];
+};
+
+struct scenario {
+    const char* name;
+    std::string request;
+    int status;                     //期望的状态码
+};
+
+struct measurement {
+    double allocations = 0;         //每个请求的operator new次数
+    double bytes = 0;               //每个请求申请的字节数
+    bool ok = false;
+};
+
+/**
+ * @brief 启动一个服务端，在同一连接上依次测量各场景
+ *
+ * @param options
+ * @param signer 两次运行共用，场景中的令牌预先签好
+ * @param scenarios
+ * @param requests 每个场景测量的请求数
+ * @return std::vector<measurement>
+ */
+std::vector<measurement> runServer(const serverOptions& options, tokenSigner& signer, const std::vector<scenario>& scenarios, std::size_t requests) {
+    kdfParams kdf_params;
+
+    kdf_params.scrypt_log2_n = 10;      //只关心分配次数，哈希越快测量越短
+
+    memoryStore store;
+    workerPool db_pool("db", 2, 1024);
+    workerPool hash_pool("hash", 1, 1024);
+    userHandler user_handler(store, db_pool, hash_pool, kdf_params);
+    postManage post_manager(store);
+    httpsServer server(options);
+    std::vector<measurement> results(scenarios.size());
+
+    installApiRoutes(server, apiServices{user_handler, post_manager, signer, db_pool});
+    store.insertUser(userRegistration{"bench_user", "", "resident", "id_card", "0", "0"}, passwordHasher(kdf_params).hash(BENCH_PASSWORD));
+    for (int i = 0; i < 50; ++i) {
+        store.insertPost(1, "title " + std::to_string(i), std::string(256, 'x'), "notice");
+    }
+    post_manager.buildIndexes();
+
+    std::thread server_thread([&server]() { server.start(); });
+    blockingClient client;
+
+    if (client.connect(options.port)) {
+        for (std::size_t i = 0; i < scenarios.size(); ++i) {
+            const std::string& request = scenarios[i].request;
+            bool ok = true;
+
+            for (std::size_t n = 0; n < WARMUP_REQUESTS && ok; ++n) {
+                ok = client.roundTrip(request) == scenarios[i].status;
+            }
+
+            std::uint64_t count = allocations.load();
+            std::uint64_t bytes = allocated_bytes.load();
+
+            for (std::size_t n = 0; n < requests && ok; ++n) {
+                ok = client.roundTrip(request) == scenarios[i].status;
+            }
+            results[i].allocations = static_cast<double>(allocations.load() - count) / requests;
+            results[i].bytes = static_cast<double>(allocated_bytes.load() - bytes) / requests;
+            results[i].ok = ok;
+        }
+    }
+    server.stop();
+    server_thread.join();
+    return results;
+}
+
+std::string makeRequest(const std::string& method, const std::string& target, const std::string& headers = "", const std::string& body = "") {
+    return method + " " + target + " HTTP/1.1\r\nHost: localhost\r\n" + headers + "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+}
+
+int main(int argc, char* argv[]) {
+    std::size_t requests = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+    serverOptions arena_on;
+
+    if (requests == 0) {
+        std::fprintf(stderr, "usage: %s [requests] [arena_bytes]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 2) {
+        arena_on.request_arena_bytes = std::strtoul(argv[2], nullptr, 10);
+    }
+    arena_on.port = 23032;
+    arena_on.threads = 1;
+    arena_on.max_keep_alive_requests = static_cast<std::size_t>(-1);
+    if (!makeTemporaryCert(arena_on.cert_path, arena_on.key_path)) {
+        std::fprintf(stderr, "Failed to generate a self-signed certificate\n");
+        return 1;
+    }
+    logger::getInstance().setLevel(logLevel::error);
+
+    serverOptions arena_off = arena_on;
+
+    arena_off.request_arena_bytes = 0;
+
+    tokenSigner signer;
+    std::string post_body = "{\"title\":\"bench\",\"content\":\"" + std::string(512, 'x') + "\",\"post_type\":\"notice\"}";
+    std::string login_body = std::string("{\"username\":\"bench_user\",\"password\":\"") + BENCH_PASSWORD + "\"}";
+    std::string json_headers = "Content-Type: application/json\r\n";
+    std::vector<scenario> scenarios = {
+        {"GET /missing (404)", makeRequest("GET", "/missing"), 404},
+        {"GET /posts/{id} (cached)", makeRequest("GET", "/posts/1"), 200},
+        {"GET /posts?limit=20", makeRequest("GET", "/posts?limit=20"), 200},
+        {"GET /search?q=title", makeRequest("GET", "/search?q=title&limit=20"), 200},
+        {"GET /feeds/type/notice", makeRequest("GET", "/feeds/type/notice?limit=20"), 200},
+        {"POST /createPost", makeRequest("POST", "/createPost", json_headers + "Authorization: Bearer " + signer.issue(1) + "\r\n", post_body), 200},
+        {"POST /login", makeRequest("POST", "/login", json_headers, login_body), 200},
+    };
+    std::vector<measurement> heap = runServer(arena_off, signer, scenarios, requests);
+    std::vector<measurement> arena = runServer(arena_on, signer, scenarios, requests);
+#ifdef HOMETOWN_COROUTINES
+    serverOptions coroutine_on = arena_on;
+
+    coroutine_on.coroutines = true;
+
+    std::vector<measurement> coroutine = runServer(coroutine_on, signer, scenarios, requests);
+#endif
+
+    std::printf("operator new per request over %zu requests (after %zu warm-up), arena block %zu bytes\n",
+        requests, WARMUP_REQUESTS, arena_on.request_arena_bytes);
+#ifdef HOMETOWN_COROUTINES
+    std::printf("%-26s %10s %10s %10s %10s %10s %10s\n", "", "heap", "heap", "arena", "arena", "coroutine", "coroutine");
+    std::printf("%-26s %10s %10s %10s %10s %10s %10s\n", "scenario", "allocs", "bytes", "allocs", "bytes", "allocs", "bytes");
+    for (std::size_t i = 0; i < scenarios.size(); ++i) {
+        if (!heap[i].ok || !arena[i].ok || !coroutine[i].ok) {
+            std::printf("%-26s failed\n", scenarios[i].name);
+            continue;
+        }
+        std::printf("%-26s %10.2f %10.0f %10.2f %10.0f %10.2f %10.0f\n", scenarios[i].name, heap[i].allocations, heap[i].bytes,
+            arena[i].allocations, arena[i].bytes, coroutine[i].allocations, coroutine[i].bytes);
+    }
+#else
+    std::printf("%-26s %10s %10s %10s %10s\n", "", "heap", "heap", "arena", "arena");
+    std::printf("%-26s %10s %10s %10s %10s\n", "scenario", "allocs", "bytes", "allocs", "bytes");
+    for (std::size_t i = 0; i < scenarios.size(); ++i) {
+        if (!heap[i].ok || !arena[i].ok) {
+            std::printf("%-26s failed\n", scenarios[i].name);
+            continue;
+        }
+        std::printf("%-26s %10.2f %10.0f %10.2f %10.0f\n", scenarios[i].name, heap[i].allocations, heap[i].bytes, arena[i].allocations, arena[i].bytes);
+    }
+#endif
+    return 0;
+}
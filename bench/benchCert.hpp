@@ -0,0 +1,86 @@
+/**
+ * @file benchCert.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief 基准测试共用的临时自签名证书
+ * @version 1.0
+ * @date 2024-11-24
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-24 <td>1.0     <td>antaresz    <td>自serverBench.cpp移出
+ * </table>
+ */
+#ifndef _BENCHCERT_HPP
+#define _BENCHCERT_HPP
+
+#include <openssl/ec.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+/**
+ * @brief 生成临时自签名证书，供未指定--cert/--key时使用
+ *
+ * @param cert_path
+ * @param key_path
+ * @return true
+ */
+inline bool writeSelfSignedCert(const std::string& cert_path, const std::string& key_path) {
+    EVP_PKEY* key = nullptr;
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    bool ok = ctx && EVP_PKEY_keygen_init(ctx) > 0 && EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1) > 0
+        && EVP_PKEY_keygen(ctx, &key) > 0;
+    X509* cert = ok ? X509_new() : nullptr;
+
+    EVP_PKEY_CTX_free(ctx);
+    if (cert) {
+        X509_NAME* name = X509_get_subject_name(cert);
+
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+        X509_set_pubkey(cert, key);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+        X509_set_issuer_name(cert, name);
+        ok = X509_sign(cert, key, EVP_sha256()) > 0;
+
+        FILE* cert_file = ok ? std::fopen(cert_path.c_str(), "w") : nullptr;
+        FILE* key_file = ok ? std::fopen(key_path.c_str(), "w") : nullptr;
+
+        ok = cert_file && key_file && PEM_write_X509(cert_file, cert) && PEM_write_PrivateKey(key_file, key, nullptr, nullptr, 0, nullptr, nullptr);
+        if (cert_file) {
+            std::fclose(cert_file);
+        }
+        if (key_file) {
+            std::fclose(key_file);
+        }
+    }
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return ok;
+}
+
+/**
+ * @brief 在临时目录中生成证书与私钥
+ *
+ * @param cert_path 输出证书路径
+ * @param key_path 输出私钥路径
+ * @return true
+ */
+inline bool makeTemporaryCert(std::string& cert_path, std::string& key_path) {
+    char dir[] = "/tmp/hometown-bench-XXXXXX";
+
+    if (!mkdtemp(dir)) {
+        return false;
+    }
+    cert_path = std::string(dir) + "/cert.pem";
+    key_path = std::string(dir) + "/key.pem";
+    return writeSelfSignedCert(cert_path, key_path);
+}
+
+#endif
@@ -0,0 +1,123 @@
+/**
+ * @file httpParserBench.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief httpParser与原istringstream解析路径的对比基准
+ * @version 1.0
+ * @date 2024-11-10
+ * 
+ * @copyright Copyright (c) 2024 antaresz
+ * 
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-10 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include "httpParser.hpp"
+
+namespace {
+const char* REQUEST =
+    "POST /login HTTP/1.1\r\n"
+    "Host: antaresz.cc:23030\r\n"
+    "User-Agent: Mozilla/5.0 (iPhone; CPU iPhone OS 17_0 like Mac OS X) AppleWebKit/605.1.15 MicroMessenger/8.0.42\r\n"
+    "Accept: */*\r\n"
+    "Accept-Language: zh-CN,zh-Hans;q=0.9\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Content-Type: application/json\r\n"
+    "Referer: https://servicewechat.com/wx0000000000000000/12/page-frame.html\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Length: 45\r\n"
+    "\r\n"
+    "{\"username\":\"antaresz\",\"password\":\"hometown\"}";
+
+/**
+ * @brief 原handleRequest中的解析逻辑：streambuf → 两次string拷贝 → istringstream → 逐行tolower
+ * 
+ * @param raw 
+ * @param body 
+ * @return std::size_t 
+ */
+std::size_t legacyParse(const std::string& raw, std::string& body) {
+    std::size_t header_end = raw.find("\r\n\r\n") + 4;
+    std::string msg_display(raw);
+    std::string raw_data(raw.begin(), raw.begin() + header_end);
+    std::istringstream request_stream(raw_data);
+    std::string method, path, http_version;
+    request_stream >> method >> path >> http_version;
+    request_stream.get();
+    request_stream.get();
+
+    std::string header;
+    std::size_t content_length = 0;
+
+    while (std::getline(request_stream, header)) {
+        std::string header_lower = header;
+        std::transform(header_lower.begin(), header_lower.end(), header_lower.begin(), ::tolower);
+
+        if (!header.empty() && header.back() == '\r') {
+            header.pop_back();
+        }
+        if (header.empty()) {
+            break;
+        }
+        if (header_lower.find("content-length:") != std::string::npos) {
+            content_length = std::stoul(header.substr(16));
+        }
+    }
+    body.assign(raw.begin() + header_end, raw.begin() + header_end + content_length);
+    return body.size() + path.size();
+}
+
+std::size_t newParse(httpParser& parser, std::string& raw) {
+    parser.reset();
+    if (parser.parse(&raw[0], raw.size()) != httpParser::status::complete) {
+        std::abort();
+    }
+    return parser.request().body.size() + parser.request().target.size();
+}
+
+template <typename F>
+double run(const char* name, std::size_t iterations, F&& f) {
+    std::size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < iterations; ++i) {
+        sink += f();
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+    std::printf("%-28s %10.1f ns/request  (checksum %zu)\n", name, ns, sink);
+    return ns;
+}
+}
+
+int main(int argc, char* argv[]) {
+    std::size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    std::string raw(REQUEST);
+    std::string body;
+    httpParser parser;
+
+    std::printf("request: %zu bytes, %zu iterations\n", raw.size(), iterations);
+
+    double legacy = run("legacy istringstream", iterations, [&]() { return legacyParse(raw, body); });
+    double parsed = run("httpParser", iterations, [&]() { return newParse(parser, raw); });
+
+    // 请求头被拆成两段到达：第一次parse不完整，第二次从断点继续
+    std::size_t split = raw.find("Connection");
+    double incremental = run("httpParser (split read)", iterations, [&]() {
+        parser.reset();
+        parser.parse(&raw[0], split);
+        parser.parse(&raw[0], raw.size());
+        return parser.request().body.size();
+    });
+
+    std::printf("speedup: %.1fx (single read), %.1fx (split read)\n", legacy / parsed, legacy / incremental);
+    return 0;
+}
@@ -0,0 +1,157 @@
+/**
+ * @file searchBench.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief postIndex检索与逐帖子子串匹配(相当于LIKE '%词%')的对比基准
+ * @version 1.0
+ * @date 2024-11-26
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-26 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "postIndex.hpp"
+
+namespace {
+// 常用词在前，按近似Zipf分布抽取
+const char* WORDS[] = {
+    "社区", "活动", "通知", "居民", "服务", "报名", "时间", "地点", "志愿者", "老人",
+    "儿童", "健康", "讲座", "物业", "停车", "垃圾分类", "维修", "电梯", "绿化", "安全",
+    "消防", "演练", "周末", "市场", "二手", "转让", "求助", "寻物", "宠物", "疫苗",
+    "图书", "阅读", "书法", "太极", "广场舞", "篮球", "乒乓球", "亲子", "手工", "烘焙",
+    "wifi", "APP", "2024", "Hometown", "家政", "保洁", "快递", "驿站", "邻里", "互助",
+    "菜园", "种植", "义诊", "体检", "理发", "防诈骗", "反诈", "宣传", "议事会", "投票",
+};
+const std::size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+struct post {
+    std::string title;
+    std::string content;
+};
+
+std::string sentence(std::mt19937& rng, std::size_t words) {
+    static std::discrete_distribution<std::size_t> pick = [] {
+        std::vector<double> weights;
+
+        for (std::size_t i = 0; i < WORD_COUNT; ++i) {
+            weights.push_back(1.0 / static_cast<double>(i + 1));
+        }
+        return std::discrete_distribution<std::size_t>(weights.begin(), weights.end());
+    }();
+    std::string out;
+
+    for (std::size_t i = 0; i < words; ++i) {
+        out += WORDS[pick(rng)];
+        out += (i % 7 == 6) ? "，" : "";
+    }
+    out += "。";
+    return out;
+}
+
+/**
+ * @brief 索引之外的做法：逐帖子查找每个词，全部出现才算命中
+ *
+ * @param posts
+ * @param terms
+ * @return std::size_t 命中数
+ */
+std::size_t scan(const std::vector<post>& posts, const std::vector<std::string>& terms) {
+    std::size_t matched = 0;
+
+    for (const post& p : posts) {
+        bool all = true;
+
+        for (const std::string& term : terms) {
+            if (p.title.find(term) == std::string::npos && p.content.find(term) == std::string::npos) {
+                all = false;
+                break;
+            }
+        }
+        matched += all;
+    }
+    return matched;
+}
+
+double percentile(std::vector<double>& samples, double p) {
+    std::size_t index = static_cast<std::size_t>(p * static_cast<double>(samples.size() - 1));
+
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+}
+
+int main(int argc, char* argv[]) {
+    std::size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    std::size_t iterations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2000;
+    std::mt19937 rng(20241126);
+    std::vector<post> posts;
+    postIndex index;
+
+    posts.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        posts.push_back({sentence(rng, 3 + rng() % 4), sentence(rng, 20 + rng() % 60)});
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < count; ++i) {
+        index.add(static_cast<int>(i + 1), posts[i].title, posts[i].content);
+    }
+
+    double build = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    indexStats stats = index.stats();
+
+    std::printf("posts: %zu, build %.2f s, %zu terms, %.1f MB postings\n",
+                stats.documents, build, stats.terms, static_cast<double>(stats.posting_bytes) / (1024 * 1024));
+
+    // 高频词、两个词求交、低频词、中英混合
+    const char* queries[][2] = {
+        {"社区", "社区"},
+        {"社区活动", "社区活动"},
+        {"防诈骗 宣传", "防诈骗 宣传"},
+        {"议事会投票", "议事会投票"},
+        {"hometown 邻里互助", "Hometown 邻里互助"},
+    };
+    std::vector<searchHit> hits;
+
+    std::printf("%-24s %8s %12s %12s %12s\n", "query", "matched", "index p50", "index p99", "scan");
+    for (const auto& query : queries) {
+        std::vector<double> samples;
+        std::size_t matched = 0;
+
+        samples.reserve(iterations);
+        for (std::size_t i = 0; i < iterations; ++i) {
+            auto begin = std::chrono::steady_clock::now();
+
+            matched = index.search(query[0], 20, hits);
+            samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+        }
+
+        // 子串匹配按空格分开的原词查找，只跑一次
+        std::vector<std::string> words;
+        std::string text = query[1];
+
+        for (std::size_t pos = 0, next; pos < text.size(); pos = next + 1) {
+            next = std::min(text.find(' ', pos), text.size());
+            words.push_back(text.substr(pos, next - pos));
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        std::size_t scanned = scan(posts, words);
+        double scan_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+
+        std::printf("%-24s %8zu %9.1f us %9.1f us %9.0f us  (scan matched %zu)\n",
+                    query[0], matched, percentile(samples, 0.5), percentile(samples, 0.99), scan_us, scanned);
+    }
+    return 0;
+}
@@ -0,0 +1,630 @@
+/**
+ * @file serverBench.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief httpsServer端到端负载与延迟基准
+ * @version 1.6
+ * @date 2024-11-20
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-20 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-22 <td>1.1     <td>antaresz    <td>使用memoryStore与apiRoutes，和服务端走同一套handler
+ * <tr><td>2024-11-23 <td>1.2     <td>antaresz    <td>可开启批量写入
+ * <tr><td>2024-11-24 <td>1.3     <td>antaresz    <td>自签名证书移到benchCert.hpp，与allocBench共用
+ * <tr><td>2024-11-28 <td>1.4     <td>antaresz    <td>准入控制参数，db线程池报告排队延迟
+ * <tr><td>2024-11-29 <td>1.5     <td>antaresz    <td>--async-store：存储走异步接口，与db线程池在同样的延迟下对比
+ * <tr><td>2024-11-30 <td>1.6     <td>antaresz    <td>--coroutines：tls模式下服务端连接由协程驱动
+ * </table>
+ *
+ * 在进程内启动httpsServer，路由由installApiRoutes注册，与main.cpp相同，存储换成带固定往返延迟的memoryStore。
+ * tls模式下由若干并发客户端经TLS连接驱动/login、/register、/createPost；
+ * inproc模式下绕过socket与TLS，直接调用simulateRequest。结果以JSON输出。
+ */
+#include <utility>      //同httpsServer.hpp，C++20下须先于asio包含
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/program_options.hpp>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "apiRoutes.hpp"
+#include "benchCert.hpp"
+#include "httpsServer.hpp"
+#include "logger.hpp"
+#include "memoryStore.hpp"
+#include "passwordHasher.hpp"
+#include "postManage.hpp"
+#include "tokenSigner.hpp"
+#include "userHandler.hpp"
+#include "workerPool.hpp"
+
+namespace po = boost::program_options;
+namespace ssl = boost::asio::ssl;
+using boost::asio::ip::tcp;
+using benchClock = std::chrono::steady_clock;
+
+namespace {
+const char* BENCH_PASSWORD = "hometown-bench";
+
+enum endpoint { LOGIN, REGISTER, CREATE_POST, ENDPOINT_COUNT };
+const char* ENDPOINT_NAMES[ENDPOINT_COUNT] = {"login", "register", "createPost"};
+
+/**
+ * @brief 基准参数
+ *
+ */
+struct benchOptions {
+    std::string mode = "tls";                   //tls或inproc
+    std::size_t connections = 32;               //并发客户端数
+    std::size_t client_threads = 2;             //运行客户端的线程数
+    std::size_t requests_per_connection = 0;    //每个连接发送的请求数，0表示一直复用直到服务端关闭
+    bool resume = true;                         //重连时是否复用TLS会话
+    double warmup = 1;                          //预热秒数，不计入结果
+    double duration = 10;                       //计时秒数
+    unsigned weights[ENDPOINT_COUNT] = {30, 10, 60};    //各接口的请求比例
+    std::size_t users = 64;                     //预先注册的用户数
+    std::size_t post_bytes = 512;               //createPost正文长度
+    std::chrono::microseconds db_latency{200};  //模拟的数据库往返时间
+};
+
+/**
+ * @brief 一次待发送的请求
+ *
+ */
+struct benchRequest {
+    endpoint kind = LOGIN;
+    std::string method = "POST";
+    std::string path;
+    std::string headers;
+    std::string body;
+
+    std::string wire() const {
+        return method + " " + path + " HTTP/1.1\r\nHost: localhost\r\n" + headers + "Content-Length: " + std::to_string(body.size())
+            + "\r\nContent-Type: application/json\r\n\r\n" + body;
+    }
+};
+
+/**
+ * @brief 客户端自己的请求生成器与延迟样本，只被该客户端访问
+ *
+ */
+class workload {
+public:
+    workload(const benchOptions& options, const std::vector<std::string>& users, std::string token, std::size_t client_id)
+        : _options(options), _users(users), _token(std::move(token)), _client_id(client_id), _rng(static_cast<std::uint32_t>(client_id) * 7919 + 1),
+        _pick(std::begin(options.weights), std::end(options.weights)) {}
+
+    benchRequest next() {
+        benchRequest request;
+
+        request.kind = static_cast<endpoint>(_pick(_rng));
+        switch (request.kind) {
+        case LOGIN:
+            request.path = "/login";
+            request.body = nlohmann::json{{"username", _users[_rng() % _users.size()]}, {"password", BENCH_PASSWORD}}.dump();
+            break;
+        case REGISTER:
+            request.path = "/register";
+            request.body = nlohmann::json{{"username", "bench_" + std::to_string(_client_id) + "_" + std::to_string(_sequence++)},
+                {"password", BENCH_PASSWORD}, {"user_type", "resident"}, {"id_type", "id_card"}, {"id_number", "0"}, {"phone", "0"}}.dump();
+            break;
+        default:
+            request.path = "/createPost";
+            request.headers = "Authorization: Bearer " + _token + "\r\n";
+            request.body = nlohmann::json{{"title", "bench"}, {"content", std::string(_options.post_bytes, 'x')}, {"post_type", "notice"}}.dump();
+            break;
+        }
+        return request;
+    }
+    /**
+     * @brief 记录一个完成的请求，只统计在计时窗口内开始并结束的请求
+     *
+     */
+    void record(endpoint kind, benchClock::time_point started, benchClock::time_point finished, bool ok,
+                benchClock::time_point measure_from, benchClock::time_point measure_until) {
+        if (started < measure_from || finished > measure_until) {
+            return;
+        }
+        if (ok) {
+            latency_us[kind].push_back(static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(finished - started).count()));
+        } else {
+            ++errors[kind];
+        }
+    }
+
+    std::vector<std::uint32_t> latency_us[ENDPOINT_COUNT];
+    std::uint64_t errors[ENDPOINT_COUNT] = {};
+
+private:
+    const benchOptions& _options;
+    const std::vector<std::string>& _users;
+    std::string _token;
+    std::size_t _client_id;
+    std::uint64_t _sequence = 0;
+    std::mt19937 _rng;
+    std::discrete_distribution<int> _pick;
+};
+
+/**
+ * @brief tls模式下的一个客户端，同一时间只有一个请求在途，回调天然串行
+ *
+ */
+class tlsClient : public std::enable_shared_from_this<tlsClient> {
+public:
+    tlsClient(boost::asio::io_context& io, ssl::context& ctx, tcp::endpoint server, const benchOptions& options, workload& load,
+              benchClock::time_point measure_from, benchClock::time_point measure_until)
+        : _io(io), _ctx(ctx), _server(server), _options(options), _load(load), _measure_from(measure_from), _measure_until(measure_until) {}
+    ~tlsClient() {
+        SSL_SESSION_free(_session);
+    }
+
+    void start() {
+        next();
+    }
+    std::uint64_t connections() const { return _connections; }
+    /**
+     * @brief 客户端context的新会话回调，TLS 1.3的票据在握手之后到达，只能由回调取得
+     *
+     * @return int 1表示接管session的引用
+     */
+    static int onNewSession(SSL* ssl, SSL_SESSION* session) {
+        auto* self = static_cast<tlsClient*>(SSL_get_ex_data(ssl, exDataIndex()));
+
+        if (!self || !SSL_SESSION_is_resumable(session)) {
+            return 0;
+        }
+        SSL_SESSION_free(self->_session);
+        self->_session = session;
+        return 1;
+    }
+
+private:
+    using stream_type = ssl::stream<tcp::socket>;
+
+    /**
+     * @brief 发出下一个请求，没有可用连接时先建连，延迟包含建连与握手
+     *
+     */
+    void next() {
+        if (benchClock::now() >= _measure_until) {
+            closeStream();
+            return;
+        }
+        _request = _load.next();
+        _wire = _request.wire();
+        _started = benchClock::now();
+        if (_stream) {
+            send();
+        } else {
+            connect();
+        }
+    }
+    void connect() {
+        auto self = shared_from_this();
+
+        _stream = std::make_unique<stream_type>(_io, _ctx);
+        _served = 0;
+        ++_connections;
+        if (_options.resume) {
+            SSL_set_ex_data(_stream->native_handle(), exDataIndex(), this);
+            if (_session) {
+                SSL_set_session(_stream->native_handle(), _session);
+            }
+        }
+        _stream->lowest_layer().async_connect(_server, [self](boost::system::error_code ec) {
+            if (ec) {
+                self->fail();
+                return;
+            }
+            self->_stream->lowest_layer().set_option(tcp::no_delay(true), ec);
+            self->_stream->async_handshake(ssl::stream_base::client, [self](boost::system::error_code ec) {
+                if (ec) {
+                    self->fail();
+                    return;
+                }
+                self->send();
+            });
+        });
+    }
+    void send() {
+        auto self = shared_from_this();
+
+        boost::asio::async_write(*_stream, boost::asio::buffer(_wire), [self](boost::system::error_code ec, std::size_t /*length*/) {
+            if (ec) {
+                self->fail();
+                return;
+            }
+            self->readHeader();
+        });
+    }
+    void readHeader() {
+        auto self = shared_from_this();
+
+        boost::asio::async_read_until(*_stream, boost::asio::dynamic_buffer(_in), "\r\n\r\n", [self](boost::system::error_code ec, std::size_t header_bytes) {
+            if (ec) {
+                self->fail();
+                return;
+            }
+
+            std::string_view head(self->_in.data(), header_bytes);
+            std::size_t content_length = 0;
+            std::string_view length = findHeader(head, "content-length:");
+
+            std::from_chars(length.data(), length.data() + length.size(), content_length);
+
+            int status = head.size() > 12 ? std::atoi(self->_in.c_str() + 9) : 0;
+            bool close = findHeader(head, "connection:") == "close";
+            std::size_t total = header_bytes + content_length;
+
+            if (self->_in.size() >= total) {
+                self->finish(status, close, total);
+                return;
+            }
+            boost::asio::async_read(*self->_stream, boost::asio::dynamic_buffer(self->_in), boost::asio::transfer_exactly(total - self->_in.size()),
+                [self, status, close, total](boost::system::error_code ec, std::size_t /*length*/) {
+                    if (ec) {
+                        self->fail();
+                        return;
+                    }
+                    self->finish(status, close, total);
+                });
+        });
+    }
+    void finish(int status, bool close, std::size_t consumed) {
+        _load.record(_request.kind, _started, benchClock::now(), status >= 200 && status < 300, _measure_from, _measure_until);
+        _in.erase(0, consumed);
+        if (close || (_options.requests_per_connection && ++_served >= _options.requests_per_connection)) {
+            closeStream();
+        }
+        next();
+    }
+    void fail() {
+        _load.record(_request.kind, _started, benchClock::now(), false, _measure_from, _measure_until);
+        closeStream();
+        next();
+    }
+    static int exDataIndex() {
+        static const int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+        return index;
+    }
+    void closeStream() {
+        if (_stream) {
+            boost::system::error_code ignored;
+
+            // 不等待close_notify，但要标记为正常关闭，否则OpenSSL会把保存的会话标记为不可复用
+            SSL_set_quiet_shutdown(_stream->native_handle(), 1);
+            SSL_shutdown(_stream->native_handle());
+            _stream->lowest_layer().close(ignored);
+            _stream.reset();
+        }
+        _in.clear();
+    }
+    static std::string_view findHeader(std::string_view head, std::string_view name) {
+        auto it = std::search(head.begin(), head.end(), name.begin(), name.end(),
+            [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
+
+        if (it == head.end()) {
+            return std::string_view();
+        }
+
+        std::size_t begin = head.find_first_not_of(' ', (it - head.begin()) + name.size());
+        std::size_t end = head.find("\r\n", begin);
+
+        return begin == std::string_view::npos ? std::string_view() : head.substr(begin, end - begin);
+    }
+
+    boost::asio::io_context& _io;
+    ssl::context& _ctx;
+    tcp::endpoint _server;
+    const benchOptions& _options;
+    workload& _load;
+    benchClock::time_point _measure_from;
+    benchClock::time_point _measure_until;
+    std::unique_ptr<stream_type> _stream;
+    SSL_SESSION* _session = nullptr;            //上一个连接的会话，重连时复用
+    benchRequest _request;
+    std::string _wire;
+    std::string _in;
+    benchClock::time_point _started;
+    std::size_t _served = 0;
+    std::uint64_t _connections = 0;
+};
+
+std::uint32_t percentile(const std::vector<std::uint32_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+
+    std::size_t rank = static_cast<std::size_t>(std::ceil(p * sorted.size()));
+
+    return sorted[std::min(std::max<std::size_t>(rank, 1), sorted.size()) - 1];
+}
+
+nlohmann::json summarize(std::vector<std::uint32_t>& latencies, std::uint64_t errors, double seconds) {
+    std::sort(latencies.begin(), latencies.end());
+
+    double sum = 0;
+
+    for (std::uint32_t us : latencies) {
+        sum += us;
+    }
+    return {
+        {"requests", latencies.size()},
+        {"errors", errors},
+        {"throughput_rps", latencies.size() / seconds},
+        {"latency_us", {
+            {"mean", latencies.empty() ? 0.0 : sum / latencies.size()},
+            {"p50", percentile(latencies, 0.5)},
+            {"p99", percentile(latencies, 0.99)},
+            {"p999", percentile(latencies, 0.999)},
+            {"max", latencies.empty() ? 0 : latencies.back()}
+        }}
+    };
+}
+
+/**
+ * @brief 解析"login=30,register=10,createPost=60"
+ *
+ * @param text
+ * @param weights
+ * @return true
+ */
+bool parseMix(const std::string& text, unsigned (&weights)[ENDPOINT_COUNT]) {
+    std::fill(std::begin(weights), std::end(weights), 0);
+
+    std::size_t pos = 0;
+
+    while (pos < text.size()) {
+        std::size_t comma = std::min(text.find(',', pos), text.size());
+        std::string item = text.substr(pos, comma - pos);
+        std::size_t eq = item.find('=');
+        auto name = std::find(std::begin(ENDPOINT_NAMES), std::end(ENDPOINT_NAMES), item.substr(0, eq));
+
+        if (eq == std::string::npos || name == std::end(ENDPOINT_NAMES)) {
+            return false;
+        }
+        weights[name - std::begin(ENDPOINT_NAMES)] = static_cast<unsigned>(std::stoul(item.substr(eq + 1)));
+        pos = comma + 1;
+    }
+    return std::any_of(std::begin(weights), std::end(weights), [](unsigned w) { return w > 0; });
+}
+}
+
+int main(int argc, char* argv[]) {
+    benchOptions bench;
+    serverOptions server_options;
+    kdfParams kdf_params;
+    std::string mix;
+    std::string output;
+    std::size_t db_threads = 16;
+    std::size_t hash_threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+    long db_latency_us = bench.db_latency.count();
+    bool batch_writes = false;
+    bool async_store = false;
+    batchOptions batch_options;
+    long batch_delay_us = batch_options.max_delay.count();
+    long queue_target_ms = std::chrono::duration_cast<std::chrono::milliseconds>(server_options.admission.queue_target).count();
+    po::options_description desc("serverBench options");
+
+    server_options.port = 23031;
+    desc.add_options()
+        ("help,h", "show help")
+        ("mode", po::value<std::string>(&bench.mode)->default_value(bench.mode), "tls: real TLS connections; inproc: httpsServer::simulateRequest")
+        ("connections,c", po::value<std::size_t>(&bench.connections)->default_value(bench.connections), "concurrent clients")
+        ("client-threads", po::value<std::size_t>(&bench.client_threads)->default_value(bench.client_threads), "threads running the tls clients")
+        ("requests-per-connection", po::value<std::size_t>(&bench.requests_per_connection)->default_value(0), "reconnect after N requests, 0 = reuse until the server closes")
+        ("resume", po::value<bool>(&bench.resume)->default_value(true), "resume TLS sessions when reconnecting")
+        ("warmup", po::value<double>(&bench.warmup)->default_value(bench.warmup), "seconds before measuring")
+        ("duration,d", po::value<double>(&bench.duration)->default_value(bench.duration), "measured seconds")
+        ("mix", po::value<std::string>(&mix)->default_value("login=30,register=10,createPost=60"), "request mix by endpoint")
+        ("users", po::value<std::size_t>(&bench.users)->default_value(bench.users), "pre-registered users used by /login")
+        ("post-bytes", po::value<std::size_t>(&bench.post_bytes)->default_value(bench.post_bytes), "content size of /createPost")
+        ("db-latency-us", po::value<long>(&db_latency_us)->default_value(db_latency_us), "simulated database round trip")
+        ("batch-writes", po::bool_switch(&batch_writes), "group-commit /register and /createPost inserts")
+        ("async-store", po::bool_switch(&async_store), "wait out the db latency on a timer of the store's event loop instead of sleeping on db threads")
+#ifdef HOMETOWN_COROUTINES
+        ("coroutines", po::bool_switch(&server_options.coroutines), "serve tls connections with the coroutine loop instead of the callback chain")
+#endif
+        ("batch-max-rows", po::value<std::size_t>(&batch_options.max_rows)->default_value(batch_options.max_rows), "rows that trigger an immediate commit")
+        ("batch-max-delay-us", po::value<long>(&batch_delay_us)->default_value(batch_delay_us), "longest time the first row of a batch waits")
+        ("db-threads", po::value<std::size_t>(&db_threads)->default_value(db_threads), "db worker threads")
+        ("hash-threads", po::value<std::size_t>(&hash_threads)->default_value(hash_threads), "password hashing threads")
+        ("kdf-cost", po::value<std::uint32_t>(&kdf_params.scrypt_log2_n)->default_value(kdf_params.scrypt_log2_n), "scrypt log2(N)")
+        ("client-rate", po::value<double>(&server_options.admission.client_rate)->default_value(0), "connections plus requests per second per client IP, 0 = unlimited")
+        ("max-inflight", po::value<std::size_t>(&server_options.admission.max_inflight)->default_value(0), "requests in progress above which new ones get 503, 0 = unlimited")
+        ("queue-target-ms", po::value<long>(&queue_target_ms)->default_value(queue_target_ms), "db queue delay that starts load shedding, 0 = disabled")
+        ("threads,t", po::value<std::size_t>(&server_options.threads)->default_value(2), "server io threads")
+        ("port", po::value<unsigned short>(&server_options.port)->default_value(server_options.port), "port of the in-process server")
+        ("cert", po::value<std::string>(&server_options.cert_path), "certificate chain, generated when omitted")
+        ("key", po::value<std::string>(&server_options.key_path), "private key, generated when omitted")
+        ("output,o", po::value<std::string>(&output), "write the JSON report to a file instead of stdout");
+
+    po::variables_map vm;
+
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch (const po::error& e) {
+        std::cerr << e.what() << std::endl << desc << std::endl;
+        return 1;
+    }
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    if ((bench.mode != "tls" && bench.mode != "inproc") || !parseMix(mix, bench.weights) || bench.connections == 0 || bench.users == 0) {
+        std::cerr << "Invalid arguments" << std::endl << desc << std::endl;
+        return 1;
+    }
+    bench.db_latency = std::chrono::microseconds(db_latency_us);
+    batch_options.max_delay = std::chrono::microseconds(batch_delay_us);
+    server_options.admission.queue_target = std::chrono::milliseconds(queue_target_ms);
+    if ((!vm.count("cert") || !vm.count("key")) && !makeTemporaryCert(server_options.cert_path, server_options.key_path)) {
+        std::cerr << "Failed to generate a self-signed certificate" << std::endl;
+        return 1;
+    }
+    logger::getInstance().setLevel(logLevel::error);     //日志与报告共用stdout，只保留错误
+
+    // 异步模式下存储的往返在单独的事件循环上等待，只占一个线程
+    boost::asio::io_context store_io(1);
+    auto store_work = boost::asio::make_work_guard(store_io);
+    std::thread store_thread;
+    memoryStore store(bench.db_latency);
+
+    if (async_store) {
+        store.enableAsync(store_io);
+        store_thread = std::thread([&store_io]() { store_io.run(); });
+    }
+
+    workerPool db_pool("db", db_threads, db_threads * 64);
+    workerPool hash_pool("hash", hash_threads, hash_threads * 16);
+    userHandler user_handler(store, db_pool, hash_pool, kdf_params);
+    postManage post_manager(store);
+    tokenSigner signer;
+    httpsServer server(server_options);
+    std::vector<std::string> users;
+    std::string user_hash = passwordHasher(kdf_params).hash(BENCH_PASSWORD);
+
+    if (batch_writes) {
+        user_handler.enableBatching(batch_options);
+        post_manager.enableBatching(batch_options);
+    }
+    db_pool.setDelayObserver([&server](std::chrono::steady_clock::duration delay) { server.admission().recordQueueDelay(delay); });
+    installApiRoutes(server, apiServices{user_handler, post_manager, signer, db_pool});
+    for (std::size_t i = 0; i < bench.users; ++i) {
+        users.push_back("bench_user_" + std::to_string(i));
+        store.insertUser(userRegistration{users.back(), "", "resident", "id_card", "0", "0"}, user_hash);
+    }
+
+    std::vector<std::unique_ptr<workload>> loads;
+
+    for (std::size_t i = 0; i < bench.connections; ++i) {
+        loads.push_back(std::make_unique<workload>(bench, users, signer.issue(static_cast<std::int64_t>(i % bench.users) + 1), i));
+    }
+
+    auto begin = benchClock::now();
+    auto measure_from = begin + std::chrono::duration_cast<benchClock::duration>(std::chrono::duration<double>(bench.warmup));
+    auto measure_until = measure_from + std::chrono::duration_cast<benchClock::duration>(std::chrono::duration<double>(bench.duration));
+    std::uint64_t connections = 0;
+
+    if (bench.mode == "tls") {
+        std::thread server_thread([&server]() { server.start(); });
+        boost::asio::io_context io(static_cast<int>(bench.client_threads));
+        ssl::context ctx(ssl::context::tls_client);
+        std::vector<std::shared_ptr<tlsClient>> clients;
+        std::vector<std::thread> threads;
+
+        ctx.set_verify_mode(ssl::verify_none);
+        SSL_CTX_set_session_cache_mode(ctx.native_handle(), SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx.native_handle(), &tlsClient::onNewSession);
+        for (auto& load : loads) {
+            clients.push_back(std::make_shared<tlsClient>(io, ctx, tcp::endpoint(boost::asio::ip::address_v4::loopback(), server_options.port),
+                bench, *load, measure_from, measure_until));
+            clients.back()->start();
+        }
+        for (std::size_t i = 0; i < std::max<std::size_t>(1, bench.client_threads); ++i) {
+            threads.emplace_back([&io]() { io.run(); });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        for (auto& client : clients) {
+            connections += client->connections();
+        }
+        server.stop();
+        server_thread.join();
+    } else {
+        std::vector<std::thread> threads;
+
+        for (auto& load : loads) {
+            threads.emplace_back([&server, &load, measure_from, measure_until]() {
+                while (benchClock::now() < measure_until) {
+                    benchRequest request = load->next();
+                    auto started = benchClock::now();
+                    std::string response = server.simulateRequest(request.method, request.path, request.body, request.headers);
+                    int status = response.size() > 12 ? std::atoi(response.c_str() + 9) : 0;
+
+                    load->record(request.kind, started, benchClock::now(), status >= 200 && status < 300, measure_from, measure_until);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    db_pool.join();
+    hash_pool.join();
+    store_work.reset();
+    if (store_thread.joinable()) {
+        store_thread.join();
+    }
+
+    nlohmann::json report = {
+        {"mode", bench.mode},
+        {"connections", bench.connections},
+        {"requests_per_connection", bench.requests_per_connection},
+        {"resume", bench.resume},
+        {"duration_s", bench.duration},
+        {"db_latency_us", bench.db_latency.count()},
+        {"batch_writes", batch_writes},
+        {"async_store", async_store},
+#ifdef HOMETOWN_COROUTINES
+        {"coroutines", server_options.coroutines},
+#endif
+        {"kdf_log2_n", kdf_params.scrypt_log2_n},
+        {"server_threads", server_options.threads}
+    };
+    std::vector<std::uint32_t> all;
+    std::uint64_t all_errors = 0;
+
+    for (int kind = 0; kind < ENDPOINT_COUNT; ++kind) {
+        std::vector<std::uint32_t> latencies;
+        std::uint64_t errors = 0;
+
+        for (auto& load : loads) {
+            latencies.insert(latencies.end(), load->latency_us[kind].begin(), load->latency_us[kind].end());
+            errors += load->errors[kind];
+        }
+        all.insert(all.end(), latencies.begin(), latencies.end());
+        all_errors += errors;
+        report["endpoints"][ENDPOINT_NAMES[kind]] = summarize(latencies, errors, bench.duration);
+    }
+    report["total"] = summarize(all, all_errors, bench.duration);
+    if (batch_writes) {
+        histogramSnapshot posts = post_manager.postBatchSizes()->snapshot();
+
+        report["post_batches"] = {
+            {"commits", posts.count},
+            {"mean_rows", posts.count ? static_cast<double>(posts.sum) / static_cast<double>(posts.count) : 0.0},
+            {"max_delay_us", batch_options.max_delay.count()}
+        };
+    }
+    if (bench.mode == "tls") {
+        report["tls"] = {
+            {"connections", connections},
+            {"full_handshakes", server.tlsSessions().fullHandshakes()},
+            {"resumed_handshakes", server.tlsSessions().resumedHandshakes()}
+        };
+    }
+
+    if (output.empty()) {
+        std::cout << report.dump(2) << std::endl;
+    } else {
+        std::ofstream(output) << report.dump(2) << std::endl;
+    }
+    return 0;
+}
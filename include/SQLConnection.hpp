@@ -2,15 +2,18 @@
  * @file SQLConnection.hpp
  * @author antaresz (antaresz1026@gmail.com)
  * @brief SQLConnection类声明定义
- * @version 1.0
+ * @version 1.3
  * @date 2024-10-11
- * 
+ *
  * @copyright Copyright (c) 2024 antaresz
- * 
+ *
  * @par 修改日志:
  * <table>
  * <tr><th>Date       <th>Version <th>Author <th>Description
  * <tr><td>2024-10-11 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-14 <td>1.1     <td>antaresz    <td>RAII租约、弹性伸缩、获取超时、后台重连与空闲探活
+ * <tr><td>2024-11-15 <td>1.2     <td>antaresz    <td>每个连接缓存预编译语句
+ * <tr><td>2024-11-21 <td>1.3     <td>antaresz    <td>获取连接等待时间直方图
  * </table>
  */
 #ifndef _SQLCONNECTION_HPP
@@ -19,32 +22,159 @@
 #include <mysql_driver.h>
 #include <mysql_connection.h>
 #include <cppconn/driver.h>
+#include <cppconn/prepared_statement.h>
+#include <chrono>
+#include <cstdint>
 #include <string>
 #include <memory>
-#include <queue>
+#include <deque>
 #include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <condition_variable>
+#include "metrics.hpp"
+
+/**
+ * @brief 连接池参数
+ *
+ */
+struct poolOptions {
+    std::size_t min_size = 4;                                               //常驻连接数，后台线程负责补足
+    std::size_t max_size = 16;                                              //连接数上限，竞争时按需扩容
+    std::chrono::milliseconds acquire_timeout = std::chrono::seconds(2);    //getConnection最长等待时间
+    std::chrono::seconds ping_interval = std::chrono::seconds(30);          //空闲超过该时间的连接会被ping
+    std::chrono::seconds idle_timeout = std::chrono::seconds(300);          //超过min_size的连接空闲超过该时间后关闭
+    std::chrono::seconds maintenance_interval = std::chrono::seconds(5);    //后台维护周期
+    std::size_t max_cached_statements = 64;                                 //每个连接缓存的预编译语句上限
+};
+
+/**
+ * @brief 连接池统计
+ *
+ */
+struct poolStats {
+    std::size_t size = 0;                       //当前连接总数
+    std::size_t idle = 0;                       //空闲连接数
+    std::size_t in_use = 0;                     //已借出的连接数
+    std::size_t waiting = 0;                    //正在等待连接的线程数
+    std::uint64_t acquired = 0;                 //累计借出次数
+    std::uint64_t timeouts = 0;                 //累计获取超时次数
+    std::uint64_t reconnects = 0;               //累计重连/替换次数
+    std::uint64_t wait_ns_total = 0;            //累计等待时间
+    std::uint64_t wait_ns_max = 0;              //最长一次等待时间
+};
 
 class SQLConnection {
+    struct pooledConnection;
+
 public:
-    SQLConnection(const std::string& host, const std::string& user, const std::string& password, const std::string& database);
+    /**
+     * @brief 借出的连接，析构时自动归还连接池
+     *
+     * 不能比连接池活得更久。
+     */
+    class lease {
+    public:
+        lease() = default;
+        lease(lease&& other) noexcept;
+        lease& operator=(lease&& other) noexcept;
+        ~lease();
+
+        lease(const lease&) = delete;
+        lease& operator=(const lease&) = delete;
+
+        sql::Connection* operator->() const;
+        sql::Connection& operator*() const;
+        explicit operator bool() const { return _conn != nullptr; }
+        /**
+         * @brief 取该连接上按SQL文本缓存的预编译语句，首次使用时才prepare
+         *
+         * 语句归连接所有，调用方不能delete，也不能在lease归还后继续使用；
+         * 返回前会清空上一次绑定的参数。
+         *
+         * @param sql
+         * @return sql::PreparedStatement*
+         */
+        sql::PreparedStatement* prepare(const std::string& sql);
+        /**
+         * @brief 标记连接已损坏，归还时直接丢弃并由后台线程补充
+         *
+         */
+        void invalidate();
+
+    private:
+        friend class SQLConnection;
+        lease(SQLConnection* pool, std::unique_ptr<pooledConnection> conn);
+        void release();
+
+        SQLConnection* _pool = nullptr;
+        std::unique_ptr<pooledConnection> _conn;
+        bool _broken = false;
+    };
+
+    SQLConnection(const std::string& host, const std::string& user, const std::string& password, const std::string& database, const poolOptions& options = poolOptions());
     ~SQLConnection();
 
-    std::shared_ptr<sql::Connection> getConnection();
-    void releaseConnection(std::shared_ptr<sql::Connection> conn);
+    /**
+     * @brief 借出一个连接
+     *
+     * 没有空闲连接且未达上限时新建连接，否则等待，最长acquire_timeout。
+     *
+     * @return lease
+     * @throw sql::SQLException 超时
+     */
+    lease getConnection();
+    /**
+     * @brief 连接池容量上限，用于确定数据库线程池的线程数
+     *
+     * @return std::size_t
+     */
+    std::size_t size() const { return _options.max_size; }
+    /**
+     * @brief 连接池统计快照
+     *
+     * @return poolStats
+     */
+    poolStats stats() const;
+    /**
+     * @brief getConnection的等待时间(微秒)，包括超时的等待
+     *
+     * @return const histogram&
+     */
+    const histogram& waitTime() const { return _wait_time; }
 
 private:
-    void createConnection();
+    struct pooledConnection {
+        std::unique_ptr<sql::Connection> conn;                      //底层连接
+        std::unordered_map<std::string, std::unique_ptr<sql::PreparedStatement>> statements;   //SQL文本 -> 预编译语句，先于conn析构
+        std::chrono::steady_clock::time_point idle_since;           //放回池中的时间
+        std::chrono::steady_clock::time_point checked_at;           //上次确认可用的时间
+    };
+
+    void releaseConnection(std::unique_ptr<pooledConnection> conn, bool broken);
+    std::unique_ptr<pooledConnection> createConnection();
+    /**
+     * @brief 后台维护线程：探活空闲连接、关闭多余的空闲连接、补足min_size
+     *
+     */
+    void maintain();
 
     std::string _host;
     std::string _user;
     std::string _password;
     std::string _database;
+    poolOptions _options;
 
-    std::queue<std::shared_ptr<sql::Connection>> _connections;
-    std::mutex _mtx;
-    std::condition_variable _cv;
+    std::deque<std::unique_ptr<pooledConnection>> _idle;            //空闲连接，尾部最近归还
+    std::size_t _total = 0;                                         //连接总数(含借出与正在建立的)
+    poolStats _stats;                                               //统计，受_mtx保护
+    histogram _wait_time;                                           //等待时间，无锁
+    mutable std::mutex _mtx;
+    std::condition_variable _cv;                                    //有连接归还或名额释放
+    std::condition_variable _maintain_cv;                           //唤醒维护线程
+    bool _stopping = false;
     sql::mysql::MySQL_Driver* _driver;
+    std::thread _maintainer;
 };
 
 #endif // SQLCONNECTION_HPP
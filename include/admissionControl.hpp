@@ -0,0 +1,183 @@
+/**
+ * @file admissionControl.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief admissionControl类定义：按客户端限速、并发上限与按排队延迟的过载保护
+ * @version 1.1
+ * @date 2024-11-28
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-28 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>报告中断时以队首任务已等待的时间判定
+ * </table>
+ */
+#ifndef _ADMISSIONCONTROL_HPP
+#define _ADMISSIONCONTROL_HPP
+
+#include <boost/asio/ip/address.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include "metrics.hpp"
+
+/**
+ * @brief 准入参数，各项为0时不启用
+ *
+ */
+struct admissionOptions {
+    double client_rate = 0;                                         //每个客户端IP每秒补充的令牌数，新连接与每个请求各消耗一个
+    double client_burst = 50;                                       //每个客户端IP的令牌桶容量
+    std::size_t max_connections = 0;                                //同时打开的连接数上限
+    std::size_t max_inflight = 0;                                   //同时处理中的请求数上限
+    std::chrono::microseconds queue_target = std::chrono::milliseconds(5);         //CoDel目标排队延迟
+    std::chrono::microseconds queue_interval = std::chrono::milliseconds(100);     //排队延迟持续超过目标多久才开始拒绝
+};
+
+/**
+ * @brief 客户端地址，IPv4按IPv4映射的IPv6地址保存
+ *
+ */
+using clientKey = std::array<unsigned char, 16>;
+
+/**
+ * @brief 准入判定
+ *
+ */
+enum class admissionVerdict {
+    admitted,
+    clientRate,                 //该客户端的令牌桶已空，请求以429应答
+    connections,                //连接数已达上限
+    concurrency,                //处理中的请求数已达上限，请求以503应答
+    queueDelay                  //排队延迟持续超标，请求以503应答
+};
+
+/**
+ * @brief 准入控制
+ *
+ * 连接在accept之后、TLS握手之前判定，未通过时直接关闭socket，不花费握手的CPU；
+ * 请求在解析完成之后、路由与handler之前判定，未通过时直接应答，不进入db线程池。
+ *
+ * 排队延迟由线程池在任务开始执行时报告，按CoDel处理：延迟在一个interval内始终高于target时进入拒绝状态，
+ * 之后拒绝的间隔按interval/sqrt(n)逐次缩短，直到延迟回到target以下；拒绝状态下新连接一律关闭。
+ * 工作线程全被占住时不再有任务开始，也就没有报告；超过一个interval没有收到报告时，
+ * 以队首任务已等待的时间补一次报告，队列为空时即为0，视为空闲。
+ *
+ * 令牌桶按地址哈希分片，每片一个互斥量；其余判定只用原子变量，只有CoDel处于拒绝状态时才加锁。
+ */
+class admissionControl {
+public:
+    explicit admissionControl(const admissionOptions& options = admissionOptions());
+
+    admissionControl(const admissionControl&) = delete;
+    admissionControl& operator=(const admissionControl&) = delete;
+
+    static clientKey keyOf(const boost::asio::ip::address& address);
+    /**
+     * @brief 判定新连接，在io线程上调用
+     *
+     * @param client
+     * @param connections 当前打开的连接数，不含这一个
+     * @return admissionVerdict
+     */
+    admissionVerdict admitConnection(const clientKey& client, std::size_t connections);
+    /**
+     * @brief 判定请求，通过时计入处理中的请求，处理结束后须调用finishRequest
+     *
+     * @param client
+     * @return admissionVerdict
+     */
+    admissionVerdict admitRequest(const clientKey& client);
+    void finishRequest() { _inflight.fetch_sub(1, std::memory_order_relaxed); }
+    /**
+     * @brief 报告一个任务的排队延迟，可在任意线程调用
+     *
+     * @param delay
+     */
+    void recordQueueDelay(std::chrono::steady_clock::duration delay);
+    /**
+     * @brief 设置查询队首任务已等待时间的函数，在请求线程上调用，须在服务开始之前设置
+     *
+     * @param probe 未设置时报告中断即视为空闲
+     */
+    void setQueueAgeProbe(std::function<std::chrono::steady_clock::duration()> probe) { _queue_age = std::move(probe); }
+    /**
+     * @brief 注册各判定的拒绝次数与处理中的请求数
+     *
+     * @param metrics
+     */
+    void registerMetrics(metricsRegistry& metrics);
+
+private:
+    static constexpr std::size_t SHARDS = 64;
+    static constexpr std::size_t MAX_SHARD_CLIENTS = 4096;         //每片记录的客户端上限，超过时清理已回满的桶
+
+    struct clientHash {
+        std::size_t operator()(const clientKey& key) const;
+    };
+    struct bucket {
+        double tokens;
+        std::int64_t refilled_at;                       //上次补充的时间，steady_clock纳秒
+    };
+    struct alignas(64) shard {
+        std::mutex mtx;
+        std::unordered_map<clientKey, bucket, clientHash> clients;
+    };
+
+    /**
+     * @brief 从客户端的桶中取一个令牌
+     *
+     * @param client
+     * @param now steady_clock纳秒
+     * @return true 取到；该片已满且无法清理时不记录新客户端，也返回true
+     */
+    bool takeToken(const clientKey& client, std::int64_t now);
+    /**
+     * @brief CoDel是否拒绝这个请求
+     *
+     * @param now
+     * @return true 拒绝
+     */
+    bool shedForDelay(std::int64_t now);
+    /**
+     * @brief 排队延迟持续超标；最近一个interval内没有报告时先查询队首任务的等待时间
+     *
+     * @param now
+     * @return true
+     */
+    bool overloaded(std::int64_t now);
+    /**
+     * @brief 按一个排队延迟样本更新超标状态，须持有_codel_mtx
+     *
+     * @param delay 纳秒
+     * @param now
+     */
+    void observeDelay(std::int64_t delay, std::int64_t now);
+    std::int64_t controlLaw(std::int64_t from, std::uint32_t count) const;
+
+    admissionOptions _options;
+    std::int64_t _target;                               //纳秒
+    std::int64_t _interval;                             //纳秒
+    shard _shards[SHARDS];
+    std::atomic<std::int64_t> _inflight{0};
+    std::function<std::chrono::steady_clock::duration()> _queue_age;     //队首任务已等待的时间，可为空
+    std::atomic<std::int64_t> _last_report{0};          //最近一次排队延迟报告或查询的时间
+    std::atomic<bool> _above{false};                    //排队延迟已持续一个interval高于target
+    std::mutex _codel_mtx;                              //保护以下CoDel状态
+    std::int64_t _first_above = 0;                      //延迟开始超标后的一个interval，0表示未超标
+    std::atomic<bool> _dropping{false};                 //处于拒绝状态，只在持有_codel_mtx时修改
+    std::int64_t _drop_next = 0;
+    std::uint32_t _drop_count = 0;
+    std::uint32_t _last_count = 0;
+    counter _rejected_connections[4];                   //按判定计数，下标为admissionVerdict - 1
+    counter _rejected_requests[4];
+};
+
+#endif
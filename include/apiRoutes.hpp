@@ -0,0 +1,44 @@
+/**
+ * @file apiRoutes.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief 业务路由注册，main与基准测试共用
+ * @version 1.0
+ * @date 2024-11-22
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-22 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#ifndef _APIROUTES_HPP
+#define _APIROUTES_HPP
+
+#include "httpsServer.hpp"
+#include "postManage.hpp"
+#include "tokenSigner.hpp"
+#include "userHandler.hpp"
+#include "workerPool.hpp"
+
+/**
+ * @brief 路由依赖的服务，须比httpsServer活得更久
+ *
+ */
+struct apiServices {
+    userHandler& users;
+    postManage& posts;
+    tokenSigner& tokens;
+    workerPool& db_pool;            //会阻塞在存储上的handler在这里执行
+};
+
+/**
+ * @brief 注册认证中间件与/register、/login、/logout、/createPost、/posts、/posts/{id}
+ *
+ * @param server
+ * @param services
+ */
+void installApiRoutes(httpsServer& server, const apiServices& services);
+
+#endif
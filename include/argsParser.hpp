@@ -2,7 +2,7 @@
  * @file argsParser.hpp
  * @author antaresz (antaresz1026@gmail.com)
  * @brief 
- * @version 0.1
+ * @version 0.2
  * @date 2024-10-24
  * 
  * @copyright Copyright (c) 2024
@@ -11,12 +11,91 @@
 #ifndef _ARGSPARSER_HPP
 #define _ARGSPARSER_HPP
 
-#include <map>
+#include <boost/container/small_vector.hpp>
+#include <cstddef>
 #include <string>
+#include <string_view>
+
+/**
+ * @brief 查询参数，key/value指向原始查询串，仍是百分号编码的形式
+ * 
+ */
+struct queryArg {
+    std::string_view key;
+    std::string_view value;
+};
+
+/**
+ * @brief 解析后的查询参数列表，16个以内不分配内存
+ * 
+ */
+class queryArgs : public boost::container::small_vector<queryArg, 16> {
+public:
+    /**
+     * @brief 查找第一个解码后等于key的参数
+     * 
+     * @param key 已解码的参数名
+     * @return const queryArg* 找不到时为nullptr
+     */
+    const queryArg* find(std::string_view key) const;
+    /**
+     * @brief 查找参数并把值解码到arena中
+     * 
+     * @param key 
+     * @param arena 调用方提供的缓冲区，解码结果追加到其末尾；
+     *              预先reserve(查询串长度)即可保证同一查询串解码出的所有值都不会因扩容失效
+     * @param fallback 参数不存在时的返回值
+     * @return std::string_view 指向arena或原始查询串
+     */
+    std::string_view get(std::string_view key, std::string& arena, std::string_view fallback = std::string_view()) const;
+};
 
 class argsParser {
 public:
-    std::map<std::string, std::string> parseQuery(const std::string& query);
+    /**
+     * @brief 解析查询串，只切分不解码
+     * 
+     * @param query 不含'?'的查询串，返回值中的string_view指向它
+     * @return queryArgs 
+     */
+    queryArgs parseQuery(std::string_view query);
+    /**
+     * @brief 是否包含需要解码的'%'或'+'
+     * 
+     * @param raw 
+     * @return true 
+     * @return false 
+     */
+    static bool needsDecoding(std::string_view raw);
+    /**
+     * @brief 解码%XX与'+'，结果写入out
+     * 
+     * 解码结果不会比原串长，out至少需要raw.size()字节；非法的%序列原样保留。
+     * 
+     * @param raw 
+     * @param out 
+     * @return std::size_t 解码后的长度
+     */
+    static std::size_t decode(std::string_view raw, char* out);
+    /**
+     * @brief 按需解码：不含转义时直接返回raw，否则解码到arena末尾
+     * 
+     * @param raw 
+     * @param arena 
+     * @return std::string_view 
+     */
+    static std::string_view decode(std::string_view raw, std::string& arena);
+    /**
+     * @brief 解码路径参数中的%XX，结果写入out
+     * 
+     * '+'只在查询串(application/x-www-form-urlencoded)中表示空格，路径中按字面保留；
+     * 其余规则与decode相同，需要解码时raw中必有'%'。
+     * 
+     * @param raw 
+     * @param out 至少raw.size()字节
+     * @return std::size_t 解码后的长度
+     */
+    static std::size_t decodePath(std::string_view raw, char* out);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,67 @@
+/**
+ * @file asyncMysqlStore.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief 基于asyncSQLConnection的存储，热点操作不占用线程
+ * @version 1.1
+ * @date 2024-11-29
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-29 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>语句以sqlStatement执行
+ * </table>
+ */
+#ifndef _ASYNCMYSQLSTORE_HPP
+#define _ASYNCMYSQLSTORE_HPP
+
+#include "asyncSQLConnection.hpp"
+#include "dataStore.hpp"
+
+/**
+ * @brief 与mysqlStore执行相同的SQL，改为在异步连接池上以文本协议执行
+ *
+ * asyncDataStore覆盖的操作直接在连接池的线程上回调；
+ * 其余dataStore接口仍在db线程池中调用，发起查询后阻塞等待结果，不能在连接池的线程上调用。
+ * 连接不绑定到调用方，无法跨语句保持事务，批量插入逐行执行。
+ */
+class asyncMysqlStore : public dataStore, public asyncDataStore {
+public:
+    explicit asyncMysqlStore(asyncSQLConnection& connectionPool) : _connection_pool(connectionPool) {}
+
+    asyncDataStore* async() override { return this; }
+
+    bool insertUser(const userRegistration& registration, const std::string& password_hash, doneCallback done) override;
+    bool findCredentials(const std::string& username, credentialsCallback done) override;
+    bool updatePassword(std::int64_t user_id, const std::string& password_hash, doneCallback done) override;
+    /**
+     * @brief 新帖子的id取自同一条语句的OK包，不需要再查LAST_INSERT_ID()
+     *
+     */
+    bool insertPost(const newPost& post, insertCallback done) override;
+    bool findPost(int id, postCallback done) override;
+
+    bool insertUser(const userRegistration& registration, const std::string& password_hash) override;
+    bool findCredentials(const std::string& username, userCredentials& found) override;
+    bool updatePassword(std::int64_t user_id, const std::string& password_hash) override;
+    int insertPost(int upid, const std::string& title, const std::string& content, const std::string& post_type) override;
+    bool deletePost(int id) override;
+    bool updatePost(int id, const std::string& title, const std::string& content) override;
+    bool findPost(int id, Post& found) override;
+    bool scanPosts(const postQuery& query, std::size_t limit, const postVisitor& visit) override;
+
+private:
+    /**
+     * @brief 发起查询并阻塞到结果返回
+     *
+     * @param statement
+     * @return sqlResult 排队已满时ok为false
+     */
+    sqlResult run(sqlStatement statement);
+
+    asyncSQLConnection& _connection_pool;
+};
+
+#endif
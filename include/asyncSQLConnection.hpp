@@ -0,0 +1,269 @@
+/**
+ * @file asyncSQLConnection.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief asyncSQLConnection类定义：在asio事件循环上驱动MariaDB Connector/C非阻塞API的连接池
+ * @version 1.2
+ * @date 2024-11-29
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-29 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>参数由执行语句的连接以mysql_real_escape_string转义，固定会话sql_mode
+ * <tr><td>2024-12-01 <td>1.2     <td>antaresz    <td>空闲过久的连接执行前先ping，断开时语句改由其他连接执行
+ * </table>
+ */
+#ifndef _ASYNCSQLCONNECTION_HPP
+#define _ASYNCSQLCONNECTION_HPP
+
+#include <mysql.h>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "metrics.hpp"
+
+/**
+ * @brief 异步连接池参数
+ *
+ */
+struct asyncPoolOptions {
+    std::size_t connections = 64;                                           //连接数，连接不占用线程，可以远多于线程数
+    std::size_t threads = 1;                                                //运行事件循环的线程数
+    std::size_t max_pending = 4096;                                         //等待空闲连接的查询数上限，超过时query返回false
+    std::chrono::milliseconds acquire_timeout = std::chrono::seconds(2);    //查询等待空闲连接的最长时间
+    std::chrono::seconds reconnect_delay = std::chrono::seconds(1);         //连接失败或断开后重连的间隔
+    unsigned int connect_timeout = 5;                                       //建立连接的超时(秒)
+    std::chrono::seconds idle_ping = std::chrono::seconds(30);              //空闲超过此时间的连接执行语句前先ping，服务端可能已按wait_timeout断开
+};
+
+/**
+ * @brief 一条语句的结果
+ *
+ */
+struct sqlResult {
+    bool ok = false;
+    unsigned int error = 0;                             //mysql_errno，排队超时或已停止时为0
+    std::string message;                                //出错原因
+    std::uint64_t affected_rows = 0;
+    std::uint64_t insert_id = 0;                        //本条INSERT分配的第一个自增id
+    std::vector<std::vector<std::string>> rows;         //结果集，NULL读作空串
+};
+
+/**
+ * @brief 带参数的语句
+ *
+ * sql中的每个'?'在执行前依次替换为对应的参数。参数由执行语句的连接以mysql_real_escape_string转义并加上单引号，
+ * 按该连接实际的字符集与sql_mode转义；sql的其余部分不能出现'?'。
+ *
+ */
+struct sqlStatement {
+    std::string sql;
+    std::vector<std::string> params;
+};
+
+/**
+ * @brief 异步连接池统计
+ *
+ */
+struct asyncPoolStats {
+    std::size_t connected = 0;                  //已建立的连接数
+    std::size_t idle = 0;                       //空闲连接数
+    std::size_t pending = 0;                    //等待空闲连接的查询数
+    std::uint64_t queries = 0;                  //累计完成的查询数，含出错的
+    std::uint64_t failures = 0;                 //累计出错的查询数，含排队超时
+    std::uint64_t reconnects = 0;               //累计重连次数
+};
+
+/**
+ * @brief 不占用线程的MySQL连接池
+ *
+ * 每个连接设置MYSQL_OPT_NONBLOCK，*_start与*_cont返回需要等待的事件时，
+ * 在连接的socket上async_wait，就绪后继续，一个连接同一时刻只执行一条语句。
+ * 查询在空闲连接上立即开始，否则排队，由最先空闲的连接取走；
+ * 成千上万的查询可以同时在途，只占用threads个线程。
+ * 语句以文本协议执行，参数以sqlStatement传入，在连接上转义后代入；回调在池的线程上调用，不能阻塞。
+ * 连接的回调都绑定到各自的strand上，threads大于1时同一连接的操作也不会并发。
+ * 空闲超过idle_ping的连接在发送语句前先mysql_ping，连接已断开时语句尚未发出，放回队首由其他连接执行。
+ */
+class asyncSQLConnection {
+public:
+    using resultCallback = std::function<void(sqlResult& result)>;
+
+    asyncSQLConnection(const std::string& host, const std::string& user, const std::string& password, const std::string& database,
+        const asyncPoolOptions& options = asyncPoolOptions());
+    /**
+     * @brief 停止事件循环并关闭所有连接，尚未完成的查询不再回调
+     *
+     */
+    ~asyncSQLConnection();
+
+    asyncSQLConnection(const asyncSQLConnection&) = delete;
+    asyncSQLConnection& operator=(const asyncSQLConnection&) = delete;
+
+    /**
+     * @brief 执行一条语句，可在任意线程调用
+     *
+     * @param statement
+     * @param done 在池的线程上调用，只调用一次；参数个数与'?'不符时以失败回调
+     * @return true 已开始或已排队
+     * @return false 排队已满或正在停止，done不会被调用
+     */
+    bool query(sqlStatement statement, resultCallback done);
+    std::size_t size() const { return _options.connections; }
+    asyncPoolStats stats() const;
+    /**
+     * @brief 查询等待空闲连接的时间(微秒)
+     *
+     * @return const histogram&
+     */
+    const histogram& waitTime() const { return _wait_time; }
+
+private:
+    /**
+     * @brief 连接当前所处的非阻塞调用
+     *
+     */
+    enum class stage {
+        connecting,
+        pinging,
+        querying,
+        storing
+    };
+    struct pendingQuery {
+        std::string sql;
+        std::vector<std::string> params;                    //执行前代入sql，代入后清空
+        resultCallback done;
+        std::chrono::steady_clock::time_point queued_at;
+    };
+    /**
+     * @brief 一个连接，状态只在它的strand上访问
+     *
+     */
+    struct link {
+        explicit link(boost::asio::io_context& io);
+
+        MYSQL* mysql = nullptr;
+        boost::asio::posix::stream_descriptor socket;       //只用于等待可读写，fd归mysql所有，关闭前先release
+        boost::asio::steady_timer timer;                    //MYSQL_WAIT_TIMEOUT与重连间隔
+        boost::asio::strand<boost::asio::io_context::executor_type> strand;
+        stage current = stage::connecting;
+        bool up = false;                                    //已建立连接，计入connected
+        std::uint64_t wait_id = 0;                          //每次等待加一，过期的完成回调据此忽略
+        bool waiting = false;
+        MYSQL* connected = nullptr;                         //mysql_real_connect的返回值
+        int ping_status = 0;                                //mysql_ping的返回值
+        int query_status = 0;                               //mysql_real_query的返回值
+        std::chrono::steady_clock::time_point last_used;    //上一次语句完成或连接建立的时间
+        MYSQL_RES* stored = nullptr;                        //mysql_store_result的返回值
+        pendingQuery query;                                 //正在执行的查询
+        sqlResult result;
+    };
+
+    void connect(std::shared_ptr<link> conn);
+    /**
+     * @brief 按*_start与*_cont返回的状态等待socket或超时，状态为0时进入下一步
+     *
+     * @param conn
+     * @param status
+     */
+    void await(std::shared_ptr<link> conn, int status);
+    void resume(std::shared_ptr<link> conn, int ready);
+    void connected(std::shared_ptr<link> conn);
+    /**
+     * @brief 把参数转义后代入sql中的'?'
+     *
+     * @param conn
+     * @return true 参数个数与'?'相符
+     */
+    bool bind(link& conn);
+    /**
+     * @brief 代入参数；连接空闲过久时先ping，再发送
+     *
+     * @param conn
+     * @param query
+     */
+    void execute(std::shared_ptr<link> conn, pendingQuery query);
+    /**
+     * @brief ping完成；连接已断开时关闭重连，尚未发出的语句交给requeue
+     *
+     * @param conn
+     */
+    void pinged(std::shared_ptr<link> conn);
+    void send(std::shared_ptr<link> conn);
+    void queried(std::shared_ptr<link> conn);
+    void stored(std::shared_ptr<link> conn);
+    /**
+     * @brief 回调当前查询，然后取下一条排队的查询或变为空闲
+     *
+     * @param conn
+     */
+    void complete(std::shared_ptr<link> conn);
+    /**
+     * @brief 当前查询出错；客户端错误(连接断开等)时关闭连接并稍后重连
+     *
+     * @param conn
+     */
+    void fail(std::shared_ptr<link> conn);
+    void close(link& conn);
+    void scheduleReconnect(std::shared_ptr<link> conn);
+    /**
+     * @brief 把尚未发出的查询交给一个空闲连接，没有空闲连接时放回队首
+     *
+     * 查询保留原来的入队时间，仍按acquire_timeout超时；放回队首不受max_pending限制。
+     *
+     * @param query
+     */
+    void requeue(pendingQuery query);
+    /**
+     * @brief 连接空闲，取走下一条未超时的排队查询；超时的查询在锁外以失败回调
+     *
+     * @param conn
+     */
+    void release(std::shared_ptr<link> conn);
+    /**
+     * @brief 所有连接都不可用时，由重连失败的连接清理超时的排队查询
+     *
+     */
+    void expirePending();
+    /**
+     * @brief 从队首取出已超时的查询，须持有_mtx
+     *
+     * @param now
+     * @param expired
+     */
+    void takeExpired(std::chrono::steady_clock::time_point now, std::vector<pendingQuery>& expired);
+    void failExpired(std::vector<pendingQuery>& expired);
+
+    std::string _host;
+    std::string _user;
+    std::string _password;
+    std::string _database;
+    asyncPoolOptions _options;
+
+    boost::asio::io_context _io;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> _work;   //没有连接在等待时保持事件循环运行
+    std::vector<std::shared_ptr<link>> _links;
+    std::vector<std::thread> _threads;
+
+    mutable std::mutex _mtx;                            //保护以下状态
+    std::vector<std::shared_ptr<link>> _idle;           //空闲连接
+    std::deque<pendingQuery> _pending;                  //等待空闲连接的查询
+    asyncPoolStats _stats;
+    bool _stopping = false;
+    histogram _wait_time;
+};
+
+#endif
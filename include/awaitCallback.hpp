@@ -0,0 +1,68 @@
+/**
+ * @file awaitCallback.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief 在协程handler中co_await回调形式的异步接口
+ * @version 1.0
+ * @date 2024-11-30
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-30 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#ifndef _AWAITCALLBACK_HPP
+#define _AWAITCALLBACK_HPP
+
+#ifdef HOMETOWN_COROUTINES
+
+#include <memory>
+#include <optional>
+#include <utility>
+#include "httpsServer.hpp"
+
+/**
+ * @brief 把“发起操作、稍后在任意线程上回调一次”的接口包装为task
+ *
+ * start以一个可复制的resume为参数发起操作，返回false表示没有发起(如线程池队列已满)，
+ * 此时结果为空。resume可以在任意线程上调用，协程总是回到自己的strand上恢复。
+ * start返回true后resume必须被调用恰好一次，否则协程不会恢复。
+ *
+ * @code
+ * auto post = co_await awaitCallback<std::shared_ptr<const cachedPost>>([&](auto resume) {
+ *     return post_manager.loadPost(id, resume);
+ * });
+ * @endcode
+ *
+ * @tparam Result 回调的参数类型
+ * @tparam Start bool(resume)
+ * @param start
+ * @return httpsServer::task<std::optional<Result>> 没有发起时为空
+ */
+template <typename Result, typename Start>
+httpsServer::task<std::optional<Result>> awaitCallback(Start start) {
+    using signature = void(std::optional<Result>);
+
+    return boost::asio::async_initiate<const boost::asio::use_awaitable_t<httpsServer::executor>&, signature>(
+        [start = std::move(start)](auto handler) mutable {
+            // 协程的完成处理器只能移动，回调接口多为std::function，须能复制
+            auto shared = std::make_shared<decltype(handler)>(std::move(handler));
+            auto complete = [shared](std::optional<Result> result) {
+                auto executor = boost::asio::get_associated_executor(*shared);
+
+                boost::asio::post(executor, [shared, result = std::move(result)]() mutable {
+                    (*shared)(std::move(result));
+                });
+            };
+
+            if (!start([complete](Result result) { complete(std::move(result)); })) {
+                complete(std::nullopt);
+            }
+        }, httpsServer::use_task);
+}
+
+#endif
+
+#endif // _AWAITCALLBACK_HPP
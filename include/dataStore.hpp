@@ -0,0 +1,244 @@
+/**
+ * @file dataStore.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief 存储接口，userHandler与postManage只通过它访问用户和帖子
+ * @version 1.3
+ * @date 2024-11-22
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-22 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-23 <td>1.1     <td>antaresz    <td>批量插入接口
+ * <tr><td>2024-11-26 <td>1.2     <td>antaresz    <td>插入帖子返回新帖子的id
+ * <tr><td>2024-11-29 <td>1.3     <td>antaresz    <td>asyncDataStore：不占用线程的异步接口
+ * </table>
+ */
+#ifndef _DATASTORE_HPP
+#define _DATASTORE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief 注册信息
+ *
+ */
+struct userRegistration {
+    std::string username;
+    std::string password;
+    std::string user_type;
+    std::string id_type;
+    std::string id_number;
+    std::string phone;
+};
+
+/**
+ * @brief 待插入的用户
+ *
+ */
+struct newUser {
+    userRegistration registration;      //password字段不使用
+    std::string password_hash;          //编码后的哈希
+};
+
+/**
+ * @brief 用户凭据
+ *
+ */
+struct userCredentials {
+    std::int64_t id = 0;
+    std::string salt;                   //旧版哈希的盐
+    std::string password;               //编码后的哈希
+};
+
+/**
+ * @brief 列表游标，指向上一页最后一行，按(created_at, id)倒序翻页
+ *
+ */
+struct postCursor {
+    std::string created_at;             //上一页最后一行的创建时间
+    int id = 0;                         //上一页最后一行的postid，created_at相同时区分先后
+
+    /**
+     * @brief 编码为"created_at,id"，作为next返回给客户端
+     *
+     * @return std::string
+     */
+    std::string format() const;
+    /**
+     * @brief 解析format()的结果
+     *
+     * @param text
+     * @param cursor
+     * @return true 格式正确
+     */
+    static bool parse(std::string_view text, postCursor& cursor);
+};
+
+/**
+ * @brief 列表查询条件
+ *
+ */
+struct postQuery {
+    static constexpr std::size_t MAX_LIMIT = 100;
+
+    std::size_t limit = 20;             //每页条数，超过MAX_LIMIT按MAX_LIMIT处理
+    std::optional<postCursor> after;    //为空时从最新的帖子开始
+    bool with_content = false;          //是否返回content，列表页通常只需要标题
+};
+
+struct Post {
+    int postid;                         //postid
+    int upid;                           //upid
+    std::string title;                  //标题
+    std::string content;                //内容
+    std::string post_type;              //post类型
+    std::string created_at;             //创建时间
+};
+
+/**
+ * @brief 待插入的帖子
+ *
+ */
+struct newPost {
+    int upid = 0;
+    std::string title;
+    std::string content;
+    std::string post_type;
+};
+
+/**
+ * @brief 存储的异步接口，只覆盖请求路径上的热点操作
+ *
+ * 操作在存储自己的事件循环上完成，等待期间不占用任何线程，可以在io线程上直接调用。
+ * 参数在调用时复制；回调在存储的线程上调用且只调用一次，不能阻塞。
+ * 返回false表示排队已满，回调不会被调用，与workerPool::post相同。
+ */
+class asyncDataStore {
+public:
+    using doneCallback = std::function<void(bool ok)>;
+    using credentialsCallback = std::function<void(bool found, userCredentials& credentials)>;
+    using insertCallback = std::function<void(int id)>;                 //新帖子的id，出错时为0
+    using postCallback = std::function<void(bool found, Post& post)>;
+
+    virtual ~asyncDataStore() = default;
+
+    virtual bool insertUser(const userRegistration& registration, const std::string& password_hash, doneCallback done) = 0;
+    virtual bool findCredentials(const std::string& username, credentialsCallback done) = 0;
+    virtual bool updatePassword(std::int64_t user_id, const std::string& password_hash, doneCallback done) = 0;
+    virtual bool insertPost(const newPost& post, insertCallback done) = 0;
+    virtual bool findPost(int id, postCallback done) = 0;
+};
+
+/**
+ * @brief 用户与帖子的存储
+ *
+ * 实现须是线程安全的，调用方在db线程池中调用，可能阻塞。
+ * 失败由实现记录日志，接口只返回是否成功。
+ */
+class dataStore {
+public:
+    using postVisitor = std::function<void(const Post&)>;
+
+    virtual ~dataStore() = default;
+
+    /**
+     * @brief 原生异步的存储返回它的异步接口，调用方对其覆盖的操作不再经过db线程池
+     *
+     * @return asyncDataStore* 不支持时为nullptr
+     */
+    virtual asyncDataStore* async() { return nullptr; }
+
+    /**
+     * @brief 插入用户
+     *
+     * @param registration
+     * @param password_hash 编码后的哈希，registration.password不会被保存
+     * @return true 插入成功；用户名已存在或出错时为false
+     */
+    virtual bool insertUser(const userRegistration& registration, const std::string& password_hash) = 0;
+    /**
+     * @brief 按用户名查找凭据
+     *
+     * @param username
+     * @param found
+     * @return true 找到
+     */
+    virtual bool findCredentials(const std::string& username, userCredentials& found) = 0;
+    /**
+     * @brief 替换用户的密码哈希，同时清空旧版的盐
+     *
+     * @param user_id
+     * @param password_hash
+     * @return true
+     */
+    virtual bool updatePassword(std::int64_t user_id, const std::string& password_hash) = 0;
+
+    /**
+     * @brief 批量插入用户，默认逐行调用insertUser
+     *
+     * @param users
+     * @param inserted 与users等长，逐行给出结果
+     */
+    virtual void insertUsers(const std::vector<newUser>& users, std::vector<bool>& inserted) {
+        inserted.resize(users.size());
+        for (std::size_t i = 0; i < users.size(); ++i) {
+            inserted[i] = insertUser(users[i].registration, users[i].password_hash);
+        }
+    }
+
+    /**
+     * @brief 插入帖子
+     *
+     * @param upid
+     * @param title
+     * @param content
+     * @param post_type
+     * @return int 新帖子的id，出错时为0
+     */
+    virtual int insertPost(int upid, const std::string& title, const std::string& content, const std::string& post_type) = 0;
+    /**
+     * @brief 批量插入帖子，默认逐行调用insertPost
+     *
+     * @param posts
+     * @param ids 与posts等长，逐行给出新帖子的id，插入失败的行为0
+     */
+    virtual void insertPosts(const std::vector<newPost>& posts, std::vector<int>& ids) {
+        ids.resize(posts.size());
+        for (std::size_t i = 0; i < posts.size(); ++i) {
+            ids[i] = insertPost(posts[i].upid, posts[i].title, posts[i].content, posts[i].post_type);
+        }
+    }
+    virtual bool deletePost(int id) = 0;
+    virtual bool updatePost(int id, const std::string& title, const std::string& content) = 0;
+    /**
+     * @brief 读取单个帖子
+     *
+     * @param id
+     * @param found
+     * @return true 找到；不存在或出错时为false
+     */
+    virtual bool findPost(int id, Post& found) = 0;
+    /**
+     * @brief 按(created_at, id)倒序逐行访问，从query.after之后开始，最多limit行
+     *
+     * 忽略query.limit；with_content为false时content可以为空。
+     * visit在实现持有的锁或连接上调用，不能再访问存储。
+     *
+     * @param query
+     * @param limit
+     * @param visit
+     * @return true 查询成功；失败前可能已经访问了部分行
+     */
+    virtual bool scanPosts(const postQuery& query, std::size_t limit, const postVisitor& visit) = 0;
+};
+
+#endif
@@ -0,0 +1,120 @@
+/**
+ * @file handlerMemory.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief 连接上异步操作的内存，代替asio按操作申请的堆内存
+ * @version 1.0
+ * @date 2024-11-24
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-24 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#ifndef _HANDLERMEMORY_HPP
+#define _HANDLERMEMORY_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+/**
+ * @brief 固定数量、固定大小的槽位
+ *
+ * 一个连接同时挂起的异步操作不超过几个(读或写、空闲定时器、投递回strand)，
+ * 每个操作占一个槽位，槽位不够或操作太大时退回全局堆。
+ * 操作可能在strand之外的线程上释放，槽位的占用标记用原子变量。
+ */
+class handlerMemory {
+public:
+    static constexpr std::size_t SLOT_BYTES = 1024;
+    static constexpr std::size_t SLOTS = 4;
+
+    handlerMemory() = default;
+    handlerMemory(const handlerMemory&) = delete;
+    handlerMemory& operator=(const handlerMemory&) = delete;
+
+    void* allocate(std::size_t size) {
+        if (size <= SLOT_BYTES) {
+            for (std::size_t i = 0; i < SLOTS; ++i) {
+                bool expected = false;
+
+                if (_used[i].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                    return _storage[i];
+                }
+            }
+        }
+        return ::operator new(size);
+    }
+    void deallocate(void* p) {
+        for (std::size_t i = 0; i < SLOTS; ++i) {
+            if (p == _storage[i]) {
+                _used[i].store(false, std::memory_order_release);
+                return;
+            }
+        }
+        ::operator delete(p);
+    }
+
+private:
+    alignas(std::max_align_t) unsigned char _storage[SLOTS][SLOT_BYTES];
+    std::atomic<bool> _used[SLOTS] = {};
+};
+
+/**
+ * @brief 从handlerMemory分配的分配器，作为回调的associated_allocator
+ *
+ * @tparam T
+ */
+template <typename T>
+class handlerAllocator {
+public:
+    using value_type = T;
+
+    explicit handlerAllocator(handlerMemory& memory) noexcept : _memory(&memory) {}
+    template <typename U>
+    handlerAllocator(const handlerAllocator<U>& other) noexcept : _memory(other._memory) {}
+
+    T* allocate(std::size_t n) { return static_cast<T*>(_memory->allocate(sizeof(T) * n)); }
+    void deallocate(T* p, std::size_t /*n*/) { _memory->deallocate(p); }
+
+    template <typename U>
+    bool operator==(const handlerAllocator<U>& other) const noexcept { return _memory == other._memory; }
+    template <typename U>
+    bool operator!=(const handlerAllocator<U>& other) const noexcept { return _memory != other._memory; }
+
+private:
+    template <typename>
+    friend class handlerAllocator;
+
+    handlerMemory* _memory;
+};
+
+/**
+ * @brief 给回调关联handlerAllocator，asio为该回调及其中间操作申请的内存都走memory
+ *
+ * @tparam Handler
+ */
+template <typename Handler>
+class allocHandler {
+public:
+    using allocator_type = handlerAllocator<Handler>;
+
+    allocHandler(handlerMemory& memory, Handler handler) : _memory(memory), _handler(std::move(handler)) {}
+
+    allocator_type get_allocator() const noexcept { return allocator_type(_memory); }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        _handler(std::forward<Args>(args)...);
+    }
+
+private:
+    handlerMemory& _memory;
+    Handler _handler;
+};
+
+#endif
@@ -0,0 +1,194 @@
+/**
+ * @file httpParser.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief httpParser类定义：增量、零拷贝的HTTP/1.1请求解析
+ * @version 1.2
+ * @date 2024-11-10
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-10 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-24 <td>1.1     <td>antaresz    <td>请求携带本次请求的内存资源
+ * <tr><td>2024-12-01 <td>1.2     <td>antaresz    <td>compact回收已解析的chunk框架
+ * </table>
+ */
+#ifndef _HTTPPARSER_HPP
+#define _HTTPPARSER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+
+#define HTTP_MAX_HEADERS 32
+#define HTTP_MAX_PARAMS 8
+
+/**
+ * @brief 请求头，name/value指向接收缓冲区
+ *
+ */
+struct httpHeader {
+    std::string_view name;
+    std::string_view value;
+};
+
+/**
+ * @brief 解析结果，所有string_view指向接收缓冲区，在该请求被consume之前有效
+ *
+ */
+struct httpRequest {
+    std::string_view method;                        //请求方法
+    std::string_view target;                        //请求目标，包含查询串
+    std::string_view path;                          //target中'?'之前的部分
+    std::string_view query;                         //target中'?'之后的部分，不含'?'
+    std::string_view version;                       //HTTP版本
+    std::string_view body;                          //请求体，chunked时为原地解码后的数据
+    httpHeader headers[HTTP_MAX_HEADERS];           //请求头
+    std::size_t header_count = 0;                   //请求头数量
+    httpHeader params[HTTP_MAX_PARAMS];             //路由匹配出的路径参数，如/posts/{id}中的id
+    std::size_t param_count = 0;                    //路径参数数量
+    bool keep_alive = false;                        //按版本与Connection头得出的是否保持连接
+    std::int64_t user_id = -1;                      //认证中间件校验令牌后填入的用户id，未认证为-1
+    std::pmr::memory_resource* memory = std::pmr::new_delete_resource();    //本次请求的临时内存，由服务端设置，在done之后失效
+
+    /**
+     * @brief 按名称查找请求头，不区分大小写
+     *
+     * @param name
+     * @return std::string_view 找不到时为空
+     */
+    std::string_view header(std::string_view name) const;
+    /**
+     * @brief 按名称查找路径参数
+     *
+     * @param name
+     * @return std::string_view 找不到时为空
+     */
+    std::string_view param(std::string_view name) const;
+};
+
+/**
+ * @brief 请求解析限制
+ *
+ */
+struct httpLimits {
+    std::size_t max_header_bytes = 8 * 1024;        //请求行+请求头的最大字节数
+    std::size_t max_body_bytes = 1024 * 1024;       //请求体最大字节数
+};
+
+/**
+ * @brief 增量HTTP请求解析器
+ *
+ * 每次调用parse传入从请求起始处开始的全部已接收数据，解析器只记录偏移量，
+ * 因此两次调用之间缓冲区可以扩容或搬移。请求头在多次读取间被拆分时，
+ * 从上次扫描的位置继续查找头部结束符，不会重复扫描。
+ * chunked请求体在缓冲区内原地解码，不额外分配内存；缓冲区满时由compact回收已解析的chunk框架。
+ */
+class httpParser {
+public:
+    enum class status {
+        complete,                                   //一个完整请求已解析
+        incomplete,                                 //需要更多数据
+        error                                       //请求非法，见errorStatus()
+    };
+
+    explicit httpParser(const httpLimits& limits = httpLimits());
+
+    /**
+     * @brief 解析请求
+     *
+     * @param data 请求起始位置，chunked解码会原地修改其中的数据
+     * @param size 已接收的字节数
+     * @return status
+     */
+    status parse(char* data, std::size_t size);
+    /**
+     * @brief parse返回complete后有效
+     *
+     * @return const httpRequest&
+     */
+    const httpRequest& request() const { return _request; }
+    httpRequest& request() { return _request; }
+    /**
+     * @brief 该请求在缓冲区中占用的字节数，处理完成后应consume
+     *
+     * @return std::size_t
+     */
+    std::size_t consumed() const { return _consumed; }
+    /**
+     * @brief parse返回error时对应的HTTP状态码
+     *
+     * @return int
+     */
+    int errorStatus() const { return _error_status; }
+    /**
+     * @brief 开始解析下一个请求
+     *
+     */
+    void reset();
+    /**
+     * @brief 回收chunked请求体中已解析的chunk长度行与CRLF
+     *
+     * 把尚未解析的数据搬到已解码数据之后，此后的parse须传入缩短后的size。
+     * 小chunk的框架可达数据的数倍，缓冲区满时先回收，请求只按解码后的大小受限。
+     *
+     * @param data 与parse相同的请求起始位置
+     * @param size 已接收的字节数
+     * @return std::size_t 回收的字节数，不在解析chunked请求体时为0
+     */
+    std::size_t compact(char* data, std::size_t size);
+    /**
+     * @brief 解析器需要的最大缓冲区大小
+     *
+     * compact之后缓冲区中只剩请求头、已解码的请求体与未解析完的一行chunk长度或CRLF，
+     * 按请求体上限预留一倍足够容纳最后一次读取。
+     *
+     * @return std::size_t
+     */
+    std::size_t maxRequestBytes() const { return _limits.max_header_bytes + _limits.max_body_bytes * 2; }
+
+private:
+    enum class state {
+        headers,                                    //查找请求头结束位置
+        body,                                       //等待Content-Length长度的请求体
+        chunkSize,                                  //读取chunk大小行
+        chunkData,                                  //读取chunk数据
+        trailers,                                   //读取最后一个chunk之后的trailer
+        done
+    };
+
+    /**
+     * @brief 相对请求起点的偏移量，请求完整后再转换为string_view
+     *
+     */
+    struct span {
+        std::uint32_t offset;
+        std::uint32_t length;
+    };
+
+    status fail(int http_status);
+    status parseHead(char* data);
+    status parseChunks(char* data, std::size_t size);
+
+    httpLimits _limits;
+    state _state;
+    httpRequest _request;
+    span _method;                                   //请求方法
+    span _target;                                   //请求目标
+    span _version;                                  //HTTP版本
+    span _header_spans[HTTP_MAX_HEADERS][2];        //请求头name/value
+    std::size_t _scanned;                           //已扫描过的字节数
+    std::size_t _header_bytes;                      //请求行+请求头(含空行)长度
+    std::size_t _content_length;                    //Content-Length
+    std::size_t _read_pos;                          //chunked: 下一个待解析的位置
+    std::size_t _write_pos;                         //chunked: 解码数据写入位置
+    std::size_t _chunk_remaining;                   //chunked: 当前chunk剩余字节数
+    std::size_t _consumed;                          //完整请求的字节数
+    bool _chunked;                                  //是否chunked
+    int _error_status;                              //错误状态码
+};
+
+#endif
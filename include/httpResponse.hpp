@@ -0,0 +1,180 @@
+/**
+ * @file httpResponse.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief httpResponse类定义：状态行、头部、body分开保存的响应
+ * @version 1.0
+ * @date 2024-11-25
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-25 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#ifndef _HTTPRESPONSE_HPP
+#define _HTTPRESPONSE_HPP
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief 响应构造器
+ *
+ * 状态行、Content-Type、Connection等常用头部取自静态字符串，Content-Length在发送时生成，
+ * 服务端把各段作为多个缓冲区一次写出，不再拼接成一个字符串。
+ * body有四种来源：复制进本对象(从构造时给定的内存资源上分配)、接管std::string、
+ * 引用外部数据(可附带一个保证其存活的owner)、分块流式产生。
+ */
+class httpResponse {
+public:
+    static constexpr std::size_t MAX_PARTS = 8;            //headerParts最多产生的段数
+
+    /**
+     * @brief 流式body的接收端，可在任意线程调用
+     *
+     * ok为false表示出错，连接直接关闭；chunk为空表示body结束。
+     * chunk指向的数据须保持有效，直到下一次调用source或响应结束。
+     */
+    using chunkSink = std::function<void(bool ok, std::string_view chunk)>;
+    using chunkSource = std::function<void(chunkSink next)>;       //服务端在上一块写完后调用，产生下一块后调用next
+
+    /**
+     * @brief 构造响应
+     *
+     * @param status 状态码
+     * @param memory 复制进来的头部与body所用的内存，通常是request.memory
+     */
+    explicit httpResponse(int status = 200, std::pmr::memory_resource* memory = std::pmr::new_delete_resource());
+    httpResponse(httpResponse&&) = default;
+    httpResponse& operator=(httpResponse&&) = delete;      //pmr字符串在资源不同时移动赋值会退化为复制
+
+    httpResponse& setStatus(int status);
+    /**
+     * @brief 设置Content-Type，常用类型使用静态头部行，其他类型复制进自定义头部
+     *
+     * @param type
+     * @return httpResponse&
+     */
+    httpResponse& setContentType(std::string_view type);
+    /**
+     * @brief 追加一个头部，不检查重复，Content-Length/Connection/Transfer-Encoding由服务端生成
+     *
+     * @param name
+     * @param value
+     * @return httpResponse&
+     */
+    httpResponse& addHeader(std::string_view name, std::string_view value);
+    /**
+     * @brief 把body复制进本对象
+     *
+     * @param body
+     * @return httpResponse&
+     */
+    httpResponse& setBody(std::string_view body);
+    /**
+     * @brief 为随后的appendBody预留空间
+     *
+     * @param size
+     * @return httpResponse&
+     */
+    httpResponse& reserveBody(std::size_t size);
+    /**
+     * @brief 在已复制的body后追加
+     *
+     * @param part
+     * @return httpResponse&
+     */
+    httpResponse& appendBody(std::string_view part);
+    /**
+     * @brief 接管body，不复制
+     *
+     * @param body
+     * @return httpResponse&
+     */
+    httpResponse& takeBody(std::string&& body);
+    /**
+     * @brief 引用外部的body，不复制
+     *
+     * @param body 须在响应发送完之前有效
+     * @param owner 非空时由响应持有，直到发送完成
+     * @return httpResponse&
+     */
+    httpResponse& referBody(std::string_view body, std::shared_ptr<const void> owner = nullptr);
+    /**
+     * @brief 分块流式发送body，HTTP/1.0客户端改为以关闭连接界定结尾
+     *
+     * @param source
+     * @return httpResponse&
+     */
+    httpResponse& streamBody(chunkSource source);
+
+    int status() const { return _status; }
+    /**
+     * @brief 当前的body，流式响应为空
+     *
+     * @return std::string_view
+     */
+    std::string_view body() const;
+    bool streaming() const { return static_cast<bool>(_source); }
+    /**
+     * @brief 流式响应的数据源
+     *
+     * @return const chunkSource&
+     */
+    const chunkSource& source() const { return _source; }
+    /**
+     * @brief 依次产生状态行、头部与body，各段指向静态字符串或本对象，在本对象修改或析构之前有效
+     *
+     * @param keep_alive 决定Connection头
+     * @param chunked 流式响应是否使用chunked编码，为false时不带长度，以关闭连接结束
+     * @param parts 输出
+     * @return std::size_t 段数，不超过MAX_PARTS
+     */
+    std::size_t headerParts(bool keep_alive, bool chunked, std::string_view (&parts)[MAX_PARTS]);
+    /**
+     * @brief 拼接为完整的响应，流式响应只包含头部
+     *
+     * @param keep_alive
+     * @return std::string
+     */
+    std::string toString(bool keep_alive);
+    /**
+     * @brief chunked编码中一块数据前的长度行
+     *
+     * @param size
+     * @param out 至少20字节
+     * @return std::string_view 指向out
+     */
+    static std::string_view chunkHeader(std::size_t size, char* out);
+
+private:
+    /**
+     * @brief body的来源
+     *
+     */
+    enum class bodyKind {
+        copied,                     //_copied
+        taken,                      //_taken
+        referenced,                 //_referenced，由_owner保活
+    };
+
+    int _status;
+    std::string_view _content_type;             //静态的Content-Type头部行，为空时不带
+    std::pmr::string _headers;                  //自定义头部行，每行以\r\n结尾
+    bodyKind _kind = bodyKind::copied;
+    std::pmr::string _copied;
+    std::string _taken;
+    std::string_view _referenced;
+    std::shared_ptr<const void> _owner;
+    chunkSource _source;                        //非空时为流式响应
+    char _status_line[40];                      //静态表中没有的状态码在发送时格式化到这里
+    char _length[24];                           //发送时格式化的Content-Length
+};
+
+#endif
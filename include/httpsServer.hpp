@@ -2,7 +2,7 @@
  * @file httpsServer.hpp
  * @author antaresz (antaresz1026@gmail.com)
  * @brief httpsServer类定义
- * @version 1.0
+ * @version 1.16
  * @date 2024-10-15
  * 
  * @copyright Copyright (c) 2024 antaresz
@@ -11,63 +11,418 @@
  * <table>
  * <tr><th>Date       <th>Version <th>Author <th>Description
  * <tr><td>2024-10-15 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-02 <td>1.1     <td>antaresz    <td>多线程io模型
+ * <tr><td>2024-11-04 <td>1.2     <td>antaresz    <td>异步路由处理函数
+ * <tr><td>2024-11-06 <td>1.3     <td>antaresz    <td>keep-alive与pipelining
+ * <tr><td>2024-11-08 <td>1.4     <td>antaresz    <td>TLS会话复用
+ * <tr><td>2024-11-10 <td>1.5     <td>antaresz    <td>增量零拷贝请求解析
+ * <tr><td>2024-11-12 <td>1.6     <td>antaresz    <td>基数树路由，按方法+路径分发
+ * <tr><td>2024-11-18 <td>1.7     <td>antaresz    <td>认证中间件，路由可要求令牌
+ * <tr><td>2024-11-20 <td>1.8     <td>antaresz    <td>实现simulateRequest，端口与证书可配置，stop
+ * <tr><td>2024-11-21 <td>1.9     <td>antaresz    <td>指标：路由延迟、收发字节、握手耗时、活跃连接
+ * <tr><td>2024-11-24 <td>1.10    <td>antaresz    <td>每个连接的请求arena，done接收string_view，回调绑定到连接的strand
+ * <tr><td>2024-11-25 <td>1.11    <td>antaresz    <td>handler以httpResponse应答，分段一次写出，支持chunked流式body
+ * <tr><td>2024-11-28 <td>1.12    <td>antaresz    <td>准入控制：握手前判定连接，路由前判定请求
+ * <tr><td>2024-11-30 <td>1.13    <td>antaresz    <td>协程handler与协程驱动的连接循环(HOMETOWN_COROUTINES)
+ * <tr><td>2024-12-01 <td>1.14    <td>antaresz    <td>chunked编码由协议版本决定，HTTP/1.1的Connection: close也分块
+ * <tr><td>2024-12-01 <td>1.15    <td>antaresz    <td>TLS握手超时
+ * <tr><td>2024-12-01 <td>1.16    <td>antaresz    <td>流式响应写完才归还准入的在途名额
  * </table>
  */
 #ifndef _HTTPSSERVER_HPP
 #define _HTTPSSERVER_HPP
 
+#include <utility>      //Boost 1.74的awaitable.hpp用到std::exchange却没有包含<utility>，C++20下须先于asio包含
 #include <boost/asio.hpp>
+#include <array>
+#include <chrono>
 #include <string>
 #include <functional>
-#include <map>
+#include <memory>
+#include <optional>
+#include <vector>
 #include <boost/asio/ssl.hpp>
+#ifdef HOMETOWN_COROUTINES
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#endif
+#include "admissionControl.hpp"
+#include "handlerMemory.hpp"
+#include "httpParser.hpp"
+#include "httpResponse.hpp"
+#include "metrics.hpp"
+#include "requestArena.hpp"
+#include "router.hpp"
+#include "tlsSessionCache.hpp"
 
 #define PORT 23030
+
+/**
+ * @brief io线程模型
+ * 
+ */
+enum class ioModel {
+    shared,                     //N个线程共享一个io_context，每个连接绑定独立strand
+    perCore                     //每个线程独占一个io_context，SO_REUSEPORT多acceptor
+};
+
+/**
+ * @brief httpsServer启动参数
+ * 
+ */
+struct serverOptions {
+    std::size_t threads = 0;                //工作线程数，0表示使用硬件并发数
+    ioModel model = ioModel::shared;        //io线程模型
+    std::chrono::seconds keep_alive_timeout = std::chrono::seconds(15);     //keep-alive连接的空闲超时
+    std::chrono::seconds handshake_timeout = std::chrono::seconds(10);      //TLS握手须在accept后多久内完成
+    std::size_t max_keep_alive_requests = 100;                              //单个连接最多处理的请求数
+    std::size_t tls_session_cache_size = 20480;                             //TLS会话缓存容量
+    std::chrono::seconds tls_session_timeout = std::chrono::hours(2);       //TLS会话/票据有效期
+    std::chrono::seconds tls_ticket_rotation = std::chrono::hours(1);       //会话票据密钥轮换周期
+    httpLimits http_limits;                                                 //请求头/请求体大小限制
+    std::size_t request_arena_bytes = 16 * 1024;                            //每个连接的请求arena初始大小，0表示逐次向全局堆申请、响应写完后释放
+    admissionOptions admission;                                             //准入控制参数，默认只在排队延迟持续超标时拒绝
+    unsigned short port = PORT;                                             //监听端口
+#ifdef HOMETOWN_COROUTINES
+    bool coroutines = false;                                                //每个连接由一个协程驱动，代替回调链
+#endif
+    std::string cert_path = "/etc/letsencrypt/live/antaresz.cc/fullchain.pem";  //证书链
+    std::string key_path = "/etc/letsencrypt/live/antaresz.cc/privkey.pem";     //私钥
+};
 /**
  * @brief httpsServer类
  * 
  */
 class httpsServer {
 public:
+    using executor = boost::asio::strand<boost::asio::io_context::executor_type>;        //连接的strand
+    using routeHandler = std::function<void(const httpRequest&, httpResponse&)>;         //同步处理函数(request, response)
+    using responder = std::function<void(httpResponse&&)>;                               //异步完成回调，可在任意线程调用，response被移动到连接上
+    using asyncRouteHandler = std::function<void(const httpRequest&, responder)>;        //异步处理函数(request, done)
+    using authenticator = std::function<bool(httpRequest&)>;                             //校验请求凭据并填入request.user_id，在io线程上执行
+#ifdef HOMETOWN_COROUTINES
+    template <typename T>
+    using task = boost::asio::awaitable<T, executor>;                                   //在连接的strand上运行的协程
+    using coroutineHandler = std::function<task<httpResponse>(const httpRequest&)>;      //协程处理函数，co_return响应
+    static constexpr boost::asio::use_awaitable_t<executor> use_task{};                  //task中异步操作的完成令牌
+#endif
     /**
      * @brief httpsServer初始化
      * 
+     * @param options 
      */
-    httpsServer();
+    explicit httpsServer(const serverOptions& options = serverOptions());
     /**
      * @brief httpsServer启动
      * 
      */
     void start();
     /**
-     * @brief 设置路由
+     * @brief 停止所有io_context，start随后返回，可在任意线程调用
+     * 
+     */
+    void stop();
+    /**
+     * @brief 设置路由，须在start之前调用
      * 
-     * @param path 
+     * @param method 
+     * @param pattern 路由模式，可包含{name}路径参数，如/posts/{id}
      * @param handler 
+     * @param authenticated 为true时先经过认证中间件，未通过返回401
      */
-    void setRoute(const std::string& path, std::function<void(const std::string&, std::string&)> handler);
-    std::string simulateRequest(const std::string& method, const std::string& path, const std::string& body = "");
+    void setRoute(const std::string& method, const std::string& pattern, routeHandler handler, bool authenticated = false);
+    /**
+     * @brief 设置异步路由，handler可将工作投递到其他线程，完成后调用done(response)
+     * 
+     * response会被投递回该连接的executor上发送，handler本身不能阻塞io线程。
+     * request引用的数据在done被调用之前一直有效；除交给done的httpResponse外，从request.memory分配的对象
+     * 必须在调用done之前析构，响应写完后这块内存会被下一个请求复用，连接关闭时连同内存资源本身一起释放。
+     * httpResponse可以引用request.memory上的数据作为body，它们在响应写完之前有效。
+     * 
+     * @param method 
+     * @param pattern 
+     * @param handler 
+     * @param authenticated 
+     */
+    void setAsyncRoute(const std::string& method, const std::string& pattern, asyncRouteHandler handler, bool authenticated = false);
+#ifdef HOMETOWN_COROUTINES
+    /**
+     * @brief 设置协程路由，handler可以co_await异步操作，在连接的strand上恢复
+     * 
+     * request与从request.memory分配的内存的约定与setAsyncRoute相同，在co_return之前有效。
+     * 协程连接循环直接co_await handler；回调驱动的连接上以co_spawn在连接的strand上运行，
+     * 每个请求多几次分配，此时应优先用setAsyncRoute(见coroutines())。
+     * handler抛出的异常记录日志并以500应答。
+     * 
+     * @param method 
+     * @param pattern 
+     * @param handler 
+     * @param authenticated 
+     */
+    void setCoroutineRoute(const std::string& method, const std::string& pattern, coroutineHandler handler, bool authenticated = false);
+    /**
+     * @brief 连接是否由协程驱动(serverOptions::coroutines)
+     * 
+     * @return true 
+     */
+    bool coroutines() const { return _coroutines; }
+#endif
+    /**
+     * @brief 设置认证中间件，须在start之前调用
+     * 
+     * 只对authenticated路由生效，必须是不阻塞的纯内存校验。
+     * 
+     * @param auth 
+     */
+    void setAuthenticator(authenticator auth);
+    /**
+     * @brief TLS握手统计
+     * 
+     * @return const tlsSessionCache& 
+     */
+    const tlsSessionCache& tlsSessions() const { return _tls_sessions; }
+    /**
+     * @brief 指标注册表，服务端自身的指标已注册，其他模块须在start之前追加
+     * 
+     * @return metricsRegistry& 
+     */
+    metricsRegistry& metrics() { return _metrics; }
+    /**
+     * @brief 准入控制，排队延迟须由执行handler工作的线程池通过recordQueueDelay报告
+     * 
+     * @return admissionControl& 
+     */
+    admissionControl& admission() { return _admission; }
+    /**
+     * @brief 不经过socket与TLS，直接把请求交给路由、认证和handler，阻塞到响应完成
+     * 
+     * 供基准测试和调试使用，可在任意非io线程上并发调用，不经过准入控制。
+     * 
+     * @param method 
+     * @param path 请求目标，可带查询字符串
+     * @param body 
+     * @param headers 额外的头部行，每行以\r\n结尾
+     * @return std::string 完整的响应
+     */
+    std::string simulateRequest(const std::string& method, const std::string& path, const std::string& body = "", const std::string& headers = "");
 private:
+    /**
+     * @brief 一个io_context及其上的acceptor
+     * 
+     */
+    struct ioWorker {
+        ioWorker(int concurrency_hint, unsigned short port, bool reuse_port);
+
+        boost::asio::io_context io_context;
+        boost::asio::ip::tcp::acceptor acceptor;
+    };
+    /**
+     * @brief 一个TLS连接的状态，在keep-alive的多个请求间复用
+     * 
+     */
+    struct connection {
+        connection(boost::asio::ip::tcp::socket&& socket, const clientKey& client, boost::asio::io_context& io_context, boost::asio::ssl::context& ssl_context,
+            const httpLimits& limits, std::size_t arena_bytes, gauge& active);
+        ~connection();
+
+        boost::asio::ssl::stream<boost::asio::ip::tcp::socket> stream;     //TLS流
+        clientKey client;                                                   //客户端地址，准入控制按它限速
+        executor strand;                                                    //该连接所有回调的串行化executor
+        handlerMemory handler_memory;                                       //该连接上异步操作的内存
+        std::vector<char> buffer;                                           //接收缓冲区，可能包含pipelining的后续请求
+        std::size_t begin = 0;                                              //当前请求在buffer中的起点
+        std::size_t end = 0;                                                //已接收数据的终点
+        httpParser parser;                                                  //当前请求的解析状态
+        requestArena arena;                                                 //当前请求的临时内存，响应写完后reset
+        std::optional<httpResponse> response;                               //待发送的响应，写完后清空
+        char chunk_header[24];                                              //当前chunk的长度行
+        std::shared_ptr<connection> pending;                                //handler处理期间指向自身，done被调用后交还给写操作
+        boost::asio::steady_timer timer;                                    //空闲超时定时器
+        std::size_t served = 0;                                             //已处理的请求数
+        bool keep_alive = false;                                            //当前请求结束后是否保持连接
+        bool chunked = false;                                               //当前流式响应使用chunked编码，否则以关闭连接结束
+        bool streaming_slot = false;                                        //流式响应写完前仍占用准入控制的在途名额
+        gauge& active;                                                      //活跃连接数，析构时减一
+        std::chrono::steady_clock::time_point started;                      //当前请求解析完成的时间
+        histogram* latency = nullptr;                                       //当前请求所属路由的延迟直方图
+#ifdef HOMETOWN_COROUTINES
+        std::optional<boost::asio::async_result<boost::asio::use_awaitable_t<executor>, void()>::handler_type> suspended;    //挂起等待回调的协程
+        bool woken = false;                                                 //回调已回到strand，只在strand上访问
+        bool chunk_ok = false;                                              //数据源给出的下一块
+        std::string_view chunk;
+        std::chrono::steady_clock::time_point deadline;                     //本次读的空闲期限，不在读时为max，连接结束时为min
+#endif
+    };
     /**
      * @brief 接受socket逻辑
      * 
+     * @param worker 
+     */
+    void accept(ioWorker& worker);
+#ifdef HOMETOWN_COROUTINES
+    /**
+     * @brief 连接的协程：握手，然后在同一帧里循环读取、分发、写出请求，直到连接结束
+     * 
+     * 连接的shared_ptr只在这里和watch中各持有一份，请求之间不再复制。
+     * 
+     * @param conn 
+     * @param accepted_at 
+     * @return task<void> 
+     */
+    task<void> serve(std::shared_ptr<connection> conn, std::chrono::steady_clock::time_point accepted_at);
+    /**
+     * @brief 空闲超时：按conn->deadline关闭socket，不随每次读重新设置定时器
+     * 
+     * @param conn 
+     * @return task<void> 
+     */
+    task<void> watch(std::shared_ptr<connection> conn);
+    /**
+     * @brief 挂起serve直到wake
+     * 
+     * 协程的完成处理器保存在连接上，wake在strand上直接调用它恢复协程，不经过定时器，也不申请内存。
+     * 
+     * @param conn 
+     * @return task<void> 
+     */
+    static task<void> suspend(connection& conn);
+    /**
+     * @brief 在strand上调用：标记回调已完成，serve已挂起时恢复它
+     * 
+     * @param conn 
+     */
+    static void wake(connection& conn);
+#endif
+    /**
+     * @brief 读取并处理连接上的下一个请求
+     * 
+     * @param conn 
+     */
+    void handleRequest(std::shared_ptr<connection> conn);
+    /**
+     * @brief 缓冲区中的数据不足以构成完整请求时继续读取
+     * 
+     * @param conn 
+     */
+    void readRequest(std::shared_ptr<connection> conn);
+    /**
+     * @brief 为下一次读腾出缓冲区尾部的空间
+     * 
+     * @param conn 
+     * @return true 有空间；false 请求已达大小上限
+     */
+    bool reserveSpace(connection& conn);
+    using bufferList = std::array<boost::asio::const_buffer, httpResponse::MAX_PARTS>;
+    /**
+     * @brief 响应的状态行与头部(以及非流式的body)
+     * 
+     * @param conn 
+     * @param buffers 
+     * @return true 写完即结束本次响应；false 还要向数据源要body
+     */
+    bool headerBuffers(connection& conn, bufferList& buffers);
+    /**
+     * @brief 按连接的编码放入数据源给出的一块body
+     * 
+     * @param conn 
+     * @param ok 
+     * @param chunk 为空表示body结束
+     * @param buffers 
+     * @param finished 写完这些段即结束本次响应
+     * @return std::size_t 段数，0表示不再写入，直接结束本次响应
+     */
+    std::size_t chunkBuffers(connection& conn, bool ok, std::string_view chunk, bufferList& buffers, bool& finished);
+    void sendResponse(std::shared_ptr<connection> conn, httpResponse&& response);
+    void writeResponse(std::shared_ptr<connection> conn);
+    /**
+     * @brief 向流式响应的数据源要下一块
+     * 
+     * @param conn 
+     */
+    void pullChunk(std::shared_ptr<connection> conn);
+    void writeChunk(std::shared_ptr<connection> conn, bool ok, std::string_view chunk);
+    /**
+     * @brief 一次写出buffers中的各段
+     * 
+     * @param conn 
+     * @param buffers 
+     * @param finished 为true时写完即结束本次响应，否则继续向数据源要下一块
+     */
+    void writeBuffers(std::shared_ptr<connection> conn, const bufferList& buffers, bool finished);
+    void finishResponse(std::shared_ptr<connection> conn);
+    /**
+     * @brief 流式响应写完或写出失败时归还在途名额；普通响应在handler应答时已归还
+     * 
+     * @param conn 
+     */
+    void releaseStreamSlot(connection& conn);
+    void processRequest(std::shared_ptr<connection> conn);
+    struct route;
+    /**
+     * @brief 路由匹配与认证
+     * 
+     * @param request 
+     * @param status 未匹配或未通过认证时为404/405/401
+     * @param latency 设为匹配路由的直方图，未匹配时为nullptr
+     * @return const route* 未匹配或未通过认证时为nullptr
+     */
+    const route* findRoute(httpRequest& request, int& status, histogram*& latency);
+    /**
+     * @brief 路由匹配、认证并调用handler，404/405/401直接以done应答
+     * 
+     * @param request 
+     * @param done 
+     * @param latency 调用handler之前设为匹配路由的直方图，未匹配时为nullptr
+     * @param strand 协程handler在它上面运行，只有回调形式的路由时可以为nullptr
+     */
+    void dispatchRequest(httpRequest& request, responder done, histogram*& latency, const executor* strand);
+    /**
+     * @brief 关闭TLS连接
+     * 
+     * @param conn 
      */
-    void accept();
+    void closeConnection(std::shared_ptr<connection> conn);
     /**
-     * @brief 对socket处理
+     * @brief 路由表中的一项
      * 
-     * @param socket 
      */
-    void handleRequest(std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> socket);
-    void readBody(std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> socket, std::shared_ptr<boost::asio::streambuf> buffer, std::size_t content_length, const std::string& path);
-    void sendResponse(std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> socket, const std::string& response);
-    void processRequest(std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> socket, const std::string& path, const std::string& body);
-    boost::asio::io_service _io_service;                                                        //io_service
-    boost::asio::ip::tcp::acceptor _acceptor;                                                   //acceptor接收器
+    struct route {
+        asyncRouteHandler handler;                  //处理函数，同步handler也包装为异步形式
+        bool authenticated;                         //是否需要认证
+        histogram* latency;                         //请求延迟，归_route_latency所有
+#ifdef HOMETOWN_COROUTINES
+        coroutineHandler coroutine;                 //协程处理函数，不为空时handler为空
+#endif
+    };
+    void addRoute(const std::string& method, const std::string& pattern, route entry);
+    std::size_t _threads;                                                                       //工作线程数
+    ioModel _model;                                                                             //io线程模型
+    std::chrono::seconds _keep_alive_timeout;                                                   //keep-alive空闲超时
+    std::chrono::seconds _handshake_timeout;                                                    //TLS握手超时
+    std::size_t _max_keep_alive_requests;                                                       //单连接请求数上限
+    httpLimits _http_limits;                                                                    //请求大小限制
+    std::size_t _request_arena_bytes;                                                           //请求arena初始大小，0表示不在请求之间保留内存
+#ifdef HOMETOWN_COROUTINES
+    bool _coroutines;                                                                           //连接由协程驱动
+#endif
+    std::vector<std::unique_ptr<ioWorker>> _workers;                                            //io_context与acceptor
     boost::asio::ssl::context _ssl_context;                                                     //ssl
+    tlsSessionCache _tls_sessions;                                                              //TLS会话缓存与票据密钥
     std::string _cert_path;                                                                     //证书目录
     std::string _key_path;                                                                      //密钥目录
-    std::map<std::string, std::function<void(const std::string&, std::string&)>> _routes;       //路由
+    router _router;                                                                             //方法+路径 -> _handlers下标
+    std::vector<route> _routes;                                                                 //路由处理函数
+    authenticator _authenticator;                                                               //认证中间件
+    metricsRegistry _metrics;                                                                   //指标注册表
+    admissionControl _admission;                                                                //准入控制
+    std::vector<std::unique_ptr<histogram>> _route_latency;                                     //各路由的延迟(微秒)
+    counter _unmatched;                                                                         //404/405请求数
+    counter _bytes_in;                                                                          //读到的请求字节数(TLS解密后)
+    counter _bytes_out;                                                                         //写出的响应字节数
+    gauge _active_connections;                                                                  //活跃连接数
+    histogram _handshake_full;                                                                  //完整握手耗时(微秒)
+    histogram _handshake_resumed;                                                               //会话复用握手耗时(微秒)
+    counter _handshake_failures;                                                                //握手失败数
 };
 
 #endif
\ No newline at end of file
@@ -2,45 +2,180 @@
  * @file log.hpp
  * @author antaresz (antaresz1026@gmail.com)
  * @brief log类定义
- * @version 1.0
+ * @version 2.1
  * @date 2024-10-15
- * 
+ *
  * @copyright Copyright (c) 2024 antaresz
- * 
+ *
  * @par 修改日志:
  * <table>
  * <tr><th>Date       <th>Version <th>Author <th>Description
  * <tr><td>2024-10-15 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-17 <td>2.0     <td>antaresz    <td>异步日志：每线程无锁环形缓冲+后台写线程，枚举级别与日志宏
+ * <tr><td>2024-11-21 <td>2.1     <td>antaresz    <td>队列深度
  * </table>
  */
 #ifndef _LOG_HPP
 #define _LOG_HPP
-#include <boost/log/trivial.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief 日志级别
+ *
+ */
+enum class logLevel : int {
+    debug,
+    info,
+    warning,
+    error
+};
 
 /**
- * @brief 对Boost.log的封装
- * 
+ * @brief 异步日志
+ *
+ * 调用线程只把消息放进自己的无锁环形缓冲区，格式化时间戳、写控制台/文件和fsync
+ * 都在后台写线程中完成。缓冲区满时丢弃消息并计数，不会阻塞io线程。
+ * 控制台输出不低于当前级别的日志，文件只记录info及以上。
  */
 class logger {
 public:
-    // 单例模式（可选）
     static logger& getInstance() {
         static logger instance;
         return instance;
     }
 
-    // 封装各种级别的日志输出
-    void log(const std::string& level, const std::string& message);
-        
+    /**
+     * @brief 级别是否开启，日志宏在格式化消息之前先调用它
+     *
+     * @param level
+     * @return true
+     */
+    bool enabled(logLevel level) const {
+        return static_cast<int>(level) >= _level.load(std::memory_order_relaxed);
+    }
+    /**
+     * @brief 设置最低输出级别
+     *
+     * @param level
+     */
+    void setLevel(logLevel level) { _level.store(static_cast<int>(level), std::memory_order_relaxed); }
+    /**
+     * @brief 记录一条日志，不检查级别，通常通过LOG_*宏调用
+     *
+     * @param level
+     * @param message
+     */
+    void log(logLevel level, std::string message);
+    /**
+     * @brief 因缓冲区满被丢弃的日志条数
+     *
+     * @return std::uint64_t
+     */
+    std::uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+    /**
+     * @brief 各线程缓冲区中尚未写出的日志条数，需要短暂持有缓冲区列表的锁
+     *
+     * @return std::size_t
+     */
+    std::size_t queued() const;
+    /**
+     * @brief 解析"debug"/"info"/"warning"/"error"
+     *
+     * @param name
+     * @param level
+     * @return true 名字合法
+     */
+    static bool parseLevel(const std::string& name, logLevel& level);
+
+    logger(const logger&) = delete;
+    logger& operator=(const logger&) = delete;
 
 private:
-    logger() {
-        // 初始化日志系统：控制台和文件
-        init();
-    }
-    static void init();
-    static bool initialized;
+    struct record {
+        std::chrono::system_clock::time_point time;
+        logLevel level;
+        std::string message;
+    };
+    class ringBuffer;
+    struct threadRing;
+
+    logger();
+    ~logger();
+
+    ringBuffer& localRing();
+    /**
+     * @brief 后台写线程主循环
+     *
+     */
+    void run();
+    /**
+     * @brief 把各线程缓冲区中的日志取出并写入，返回写入条数
+     *
+     * @return std::size_t
+     */
+    std::size_t drain();
+    void write(const record& rec);
+    void openFile(std::chrono::system_clock::time_point now);
+    void flush(bool force_sync);
+
+    std::atomic<int> _level;                                    //最低输出级别
+    std::atomic<std::uint64_t> _dropped{0};                     //丢弃的日志条数
+    std::uint64_t _reported_dropped = 0;                        //已提示过的丢弃条数，仅写线程访问
+
+    mutable std::mutex _rings_mtx;
+    std::vector<std::shared_ptr<ringBuffer>> _rings;            //所有线程的缓冲区，线程退出且取空后移除
+
+    std::mutex _wake_mtx;
+    std::condition_variable _wake;
+    bool _stopping = false;
+
+    // 以下只在写线程中访问
+    std::string _console_batch;                                 //本批次待写控制台的内容
+    std::string _file_batch;                                    //本批次待写文件的内容
+    std::time_t _cached_second = -1;                            //_cached_time对应的秒
+    char _cached_time[32] = {};                                 //"YYYY-MM-DD HH:MM:SS"，同一秒内复用
+    int _cached_day = -1;                                       //_cached_second对应的tm_yday
+    std::FILE* _file = nullptr;
+    std::size_t _file_size = 0;
+    int _file_day = -1;                                         //当前文件对应的日期(tm_yday)，跨天轮转
+    unsigned _file_index = 0;                                   //文件名中的序号
+    std::chrono::steady_clock::time_point _last_sync;
+    bool _unsynced = false;
+
+    std::thread _writer;
 };
 
+/**
+ * @brief 先检查级别再求值message，级别关闭时不产生任何格式化开销
+ *
+ */
+#define HOMETOWN_LOG(level, message)                                    \
+    do {                                                                \
+        if (logger::getInstance().enabled(level)) {                     \
+            logger::getInstance().log(level, message);                  \
+        }                                                               \
+    } while (0)
+
+#define LOG_INFO(message) HOMETOWN_LOG(logLevel::info, message)
+#define LOG_WARNING(message) HOMETOWN_LOG(logLevel::warning, message)
+#define LOG_ERROR(message) HOMETOWN_LOG(logLevel::error, message)
+
+// release构建(NDEBUG)中debug日志整体编译掉，定义HOMETOWN_DEBUG_LOG可保留
+#if defined(NDEBUG) && !defined(HOMETOWN_DEBUG_LOG)
+#define LOG_DEBUG(message) do { } while (0)
+#else
+#define LOG_DEBUG(message) HOMETOWN_LOG(logLevel::debug, message)
+#endif
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,110 @@
+/**
+ * @file memoryStore.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief 进程内存储，用于基准测试与无数据库的本地运行
+ * @version 1.3
+ * @date 2024-11-22
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-22 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-23 <td>1.1     <td>antaresz    <td>批量插入只计一次往返
+ * <tr><td>2024-11-26 <td>1.2     <td>antaresz    <td>插入帖子返回新帖子的id
+ * <tr><td>2024-11-29 <td>1.3     <td>antaresz    <td>异步接口，往返延迟由定时器等待
+ * </table>
+ */
+#ifndef _MEMORYSTORE_HPP
+#define _MEMORYSTORE_HPP
+
+#include <boost/asio/io_context.hpp>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include "dataStore.hpp"
+
+/**
+ * @brief 用户按用户名哈希索引，帖子按(created_at, id)倒序有序保存
+ *
+ * 用户与帖子各用一把读写锁，读操作之间不互斥。数据不落盘，进程退出即丢失。
+ * latency不为0时每次调用先休眠该时间，模拟数据库往返；批量插入整批只休眠一次，与一次提交对应。
+ * enableAsync后asyncDataStore的操作改由定时器等待同样的延迟，不占用调用线程，用于与阻塞接口对比。
+ */
+class memoryStore : public dataStore, public asyncDataStore {
+public:
+    explicit memoryStore(std::chrono::microseconds latency = std::chrono::microseconds(0)) : _latency(latency) {}
+
+    /**
+     * @brief 开启异步接口，回调在运行io的线程上调用
+     *
+     * 须在交给userHandler与postManage之前调用，io须比所有在途的异步操作活得更久。
+     *
+     * @param io
+     */
+    void enableAsync(boost::asio::io_context& io) { _io = &io; }
+    asyncDataStore* async() override { return _io ? this : nullptr; }
+
+    bool insertUser(const userRegistration& registration, const std::string& password_hash, doneCallback done) override;
+    bool findCredentials(const std::string& username, credentialsCallback done) override;
+    bool updatePassword(std::int64_t user_id, const std::string& password_hash, doneCallback done) override;
+    bool insertPost(const newPost& post, insertCallback done) override;
+    bool findPost(int id, postCallback done) override;
+
+    bool insertUser(const userRegistration& registration, const std::string& password_hash) override;
+    bool findCredentials(const std::string& username, userCredentials& found) override;
+    bool updatePassword(std::int64_t user_id, const std::string& password_hash) override;
+    void insertUsers(const std::vector<newUser>& users, std::vector<bool>& inserted) override;
+
+    int insertPost(int upid, const std::string& title, const std::string& content, const std::string& post_type) override;
+    void insertPosts(const std::vector<newPost>& posts, std::vector<int>& ids) override;
+    bool deletePost(int id) override;
+    bool updatePost(int id, const std::string& title, const std::string& content) override;
+    bool findPost(int id, Post& found) override;
+    bool scanPosts(const postQuery& query, std::size_t limit, const postVisitor& visit) override;
+
+private:
+    struct userRow {
+        userRegistration registration;          //password字段为空
+        userCredentials credentials;
+    };
+    using postKey = std::pair<std::string, int>;    //(created_at, id)
+
+    void roundTrip() const;
+    template <typename Operation>
+    bool afterRoundTrip(Operation operation);
+    bool storeUser(const userRegistration& registration, const std::string& password_hash);
+    bool lookupCredentials(const std::string& username, userCredentials& found) const;
+    bool replacePassword(std::int64_t user_id, const std::string& password_hash);
+    int storePost(int upid, const std::string& title, const std::string& content, const std::string& post_type);
+    bool lookupPost(int id, Post& found) const;
+    /**
+     * @brief 须持有_users_mtx的写锁
+     *
+     */
+    bool addUser(const userRegistration& registration, const std::string& password_hash);
+    /**
+     * @brief 须持有_posts_mtx的写锁
+     *
+     */
+    int addPost(int upid, const std::string& title, const std::string& content, const std::string& post_type, const std::string& created_at);
+
+    std::chrono::microseconds _latency;
+    boost::asio::io_context* _io = nullptr;
+
+    mutable std::shared_mutex _users_mtx;
+    std::unordered_map<std::string, userRow> _users;                //username -> 用户
+    std::unordered_map<std::int64_t, std::string> _usernames;       //id -> username
+    std::int64_t _next_user_id = 1;
+
+    mutable std::shared_mutex _posts_mtx;
+    std::map<postKey, Post, std::greater<postKey>> _posts;          //按(created_at, id)倒序
+    std::unordered_map<int, std::string> _post_times;              //id -> created_at，用于按id定位
+    int _next_post_id = 1;
+};
+
+#endif
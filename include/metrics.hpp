@@ -0,0 +1,225 @@
+/**
+ * @file metrics.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief 无锁计数器、HDR风格直方图与Prometheus文本格式导出
+ * @version 1.1
+ * @date 2024-11-21
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-21 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>countBelow按小于bound计数，导出的le为bound-1
+ * </table>
+ */
+#ifndef _METRICS_HPP
+#define _METRICS_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace metricsDetail {
+constexpr std::size_t SHARDS = 16;              //每个指标的分片数，线程按首次使用顺序分到不同分片
+
+/**
+ * @brief 当前线程的分片下标
+ *
+ * @return std::size_t
+ */
+inline std::size_t threadShard() {
+    static std::atomic<std::size_t> next{0};
+    thread_local std::size_t shard = next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+
+    return shard;
+}
+}
+
+/**
+ * @brief 单调递增计数器
+ *
+ * 每个线程写自己的分片(独占缓存行)，读取时求和，写路径只有一次relaxed的fetch_add。
+ */
+class counter {
+public:
+    void add(std::uint64_t n = 1) { _cells[metricsDetail::threadShard()].value.fetch_add(n, std::memory_order_relaxed); }
+    std::uint64_t value() const;
+
+private:
+    struct alignas(64) cell {
+        std::atomic<std::uint64_t> value{0};
+    };
+    cell _cells[metricsDetail::SHARDS];
+};
+
+/**
+ * @brief 可增可减的计量值，增减可以发生在不同线程上
+ *
+ */
+class gauge {
+public:
+    void add(std::int64_t n = 1) { _cells[metricsDetail::threadShard()].value.fetch_add(n, std::memory_order_relaxed); }
+    void sub(std::int64_t n = 1) { add(-n); }
+    std::int64_t value() const;
+
+private:
+    struct alignas(64) cell {
+        std::atomic<std::int64_t> value{0};
+    };
+    cell _cells[metricsDetail::SHARDS];
+};
+
+/**
+ * @brief 直方图快照
+ *
+ */
+struct histogramSnapshot {
+    std::vector<std::uint64_t> buckets;         //各桶的计数
+    std::uint64_t count = 0;
+    std::uint64_t sum = 0;
+
+    /**
+     * @brief 分位数，返回所在桶的上界，相对误差不超过1/16
+     *
+     * @param quantile 0~1
+     * @return std::uint64_t
+     */
+    std::uint64_t percentile(double quantile) const;
+    /**
+     * @brief 小于bound的样本数，bound须为2的幂
+     *
+     * 等于bound的样本与略大于它的样本同在一个桶中，无法单独计入；样本都是整数，
+     * 因此结果即不大于bound-1的样本数。
+     *
+     * @param bound
+     * @return std::uint64_t
+     */
+    std::uint64_t countBelow(std::uint64_t bound) const;
+};
+
+/**
+ * @brief 对数-线性分桶的直方图
+ *
+ * 每个2的幂区间再等分为16个桶，小于16的值精确记录，覆盖[0, 2^40)，
+ * 更大的值记入最后一个桶。单位由调用方决定，服务端统一使用微秒。
+ */
+class histogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 4;
+    static constexpr std::size_t SUB_BUCKETS = std::size_t(1) << SUB_BUCKET_BITS;
+    static constexpr unsigned MAX_BITS = 40;
+    static constexpr std::size_t BUCKETS = (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    histogram();
+
+    histogram(const histogram&) = delete;
+    histogram& operator=(const histogram&) = delete;
+
+    void record(std::uint64_t value) {
+        shard& s = _shards[metricsDetail::threadShard()];
+
+        s.buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        s.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+    histogramSnapshot snapshot() const;
+
+    static std::size_t bucketIndex(std::uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return static_cast<std::size_t>(value);
+        }
+
+        unsigned msb = 63 - static_cast<unsigned>(__builtin_clzll(value));
+
+        if (msb >= MAX_BITS) {
+            return BUCKETS - 1;
+        }
+
+        unsigned shift = msb - SUB_BUCKET_BITS;
+
+        return (shift + 1) * SUB_BUCKETS + static_cast<std::size_t>((value >> shift) - SUB_BUCKETS);
+    }
+    /**
+     * @brief 桶的上界(不含)
+     *
+     * @param index
+     * @return std::uint64_t
+     */
+    static std::uint64_t bucketUpper(std::size_t index) {
+        if (index < SUB_BUCKETS) {
+            return index + 1;
+        }
+
+        std::size_t shift = index / SUB_BUCKETS - 1;
+
+        return (static_cast<std::uint64_t>(index % SUB_BUCKETS + SUB_BUCKETS) + 1) << shift;
+    }
+
+private:
+    struct alignas(64) shard {
+        std::atomic<std::uint64_t> sum{0};
+        std::atomic<std::uint64_t> buckets[BUCKETS];
+    };
+    std::unique_ptr<shard[]> _shards;
+};
+
+/**
+ * @brief 指标注册表，按Prometheus文本格式导出
+ *
+ * 注册表只保存指标的引用或取值函数，指标本身由各模块持有。
+ * 注册须在服务启动前完成，render只读取原子变量和调用取值函数，不与写路径争锁。
+ */
+class metricsRegistry {
+public:
+    using valueFunction = std::function<double()>;
+
+    void addCounter(const std::string& name, const std::string& help, const std::string& labels, const counter& metric);
+    void addCounter(const std::string& name, const std::string& help, const std::string& labels, valueFunction value);
+    void addGauge(const std::string& name, const std::string& help, const std::string& labels, const gauge& metric);
+    void addGauge(const std::string& name, const std::string& help, const std::string& labels, valueFunction value);
+    /**
+     * @brief 注册直方图，同时导出name_quantile{quantile="0.5|0.99|0.999"}
+     *
+     * @param name
+     * @param help
+     * @param labels
+     * @param metric
+     * @param unit 直方图单位换算为秒的系数，默认直方图以微秒记录
+     */
+    void addHistogram(const std::string& name, const std::string& help, const std::string& labels, const histogram& metric, double unit = 1e-6);
+    /**
+     * @brief 生成文本格式的全部指标
+     *
+     * @return std::string
+     */
+    std::string render() const;
+    /**
+     * @brief 拼出name="value"，value中的\、"和换行会被转义
+     *
+     * @param name
+     * @param value
+     * @return std::string
+     */
+    static std::string label(const std::string& name, const std::string& value);
+
+private:
+    enum class metricType { counter, gauge, histogram };
+    struct entry {
+        std::string name;
+        std::string help;
+        std::string labels;
+        metricType type;
+        valueFunction value;
+        const histogram* hist = nullptr;
+        double unit = 1;
+    };
+
+    std::vector<entry> _entries;
+};
+
+#endif
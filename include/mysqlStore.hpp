@@ -0,0 +1,64 @@
+/**
+ * @file mysqlStore.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief 基于MySQL连接池的存储
+ * @version 1.2
+ * @date 2024-11-22
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-22 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-23 <td>1.1     <td>antaresz    <td>批量插入使用多行INSERT与单个事务
+ * <tr><td>2024-11-26 <td>1.2     <td>antaresz    <td>插入帖子返回新帖子的id
+ * </table>
+ */
+#ifndef _MYSQLSTORE_HPP
+#define _MYSQLSTORE_HPP
+
+#include "SQLConnection.hpp"
+#include "dataStore.hpp"
+
+/**
+ * @brief 每次调用借出一个连接，语句使用连接上缓存的预编译语句
+ *
+ */
+class mysqlStore : public dataStore {
+public:
+    explicit mysqlStore(SQLConnection& connectionPool) : _connection_pool(connectionPool) {}
+
+    bool insertUser(const userRegistration& registration, const std::string& password_hash) override;
+    bool findCredentials(const std::string& username, userCredentials& found) override;
+    bool updatePassword(std::int64_t user_id, const std::string& password_hash) override;
+    /**
+     * @brief 一个事务内用多行INSERT插入，只提交一次；失败时回滚并逐行重试，隔离出出错的行
+     *
+     */
+    void insertUsers(const std::vector<newUser>& users, std::vector<bool>& inserted) override;
+
+    /**
+     * @brief 新帖子的id在同一连接上由LAST_INSERT_ID()取得
+     *
+     */
+    int insertPost(int upid, const std::string& title, const std::string& content, const std::string& post_type) override;
+    /**
+     * @brief 同insertUsers；多行INSERT分配的自增id是连续的，每条语句的id为LAST_INSERT_ID()起依次加一
+     *
+     */
+    void insertPosts(const std::vector<newPost>& posts, std::vector<int>& ids) override;
+    bool deletePost(int id) override;
+    bool updatePost(int id, const std::string& title, const std::string& content) override;
+    bool findPost(int id, Post& found) override;
+    /**
+     * @brief 依赖posts(created_at, id)上的索引，按索引倒序扫描limit行即可结束
+     *
+     */
+    bool scanPosts(const postQuery& query, std::size_t limit, const postVisitor& visit) override;
+
+private:
+    SQLConnection& _connection_pool;
+};
+
+#endif
@@ -0,0 +1,105 @@
+/**
+ * @file passwordHasher.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief passwordHasher类定义：可配置的密码KDF
+ * @version 1.1
+ * @date 2024-11-19
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-19 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>validParams限制scrypt的r、p与内存及PBKDF2迭代次数
+ * </table>
+ */
+#ifndef _PASSWORDHASHER_HPP
+#define _PASSWORDHASHER_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief 密码派生算法
+ *
+ */
+enum class kdfType {
+    scrypt,                             //内存困难，默认
+    pbkdf2                              //PBKDF2-HMAC-SHA256
+};
+
+/**
+ * @brief KDF参数
+ *
+ */
+struct kdfParams {
+    kdfType type = kdfType::scrypt;
+    std::uint32_t scrypt_log2_n = 15;               //scrypt的N=2^log2_n，内存约128*r*N字节(默认32MB)
+    std::uint32_t scrypt_r = 8;
+    std::uint32_t scrypt_p = 1;
+    std::uint32_t pbkdf2_iterations = 600000;
+};
+
+/**
+ * @brief 密码哈希与校验
+ *
+ * 哈希以"$scrypt$ln=15,r=8,p=1$盐$哈希"或"$pbkdf2-sha256$i=600000$盐$哈希"的形式
+ * 存在users.password中，算法与参数随哈希保存，修改配置后旧哈希仍能校验。
+ * 不以'$'开头的是旧版HMAC-SHA256(盐取自users.salt)。
+ * 计算开销大，只能在哈希线程池中调用；所有方法都是const，可被多个线程同时调用。
+ */
+class passwordHasher {
+public:
+    explicit passwordHasher(const kdfParams& params = kdfParams());
+
+    /**
+     * @brief 用当前参数和新的随机盐计算哈希
+     *
+     * @param password
+     * @return std::string 编码后的哈希
+     */
+    std::string hash(std::string_view password) const;
+    /**
+     * @brief 校验密码，比较为定长时间
+     *
+     * @param password
+     * @param stored users.password中的值
+     * @param legacy_salt users.salt中的值，只用于旧版哈希
+     * @param needs_rehash 校验通过且存储的算法或参数与当前配置不同时为true
+     * @return true 密码正确
+     */
+    bool verify(std::string_view password, std::string_view stored, std::string_view legacy_salt, bool& needs_rehash) const;
+    /**
+     * @brief 解析"scrypt"/"pbkdf2"
+     *
+     * @param name
+     * @param type
+     * @return true
+     */
+    static bool parseType(const std::string& name, kdfType& type);
+    /**
+     * @brief 参数是否在可以安全计算的范围内
+     *
+     * 存储的哈希与--kdf-cost都经此校验：过大的参数会让一次计算耗尽内存或长时间占用hash线程，
+     * 越界的scrypt参数会使CryptoPP抛出InvalidArgument。
+     *
+     * @param params
+     * @return true
+     */
+    static bool validParams(const kdfParams& params);
+
+private:
+    static constexpr std::size_t SALT_BYTES = 16;
+    static constexpr std::size_t HASH_BYTES = 32;
+
+    static std::string derive(const kdfParams& params, std::string_view password, const std::string& salt);
+    static std::string encode(const kdfParams& params, const std::string& salt, const std::string& derived);
+    static bool decode(std::string_view stored, kdfParams& params, std::string& salt, std::string& derived);
+    static std::string legacyHash(std::string_view password, std::string_view salt);
+
+    kdfParams _params;
+};
+
+#endif
@@ -0,0 +1,154 @@
+/**
+ * @file postFeeds.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief postFeeds类定义：按帖子类型与作者物化的最新帖子列表
+ * @version 1.1
+ * @date 2024-11-27
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-27 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>新帖子按id插入，并发创建时列表仍从新到旧
+ * </table>
+ */
+#ifndef _POSTFEEDS_HPP
+#define _POSTFEEDS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief 列表统计
+ *
+ */
+struct feedStats {
+    std::size_t type_feeds = 0;             //帖子类型数
+    std::size_t author_feeds = 0;           //作者数
+    std::size_t posts = 0;                  //至少在一个列表中的帖子数
+};
+
+/**
+ * @brief 每个post_type、每个upid各一个定长环形缓冲区，保存最新的FEED_LENGTH个帖子id
+ *
+ * 新帖子按id插入，通常就在环尾，满时挤掉最旧的一个；删除时从所在的两个列表中移除，列表随之变短，
+ * 直到有新帖子补上，不会回头从存储补齐更旧的帖子。
+ * 读写各用共享锁与独占锁，线程安全。
+ */
+class postFeeds {
+public:
+    static constexpr std::size_t FEED_LENGTH = 64;
+
+    postFeeds() = default;
+    postFeeds(const postFeeds&) = delete;
+    postFeeds& operator=(const postFeeds&) = delete;
+
+    /**
+     * @brief 加入一个新帖子
+     *
+     * 并发创建的帖子完成的顺序与id顺序可能不同，按id插入到对应位置；
+     * 列表已满且它比其中都旧时忽略。
+     *
+     * @param post_id
+     * @param upid
+     * @param post_type
+     */
+    void append(int post_id, int upid, const std::string& post_type);
+    /**
+     * @brief 加入一个比列表中都旧的帖子，列表已满时忽略，用于启动时按从新到旧的顺序填充
+     *
+     * @param post_id
+     * @param upid
+     * @param post_type
+     */
+    void appendOlder(int post_id, int upid, const std::string& post_type);
+    /**
+     * @brief 从所在的列表中移除，不在任何列表中时什么也不做
+     *
+     * @param post_id
+     */
+    void remove(int post_id);
+    /**
+     * @brief 复制某类型最新的帖子id
+     *
+     * @param post_type
+     * @param limit 超过FEED_LENGTH按FEED_LENGTH处理
+     * @param ids 至少limit个元素，从新到旧
+     * @return std::size_t 写入的个数
+     */
+    std::size_t byType(const std::string& post_type, std::size_t limit, int* ids) const;
+    /**
+     * @brief 复制某作者最新的帖子id
+     *
+     * @param upid
+     * @param limit
+     * @param ids
+     * @return std::size_t
+     */
+    std::size_t byAuthor(int upid, std::size_t limit, int* ids) const;
+    feedStats stats() const;
+
+private:
+    /**
+     * @brief 定长环形缓冲区，_ids[(_head + i) % FEED_LENGTH]为第i旧的帖子
+     *
+     */
+    class ring {
+    public:
+        /**
+         * @brief 按id顺序写入，从最新处向前找位置
+         *
+         * @param post_id
+         * @return int 被挤掉的最旧的帖子id，没有时为0；已满且post_id比其中都旧时为post_id本身
+         */
+        int insert(int post_id);
+        /**
+         * @brief 写入最旧的一个
+         *
+         * @param post_id
+         * @return true 已写入；已满时为false
+         */
+        bool pushOldest(int post_id);
+        /**
+         * @brief 移除一个帖子，其后较新的依次前移
+         *
+         * @param post_id
+         */
+        void erase(int post_id);
+        std::size_t copyNewest(std::size_t limit, int* ids) const;
+
+    private:
+        std::array<int, FEED_LENGTH> _ids{};
+        std::uint32_t _head = 0;
+        std::uint32_t _size = 0;
+    };
+    /**
+     * @brief 帖子所在的两个列表，指向的元素在unordered_map中地址稳定；被挤出某个列表后对应项置空
+     *
+     */
+    struct membership {
+        ring* type = nullptr;
+        ring* author = nullptr;
+    };
+
+    /**
+     * @brief 帖子被挤出一个列表，两个都不在时不再记录，须持有写锁
+     *
+     * @param post_id
+     * @param slot membership中对应的成员
+     */
+    void evict(int post_id, ring* membership::*slot);
+
+    mutable std::shared_mutex _mtx;
+    std::unordered_map<std::string, ring> _types;           //post_type -> 列表
+    std::unordered_map<int, ring> _authors;                 //upid -> 列表
+    std::unordered_map<int, membership> _posts;             //postid -> 所在列表
+};
+
+#endif
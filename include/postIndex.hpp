@@ -0,0 +1,164 @@
+/**
+ * @file postIndex.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief postIndex类定义：帖子标题与正文的内存倒排索引
+ * @version 1.0
+ * @date 2024-11-26
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-26 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#ifndef _POSTINDEX_HPP
+#define _POSTINDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief 一条检索结果
+ *
+ */
+struct searchHit {
+    int post_id;
+    float score;                            //BM25得分，越大越相关
+};
+
+/**
+ * @brief 索引统计
+ *
+ */
+struct indexStats {
+    std::size_t documents = 0;              //可检索的帖子数
+    std::size_t deleted = 0;                //已删除或已被更新替换、尚未压缩掉的文档数
+    std::size_t terms = 0;                  //词项数
+    std::size_t posting_bytes = 0;          //倒排表压缩后的字节数
+};
+
+/**
+ * @brief 倒排索引
+ *
+ * 分词：ASCII字母数字连续成词并转小写；汉字、假名、谚文按相邻两字切成二元词，
+ * 同时保留单字，单字查询也能命中；其余字符作为分隔符。
+ *
+ * 每个帖子在索引内有一个按加入顺序递增的文档号，倒排表按文档号升序保存，
+ * 文档号差值与词频用varint编码，新文档只追加在表尾；每BLOCK_POSTINGS条记一个跳表项，
+ * 求交时按跳表跳过整块。更新或删除只把旧文档号标记为删除，更新后的内容以新文档号追加，
+ * 删除的文档占比过高时整体压缩。
+ *
+ * 查询按AND语义求交，以BM25排序取前k个。读写各用共享锁与独占锁，线程安全。
+ */
+class postIndex {
+public:
+    static constexpr std::size_t BLOCK_POSTINGS = 128;         //跳表间隔
+    static constexpr std::uint32_t TITLE_WEIGHT = 3;           //标题中的词按几次计入词频
+
+    postIndex() = default;
+    postIndex(const postIndex&) = delete;
+    postIndex& operator=(const postIndex&) = delete;
+
+    /**
+     * @brief 加入或替换一个帖子
+     *
+     * @param post_id
+     * @param title
+     * @param content
+     */
+    void add(int post_id, std::string_view title, std::string_view content);
+    /**
+     * @brief 替换已在索引中的帖子
+     *
+     * @param post_id
+     * @param title
+     * @param content
+     * @return true 已替换；帖子不在索引中时什么也不做
+     */
+    bool update(int post_id, std::string_view title, std::string_view content);
+    /**
+     * @brief 删除一个帖子，不存在时什么也不做
+     *
+     * @param post_id
+     */
+    void remove(int post_id);
+    /**
+     * @brief 检索
+     *
+     * @param query
+     * @param k 最多返回的条数
+     * @param hits 按得分从高到低，得分相同时新帖子在前
+     * @return std::size_t 命中的帖子总数
+     */
+    std::size_t search(std::string_view query, std::size_t k, std::vector<searchHit>& hits) const;
+    indexStats stats() const;
+    /**
+     * @brief 把text切分为词项，查询与建索引使用同一规则
+     *
+     * @param text
+     * @param terms 追加，可能有重复
+     */
+    static void tokenize(std::string_view text, std::vector<std::string>& terms);
+
+private:
+    /**
+     * @brief 跳表项：块内第一条记录之前的文档号(差值的基准)与块的起始偏移
+     *
+     */
+    struct skipEntry {
+        std::uint32_t base;
+        std::uint32_t offset;
+    };
+    /**
+     * @brief 一个词项的倒排表
+     *
+     */
+    struct postingList {
+        std::string bytes;                  //(文档号差值, 词频)的varint序列
+        std::vector<skipEntry> skips;       //第i项对应第i*BLOCK_POSTINGS条记录
+        std::uint32_t count = 0;            //记录数，包括已删除的文档
+        std::uint32_t last = 0;             //最后一条记录的文档号
+
+        void append(std::uint32_t doc, std::uint32_t frequency);
+    };
+    class cursor;
+
+    /**
+     * @brief 以新的文档号加入，须持有写锁且post_id不在索引中
+     *
+     * @param post_id
+     * @param title
+     * @param content
+     */
+    void addLocked(int post_id, std::string_view title, std::string_view content);
+    /**
+     * @brief 须持有写锁
+     *
+     * @param post_id
+     */
+    void removeLocked(int post_id);
+    /**
+     * @brief 去掉已删除的文档并重新编号，须持有写锁
+     *
+     */
+    void compact();
+
+    mutable std::shared_mutex _mtx;
+    std::unordered_map<std::string, postingList> _terms;       //词项 -> 倒排表
+    std::vector<int> _post_ids;                                 //文档号 -> 帖子id
+    std::vector<std::uint32_t> _lengths;                        //文档号 -> 加权后的词数
+    std::vector<bool> _live;                                    //文档号 -> 是否仍可检索
+    std::unordered_map<int, std::uint32_t> _documents;          //帖子id -> 当前的文档号
+    std::uint64_t _total_length = 0;                            //可检索文档的长度之和
+    std::size_t _posting_bytes = 0;
+    std::vector<std::string> _scratch;                          //add时的分词缓冲，受写锁保护
+};
+
+#endif
@@ -12,26 +12,198 @@
 #include <string>
 #include <vector>
 #include <optional>
-#include "SQLConnection.hpp"
+#include <functional>
+#include <memory>
+#include "dataStore.hpp"
+#include "postFeeds.hpp"
+#include "postIndex.hpp"
+#include "shardedCache.hpp"
+#include "writeBatcher.hpp"
 
-struct Post {
-    int postid;                         //postid
-    int upid;                           //upid
-    std::string title;                  //标题
-    std::string content;                //内容
-    std::string post_type;              //post类型
-    std::string created_at;             //创建时间
+/**
+ * @brief 缓存中的帖子，连同预先序列化好的JSON一起保存
+ * 
+ */
+struct cachedPost {
+    Post post;                          //帖子
+    std::string json;                   //post序列化后的JSON对象
 };
 
 class postManage {
 public:
-    postManage(SQLConnection& connectionPool);
+    /**
+     * @brief Construct a new post Manage object
+     * 
+     * @param store 
+     * @param cache_bytes 帖子缓存的内存预算
+     */
+    postManage(dataStore& store, std::size_t cache_bytes = 64 * 1024 * 1024);
 
     bool createPost(int upid, const std::string& title, const std::string& conten, const std::string& post_typet);
+    /**
+     * @brief 开启批量写入，之后submitPost与其他请求合并为一次提交
+     * 
+     * 须在服务启动前调用。
+     * 
+     * @param options 
+     */
+    void enableBatching(const batchOptions& options);
+    bool batching() const { return _post_writer != nullptr; }
+    /**
+     * @brief 交给批量写入线程，所在批次提交后在该线程上调用done，须先enableBatching
+     * 
+     * @param post 
+     * @param done 
+     * @return true 已入队
+     * @return false 队列已满，done不会被调用
+     */
+    bool submitPost(newPost post, std::function<void(bool)> done);
+    /**
+     * @brief 每批插入的帖子数，未开启批量写入时为nullptr
+     * 
+     * @return const histogram* 
+     */
+    const histogram* postBatchSizes() const { return _post_writer ? &_post_writer->batchSizes() : nullptr; }
+    /**
+     * @brief 存储是否提供asyncDataStore，为true时可用createPostAsync与loadPost
+     * 
+     * @return true 
+     */
+    bool asynchronous() const { return _async != nullptr; }
+    /**
+     * @brief 经存储的异步接口插入，不占用线程，插入后在存储的线程上更新索引并调用done
+     * 
+     * @param post 
+     * @param done 
+     * @return true 已发起
+     * @return false 存储排队已满，done不会被调用
+     */
+    bool createPostAsync(newPost post, std::function<void(bool)> done);
     bool deletePost(int id);
     bool updatePost(int id, const std::string& title, const std::string& content);
-    std::optional<Post> getPost(int id);
-    std::vector<Post> getAllPosts();
+    /**
+     * @brief 读穿透获取单个帖子，命中缓存时不访问数据库
+     * 
+     * @param id 
+     * @return std::shared_ptr<const cachedPost> 不存在或查询失败时为nullptr
+     */
+    std::shared_ptr<const cachedPost> getPost(int id);
+    /**
+     * @brief getPost的异步版本，未命中时经存储的异步接口读取并回填缓存
+     * 
+     * 命中时直接在调用线程上调用done，否则在存储的线程上调用。
+     * 
+     * @param id 
+     * @param done 参数为nullptr表示不存在或查询失败
+     * @return true 已发起
+     * @return false 存储排队已满，done不会被调用
+     */
+    bool loadPost(int id, std::function<void(std::shared_ptr<const cachedPost>)> done);
+    /**
+     * @brief 只查缓存，不访问数据库，可以在io线程上调用
+     * 
+     * @param id 
+     * @return std::shared_ptr<const cachedPost> 未命中时为nullptr
+     */
+    std::shared_ptr<const cachedPost> findCachedPost(int id) { return _cache.get(id); }
+    /**
+     * @brief 分页读取全部帖子，建立全文索引与按类型、作者的最新帖子列表
+     * 
+     * 须在服务启动前调用，之后由createPost/updatePost/deletePost增量维护。
+     * 
+     * @param page_rows 每次查询的行数
+     * @return true 全部读完；失败时只包含已读到的帖子
+     */
+    bool buildIndexes(std::size_t page_rows = 500);
+    /**
+     * @brief 全文检索并序列化为JSON追加到out
+     * 
+     * 输出格式为{"total":n,"posts":[{...},...]}，total为命中的帖子总数，
+     * posts按相关度排序，最多limit条，逐个读穿透缓存取帖子，可能访问数据库。
+     * 
+     * @param query 
+     * @param limit 超过postQuery::MAX_LIMIT按MAX_LIMIT处理
+     * @param with_content 
+     * @param out 
+     */
+    void writeSearchJson(std::string_view query, std::size_t limit, bool with_content, std::string& out);
+    /**
+     * @brief 全文索引统计
+     * 
+     * @return indexStats 
+     */
+    indexStats searchIndexStats() const { return _index.stats(); }
+    /**
+     * @brief 某类型最新的帖子id，只读内存
+     * 
+     * @param post_type 
+     * @param limit 
+     * @param ids 至少limit个元素，从新到旧
+     * @return std::size_t 个数
+     */
+    std::size_t feedByType(const std::string& post_type, std::size_t limit, int* ids) const { return _feeds.byType(post_type, limit, ids); }
+    /**
+     * @brief 某作者最新的帖子id，只读内存
+     * 
+     * @param upid 
+     * @param limit 
+     * @param ids 
+     * @return std::size_t 
+     */
+    std::size_t feedByAuthor(int upid, std::size_t limit, int* ids) const { return _feeds.byAuthor(upid, limit, ids); }
+    feedStats postFeedStats() const { return _feeds.stats(); }
+    /**
+     * @brief 按给定顺序序列化一组帖子，输出格式为{"posts":[{...},...]}，已不存在的帖子跳过
+     * 
+     * @param ids 
+     * @param count 
+     * @param with_content 
+     * @param cached_only 为true时只查缓存，可以在io线程上调用
+     * @param out 
+     * @return true 成功；cached_only时有帖子未命中缓存则返回false，out恢复原状
+     */
+    bool writeFeedJson(const int* ids, std::size_t count, bool with_content, bool cached_only, std::string& out);
+    /**
+     * @brief 帖子缓存统计
+     * 
+     * @return cacheStats 
+     */
+    cacheStats postCacheStats() const { return _cache.stats(); }
+    /**
+     * @brief 分页查询并把结果直接序列化为JSON追加到out，不经过Post对象
+     * 
+     * 输出格式为{"posts":[{...},...],"next":"created_at,id"|null}。
+     * 
+     * @param query 
+     * @param out 
+     * @return true 查询成功；失败时out恢复原状
+     */
+    bool writePostsJson(const postQuery& query, std::string& out);
+    /**
+     * @brief 读取一页帖子，把各行以逗号分隔追加到out，不带外层的数组与游标，供流式列表逐页输出
+     * 
+     * @param query 
+     * @param first 为false时第一行前也加逗号，接在上一页之后
+     * @param out 
+     * @param next 还有下一页时为下一页的游标，否则为空
+     * @return true 查询成功；失败时out恢复原状
+     */
+    bool writePostsPage(const postQuery& query, bool first, std::string& out, std::optional<postCursor>& next);
 private:
-    SQLConnection& _connection_pool;
+    /**
+     * @brief 序列化读到的帖子并回填缓存
+     * 
+     * @param id 
+     * @param entry 
+     * @param generation 查询前取得的分片代数
+     * @return std::shared_ptr<const cachedPost> 
+     */
+    std::shared_ptr<const cachedPost> fillCache(int id, std::shared_ptr<cachedPost> entry, std::uint64_t generation);
+
+    dataStore& _store;
+    asyncDataStore* _async;                         //存储不支持异步接口时为nullptr
+    shardedCache<int, cachedPost> _cache;           //postid -> 帖子与其JSON
+    postIndex _index;                               //标题与内容的全文索引，先于_post_writer构造、后于其析构
+    postFeeds _feeds;                               //按类型、作者的最新帖子id，同上
+    std::unique_ptr<writeBatcher<newPost>> _post_writer;    //未开启批量写入时为空
 };
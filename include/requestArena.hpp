@@ -0,0 +1,86 @@
+/**
+ * @file requestArena.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief requestArena类定义：连接上逐请求复用的单调内存
+ * @version 1.0
+ * @date 2024-11-24
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-24 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#ifndef _REQUESTARENA_HPP
+#define _REQUESTARENA_HPP
+
+#include <cstddef>
+#include <memory_resource>
+
+/**
+ * @brief 单调分配的内存资源，一个请求内的临时数据都从这里分配
+ *
+ * 分配只移动指针，deallocate不做任何事，reset一次性回收全部内存。
+ * 当前块用完时追加一个两倍大小的块；reset时若用到了多个块，就合并为一块，
+ * 大小等于这一轮的总容量，于是同样大小的请求之后不再调用malloc。
+ * 单个请求用得太多时不保留大块，避免一次大请求长期占住连接的内存。
+ * 初始大小为0时每次分配单独向全局堆申请，reset时全部释放，请求之间不保留内存。
+ * 不是线程安全的，同一时刻只能有一个线程使用。
+ */
+class requestArena : public std::pmr::memory_resource {
+public:
+    static constexpr std::size_t MAX_RETAINED_BYTES = 256 * 1024;     //reset后最多保留的容量
+
+    /**
+     * @brief 第一次分配时才申请内存
+     *
+     * @param initial_bytes 第一个块的大小，0表示不预留块
+     */
+    explicit requestArena(std::size_t initial_bytes = 16 * 1024) : _initial_bytes(initial_bytes) {}
+    ~requestArena() override;
+    requestArena(const requestArena&) = delete;
+    requestArena& operator=(const requestArena&) = delete;
+
+    /**
+     * @brief 回收本轮分配的全部内存，之前返回的指针全部失效
+     *
+     */
+    void reset();
+    /**
+     * @brief 各块容量之和
+     *
+     * @return std::size_t
+     */
+    std::size_t capacity() const { return _capacity; }
+
+private:
+    /**
+     * @brief 块头，数据紧跟其后
+     *
+     */
+    struct block {
+        block* next;                //上一个块
+        std::size_t size;           //数据部分的字节数
+    };
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* /*p*/, std::size_t /*bytes*/, std::size_t /*alignment*/) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+    /**
+     * @brief 追加一个至少能容纳bytes的块
+     *
+     * @param bytes
+     */
+    void grow(std::size_t bytes);
+    void release();
+
+    std::size_t _initial_bytes;                 //第一个块的大小
+    block* _head = nullptr;                     //当前块，链表按新到旧排列
+    char* _cursor = nullptr;                    //当前块中下一次分配的位置
+    char* _limit = nullptr;                     //当前块的末尾
+    std::size_t _capacity = 0;                  //各块数据部分之和
+};
+
+#endif
@@ -0,0 +1,91 @@
+/**
+ * @file requestJson.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief 从请求的内存资源上分配的JSON类型
+ * @version 1.0
+ * @date 2024-11-24
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-24 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#ifndef _REQUESTJSON_HPP
+#define _REQUESTJSON_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+/**
+ * @brief 当前线程上requestAllocator使用的内存资源，默认是全局堆
+ *
+ * @return std::pmr::memory_resource*&
+ */
+inline std::pmr::memory_resource*& currentRequestMemory() {
+    thread_local std::pmr::memory_resource* memory = std::pmr::new_delete_resource();
+
+    return memory;
+}
+
+/**
+ * @brief 在作用域内把当前线程的requestAllocator指向memory，离开时恢复
+ *
+ * 作用域内用requestAllocator分配的对象必须在离开作用域之前析构，
+ * 否则会把memory上的内存归还给另一个资源。
+ */
+class requestMemoryScope {
+public:
+    explicit requestMemoryScope(std::pmr::memory_resource* memory) : _previous(currentRequestMemory()) {
+        currentRequestMemory() = memory;
+    }
+    ~requestMemoryScope() { currentRequestMemory() = _previous; }
+    requestMemoryScope(const requestMemoryScope&) = delete;
+    requestMemoryScope& operator=(const requestMemoryScope&) = delete;
+
+private:
+    std::pmr::memory_resource* _previous;
+};
+
+/**
+ * @brief 无状态分配器，转发给currentRequestMemory()
+ *
+ * nlohmann::basic_json要求分配器可以默认构造，不能像polymorphic_allocator那样携带资源指针，
+ * 只能通过线程局部变量找到本次请求的资源。
+ *
+ * @tparam T
+ */
+template <typename T>
+struct requestAllocator {
+    using value_type = T;
+
+    requestAllocator() noexcept = default;
+    template <typename U>
+    requestAllocator(const requestAllocator<U>& /*other*/) noexcept {}
+
+    T* allocate(std::size_t n) { return static_cast<T*>(currentRequestMemory()->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T* p, std::size_t n) noexcept { currentRequestMemory()->deallocate(p, n * sizeof(T), alignof(T)); }
+
+    template <typename U>
+    bool operator==(const requestAllocator<U>& /*other*/) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const requestAllocator<U>& /*other*/) const noexcept { return false; }
+};
+
+using requestString = std::basic_string<char, std::char_traits<char>, requestAllocator<char>>;
+/**
+ * @brief 对象、数组、字符串和解析时的词法缓冲都走requestAllocator的JSON
+ *
+ * 只能在requestMemoryScope内创建和销毁。取出的字符串可以用get<std::string>()复制，
+ * 或者用get_ref<const requestString&>()得到引用，在作用域内使用。
+ */
+using requestJson = nlohmann::basic_json<std::map, std::vector, requestString, bool, std::int64_t, std::uint64_t, double, requestAllocator>;
+
+#endif
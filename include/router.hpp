@@ -0,0 +1,88 @@
+/**
+ * @file router.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief router类定义：按方法+路径分发的基数树路由
+ * @version 1.0
+ * @date 2024-11-12
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-12 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#ifndef _ROUTER_HPP
+#define _ROUTER_HPP
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "httpParser.hpp"
+
+/**
+ * @brief 基数树路由
+ *
+ * 路由模式由静态片段与{name}参数组成，例如/posts/{id}/comments。
+ * 启动时add所有路由，运行期只读，可被多个io线程并发match。
+ * 节点存放在连续的vector中，子节点按首字符查找，匹配开销与路径长度成正比，
+ * 与路由数量无关；同一位置静态片段优先于参数。
+ */
+class router {
+public:
+    /**
+     * @brief 匹配结果
+     *
+     */
+    enum class result {
+        matched,                    //找到路由
+        notFound,                   //路径不存在
+        methodNotAllowed            //路径存在但方法不匹配
+    };
+
+    router();
+
+    /**
+     * @brief 添加路由
+     *
+     * @param method GET/POST/PUT/DELETE/PATCH/HEAD/OPTIONS
+     * @param pattern 以'/'开头的路由模式
+     * @param id 路由编号，match成功时返回
+     * @throw std::invalid_argument 方法未知、模式非法或与已有路由冲突
+     */
+    void add(std::string_view method, std::string_view pattern, std::uint32_t id);
+    /**
+     * @brief 匹配请求，成功时把路径参数写入request.params
+     *
+     * @param request
+     * @param id
+     * @return result
+     */
+    result match(httpRequest& request, std::uint32_t& id) const;
+
+private:
+    static constexpr std::uint32_t NONE = UINT32_MAX;
+    static constexpr std::size_t METHOD_COUNT = 7;
+
+    struct node {
+        std::string prefix;                                             //静态片段(参数节点为空)
+        std::string param_name;                                         //参数名(静态节点为空)
+        std::vector<std::pair<char, std::uint32_t>> children;           //静态子节点，按首字符有序
+        std::uint32_t param_child = NONE;                               //参数子节点
+        std::array<std::uint32_t, METHOD_COUNT> routes;                 //各方法对应的路由编号
+        bool has_route = false;                                         //是否有任一方法的路由
+    };
+
+    static int methodIndex(std::string_view method);
+    std::uint32_t newNode();
+    std::uint32_t insertStatic(std::uint32_t index, std::string_view segment);
+    bool matchNode(std::uint32_t index, std::string_view path, std::size_t pos, int method, httpRequest& request, std::uint32_t& id, bool& method_mismatch) const;
+
+    std::vector<node> _nodes;                                           //_nodes[0]为根节点
+};
+
+#endif
@@ -0,0 +1,204 @@
+/**
+ * @file shardedCache.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief shardedCache类定义：分片LRU缓存，按内存预算淘汰
+ * @version 1.0
+ * @date 2024-11-16
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-16 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#ifndef _SHARDEDCACHE_HPP
+#define _SHARDEDCACHE_HPP
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief 缓存统计
+ *
+ */
+struct cacheStats {
+    std::uint64_t hits = 0;                 //命中次数
+    std::uint64_t misses = 0;               //未命中次数
+    std::uint64_t evictions = 0;            //因超出预算被淘汰的条目数
+    std::size_t entries = 0;                //当前条目数
+    std::size_t bytes = 0;                  //当前占用(按put时给出的cost累计)
+};
+
+/**
+ * @brief 分片LRU缓存
+ *
+ * key按哈希分到若干分片，每个分片一把锁、一条LRU链表和总预算的一份，
+ * 不同分片上的读写互不阻塞。值以shared_ptr<const Value>保存，get返回后即使条目
+ * 被淘汰或失效，调用方持有的对象仍然有效。
+ *
+ * 读穿透时先取generation(key)再查数据库，put时带上该值；期间若同一分片发生过
+ * invalidate，put会被拒绝，避免把失效前读到的旧数据写回缓存。
+ *
+ * @tparam Key
+ * @tparam Value
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class shardedCache {
+public:
+    /**
+     * @brief Construct a new sharded Cache object
+     *
+     * @param budget_bytes 总内存预算
+     * @param shards 分片数
+     */
+    explicit shardedCache(std::size_t budget_bytes, std::size_t shards = 16)
+        : _shards(shards == 0 ? 1 : shards) {
+        for (auto& shard : _shards) {
+            shard.budget = budget_bytes / _shards.size();
+        }
+    }
+
+    /**
+     * @brief 查找并把条目移到LRU头部
+     *
+     * @param key
+     * @return std::shared_ptr<const Value> 未命中时为nullptr
+     */
+    std::shared_ptr<const Value> get(const Key& key) {
+        shard& s = shardFor(key);
+        std::lock_guard<std::mutex> lock(s.mtx);
+        auto it = s.index.find(key);
+
+        if (it == s.index.end()) {
+            ++s.misses;
+            return nullptr;
+        }
+        ++s.hits;
+        s.lru.splice(s.lru.begin(), s.lru, it->second);
+        return it->second->value;
+    }
+    /**
+     * @brief 读穿透前记录的分片版本号
+     *
+     * @param key
+     * @return std::uint64_t
+     */
+    std::uint64_t generation(const Key& key) {
+        shard& s = shardFor(key);
+        std::lock_guard<std::mutex> lock(s.mtx);
+
+        return s.generation;
+    }
+    /**
+     * @brief 写入条目，必要时从LRU尾部淘汰
+     *
+     * @param key
+     * @param value
+     * @param cost 条目占用的字节数
+     * @param generation put前调用generation(key)得到的值
+     * @return true 已写入；分片版本号已变化或单个条目超过分片预算时返回false
+     */
+    bool put(const Key& key, std::shared_ptr<const Value> value, std::size_t cost, std::uint64_t generation) {
+        shard& s = shardFor(key);
+        std::lock_guard<std::mutex> lock(s.mtx);
+
+        if (s.generation != generation || cost > s.budget) {
+            return false;
+        }
+
+        auto it = s.index.find(key);
+
+        if (it != s.index.end()) {
+            s.bytes -= it->second->cost;
+            it->second->value = std::move(value);
+            it->second->cost = cost;
+            s.lru.splice(s.lru.begin(), s.lru, it->second);
+        } else {
+            s.lru.push_front(entry{key, std::move(value), cost});
+            s.index.emplace(key, s.lru.begin());
+        }
+        s.bytes += cost;
+        while (s.bytes > s.budget) {
+            entry& victim = s.lru.back();
+
+            s.bytes -= victim.cost;
+            s.index.erase(victim.key);
+            s.lru.pop_back();
+            ++s.evictions;
+        }
+        return true;
+    }
+    /**
+     * @brief 删除条目并使该分片上进行中的读穿透失效
+     *
+     * @param key
+     */
+    void invalidate(const Key& key) {
+        shard& s = shardFor(key);
+        std::lock_guard<std::mutex> lock(s.mtx);
+        auto it = s.index.find(key);
+
+        ++s.generation;
+        if (it != s.index.end()) {
+            s.bytes -= it->second->cost;
+            s.lru.erase(it->second);
+            s.index.erase(it);
+        }
+    }
+    /**
+     * @brief 各分片统计之和
+     *
+     * @return cacheStats
+     */
+    cacheStats stats() const {
+        cacheStats total;
+
+        for (const auto& s : _shards) {
+            std::lock_guard<std::mutex> lock(s.mtx);
+
+            total.hits += s.hits;
+            total.misses += s.misses;
+            total.evictions += s.evictions;
+            total.entries += s.index.size();
+            total.bytes += s.bytes;
+        }
+        return total;
+    }
+
+private:
+    struct entry {
+        Key key;
+        std::shared_ptr<const Value> value;
+        std::size_t cost;
+    };
+
+    struct shard {
+        mutable std::mutex mtx;
+        std::list<entry> lru;                                                   //头部最近使用
+        std::unordered_map<Key, typename std::list<entry>::iterator, Hash> index;
+        std::size_t budget = 0;
+        std::size_t bytes = 0;
+        std::uint64_t generation = 0;                                           //每次invalidate递增
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+    };
+
+    shard& shardFor(const Key& key) {
+        // 再混合一次，避免整数key的std::hash是恒等映射时分片不均
+        std::uint64_t h = static_cast<std::uint64_t>(Hash()(key)) * 0x9E3779B97F4A7C15ULL;
+
+        return _shards[(h >> 32) % _shards.size()];
+    }
+
+    std::vector<shard> _shards;
+};
+
+#endif
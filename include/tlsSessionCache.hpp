@@ -0,0 +1,91 @@
+/**
+ * @file tlsSessionCache.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief tlsSessionCache类定义：服务端会话缓存与轮换的会话票据密钥
+ * @version 1.0
+ * @date 2024-11-08
+ * 
+ * @copyright Copyright (c) 2024 antaresz
+ * 
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-08 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#ifndef _TLSSESSIONCACHE_HPP
+#define _TLSSESSIONCACHE_HPP
+
+#include <boost/asio/ssl.hpp>
+#include <openssl/evp.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+/**
+ * @brief 为ssl::context配置会话复用
+ * 
+ * 有状态的会话缓存用于TLS 1.2的session id复用；无状态会话票据使用内存中的密钥，
+ * 密钥按固定周期轮换，旧密钥保留到其签发的票据全部过期为止。
+ */
+class tlsSessionCache {
+public:
+    /**
+     * @brief Construct a new tlsSessionCache object
+     * 
+     * @param cache_size 有状态会话缓存容量
+     * @param session_timeout 会话/票据有效期
+     * @param rotation_interval 票据密钥轮换周期
+     */
+    tlsSessionCache(std::size_t cache_size, std::chrono::seconds session_timeout, std::chrono::seconds rotation_interval);
+
+    tlsSessionCache(const tlsSessionCache&) = delete;
+    tlsSessionCache& operator=(const tlsSessionCache&) = delete;
+
+    /**
+     * @brief 在context上启用会话缓存、票据回调，并关闭0-RTT
+     * 
+     * @param ctx 
+     */
+    void configure(boost::asio::ssl::context& ctx);
+    /**
+     * @brief 握手完成后调用，统计复用/完整握手次数
+     * 
+     * @param ssl 
+     */
+    void recordHandshake(SSL* ssl);
+
+    std::uint64_t resumedHandshakes() const { return _resumed.load(std::memory_order_relaxed); }
+    std::uint64_t fullHandshakes() const { return _full.load(std::memory_order_relaxed); }
+
+private:
+    struct ticketKey {
+        unsigned char name[16];                                 //票据中携带的密钥名
+        unsigned char aes_key[32];                              //AES-256-CBC加密密钥
+        unsigned char hmac_key[32];                             //HMAC-SHA256密钥
+        std::chrono::steady_clock::time_point created;          //生成时间
+    };
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static int ticketKeyCallback(SSL* ssl, unsigned char* key_name, unsigned char* iv, EVP_CIPHER_CTX* cipher_ctx, EVP_MAC_CTX* mac_ctx, int enc);
+#else
+    static int ticketKeyCallback(SSL* ssl, unsigned char* key_name, unsigned char* iv, EVP_CIPHER_CTX* cipher_ctx, HMAC_CTX* mac_ctx, int enc);
+#endif
+    /**
+     * @brief 需要时轮换密钥并淘汰过期密钥，调用方持有_mtx
+     * 
+     */
+    void rotateLocked();
+
+    std::size_t _cache_size;                                    //会话缓存容量
+    std::chrono::seconds _session_timeout;                      //会话有效期
+    std::chrono::seconds _rotation_interval;                    //密钥轮换周期
+    std::mutex _mtx;                                            //保护_keys
+    std::deque<ticketKey> _keys;                                //front为当前用于加密的密钥
+    std::atomic<std::uint64_t> _resumed;                        //复用握手次数
+    std::atomic<std::uint64_t> _full;                           //完整握手次数
+};
+
+#endif
@@ -0,0 +1,112 @@
+/**
+ * @file tokenSigner.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief tokenSigner类定义：HMAC签名的无状态会话令牌
+ * @version 1.1
+ * @date 2024-11-18
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-18 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>保留的密钥数由有效期与轮换周期推出
+ * </table>
+ */
+#ifndef _TOKENSIGNER_HPP
+#define _TOKENSIGNER_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief 令牌中携带的信息
+ *
+ */
+struct tokenClaims {
+    std::uint32_t key_id = 0;           //签名密钥编号
+    std::int64_t user_id = 0;           //用户id
+    std::int64_t expires = 0;           //过期时间(unix秒)
+    std::uint64_t token_id = 0;         //随机编号，用于吊销
+};
+
+/**
+ * @brief 签发与校验会话令牌
+ *
+ * 令牌格式为"key_id.user_id.expires.token_id.signature"，signature是前四段的
+ * HMAC-SHA256(base64url)。校验只在内存中完成：查找密钥、比较签名、检查过期和吊销。
+ *
+ * 签名密钥按rotation_interval轮换，旧密钥保留到用它签发的令牌全部过期。
+ * 吊销记录在两代布隆过滤器中，每过一个有效期淘汰较旧的一代；误判只会让
+ * 少量未吊销的令牌需要重新登录。
+ */
+class tokenSigner {
+public:
+    /**
+     * @brief Construct a new token Signer object
+     *
+     * @param ttl 令牌有效期
+     * @param rotation_interval 签名密钥轮换周期
+     * @throw std::invalid_argument ttl或rotation_interval不为正
+     */
+    explicit tokenSigner(std::chrono::seconds ttl = std::chrono::hours(24), std::chrono::seconds rotation_interval = std::chrono::hours(6));
+
+    /**
+     * @brief 为用户签发令牌
+     *
+     * @param user_id
+     * @return std::string
+     */
+    std::string issue(std::int64_t user_id);
+    /**
+     * @brief 校验令牌
+     *
+     * @param token
+     * @param claims 校验通过时填入
+     * @return true 签名正确、未过期且未被吊销
+     */
+    bool verify(std::string_view token, tokenClaims& claims) const;
+    /**
+     * @brief 吊销令牌(登出)，直到它自然过期
+     *
+     * @param claims verify得到的信息
+     */
+    void revoke(const tokenClaims& claims);
+
+private:
+    static constexpr std::size_t KEY_BYTES = 32;
+    static constexpr std::size_t BLOOM_WORDS = 1 << 14;        //每代2^20位
+    static constexpr int BLOOM_HASHES = 4;
+
+    struct signingKey {
+        std::uint32_t id;
+        std::array<unsigned char, KEY_BYTES> secret;
+        std::chrono::system_clock::time_point created;
+    };
+
+    void rotateLocked(std::chrono::system_clock::time_point now);
+    void ageFilterLocked(std::chrono::system_clock::time_point now);
+    const signingKey* findKeyLocked(std::uint32_t id) const;
+    static std::string sign(const signingKey& key, std::string_view payload);
+    static bool bloomContains(const std::vector<std::uint64_t>& filter, std::uint64_t token_id);
+    static void bloomInsert(std::vector<std::uint64_t>& filter, std::uint64_t token_id);
+
+    std::chrono::seconds _ttl;
+    std::chrono::seconds _rotation_interval;
+    std::size_t _max_keys;                                      //ceil(ttl/rotation)+1，未过期令牌的密钥都能保留
+    mutable std::shared_mutex _mtx;
+    std::deque<signingKey> _keys;                               //back为当前签名密钥
+    std::uint32_t _next_key_id;
+    std::vector<std::uint64_t> _revoked;                        //当代吊销过滤器
+    std::vector<std::uint64_t> _revoked_previous;               //上一代吊销过滤器
+    std::chrono::system_clock::time_point _revoked_since;       //当代过滤器的起始时间
+};
+
+#endif
@@ -2,35 +2,106 @@
  * @file userHandler.hpp
  * @author antaresz (antaresz1026@gmail.com)
  * @brief 注册/登录api
- * @version 1.0
+ * @version 1.5
  * @date 2024-10-11
- * 
+ *
  * @copyright Copyright (c) 2024 antaresz
- * 
+ *
  * @par 修改日志:
  * <table>
  * <tr><th>Date       <th>Version <th>Author <th>Description
  * <tr><td>2024-10-11 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-19 <td>1.1     <td>antaresz    <td>可配置KDF，哈希在独立线程池中异步计算，登录时透明升级
+ * <tr><td>2024-11-22 <td>1.2     <td>antaresz    <td>通过dataStore访问用户数据，不再依赖MySQL
+ * <tr><td>2024-11-23 <td>1.3     <td>antaresz    <td>注册可走批量写入
+ * <tr><td>2024-11-29 <td>1.4     <td>antaresz    <td>存储支持异步接口时数据库操作不经过db线程池
+ * <tr><td>2024-12-01 <td>1.5     <td>antaresz    <td>用户不存在时也计算一次哈希，登录耗时不暴露用户名是否存在
  * </table>
  */
 #ifndef _USERHANDLER_HPP
 #define _USERHANDLER_HPP
 
-#include "SQLConnection.hpp"
+#include "dataStore.hpp"
+#include "passwordHasher.hpp"
+#include "workerPool.hpp"
+#include "writeBatcher.hpp"
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
 
+/**
+ * @brief 注册/登录结果
+ *
+ */
+enum class authStatus {
+    ok,                         //成功
+    failed,                     //用户名或密码错误/注册失败
+    busy                        //线程池队列已满，应返回503
+};
+
+/**
+ * @brief 注册与登录
+ *
+ * 数据库操作投递到db线程池，密码哈希投递到hash线程池，两者都不在io线程上执行；
+ * 回调在最后完成工作的线程池线程中调用。存储提供asyncDataStore时，数据库操作改由它直接发起，
+ * 回调也可能在存储的线程上调用。
+ */
 class userHandler {
 public:
-    userHandler(SQLConnection& connectionPool);
-    bool registerUser(const std::string& username, const std::string& password, const std::string& usertype, const std::string& idtype, const std::string& idnumber, const std::string& phone);
-    bool loginUser(const std::string& username, const std::string& password);
+    using registerCallback = std::function<void(authStatus)>;
+    using loginCallback = std::function<void(authStatus, std::int64_t user_id)>;
+
+    userHandler(dataStore& store, workerPool& db_pool, workerPool& hash_pool, const kdfParams& params = kdfParams());
+    /**
+     * @brief 开启批量写入，注册时的插入与其他注册合并为一次提交，须在服务启动前调用
+     *
+     * @param options
+     */
+    void enableBatching(const batchOptions& options);
+    /**
+     * @brief 每批插入的用户数，未开启批量写入时为nullptr
+     *
+     * @return const histogram*
+     */
+    const histogram* userBatchSizes() const { return _user_writer ? &_user_writer->batchSizes() : nullptr; }
+    /**
+     * @brief 注册：hash线程池中计算哈希，再到db线程池或批量写入线程中插入
+     *
+     * @param registration
+     * @param done
+     */
+    void registerUser(userRegistration registration, registerCallback done);
+    /**
+     * @brief 登录：db线程池中(或异步)读取哈希，hash线程池中校验
+     *
+     * 存储的哈希是旧版或参数与当前配置不同时，校验通过后重新计算并在后台写回。
+     * 用户不存在时同样在hash线程池中校验一个固定的哈希，排队、503与耗时都与密码错误相同。
+     *
+     * @param username
+     * @param password
+     * @param done 成功时带上用户id
+     */
+    void loginUser(std::string username, std::string password, loginCallback done);
 
 private:
-    SQLConnection& _connection_pool;
-    std::string encryptPassword(const std::string& password, const std::string& salt);
-    
-    std::string generateSalt();  // 生成盐值
-    const size_t SALT_LENGTH = 16;  // 盐的长度
+    /**
+     * @brief 在hash线程池中校验读到的哈希
+     *
+     * @param found
+     * @param password
+     * @param done
+     */
+    void verifyLogin(std::shared_ptr<userCredentials> found, std::string password, loginCallback done);
+    void upgradeHash(std::int64_t user_id, std::string password);
+
+    dataStore& _store;
+    asyncDataStore* _async;                                 //存储不支持异步接口时为nullptr
+    workerPool& _db_pool;
+    workerPool& _hash_pool;
+    passwordHasher _hasher;
+    std::shared_ptr<userCredentials> _unknown_user;         //用户不存在时参与校验的哈希，构造时按当前参数计算
+    std::unique_ptr<writeBatcher<newUser>> _user_writer;    //未开启批量写入时为空
 };
 
 #endif // USERHANDLER_HPP
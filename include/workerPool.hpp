@@ -0,0 +1,93 @@
+/**
+ * @file workerPool.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief workerPool类定义，用于把阻塞任务移出io线程
+ * @version 1.2
+ * @date 2024-11-28
+ * 
+ * @copyright Copyright (c) 2024 antaresz
+ * 
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-04 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-28 <td>1.1     <td>antaresz    <td>报告任务的排队延迟
+ * <tr><td>2024-12-01 <td>1.2     <td>antaresz    <td>oldestWait返回队首任务已等待的时间
+ * </table>
+ */
+#ifndef _WORKERPOOL_HPP
+#define _WORKERPOOL_HPP
+
+#include <boost/asio/thread_pool.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief 固定线程数、队列深度有上限的线程池
+ * 
+ */
+class workerPool {
+public:
+    /**
+     * @brief Construct a new workerPool object
+     * 
+     * @param name 线程池名称，仅用于日志
+     * @param threads 线程数
+     * @param max_pending 排队+执行中任务数上限，超过时post返回false
+     */
+    workerPool(const std::string& name, std::size_t threads, std::size_t max_pending);
+    ~workerPool();
+
+    workerPool(const workerPool&) = delete;
+    workerPool& operator=(const workerPool&) = delete;
+
+    /**
+     * @brief 投递任务
+     * 
+     * @param task 
+     * @return true 已入队
+     * @return false 队列已满，任务被拒绝
+     */
+    bool post(std::function<void()> task);
+    /**
+     * @brief 设置排队延迟的观察者，每个任务开始执行时以其排队时长调用，在工作线程上执行
+     * 
+     * 须在投递第一个任务之前设置。
+     * 
+     * @param observer 
+     */
+    void setDelayObserver(std::function<void(std::chrono::steady_clock::duration)> observer) { _delay_observer = std::move(observer); }
+    /**
+     * @brief 阻塞等待所有任务完成并停止线程
+     * 
+     */
+    void join();
+
+    std::size_t threads() const { return _threads; }
+    std::size_t pending() const { return _pending.load(std::memory_order_relaxed); }
+    /**
+     * @brief 最早入队、尚未开始的任务已等待的时间，队列为空时为0
+     *
+     * 工作线程全被长任务占住时不再有任务开始，排队延迟的观察者也就收不到报告，须由此查询。
+     *
+     * @return std::chrono::steady_clock::duration
+     */
+    std::chrono::steady_clock::duration oldestWait() const;
+
+private:
+    std::string _name;                          //线程池名称
+    std::size_t _threads;                       //线程数
+    std::size_t _max_pending;                   //队列深度上限
+    std::atomic<std::size_t> _pending;          //排队+执行中任务数
+    std::function<void(std::chrono::steady_clock::duration)> _delay_observer;     //排队延迟观察者，可为空
+    mutable std::mutex _queued_mtx;             //保护_queued
+    std::deque<std::chrono::steady_clock::time_point> _queued;     //尚未开始的任务的入队时间，按入队顺序
+    boost::asio::thread_pool _pool;             //底层线程池
+};
+
+#endif
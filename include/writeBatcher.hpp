@@ -0,0 +1,174 @@
+/**
+ * @file writeBatcher.hpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief writeBatcher类定义：把并发的插入合并为一次提交
+ * @version 1.0
+ * @date 2024-11-23
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-23 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#ifndef _WRITEBATCHER_HPP
+#define _WRITEBATCHER_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "logger.hpp"
+#include "metrics.hpp"
+
+/**
+ * @brief 批量写入参数
+ *
+ */
+struct batchOptions {
+    std::size_t max_rows = 64;                                      //一批最多的行数，攒满立即提交
+    std::chrono::microseconds max_delay = std::chrono::milliseconds(2);    //第一行入队后最多等待的时间
+    std::size_t max_pending = 4096;                                 //排队行数上限，超过时submit返回false
+};
+
+/**
+ * @brief 组提交
+ *
+ * submit只把行放进队列，由专门的线程在攒满max_rows或最早一行等待满max_delay时
+ * 取出一批交给flush，flush返回后在该线程上逐个调用各行的回调。
+ * 提交耗时期间新到的行继续排队，下一批自然更大，提交次数随负载增长而非随请求数增长。
+ *
+ * flush须为每一行给出结果，部分行失败时由flush自行决定如何隔离。
+ *
+ * @tparam Row
+ */
+template <typename Row>
+class writeBatcher {
+public:
+    using callback = std::function<void(bool)>;
+    using flushFunction = std::function<void(const std::vector<Row>& rows, std::vector<bool>& succeeded)>;
+
+    writeBatcher(const std::string& name, flushFunction flush, const batchOptions& options = batchOptions())
+        : _name(name), _flush(std::move(flush)), _options(options) {
+        if (_options.max_rows == 0) {
+            _options.max_rows = 1;
+        }
+        _thread = std::thread([this]() { run(); });
+    }
+    /**
+     * @brief 提交剩余的行后退出
+     *
+     */
+    ~writeBatcher() {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            _stopping = true;
+        }
+        _cv.notify_one();
+        _thread.join();
+    }
+
+    writeBatcher(const writeBatcher&) = delete;
+    writeBatcher& operator=(const writeBatcher&) = delete;
+
+    /**
+     * @brief 入队，所在批次提交后调用done
+     *
+     * @param row
+     * @param done
+     * @return true 已入队
+     * @return false 队列已满或正在停止，done不会被调用
+     */
+    bool submit(Row row, callback done) {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+
+            if (_stopping || _queue.size() >= _options.max_pending) {
+                LOG_WARNING("Write batcher '" + _name + "' is saturated, rejecting row.");
+                return false;
+            }
+            _queue.push_back(pending{std::move(row), std::move(done), std::chrono::steady_clock::now()});
+            // 只有从空变为非空、或刚好攒满时才需要唤醒提交线程
+            if (_queue.size() != 1 && _queue.size() != _options.max_rows) {
+                return true;
+            }
+        }
+        _cv.notify_one();
+        return true;
+    }
+    /**
+     * @brief 每批行数的分布
+     *
+     * @return const histogram&
+     */
+    const histogram& batchSizes() const { return _batch_sizes; }
+
+private:
+    struct pending {
+        Row row;
+        callback done;
+        std::chrono::steady_clock::time_point queued_at;
+    };
+
+    void run() {
+        std::vector<Row> rows;
+        std::vector<callback> callbacks;
+        std::vector<bool> succeeded;
+        std::unique_lock<std::mutex> lock(_mtx);
+
+        for (;;) {
+            _cv.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+            if (_queue.empty()) {
+                return;
+            }
+            _cv.wait_until(lock, _queue.front().queued_at + _options.max_delay,
+                [this]() { return _stopping || _queue.size() >= _options.max_rows; });
+
+            std::size_t count = std::min(_queue.size(), _options.max_rows);
+
+            rows.clear();
+            callbacks.clear();
+            for (std::size_t i = 0; i < count; ++i) {
+                rows.push_back(std::move(_queue.front().row));
+                callbacks.push_back(std::move(_queue.front().done));
+                _queue.pop_front();
+            }
+            lock.unlock();
+
+            succeeded.assign(rows.size(), false);
+            try {
+                _flush(rows, succeeded);
+            } catch (const std::exception& e) {
+                LOG_ERROR("Uncaught exception in write batcher '" + _name + "': " + e.what());
+                succeeded.assign(rows.size(), false);
+            }
+            _batch_sizes.record(rows.size());
+            for (std::size_t i = 0; i < callbacks.size(); ++i) {
+                callbacks[i](succeeded[i]);
+            }
+            lock.lock();
+        }
+    }
+
+    std::string _name;                  //名称，仅用于日志
+    flushFunction _flush;
+    batchOptions _options;
+    std::deque<pending> _queue;         //待提交的行，受_mtx保护
+    bool _stopping = false;
+    std::mutex _mtx;
+    std::condition_variable _cv;
+    histogram _batch_sizes;
+    std::thread _thread;                //在构造函数体中启动，此时其余成员已构造完成
+};
+
+#endif
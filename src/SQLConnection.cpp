@@ -2,98 +2,331 @@
  * @file SQLConnection.cpp
  * @author antaresz (antaresz1026@gmail.com)
  * @brief SQLConnection类实现
- * @version 1.0
+ * @version 1.3
  * @date 2024-10-11
- * 
+ *
  * @copyright Copyright (c) 2024 antaresz
- * 
+ *
  * @par 修改日志:
  * <table>
  * <tr><th>Date       <th>Version <th>Author <th>Description
  * <tr><td>2024-10-11 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-14 <td>1.1     <td>antaresz    <td>RAII租约、弹性伸缩、获取超时、后台重连与空闲探活
+ * <tr><td>2024-11-15 <td>1.2     <td>antaresz    <td>每个连接缓存预编译语句
+ * <tr><td>2024-11-21 <td>1.3     <td>antaresz    <td>获取连接等待时间直方图
  * </table>
  */
-#include <mysql_driver.h>           
-#include <mysql_connection.h> 
-#include <boost/log/trivial.hpp>
+#include <mysql_driver.h>
+#include <mysql_connection.h>
 #include <cppconn/driver.h>
 #include <cppconn/exception.h>
 #include <cppconn/resultset.h>
 #include <cppconn/statement.h>
 #include <cppconn/prepared_statement.h>
+#include <algorithm>
+#include <vector>
 #include "SQLConnection.hpp"
 #include "logger.hpp"
+
+SQLConnection::lease::lease(SQLConnection* pool, std::unique_ptr<pooledConnection> conn)
+    : _pool(pool), _conn(std::move(conn)) {}
+
+SQLConnection::lease::lease(lease&& other) noexcept
+    : _pool(other._pool), _conn(std::move(other._conn)), _broken(other._broken) {
+    other._pool = nullptr;
+}
+
+SQLConnection::lease& SQLConnection::lease::operator=(lease&& other) noexcept {
+    if (this != &other) {
+        release();
+        _pool = other._pool;
+        _conn = std::move(other._conn);
+        _broken = other._broken;
+        other._pool = nullptr;
+    }
+    return *this;
+}
+
+SQLConnection::lease::~lease() {
+    release();
+}
+
+sql::Connection* SQLConnection::lease::operator->() const {
+    return _conn->conn.get();
+}
+
+sql::Connection& SQLConnection::lease::operator*() const {
+    return *_conn->conn;
+}
+
+sql::PreparedStatement* SQLConnection::lease::prepare(const std::string& sql) {
+    auto& statements = _conn->statements;
+    auto it = statements.find(sql);
+
+    if (it == statements.end()) {
+        // SQL文本都是代码中的常量，超出上限说明有拼接的SQL，整体丢弃即可
+        if (statements.size() >= _pool->_options.max_cached_statements) {
+            statements.clear();
+        }
+        std::unique_ptr<sql::PreparedStatement> stmt(_conn->conn->prepareStatement(sql));
+
+        it = statements.emplace(sql, std::move(stmt)).first;
+    } else {
+        it->second->clearParameters();
+    }
+    return it->second.get();
+}
+
+void SQLConnection::lease::invalidate() {
+    _broken = true;
+}
+
+void SQLConnection::lease::release() {
+    if (_pool && _conn) {
+        _pool->releaseConnection(std::move(_conn), _broken);
+    }
+    _pool = nullptr;
+}
+
 /**
  * @brief Construct a new SQLConnection::SQLConnection object
- * 
- * @param host 
- * @param user 
- * @param password 
- * @param database 
+ *
+ * 先同步建立min_size个连接，之后由维护线程负责补足与探活。
+ *
+ * @param host
+ * @param user
+ * @param password
+ * @param database
+ * @param options
  */
-SQLConnection::SQLConnection(const std::string& host, const std::string& user, const std::string& password, const std::string& database)
-    : _host(host), _user(user), _password(password), _database(database) {
+SQLConnection::SQLConnection(const std::string& host, const std::string& user, const std::string& password, const std::string& database, const poolOptions& options)
+    : _host(host), _user(user), _password(password), _database(database), _options(options) {
+    if (_options.max_size == 0) {
+        _options.max_size = 1;
+    }
+    if (_options.min_size > _options.max_size) {
+        _options.min_size = _options.max_size;
+    }
     _driver = sql::mysql::get_mysql_driver_instance();
-    createConnection();
+
+    for (std::size_t i = 0; i < _options.min_size; ++i) {
+        try {
+            _idle.push_back(createConnection());
+            ++_total;
+        } catch (sql::SQLException& e) {
+            std::string error = e.what();
+            std::string msg = "Could not connect to database. Error: " + error;
+
+            LOG_ERROR(msg);
+        }
+    }
+    _maintainer = std::thread([this]() { maintain(); });
 }
 /**
  * @brief Destroy the SQLConnection::SQLConnection object
- * 
+ *
+ * 所有lease必须已经归还。
  */
 SQLConnection::~SQLConnection() {
-    std::lock_guard<std::mutex> lock(_mtx);
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
 
-    while (!_connections.empty()) {
-        auto conn = _connections.front();
-        _connections.pop();  // 释放所有连接
+        _stopping = true;
+    }
+    _maintain_cv.notify_all();
+    _cv.notify_all();
+    if (_maintainer.joinable()) {
+        _maintainer.join();
     }
+
+    std::lock_guard<std::mutex> lock(_mtx);
+
+    _idle.clear();  // 释放所有连接
 }
 /**
- * @brief 对信号量上锁，空闲时从连接池中取出一个连接
- * 
- * @return std::shared_ptr<sql::Connection> 
+ * @brief 从连接池中借出一个连接
+ *
+ * 优先复用最近归还的空闲连接；没有空闲连接且未达上限时在锁外新建连接；
+ * 否则在条件变量上等待，直到有连接归还或超时。
+ *
+ * @return SQLConnection::lease
  */
-std::shared_ptr<sql::Connection> SQLConnection::getConnection() {
+SQLConnection::lease SQLConnection::getConnection() {
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + _options.acquire_timeout;
     std::unique_lock<std::mutex> lock(_mtx);
 
-    while (_connections.empty()) {
-        _cv.wait(lock);  // 等待直到有空闲连接
+    ++_stats.waiting;
+    while (!_stopping) {
+        std::unique_ptr<pooledConnection> conn;
+
+        if (!_idle.empty()) {
+            conn = std::move(_idle.back());
+            _idle.pop_back();
+        } else if (_total < _options.max_size) {
+            // 先占用名额再解锁建连，避免多个线程同时超出上限
+            ++_total;
+            lock.unlock();
+            try {
+                conn = createConnection();
+                lock.lock();
+            } catch (sql::SQLException& e) {
+                lock.lock();
+                --_total;
+                _cv.notify_one();
+                LOG_ERROR("Could not grow connection pool: " + std::string(e.what()));
+            }
+        }
+
+        if (conn) {
+            auto waited = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+            --_stats.waiting;
+            ++_stats.acquired;
+            _stats.wait_ns_total += waited;
+            _stats.wait_ns_max = std::max(_stats.wait_ns_max, waited);
+            _wait_time.record(waited / 1000);
+            return lease(this, std::move(conn));
+        }
+        if (_cv.wait_until(lock, deadline) == std::cv_status::timeout && _idle.empty()) {
+            break;
+        }
     }
-    auto conn = _connections.front();
-    _connections.pop();
 
-    return conn;
+    --_stats.waiting;
+    ++_stats.timeouts;
+    _wait_time.record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()));
+    LOG_WARNING("Timed out waiting for a database connection.");
+    throw sql::SQLException("Timed out waiting for a database connection");
 }
-/// @brief 释放连接，将其放回连接池
+/**
+ * @brief 归还连接，已损坏或已关闭的连接直接丢弃并通知维护线程补充
+ *
+ * 这里不调用isValid()，它会产生一次到服务器的往返；空闲连接由维护线程定期探活。
+ *
+ * @param conn
+ * @param broken
+ */
+void SQLConnection::releaseConnection(std::unique_ptr<pooledConnection> conn, bool broken) {
+    if (broken || conn->conn->isClosed()) {
+        LOG_WARNING("Invalid connection detected. Dropping it.");
+        conn.reset();
 
-/// @param conn 
-void SQLConnection::releaseConnection(std::shared_ptr<sql::Connection> conn) {
-    std::lock_guard<std::mutex> lock(_mtx);
+        std::lock_guard<std::mutex> lock(_mtx);
 
-    if (conn && conn->isValid()) {  // 确保连接有效
-        _connections.push(conn);
+        --_total;
         _cv.notify_one();
-    } else {
-        logger::getInstance().log("warning", "Invalid connection detected. Dropping it.");
+        _maintain_cv.notify_one();
+        return;
     }
+
+    conn->idle_since = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(_mtx);
+
+    _idle.push_back(std::move(conn));
+    _cv.notify_one();
+}
+
+poolStats SQLConnection::stats() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    poolStats stats = _stats;
+
+    stats.size = _total;
+    stats.idle = _idle.size();
+    stats.in_use = _total - _idle.size();
+    return stats;
+}
+
+/**
+ * @brief 新建一个连接
+ *
+ * @return std::unique_ptr<SQLConnection::pooledConnection>
+ */
+std::unique_ptr<SQLConnection::pooledConnection> SQLConnection::createConnection() {
+    auto conn = std::make_unique<pooledConnection>();
+
+    conn->conn.reset(_driver->connect(_host, _user, _password));
+    conn->conn->setSchema(_database);
+    conn->idle_since = conn->checked_at = std::chrono::steady_clock::now();
+    return conn;
 }
+
 /**
- * @brief 连接池创建
- * 
+ * @brief 维护线程主循环
+ *
+ * 网络操作(ping、重连、建连)都在锁外进行，期间被取出的连接计入_total但不在_idle中，
+ * 与借出状态相同，不会被其他线程拿到。
  */
+void SQLConnection::maintain() {
+    std::unique_lock<std::mutex> lock(_mtx);
 
-void SQLConnection::createConnection() {
-    for (int i = 0; i < 10; ++i) {  // 创建10个初始连接
-        try {
-            std::shared_ptr<sql::Connection> conn(_driver->connect(_host, _user, _password));
+    while (!_stopping) {
+        _maintain_cv.wait_for(lock, _options.maintenance_interval);
+        if (_stopping) {
+            break;
+        }
 
-            conn->setSchema(_database);
-            _connections.push(conn);  // 将新连接放入连接池中
-        } catch (sql::SQLException& e) {
-            std::string error = e.what();
-            std::string msg = "Could not connect to database. Error: " + error;
+        auto now = std::chrono::steady_clock::now();
+        std::vector<std::unique_ptr<pooledConnection>> to_check;
+        std::size_t closed = 0;
+
+        // 头部是最久未用的连接：多余的关闭，空闲太久的取出探活
+        for (auto it = _idle.begin(); it != _idle.end();) {
+            if (_total - closed > _options.min_size && now - (*it)->idle_since > _options.idle_timeout) {
+                it = _idle.erase(it);
+                ++closed;
+            } else if (now - (*it)->checked_at > _options.ping_interval) {
+                to_check.push_back(std::move(*it));
+                it = _idle.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        _total -= closed;
+
+        std::size_t missing = _total < _options.min_size ? _options.min_size - _total : 0;
+
+        _total += missing;
+        lock.unlock();
+
+        std::vector<std::unique_ptr<pooledConnection>> ready;
+        std::size_t dropped = 0;
+        std::uint64_t reconnects = 0;
+
+        for (auto& conn : to_check) {
+            try {
+                if (!conn->conn->isValid()) {
+                    // 预编译语句绑定在服务端会话上，重连后全部失效
+                    conn->statements.clear();
+                    if (!conn->conn->reconnect()) {
+                        throw sql::SQLException("reconnect failed");
+                    }
+                    ++reconnects;
+                }
+                conn->checked_at = std::chrono::steady_clock::now();
+                ready.push_back(std::move(conn));
+            } catch (sql::SQLException& e) {
+                LOG_WARNING("Dropping dead pooled connection: " + std::string(e.what()));
+                ++dropped;
+            }
+        }
+        for (std::size_t i = 0; i < missing; ++i) {
+            try {
+                ready.push_back(createConnection());
+                ++reconnects;
+            } catch (sql::SQLException& e) {
+                LOG_ERROR("Could not reconnect to database. Error: " + std::string(e.what()));
+                ++dropped;
+            }
+        }
 
-            logger::getInstance().log("error", msg);
+        lock.lock();
+        _total -= dropped;
+        _stats.reconnects += reconnects;
+        for (auto& conn : ready) {
+            _idle.push_front(std::move(conn));
+            _cv.notify_one();
         }
     }
 }
@@ -0,0 +1,227 @@
+/**
+ * @file admissionControl.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief admissionControl类实现
+ * @version 1.1
+ * @date 2024-11-28
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-28 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>报告中断时以队首任务已等待的时间判定
+ * </table>
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include "admissionControl.hpp"
+
+namespace {
+std::int64_t nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::size_t verdictIndex(admissionVerdict verdict) {
+    return static_cast<std::size_t>(verdict) - 1;
+}
+}
+
+admissionControl::admissionControl(const admissionOptions& options)
+    : _options(options),
+      _target(std::chrono::duration_cast<std::chrono::nanoseconds>(options.queue_target).count()),
+      _interval(std::max<std::int64_t>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(options.queue_interval).count())) {}
+
+clientKey admissionControl::keyOf(const boost::asio::ip::address& address) {
+    if (address.is_v4()) {
+        return boost::asio::ip::make_address_v6(boost::asio::ip::v4_mapped, address.to_v4()).to_bytes();
+    }
+    return address.to_v6().to_bytes();
+}
+
+std::size_t admissionControl::clientHash::operator()(const clientKey& key) const {
+    std::uint64_t high;
+    std::uint64_t low;
+
+    std::memcpy(&high, key.data(), sizeof(high));
+    std::memcpy(&low, key.data() + sizeof(high), sizeof(low));
+    // IPv4映射地址的高64位都相同，区分度全在低位
+    return static_cast<std::size_t>((low ^ (high * 0x9e3779b97f4a7c15ULL)) * 0xbf58476d1ce4e5b9ULL >> 7);
+}
+
+/**
+ * @brief 先做不消耗令牌的判定，令牌只在其余条件都满足时扣除
+ */
+admissionVerdict admissionControl::admitConnection(const clientKey& client, std::size_t connections) {
+    std::int64_t now = nowNanoseconds();
+    admissionVerdict verdict = admissionVerdict::admitted;
+
+    if (_options.max_connections > 0 && connections >= _options.max_connections) {
+        verdict = admissionVerdict::connections;
+    } else if (_dropping.load(std::memory_order_relaxed) && overloaded(now)) {
+        verdict = admissionVerdict::queueDelay;
+    } else if (_options.client_rate > 0 && !takeToken(client, now)) {
+        verdict = admissionVerdict::clientRate;
+    }
+    if (verdict != admissionVerdict::admitted) {
+        _rejected_connections[verdictIndex(verdict)].add();
+    }
+    return verdict;
+}
+
+admissionVerdict admissionControl::admitRequest(const clientKey& client) {
+    std::int64_t now = nowNanoseconds();
+    admissionVerdict verdict = admissionVerdict::admitted;
+
+    if (_options.client_rate > 0 && !takeToken(client, now)) {
+        verdict = admissionVerdict::clientRate;
+    } else {
+        std::int64_t inflight = _inflight.fetch_add(1, std::memory_order_relaxed);
+
+        if (_options.max_inflight > 0 && static_cast<std::size_t>(inflight) >= _options.max_inflight) {
+            verdict = admissionVerdict::concurrency;
+        } else if (_target > 0 && shedForDelay(now)) {
+            verdict = admissionVerdict::queueDelay;
+        }
+        if (verdict != admissionVerdict::admitted) {
+            _inflight.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+    if (verdict != admissionVerdict::admitted) {
+        _rejected_requests[verdictIndex(verdict)].add();
+    }
+    return verdict;
+}
+
+/**
+ * @brief 令牌按距上次补充的时间连续补充，不需要定时器
+ */
+bool admissionControl::takeToken(const clientKey& client, std::int64_t now) {
+    shard& s = _shards[clientHash()(client) % SHARDS];
+    std::lock_guard<std::mutex> lock(s.mtx);
+    auto it = s.clients.find(client);
+
+    if (it == s.clients.end()) {
+        if (s.clients.size() >= MAX_SHARD_CLIENTS) {
+            // 已回满的桶与没有记录等价，可以丢弃
+            double full_after = _options.client_burst / _options.client_rate * 1e9;
+
+            for (auto old = s.clients.begin(); old != s.clients.end();) {
+                old = static_cast<double>(now - old->second.refilled_at) >= full_after ? s.clients.erase(old) : std::next(old);
+            }
+            if (s.clients.size() >= MAX_SHARD_CLIENTS) {
+                return true;
+            }
+        }
+        s.clients.emplace(client, bucket{_options.client_burst - 1, now});
+        return true;
+    }
+
+    bucket& b = it->second;
+
+    b.tokens = std::min(_options.client_burst, b.tokens + static_cast<double>(now - b.refilled_at) * 1e-9 * _options.client_rate);
+    b.refilled_at = now;
+    if (b.tokens < 1) {
+        return false;
+    }
+    b.tokens -= 1;
+    return true;
+}
+
+/**
+ * @brief 查询结果也记作一次报告，每个interval最多查询一次
+ */
+bool admissionControl::overloaded(std::int64_t now) {
+    if (now - _last_report.load(std::memory_order_relaxed) <= _interval) {
+        return _above.load(std::memory_order_relaxed);
+    }
+    if (!_queue_age) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_codel_mtx);
+
+    // 等锁期间可能已有其他线程查询或收到报告
+    if (now - _last_report.load(std::memory_order_relaxed) > _interval) {
+        observeDelay(std::chrono::duration_cast<std::chrono::nanoseconds>(_queue_age()).count(), now);
+    }
+    return _above.load(std::memory_order_relaxed);
+}
+
+std::int64_t admissionControl::controlLaw(std::int64_t from, std::uint32_t count) const {
+    return from + static_cast<std::int64_t>(static_cast<double>(_interval) / std::sqrt(static_cast<double>(count)));
+}
+
+/**
+ * @brief RFC 8289的出队判定，这里作用在请求进入时
+ *
+ * 刚退出拒绝状态不久又进入时，从上次的拒绝频率附近继续，而不是从头开始。
+ */
+bool admissionControl::shedForDelay(std::int64_t now) {
+    if (!overloaded(now)) {
+        if (_dropping.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(_codel_mtx);
+
+            _dropping.store(false, std::memory_order_relaxed);
+        }
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_codel_mtx);
+
+    if (!_dropping.load(std::memory_order_relaxed)) {
+        std::uint32_t delta = _drop_count - _last_count;
+
+        _dropping.store(true, std::memory_order_relaxed);
+        _drop_count = (delta > 1 && now - _drop_next < 16 * _interval) ? delta : 1;
+        _last_count = _drop_count;
+        _drop_next = controlLaw(now, _drop_count);
+        return true;
+    }
+    if (now < _drop_next) {
+        return false;
+    }
+    ++_drop_count;
+    _drop_next = controlLaw(_drop_next, _drop_count);
+    return true;
+}
+
+void admissionControl::recordQueueDelay(std::chrono::steady_clock::duration delay) {
+    if (_target <= 0) {
+        return;
+    }
+
+    std::int64_t now = nowNanoseconds();
+    std::lock_guard<std::mutex> lock(_codel_mtx);
+
+    observeDelay(std::chrono::duration_cast<std::chrono::nanoseconds>(delay).count(), now);
+}
+
+void admissionControl::observeDelay(std::int64_t delay, std::int64_t now) {
+    _last_report.store(now, std::memory_order_relaxed);
+    if (delay < _target) {
+        _first_above = 0;
+        _above.store(false, std::memory_order_relaxed);
+    } else if (_first_above == 0) {
+        _first_above = now + _interval;
+    } else if (now >= _first_above) {
+        _above.store(true, std::memory_order_relaxed);
+    }
+}
+
+void admissionControl::registerMetrics(metricsRegistry& metrics) {
+    const std::string name = "hometown_admission_rejected_total";
+    const std::string help = "Connections closed before the TLS handshake and requests answered before routing by admission control";
+
+    metrics.addCounter(name, help, "stage=\"connection\",reason=\"client_rate\"", _rejected_connections[verdictIndex(admissionVerdict::clientRate)]);
+    metrics.addCounter(name, help, "stage=\"connection\",reason=\"connections\"", _rejected_connections[verdictIndex(admissionVerdict::connections)]);
+    metrics.addCounter(name, help, "stage=\"connection\",reason=\"queue_delay\"", _rejected_connections[verdictIndex(admissionVerdict::queueDelay)]);
+    metrics.addCounter(name, help, "stage=\"request\",reason=\"client_rate\"", _rejected_requests[verdictIndex(admissionVerdict::clientRate)]);
+    metrics.addCounter(name, help, "stage=\"request\",reason=\"concurrency\"", _rejected_requests[verdictIndex(admissionVerdict::concurrency)]);
+    metrics.addCounter(name, help, "stage=\"request\",reason=\"queue_delay\"", _rejected_requests[verdictIndex(admissionVerdict::queueDelay)]);
+    metrics.addGauge("hometown_http_inflight_requests", "Requests admitted and not yet answered", "",
+        [this]() { return static_cast<double>(_inflight.load(std::memory_order_relaxed)); });
+}
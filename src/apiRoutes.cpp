@@ -0,0 +1,597 @@
+/**
+ * @file apiRoutes.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief 业务路由实现，自main.cpp迁移而来
+ * @version 1.11
+ * @date 2024-11-22
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-22 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-23 <td>1.1     <td>antaresz    <td>createPost在io线程上解析，可走批量写入
+ * <tr><td>2024-11-24 <td>1.2     <td>antaresz    <td>请求JSON与响应在request.memory上分配
+ * <tr><td>2024-11-25 <td>1.3     <td>antaresz    <td>以httpResponse应答，缓存的帖子JSON不再复制
+ * <tr><td>2024-11-26 <td>1.4     <td>antaresz    <td>全文检索/search
+ * <tr><td>2024-11-27 <td>1.5     <td>antaresz    <td>按类型、作者的最新帖子列表/feeds
+ * <tr><td>2024-11-29 <td>1.6     <td>antaresz    <td>存储支持异步接口时创建帖子与读帖子不进入db线程池
+ * <tr><td>2024-11-30 <td>1.7     <td>antaresz    <td>连接由协程驱动时/posts/{id}为协程路由
+ * <tr><td>2024-12-01 <td>1.8     <td>antaresz    <td>db线程池中的handler抛出异常时以500应答
+ * <tr><td>2024-12-01 <td>1.9     <td>antaresz    <td>/posts?all=1逐页流式列出全部帖子
+ * <tr><td>2024-12-01 <td>1.10    <td>antaresz    <td>路径参数只解码%XX，'+'不再变为空格
+ * <tr><td>2024-12-01 <td>1.11    <td>antaresz    <td>协程路由/posts/{id}的db线程池任务抛出异常时仍恢复协程
+ * </table>
+ */
+#include <algorithm>
+#include <charconv>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <memory_resource>
+#include "apiRoutes.hpp"
+#include "argsParser.hpp"
+#include "awaitCallback.hpp"
+#include "logger.hpp"
+#include "requestJson.hpp"
+
+namespace {
+/**
+ * @brief 在请求的内存上构造响应，body依次拼接各段
+ * 
+ * @param memory request.memory
+ * @param status 
+ * @param body 
+ * @param content_type 为空时不带Content-Type
+ * @return httpResponse 
+ */
+httpResponse makeResponse(std::pmr::memory_resource* memory, int status, std::initializer_list<std::string_view> body,
+    std::string_view content_type = std::string_view()) {
+    httpResponse response(status, memory);
+    std::size_t size = 0;
+
+    for (std::string_view part : body) {
+        size += part.size();
+    }
+    response.reserveBody(size);
+    for (std::string_view part : body) {
+        response.appendBody(part);
+    }
+    if (!content_type.empty()) {
+        response.setContentType(content_type);
+    }
+    return response;
+}
+/**
+ * @brief JSON解析失败时的400响应
+ * 
+ * @param memory 
+ * @param e 
+ * @return httpResponse 
+ */
+httpResponse invalidJson(std::pmr::memory_resource* memory, const nlohmann::json::exception& e) {
+    return makeResponse(memory, 400, {"Invalid JSON: ", e.what()});
+}
+/**
+ * @brief 记录db线程池中任务抛出的异常
+ * 
+ * @param error 
+ */
+void logTaskFailure(std::exception_ptr error) {
+    try {
+        std::rethrow_exception(error);
+    } catch (const std::exception& e) {
+        LOG_ERROR(std::string("Route task failed: ") + e.what());
+    } catch (...) {
+        LOG_ERROR("Route task failed");
+    }
+}
+/**
+ * @brief db线程池中的任务抛出异常时的响应
+ * 
+ * 任务抛出时还没有调用done，必须由这里应答，否则连接与在途请求计数都不会结束。
+ * 
+ * @param error 
+ * @return httpResponse 
+ */
+httpResponse taskFailed(std::exception_ptr error) {
+    logTaskFailure(error);
+    return httpResponse(500);
+}
+/**
+ * @brief 把整个text解析为十进制整数
+ * 
+ * @tparam T 
+ * @param text 
+ * @param value 
+ * @return true 格式正确且没有多余字符
+ */
+template <typename T>
+bool parseNumber(std::string_view text, T& value) {
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+
+    return ec == std::errc() && ptr == text.data() + text.size();
+}
+/**
+ * @brief 取出"Authorization: Bearer <token>"中的令牌
+ * 
+ * @param request 
+ * @return std::string_view 没有时为空
+ */
+std::string_view bearerToken(const httpRequest& request) {
+    constexpr std::string_view PREFIX = "Bearer ";
+    std::string_view value = request.header("authorization");
+
+    if (value.size() <= PREFIX.size() || value.substr(0, PREFIX.size()) != PREFIX) {
+        return std::string_view();
+    }
+    return value.substr(PREFIX.size());
+}
+/**
+ * @brief 列表参数?limit=20&content=1
+ * 
+ * @param request 
+ * @param limit 
+ * @param with_content 
+ * @return true 格式正确
+ */
+bool feedArgs(const httpRequest& request, std::size_t& limit, bool& with_content) {
+    argsParser args_parser;
+    queryArgs args = args_parser.parseQuery(request.query);
+    std::string arena;
+
+    if (argsParser::needsDecoding(request.query)) {
+        arena.reserve(request.query.size());
+    }
+
+    std::string_view limit_arg = args.get("limit", arena);
+
+    limit = 20;
+    with_content = args.get("content", arena) == "1";
+    return limit_arg.empty() || parseNumber(limit_arg, limit);
+}
+/**
+ * @brief 流式列出query之后的全部帖子，body为{"posts":[...]}
+ * 
+ * 服务端每要下一块才把读一页的任务投递到db线程池，一页即一块；写网络期间不占用数据库连接，
+ * 内存只与页大小有关。查询失败或线程池已满时中止响应，客户端据缺少结束块得知列表不完整。
+ * 
+ * @param post_manager 
+ * @param db_pool 
+ * @param query limit为每页行数
+ * @return httpResponse::chunkSource 
+ */
+httpResponse::chunkSource streamPosts(postManage& post_manager, workerPool& db_pool, postQuery query) {
+    struct listing {
+        postQuery query;
+        std::string chunk;                      //当前块，在服务端要下一块之前有效
+        bool first = true;
+        bool finished = false;
+    };
+    auto state = std::make_shared<listing>();
+
+    state->query = std::move(query);
+    return [&post_manager, &db_pool, state](httpResponse::chunkSink next) {
+        if (state->finished) {
+            next(true, std::string_view());
+            return;
+        }
+
+        bool accepted = db_pool.post([&post_manager, state, next]() {
+            std::optional<postCursor> cursor;
+            bool ok = false;
+
+            state->chunk.clear();
+            if (state->first) {
+                state->chunk += "{\"posts\":[";
+            }
+            try {
+                ok = post_manager.writePostsPage(state->query, state->first, state->chunk, cursor);
+            } catch (...) {
+                logTaskFailure(std::current_exception());
+            }
+            if (!ok) {
+                next(false, std::string_view());
+                return;
+            }
+            state->first = false;
+            if (cursor) {
+                state->query.after = std::move(cursor);
+            } else {
+                state->chunk += "]}";
+                state->finished = true;
+            }
+            next(true, state->chunk);
+        });
+
+        if (!accepted) {
+            next(false, std::string_view());
+        }
+    };
+}
+}
+
+void installApiRoutes(httpsServer& server, const apiServices& services) {
+    userHandler& user_handler = services.users;
+    postManage& post_manager = services.posts;
+    tokenSigner& token_signer = services.tokens;
+    workerPool& db_pool = services.db_pool;
+
+    // 把会阻塞在存储上的handler放到db线程池中执行，handler只在池中的线程上共享一份，投递时不复制。
+    // handler调用done之后不能再抛出异常
+    auto offload = [&db_pool](httpsServer::asyncRouteHandler handler) -> httpsServer::asyncRouteHandler {
+        auto shared = std::make_shared<const httpsServer::asyncRouteHandler>(std::move(handler));
+
+        return [&db_pool, shared](const httpRequest& request, httpsServer::responder done) {
+            // request在done被调用前有效，无需拷贝
+            bool accepted = db_pool.post([shared, &request, done]() {
+                try {
+                    (*shared)(request, done);
+                } catch (...) {
+                    done(taskFailed(std::current_exception()));
+                }
+            });
+
+            if (!accepted) {
+                done(httpResponse(503));
+            }
+        };
+    };
+
+    // 令牌校验只在内存中完成，在io线程上执行
+    server.setAuthenticator([&token_signer](httpRequest& request) {
+        tokenClaims claims;
+
+        if (!token_signer.verify(bearerToken(request), claims)) {
+            return false;
+        }
+        request.user_id = claims.user_id;
+        return true;
+    });
+
+    server.setAsyncRoute("POST", "/register", [&user_handler](const httpRequest& request, httpsServer::responder done) {
+        // JSON在io线程上解析，哈希与插入由userHandler分别投递到hash/db线程池
+        std::pmr::memory_resource* memory = request.memory;
+        userRegistration registration;
+
+        try {
+            requestMemoryScope scope(memory);
+            auto json_body = requestJson::parse(request.body.begin(), request.body.end());
+            registration.username = json_body["username"];
+            registration.password = json_body["password"];
+            registration.user_type = json_body["user_type"];
+            registration.id_type = json_body["id_type"];
+            registration.id_number = json_body["id_number"];
+            registration.phone = json_body["phone"];
+        } catch (const nlohmann::json::exception& e) {
+            // 构造错误响应
+            done(invalidJson(memory, e));
+            return;
+        }
+
+        std::string username = registration.username;
+
+        user_handler.registerUser(std::move(registration), [done, memory, username](authStatus status) {
+            if (status == authStatus::ok) {
+                done(makeResponse(memory, 200, {"Welcome, ", username, "!"}));
+            } else if (status == authStatus::busy) {
+                done(httpResponse(503));
+            } else {
+                done(makeResponse(memory, 200, {"Sorry, something wrong happend when registing."}));
+            }
+        });
+    });
+    server.setAsyncRoute("POST", "/createPost", [&post_manager, &db_pool](const httpRequest& request, httpsServer::responder done) {
+        std::pmr::memory_resource* memory = request.memory;
+        newPost post;
+
+        try {
+            requestMemoryScope scope(memory);
+            auto json_body = requestJson::parse(request.body.begin(), request.body.end());
+            post.title = json_body["title"];
+            post.content = json_body["content"];
+            post.post_type = json_body["post_type"];
+        } catch (const nlohmann::json::exception& e) {
+            // 构造错误响应
+            done(invalidJson(memory, e));
+            return;
+        }
+        // upid取自已校验的令牌，不信任请求体
+        post.upid = static_cast<int>(request.user_id);
+
+        auto reply = [done, memory](bool created) {
+            done(created ? makeResponse(memory, 200, {"Post create successfully"}) : makeResponse(memory, 401, {"Post create failed"}));
+        };
+        // 开启批量写入时与其他请求合并提交，存储支持异步接口时直接发起，否则在db线程池中单独插入
+        bool accepted;
+
+        if (post_manager.batching()) {
+            accepted = post_manager.submitPost(std::move(post), reply);
+        } else if (post_manager.asynchronous()) {
+            accepted = post_manager.createPostAsync(std::move(post), reply);
+        } else {
+            accepted = db_pool.post([&post_manager, post = std::move(post), reply, done]() {
+                bool created;
+
+                try {
+                    created = post_manager.createPost(post.upid, post.title, post.content, post.post_type);
+                } catch (...) {
+                    done(taskFailed(std::current_exception()));
+                    return;
+                }
+                reply(created);
+            });
+        }
+
+        if (!accepted) {
+            done(httpResponse(503));
+        }
+    }, true);
+    server.setAsyncRoute("GET", "/posts", offload([&post_manager, &db_pool](const httpRequest& request, httpsServer::responder done) {
+        // GET /posts?limit=20&after=<next>&content=1，all=1时流式列出after之后的全部帖子，limit为每页行数
+        argsParser args_parser;
+        queryArgs args = args_parser.parseQuery(request.query);
+        std::string arena;
+        postQuery query;
+
+        // 只有需要解码时才会写入arena
+        if (argsParser::needsDecoding(request.query)) {
+            arena.reserve(request.query.size());
+        }
+
+        std::string_view limit = args.get("limit", arena);
+        std::string_view after = args.get("after", arena);
+
+        if (!limit.empty() && !parseNumber(limit, query.limit)) {
+            done(makeResponse(request.memory, 400, {"Invalid limit"}));
+            return;
+        }
+        if (!after.empty()) {
+            postCursor cursor;
+
+            if (!postCursor::parse(after, cursor)) {
+                done(makeResponse(request.memory, 400, {"Invalid cursor"}));
+                return;
+            }
+            query.after = std::move(cursor);
+        }
+        query.with_content = args.get("content", arena) == "1";
+        if (args.get("all", arena) == "1") {
+            httpResponse response(200, request.memory);
+
+            response.setContentType("application/json").streamBody(streamPosts(post_manager, db_pool, std::move(query)));
+            done(std::move(response));
+            return;
+        }
+
+        // 行直接序列化进body，由响应接管，不再复制
+        std::string body;
+
+        if (!post_manager.writePostsJson(query, body)) {
+            done(makeResponse(request.memory, 500, {"Failed to list posts"}));
+            return;
+        }
+        httpResponse response(200, request.memory);
+
+        response.setContentType("application/json").takeBody(std::move(body));
+        done(std::move(response));
+    }));
+    server.setAsyncRoute("GET", "/search", offload([&post_manager](const httpRequest& request, httpsServer::responder done) {
+        // GET /search?q=<关键词>&limit=20&content=1，检索只在内存中完成，取帖子可能访问数据库
+        argsParser args_parser;
+        queryArgs args = args_parser.parseQuery(request.query);
+        std::string arena;
+        std::size_t limit = 20;
+
+        if (argsParser::needsDecoding(request.query)) {
+            arena.reserve(request.query.size());
+        }
+
+        std::string_view text = args.get("q", arena);
+        std::string_view limit_arg = args.get("limit", arena);
+
+        if (text.empty()) {
+            done(makeResponse(request.memory, 400, {"Missing query"}));
+            return;
+        }
+        if (!limit_arg.empty() && !parseNumber(limit_arg, limit)) {
+            done(makeResponse(request.memory, 400, {"Invalid limit"}));
+            return;
+        }
+
+        std::string body;
+
+        post_manager.writeSearchJson(text, limit, args.get("content", arena) == "1", body);
+
+        httpResponse response(200, request.memory);
+
+        response.setContentType("application/json").takeBody(std::move(body));
+        done(std::move(response));
+    }));
+    auto post_response = [](std::pmr::memory_resource* memory, const std::shared_ptr<const cachedPost>& post) {
+        if (!post) {
+            return makeResponse(memory, 404, {"Post not found"});
+        }
+        // 直接引用缓存中的JSON，响应持有post直到写完
+        httpResponse response(200, memory);
+
+        response.setContentType("application/json").referBody(post->json, post);
+        return response;
+    };
+    auto load_post = offload([&post_manager, post_response](const httpRequest& request, httpsServer::responder done) {
+        int id = 0;
+
+        parseNumber(request.param("id"), id);   // 已在io线程上校验过
+        done(post_response(request.memory, post_manager.getPost(id)));
+    });
+    httpsServer::asyncRouteHandler get_post = [&post_manager, post_response, load_post](const httpRequest& request, httpsServer::responder done) {
+        int id = 0;
+
+        if (!parseNumber(request.param("id"), id)) {
+            done(makeResponse(request.memory, 400, {"Invalid post id"}));
+            return;
+        }
+        // 热点帖子直接在io线程上用缓存中的JSON应答，只有未命中才进入db线程池；存储支持异步接口时不进入
+        if (auto post = post_manager.findCachedPost(id)) {
+            done(post_response(request.memory, post));
+            return;
+        }
+        if (post_manager.asynchronous()) {
+            std::pmr::memory_resource* memory = request.memory;
+
+            if (!post_manager.loadPost(id, [done, memory, post_response](std::shared_ptr<const cachedPost> post) {
+                done(post_response(memory, post));
+            })) {
+                done(httpResponse(503));
+            }
+            return;
+        }
+        load_post(request, std::move(done));
+    };
+#ifdef HOMETOWN_COROUTINES
+    // 与回调版本相同：命中缓存直接应答，未命中时经存储的异步接口或db线程池读取，协程在此期间挂起。
+    // 回调驱动的连接上协程路由要经co_spawn，每个请求多几次分配，仍用回调版本
+    if (server.coroutines()) {
+        server.setCoroutineRoute("GET", "/posts/{id}", [&post_manager, &db_pool, post_response](const httpRequest& request) -> httpsServer::task<httpResponse> {
+            int id = 0;
+
+            if (!parseNumber(request.param("id"), id)) {
+                co_return makeResponse(request.memory, 400, {"Invalid post id"});
+            }
+            if (auto post = post_manager.findCachedPost(id)) {
+                co_return post_response(request.memory, post);
+            }
+
+            std::exception_ptr error;
+            auto post = co_await awaitCallback<std::shared_ptr<const cachedPost>>([&post_manager, &db_pool, &error, id](auto resume) {
+                if (post_manager.asynchronous()) {
+                    return post_manager.loadPost(id, resume);
+                }
+                return db_pool.post([&post_manager, &error, id, resume]() {
+                    // 抛出时也必须resume，否则协程不再恢复；异常交回协程，由连接循环以500应答
+                    std::shared_ptr<const cachedPost> post;
+
+                    try {
+                        post = post_manager.getPost(id);
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                    resume(std::move(post));
+                });
+            });
+
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            co_return post ? post_response(request.memory, *post) : httpResponse(503);
+        });
+    } else {
+        server.setAsyncRoute("GET", "/posts/{id}", get_post);
+    }
+#else
+    server.setAsyncRoute("GET", "/posts/{id}", get_post);
+#endif
+    // 帖子id取自内存中的列表，不查询数据库；帖子全部命中缓存时在io线程上应答，否则进入db线程池读穿透
+    // lookup解析路径参数并取出id，参数非法时返回false
+    using feedLookup = std::function<bool(const httpRequest&, std::size_t limit, int* ids, std::size_t& count)>;
+    auto feed_route = [&post_manager, &offload](feedLookup lookup) -> httpsServer::asyncRouteHandler {
+        auto respond = [&post_manager, lookup](const httpRequest& request, bool cached_only, const httpsServer::responder& done) {
+            std::size_t limit;
+            bool with_content;
+            int ids[postFeeds::FEED_LENGTH];
+            std::size_t count = 0;
+
+            if (!feedArgs(request, limit, with_content)) {
+                done(makeResponse(request.memory, 400, {"Invalid limit"}));
+                return true;
+            }
+            if (!lookup(request, std::min(limit, postFeeds::FEED_LENGTH), ids, count)) {
+                done(makeResponse(request.memory, 400, {"Invalid feed"}));
+                return true;
+            }
+
+            std::string body;
+
+            if (!post_manager.writeFeedJson(ids, count, with_content, cached_only, body)) {
+                return false;
+            }
+            httpResponse response(200, request.memory);
+
+            response.setContentType("application/json").takeBody(std::move(body));
+            done(std::move(response));
+            return true;
+        };
+        auto load = offload([respond](const httpRequest& request, httpsServer::responder done) {
+            respond(request, false, done);
+        });
+
+        return [respond, load](const httpRequest& request, httpsServer::responder done) {
+            if (!respond(request, true, done)) {
+                load(request, std::move(done));
+            }
+        };
+    };
+    server.setAsyncRoute("GET", "/feeds/type/{type}", feed_route([&post_manager](const httpRequest& request, std::size_t limit, int* ids, std::size_t& count) {
+        std::string_view raw = request.param("type");
+        std::string type(raw);
+
+        // 路径中的'+'是字面的加号，只解码%XX
+        if (raw.find('%') != std::string_view::npos) {
+            type.resize(argsParser::decodePath(raw, &type[0]));
+        }
+        count = post_manager.feedByType(type, limit, ids);
+        return !type.empty();
+    }));
+    server.setAsyncRoute("GET", "/feeds/user/{upid}", feed_route([&post_manager](const httpRequest& request, std::size_t limit, int* ids, std::size_t& count) {
+        int upid = 0;
+
+        if (!parseNumber(request.param("upid"), upid)) {
+            return false;
+        }
+        count = post_manager.feedByAuthor(upid, limit, ids);
+        return true;
+    }));
+    server.setAsyncRoute("POST", "/login", [&user_handler, &token_signer](const httpRequest& request, httpsServer::responder done) {
+        std::pmr::memory_resource* memory = request.memory;
+        std::string username;
+        std::string password;
+
+        try {
+            requestMemoryScope scope(memory);
+            auto json_body = requestJson::parse(request.body.begin(), request.body.end());
+            username = json_body["username"];
+            password = json_body["password"];
+        } catch (const nlohmann::json::exception& e) {
+            // 构造错误响应
+            done(invalidJson(memory, e));
+            return;
+        }
+        user_handler.loginUser(std::move(username), std::move(password), [done, memory, &token_signer](authStatus status, std::int64_t user_id) {
+            if (status == authStatus::ok) {
+                httpResponse response(200, memory);
+
+                // JSON与dump的结果都在done之前析构
+                {
+                    requestMemoryScope scope(memory);
+                    requestString body = requestJson{{"token", token_signer.issue(user_id)}}.dump();
+
+                    response.setContentType("application/json").setBody(body);
+                }
+                done(std::move(response));
+            } else if (status == authStatus::busy) {
+                done(httpResponse(503));
+            } else {
+                done(makeResponse(memory, 401, {"Login failed"}));
+            }
+        });
+    });
+    server.setAsyncRoute("POST", "/logout", [&token_signer](const httpRequest& request, httpsServer::responder done) {
+        tokenClaims claims;
+
+        if (token_signer.verify(bearerToken(request), claims)) {
+            token_signer.revoke(claims);
+        }
+        done(makeResponse(request.memory, 200, {"Logged out"}));
+    }, true);
+}
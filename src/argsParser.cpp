@@ -2,29 +2,144 @@
  * @file argsParser.cpp
  * @author antaresz (antaresz1026@gmail.com)
  * @brief 
- * @version 0.1
+ * @version 0.2
  * @date 2024-10-24
  * 
  * @copyright Copyright (c) 2024
  * 
  */
+#include <cstring>
 #include "argsParser.hpp"
-#include <map>
-#include <string>
-#include <sstream>
-
-std::map<std::string, std::string> argsParser::parseQuery(const std::string& query) {
-    std::map<std::string, std::string> result;
-    std::istringstream queryStream(query);
-    std::string pair;
-    
-    while (std::getline(queryStream, pair, '&')) {
-        size_t pos = pair.find('=');
-        if (pos != std::string::npos) {
-            std::string key = pair.substr(0, pos);
-            std::string value = pair.substr(pos + 1);
-            result[key] = value;
+
+namespace {
+const std::size_t MAX_STACK_KEY = 128;      //解码参数名时使用的栈缓冲区大小
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @brief 解码%XX，非法的%序列原样保留
+ * 
+ * @param raw 
+ * @param out 
+ * @param plus_is_space 查询串中'+'解码为空格
+ * @return std::size_t 解码后的长度
+ */
+std::size_t percentDecode(std::string_view raw, char* out, bool plus_is_space) {
+    std::size_t length = 0;
+
+    for (std::size_t i = 0; i < raw.size(); ++i) {
+        char c = raw[i];
+
+        if (c == '+' && plus_is_space) {
+            c = ' ';
+        } else if (c == '%' && i + 2 < raw.size() && hexValue(raw[i + 1]) >= 0 && hexValue(raw[i + 2]) >= 0) {
+            c = static_cast<char>(hexValue(raw[i + 1]) << 4 | hexValue(raw[i + 2]));
+            i += 2;
+        }
+        out[length++] = c;
+    }
+    return length;
+}
+
+/**
+ * @brief 比较原始(编码的)参数名与已解码的key
+ * 
+ * @param raw 
+ * @param key 
+ * @return true 
+ * @return false 
+ */
+bool keyEquals(std::string_view raw, std::string_view key) {
+    if (!argsParser::needsDecoding(raw)) {
+        return raw == key;
+    }
+    if (raw.size() > MAX_STACK_KEY || raw.size() < key.size()) {
+        return false;
+    }
+
+    char buffer[MAX_STACK_KEY];
+
+    return std::string_view(buffer, argsParser::decode(raw, buffer)) == key;
+}
+}
+
+const queryArg* queryArgs::find(std::string_view key) const {
+    for (const auto& arg : *this) {
+        if (keyEquals(arg.key, key)) {
+            return &arg;
         }
     }
+    return nullptr;
+}
+
+std::string_view queryArgs::get(std::string_view key, std::string& arena, std::string_view fallback) const {
+    const queryArg* arg = find(key);
+
+    return arg ? argsParser::decode(arg->value, arena) : fallback;
+}
+
+/**
+ * @brief 用memchr切分'&'与'='，glibc的memchr按SIMD宽度扫描，长查询串上远快于逐字节比较
+ * 
+ * 没有'='的参数视为值为空，空段被跳过；重复的参数全部保留，find返回第一个。
+ * 
+ * @param query 
+ * @return queryArgs 
+ */
+queryArgs argsParser::parseQuery(std::string_view query) {
+    queryArgs result;
+    const char* p = query.data();
+    const char* end = p + query.size();
+
+    while (p < end) {
+        auto amp = static_cast<const char*>(std::memchr(p, '&', end - p));
+        const char* pair_end = amp ? amp : end;
+
+        if (pair_end != p) {
+            auto eq = static_cast<const char*>(std::memchr(p, '=', pair_end - p));
+
+            if (eq) {
+                result.push_back(queryArg{std::string_view(p, eq - p), std::string_view(eq + 1, pair_end - eq - 1)});
+            } else {
+                result.push_back(queryArg{std::string_view(p, pair_end - p), std::string_view()});
+            }
+        }
+        p = pair_end + 1;
+    }
     return result;
 }
+
+bool argsParser::needsDecoding(std::string_view raw) {
+    return raw.find_first_of("%+") != std::string_view::npos;
+}
+
+std::size_t argsParser::decode(std::string_view raw, char* out) {
+    return percentDecode(raw, out, true);
+}
+
+std::string_view argsParser::decode(std::string_view raw, std::string& arena) {
+    if (!needsDecoding(raw)) {
+        return raw;
+    }
+
+    std::size_t offset = arena.size();
+
+    arena.resize(offset + raw.size());
+    arena.resize(offset + decode(raw, &arena[offset]));
+    return std::string_view(arena.data() + offset, arena.size() - offset);
+}
+
+std::size_t argsParser::decodePath(std::string_view raw, char* out) {
+    return percentDecode(raw, out, false);
+}
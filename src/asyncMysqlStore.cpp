@@ -0,0 +1,225 @@
+/**
+ * @file asyncMysqlStore.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief asyncMysqlStore实现，SQL与mysqlStore相同
+ * @version 1.1
+ * @date 2024-11-29
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-29 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>字符串参数以sqlStatement传入，由连接转义
+ * </table>
+ */
+#include <charconv>
+#include <future>
+#include "asyncMysqlStore.hpp"
+#include "logger.hpp"
+
+namespace {
+template <typename Integer>
+Integer toInteger(const std::string& text) {
+    Integer value = 0;
+
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    return value;
+}
+
+/**
+ * @brief 出错时记录日志
+ *
+ * @param result
+ * @param what 日志中的操作
+ * @return true 成功
+ */
+bool succeeded(const sqlResult& result, const char* what) {
+    if (!result.ok) {
+        LOG_ERROR(std::string(what) + ". Error: " + result.message);
+    }
+    return result.ok;
+}
+
+sqlStatement insertUserSql(const userRegistration& registration, const std::string& password_hash) {
+    // 新格式的盐保存在password中
+    return sqlStatement{"INSERT INTO users (username, salt, password, user_type, id_type, id_number, phone) VALUES (?, '', ?, ?, ?, ?, ?)",
+        {registration.username, password_hash, registration.user_type, registration.id_type, registration.id_number, registration.phone}};
+}
+
+sqlStatement findCredentialsSql(const std::string& username) {
+    return sqlStatement{"SELECT id, salt, password FROM users WHERE username = ?", {username}};
+}
+
+sqlStatement updatePasswordSql(std::int64_t user_id, const std::string& password_hash) {
+    return sqlStatement{"UPDATE users SET salt = '', password = ? WHERE id = " + std::to_string(user_id), {password_hash}};
+}
+
+sqlStatement insertPostSql(int upid, const std::string& title, const std::string& content, const std::string& post_type) {
+    return sqlStatement{"INSERT INTO posts (upid, title, content, post_type) VALUES (" + std::to_string(upid) + ", ?, ?, ?)",
+        {title, content, post_type}};
+}
+
+sqlStatement findPostSql(int id) {
+    return sqlStatement{"SELECT id, upid, title, post_type, created_at, content FROM posts WHERE id = " + std::to_string(id), {}};
+}
+
+bool readCredentials(const sqlResult& result, userCredentials& found) {
+    if (result.rows.empty()) {  // 没有匹配的用户
+        return false;
+    }
+
+    const std::vector<std::string>& row = result.rows.front();
+
+    found.id = toInteger<std::int64_t>(row[0]);
+    found.salt = row[1];
+    found.password = row[2];
+    return true;
+}
+
+/**
+ * @brief 列顺序为id, upid, title, post_type, created_at[, content]
+ *
+ * @param row
+ * @param post
+ */
+void readPost(std::vector<std::string>& row, Post& post) {
+    post.postid = toInteger<int>(row[0]);
+    post.upid = toInteger<int>(row[1]);
+    post.title = std::move(row[2]);
+    post.post_type = std::move(row[3]);
+    post.created_at = std::move(row[4]);
+    if (row.size() > 5) {
+        post.content = std::move(row[5]);
+    }
+}
+}
+
+sqlResult asyncMysqlStore::run(sqlStatement statement) {
+    std::promise<sqlResult> promise;
+    std::future<sqlResult> future = promise.get_future();
+
+    if (!_connection_pool.query(std::move(statement), [&promise](sqlResult& result) { promise.set_value(std::move(result)); })) {
+        sqlResult busy;
+
+        busy.message = "query queue is full";
+        return busy;
+    }
+    return future.get();
+}
+
+bool asyncMysqlStore::insertUser(const userRegistration& registration, const std::string& password_hash, doneCallback done) {
+    return _connection_pool.query(insertUserSql(registration, password_hash), [done = std::move(done)](sqlResult& result) {
+        done(succeeded(result, "Registration failed"));
+    });
+}
+
+bool asyncMysqlStore::findCredentials(const std::string& username, credentialsCallback done) {
+    return _connection_pool.query(findCredentialsSql(username), [done = std::move(done)](sqlResult& result) {
+        userCredentials found;
+        bool ok = succeeded(result, "Login failed") && readCredentials(result, found);
+
+        done(ok, found);
+    });
+}
+
+bool asyncMysqlStore::updatePassword(std::int64_t user_id, const std::string& password_hash, doneCallback done) {
+    return _connection_pool.query(updatePasswordSql(user_id, password_hash), [done = std::move(done)](sqlResult& result) {
+        if (!result.ok) {
+            LOG_WARNING("Password hash upgrade failed. Error: " + result.message);
+        }
+        done(result.ok);
+    });
+}
+
+bool asyncMysqlStore::insertPost(const newPost& post, insertCallback done) {
+    return _connection_pool.query(insertPostSql(post.upid, post.title, post.content, post.post_type), [done = std::move(done)](sqlResult& result) {
+        done(succeeded(result, "Failed to create post") ? static_cast<int>(result.insert_id) : 0);
+    });
+}
+
+bool asyncMysqlStore::findPost(int id, postCallback done) {
+    return _connection_pool.query(findPostSql(id), [done = std::move(done)](sqlResult& result) {
+        Post post{};
+        bool found = succeeded(result, "Failed to get post") && !result.rows.empty();
+
+        if (found) {
+            readPost(result.rows.front(), post);
+        }
+        done(found, post);
+    });
+}
+
+bool asyncMysqlStore::insertUser(const userRegistration& registration, const std::string& password_hash) {
+    return succeeded(run(insertUserSql(registration, password_hash)), "Registration failed");
+}
+
+bool asyncMysqlStore::findCredentials(const std::string& username, userCredentials& found) {
+    sqlResult result = run(findCredentialsSql(username));
+
+    return succeeded(result, "Login failed") && readCredentials(result, found);
+}
+
+bool asyncMysqlStore::updatePassword(std::int64_t user_id, const std::string& password_hash) {
+    sqlResult result = run(updatePasswordSql(user_id, password_hash));
+
+    if (!result.ok) {
+        LOG_WARNING("Password hash upgrade failed. Error: " + result.message);
+    }
+    return result.ok;
+}
+
+int asyncMysqlStore::insertPost(int upid, const std::string& title, const std::string& content, const std::string& post_type) {
+    sqlResult result = run(insertPostSql(upid, title, content, post_type));
+
+    return succeeded(result, "Failed to create post") ? static_cast<int>(result.insert_id) : 0;
+}
+
+bool asyncMysqlStore::deletePost(int id) {
+    return succeeded(run(sqlStatement{"DELETE FROM posts WHERE id = " + std::to_string(id), {}}), "Failed to delete post");
+}
+
+bool asyncMysqlStore::updatePost(int id, const std::string& title, const std::string& content) {
+    return succeeded(run(sqlStatement{"UPDATE posts SET title = ?, content = ? WHERE id = " + std::to_string(id), {title, content}}),
+        "Failed to update post");
+}
+
+bool asyncMysqlStore::findPost(int id, Post& found) {
+    sqlResult result = run(findPostSql(id));
+
+    if (!succeeded(result, "Failed to get post") || result.rows.empty()) {
+        return false;
+    }
+    readPost(result.rows.front(), found);
+    return true;
+}
+
+/**
+ * @brief 与mysqlStore相同，依赖posts(created_at, id)上的索引
+ */
+bool asyncMysqlStore::scanPosts(const postQuery& query, std::size_t limit, const postVisitor& visit) {
+    sqlStatement statement;
+
+    statement.sql = query.with_content
+        ? "SELECT id, upid, title, post_type, created_at, content FROM posts "
+        : "SELECT id, upid, title, post_type, created_at FROM posts ";
+    if (query.after) {
+        // 游标来自请求参数，与其他字符串一样由连接转义
+        statement.sql += "WHERE created_at < ? OR (created_at = ? AND id < " + std::to_string(query.after->id) + ") ";
+        statement.params.assign(2, query.after->created_at);
+    }
+    statement.sql += "ORDER BY created_at DESC, id DESC LIMIT " + std::to_string(limit);
+
+    sqlResult result = run(std::move(statement));
+    Post row{};
+
+    if (!succeeded(result, "Failed to list posts")) {
+        return false;
+    }
+    for (std::vector<std::string>& columns : result.rows) {
+        readPost(columns, row);
+        visit(row);
+    }
+    return true;
+}
@@ -0,0 +1,525 @@
+/**
+ * @file asyncSQLConnection.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief asyncSQLConnection类实现
+ * @version 1.3
+ * @date 2024-11-29
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-29 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>参数由执行语句的连接以mysql_real_escape_string转义，固定会话sql_mode
+ * <tr><td>2024-12-01 <td>1.2     <td>antaresz    <td>只有2000-2999的客户端错误码关闭连接
+ * <tr><td>2024-12-01 <td>1.3     <td>antaresz    <td>空闲过久的连接执行前先ping，断开时语句改由其他连接执行
+ * </table>
+ */
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/post.hpp>
+#include <algorithm>
+#include <optional>
+#include "asyncSQLConnection.hpp"
+#include "logger.hpp"
+
+namespace {
+// 2000-2999是客户端错误，如连接断开、读写超时，连接不能再用；3000以上是新版本服务端的错误码
+constexpr unsigned int CR_MIN_CLIENT_ERROR = 2000;
+constexpr unsigned int CR_MAX_CLIENT_ERROR = 2999;
+// 每个连接建立时固定sql_mode，只保留严格模式等与语句解析无关的选项，
+// 不继承服务器全局设置中可能有的NO_BACKSLASH_ESCAPES、ANSI_QUOTES等改变字符串与引号解析的选项
+constexpr const char* SESSION_INIT = "SET SESSION sql_mode = 'STRICT_TRANS_TABLES,ERROR_FOR_DIVISION_BY_ZERO,NO_ENGINE_SUBSTITUTION'";
+
+std::uint64_t microsecondsSince(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point now) {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - start).count());
+}
+}
+
+asyncSQLConnection::link::link(boost::asio::io_context& io)
+    : socket(io), timer(io), strand(boost::asio::make_strand(io)) {}
+
+asyncSQLConnection::asyncSQLConnection(const std::string& host, const std::string& user, const std::string& password, const std::string& database,
+    const asyncPoolOptions& options)
+    : _host(host), _user(user), _password(password), _database(database), _options(options), _work(boost::asio::make_work_guard(_io)) {
+    _options.connections = std::max<std::size_t>(1, _options.connections);
+    _options.threads = std::max<std::size_t>(1, _options.threads);
+    for (std::size_t i = 0; i < _options.connections; ++i) {
+        auto conn = std::make_shared<link>(_io);
+
+        _links.push_back(conn);
+        boost::asio::post(conn->strand, [this, conn]() { connect(conn); });
+    }
+    for (std::size_t i = 0; i < _options.threads; ++i) {
+        _threads.emplace_back([this]() { _io.run(); });
+    }
+    LOG_INFO("Async MySQL pool started with " + std::to_string(_options.connections) + " connections on "
+        + std::to_string(_options.threads) + " threads.");
+}
+
+asyncSQLConnection::~asyncSQLConnection() {
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+
+        _stopping = true;
+    }
+    _work.reset();
+    _io.stop();
+    for (std::thread& thread : _threads) {
+        thread.join();
+    }
+    for (auto& conn : _links) {
+        close(*conn);
+    }
+}
+
+bool asyncSQLConnection::query(sqlStatement statement, resultCallback done) {
+    std::shared_ptr<link> conn;
+    auto now = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+
+        if (_stopping) {
+            return false;
+        }
+        if (_idle.empty()) {
+            if (_pending.size() >= _options.max_pending) {
+                return false;
+            }
+            _pending.push_back(pendingQuery{std::move(statement.sql), std::move(statement.params), std::move(done), now});
+            return true;
+        }
+        conn = std::move(_idle.back());
+        _idle.pop_back();
+    }
+    _wait_time.record(0);
+    boost::asio::post(conn->strand, [this, conn, query = pendingQuery{std::move(statement.sql), std::move(statement.params), std::move(done), now}]() mutable {
+        execute(conn, std::move(query));
+    });
+    return true;
+}
+
+asyncPoolStats asyncSQLConnection::stats() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    asyncPoolStats result = _stats;
+
+    result.idle = _idle.size();
+    result.pending = _pending.size();
+    return result;
+}
+
+void asyncSQLConnection::connect(std::shared_ptr<link> conn) {
+    conn->mysql = mysql_init(nullptr);
+    if (!conn->mysql) {
+        LOG_ERROR("Async MySQL connection failed: out of memory");
+        scheduleReconnect(conn);
+        return;
+    }
+    mysql_options(conn->mysql, MYSQL_OPT_NONBLOCK, nullptr);
+    mysql_options(conn->mysql, MYSQL_SET_CHARSET_NAME, "utf8mb4");
+    mysql_options(conn->mysql, MYSQL_INIT_COMMAND, SESSION_INIT);
+    mysql_options(conn->mysql, MYSQL_OPT_CONNECT_TIMEOUT, &_options.connect_timeout);
+    conn->current = stage::connecting;
+    conn->connected = nullptr;
+    await(conn, mysql_real_connect_start(&conn->connected, conn->mysql, _host.c_str(), _user.c_str(), _password.c_str(), _database.c_str(),
+        0, nullptr, 0));
+}
+
+/**
+ * @brief socket只在第一次需要等待时登记，此后同一连接上的等待都复用它
+ *
+ * 需要超时的等待同时挂上socket与定时器，先完成的一方取消另一方；
+ * 被取消的一方可能已经排进队列，按wait_id忽略。
+ */
+void asyncSQLConnection::await(std::shared_ptr<link> conn, int status) {
+    if (status == 0) {
+        switch (conn->current) {
+        case stage::connecting:
+            connected(conn);
+            break;
+        case stage::pinging:
+            pinged(conn);
+            break;
+        case stage::querying:
+            queried(conn);
+            break;
+        case stage::storing:
+            stored(conn);
+            break;
+        }
+        return;
+    }
+    if (!conn->socket.is_open()) {
+        boost::system::error_code ec;
+
+        conn->socket.assign(mysql_get_socket(conn->mysql), ec);
+        if (ec) {
+            LOG_ERROR("Async MySQL connection failed: " + ec.message());
+            close(*conn);
+            scheduleReconnect(conn);
+            return;
+        }
+    }
+
+    std::uint64_t id = ++conn->wait_id;
+
+    conn->waiting = true;
+    if (status & MYSQL_WAIT_TIMEOUT) {
+        conn->timer.expires_after(std::chrono::milliseconds(mysql_get_timeout_value_ms(conn->mysql)));
+        conn->timer.async_wait(boost::asio::bind_executor(conn->strand, [this, conn, id](boost::system::error_code ec) {
+            if (ec || !conn->waiting || conn->wait_id != id) {
+                return;
+            }
+
+            boost::system::error_code ignored;
+
+            conn->waiting = false;
+            conn->socket.cancel(ignored);
+            resume(conn, MYSQL_WAIT_TIMEOUT);
+        }));
+    }
+
+    // 同时要求读写时先等可写，库会在下一次返回时再要求读
+    int event = (status & MYSQL_WAIT_WRITE) ? MYSQL_WAIT_WRITE : (status & MYSQL_WAIT_READ) ? MYSQL_WAIT_READ : MYSQL_WAIT_EXCEPT;
+    auto type = event == MYSQL_WAIT_WRITE ? boost::asio::posix::descriptor_base::wait_write
+        : event == MYSQL_WAIT_READ ? boost::asio::posix::descriptor_base::wait_read : boost::asio::posix::descriptor_base::wait_error;
+
+    conn->socket.async_wait(type, boost::asio::bind_executor(conn->strand, [this, conn, id, event](boost::system::error_code ec) {
+        if (ec == boost::asio::error::operation_aborted || !conn->waiting || conn->wait_id != id) {
+            return;
+        }
+        // 其他错误也交给库，由下一次读写报告
+        conn->waiting = false;
+        conn->timer.cancel();
+        resume(conn, event);
+    }));
+}
+
+void asyncSQLConnection::resume(std::shared_ptr<link> conn, int ready) {
+    int status = 0;
+
+    switch (conn->current) {
+    case stage::connecting:
+        status = mysql_real_connect_cont(&conn->connected, conn->mysql, ready);
+        break;
+    case stage::pinging:
+        status = mysql_ping_cont(&conn->ping_status, conn->mysql, ready);
+        break;
+    case stage::querying:
+        status = mysql_real_query_cont(&conn->query_status, conn->mysql, ready);
+        break;
+    case stage::storing:
+        status = mysql_store_result_cont(&conn->stored, conn->mysql, ready);
+        break;
+    }
+    await(conn, status);
+}
+
+void asyncSQLConnection::connected(std::shared_ptr<link> conn) {
+    if (!conn->connected) {
+        LOG_ERROR("Async MySQL connection failed: " + std::string(mysql_error(conn->mysql)));
+        close(*conn);
+        scheduleReconnect(conn);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+
+        ++_stats.connected;
+    }
+    conn->up = true;
+    release(conn);
+}
+
+/**
+ * @brief mysql_real_escape_string按连接的字符集转义多字节字符，服务器开启NO_BACKSLASH_ESCAPES时改为双写引号
+ *
+ * 每个参数最多转义为两倍长度，另加两个引号与转义函数写入的结束符，一次分配足够的空间。
+ */
+bool asyncSQLConnection::bind(link& conn) {
+    pendingQuery& query = conn.query;
+
+    if (query.params.empty()) {
+        return true;
+    }
+
+    std::size_t capacity = query.sql.size();
+
+    for (const std::string& param : query.params) {
+        capacity += param.size() * 2 + 3;
+    }
+
+    std::string sql(capacity, '\0');
+    std::string_view text = query.sql;
+    char* out = &sql[0];
+
+    for (const std::string& param : query.params) {
+        std::size_t mark = text.find('?');
+
+        if (mark == std::string_view::npos) {
+            return false;
+        }
+        out = std::copy(text.begin(), text.begin() + mark, out);
+        text.remove_prefix(mark + 1);
+        *out++ = '\'';
+
+        unsigned long length = mysql_real_escape_string(conn.mysql, out, param.data(), static_cast<unsigned long>(param.size()));
+
+        if (length == static_cast<unsigned long>(-1)) {
+            return false;
+        }
+        out += length;
+        *out++ = '\'';
+    }
+    if (text.find('?') != std::string_view::npos) {
+        return false;
+    }
+    out = std::copy(text.begin(), text.end(), out);
+    sql.resize(static_cast<std::size_t>(out - sql.data()));
+    query.sql = std::move(sql);
+    query.params.clear();
+    return true;
+}
+
+void asyncSQLConnection::execute(std::shared_ptr<link> conn, pendingQuery query) {
+    conn->query = std::move(query);
+    conn->result = sqlResult();
+    if (!bind(*conn)) {
+        conn->result.message = "statement parameters do not match its placeholders";
+        LOG_ERROR("Async MySQL query not sent: " + conn->result.message);
+        complete(conn);
+        return;
+    }
+    if (std::chrono::steady_clock::now() - conn->last_used > _options.idle_ping) {
+        conn->current = stage::pinging;
+        conn->ping_status = 0;
+        await(conn, mysql_ping_start(&conn->ping_status, conn->mysql));
+        return;
+    }
+    send(conn);
+}
+
+void asyncSQLConnection::pinged(std::shared_ptr<link> conn) {
+    if (conn->ping_status == 0) {
+        send(conn);
+        return;
+    }
+
+    pendingQuery query = std::move(conn->query);
+
+    LOG_WARNING("Async MySQL idle connection lost: " + std::string(mysql_error(conn->mysql)));
+    close(*conn);
+    scheduleReconnect(conn);
+    requeue(std::move(query));
+}
+
+void asyncSQLConnection::send(std::shared_ptr<link> conn) {
+    conn->current = stage::querying;
+    conn->query_status = 0;
+    await(conn, mysql_real_query_start(&conn->query_status, conn->mysql, conn->query.sql.data(), static_cast<unsigned long>(conn->query.sql.size())));
+}
+
+void asyncSQLConnection::queried(std::shared_ptr<link> conn) {
+    if (conn->query_status != 0) {
+        fail(conn);
+        return;
+    }
+    if (mysql_field_count(conn->mysql) == 0) {
+        conn->result.ok = true;
+        conn->result.affected_rows = mysql_affected_rows(conn->mysql);
+        conn->result.insert_id = mysql_insert_id(conn->mysql);
+        complete(conn);
+        return;
+    }
+    conn->current = stage::storing;
+    conn->stored = nullptr;
+    await(conn, mysql_store_result_start(&conn->stored, conn->mysql));
+}
+
+/**
+ * @brief 结果集已整体读入客户端内存，逐行取出不会再等待socket
+ */
+void asyncSQLConnection::stored(std::shared_ptr<link> conn) {
+    if (!conn->stored) {
+        fail(conn);
+        return;
+    }
+
+    unsigned int fields = mysql_num_fields(conn->stored);
+
+    while (MYSQL_ROW row = mysql_fetch_row(conn->stored)) {
+        unsigned long* lengths = mysql_fetch_lengths(conn->stored);
+        std::vector<std::string>& out = conn->result.rows.emplace_back();
+
+        out.reserve(fields);
+        for (unsigned int i = 0; i < fields; ++i) {
+            out.emplace_back(row[i] ? std::string(row[i], lengths[i]) : std::string());
+        }
+    }
+    mysql_free_result(conn->stored);
+    conn->stored = nullptr;
+    conn->result.ok = true;
+    complete(conn);
+}
+
+/**
+ * @brief 先交还连接再回调，排队的查询不必等回调执行完
+ */
+void asyncSQLConnection::complete(std::shared_ptr<link> conn) {
+    pendingQuery finished = std::move(conn->query);
+    sqlResult result = std::move(conn->result);
+
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+
+        ++_stats.queries;
+        _stats.failures += !result.ok;
+    }
+    release(conn);
+    finished.done(result);
+}
+
+void asyncSQLConnection::fail(std::shared_ptr<link> conn) {
+    conn->result.ok = false;
+    conn->result.error = mysql_errno(conn->mysql);
+    conn->result.message = mysql_error(conn->mysql);
+    if (conn->result.error < CR_MIN_CLIENT_ERROR || conn->result.error > CR_MAX_CLIENT_ERROR) {
+        // 服务端错误(如唯一键冲突)，连接仍可继续使用
+        complete(conn);
+        return;
+    }
+
+    pendingQuery finished = std::move(conn->query);
+    sqlResult result = std::move(conn->result);
+
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+
+        ++_stats.queries;
+        ++_stats.failures;
+    }
+    LOG_WARNING("Async MySQL connection lost: " + result.message);
+    close(*conn);
+    scheduleReconnect(conn);
+    finished.done(result);
+}
+
+/**
+ * @brief fd归mysql所有，先从asio中取回再由mysql_close关闭
+ */
+void asyncSQLConnection::close(link& conn) {
+    if (conn.socket.is_open()) {
+        conn.socket.release();
+    }
+    if (conn.mysql) {
+        mysql_close(conn.mysql);
+        conn.mysql = nullptr;
+    }
+    if (conn.up) {
+        std::lock_guard<std::mutex> lock(_mtx);
+
+        --_stats.connected;
+        conn.up = false;
+    }
+}
+
+void asyncSQLConnection::scheduleReconnect(std::shared_ptr<link> conn) {
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+
+        if (_stopping) {
+            return;
+        }
+        ++_stats.reconnects;
+    }
+    expirePending();
+    conn->timer.expires_after(_options.reconnect_delay);
+    conn->timer.async_wait(boost::asio::bind_executor(conn->strand, [this, conn](boost::system::error_code ec) {
+        if (!ec) {
+            connect(conn);
+        }
+    }));
+}
+
+void asyncSQLConnection::requeue(pendingQuery query) {
+    std::shared_ptr<link> conn;
+
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+
+        if (_idle.empty()) {
+            _pending.push_front(std::move(query));
+            return;
+        }
+        conn = std::move(_idle.back());
+        _idle.pop_back();
+    }
+    boost::asio::post(conn->strand, [this, conn, query = std::move(query)]() mutable {
+        execute(conn, std::move(query));
+    });
+}
+
+void asyncSQLConnection::release(std::shared_ptr<link> conn) {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<pendingQuery> expired;
+    std::optional<pendingQuery> next;
+
+    conn->last_used = now;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+
+        takeExpired(now, expired);
+        if (_pending.empty()) {
+            _idle.push_back(conn);
+        } else {
+            next.emplace(std::move(_pending.front()));
+            _pending.pop_front();
+        }
+    }
+    failExpired(expired);
+    if (next) {
+        _wait_time.record(microsecondsSince(next->queued_at, now));
+        execute(conn, std::move(*next));
+    }
+}
+
+void asyncSQLConnection::expirePending() {
+    std::vector<pendingQuery> expired;
+
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+
+        takeExpired(std::chrono::steady_clock::now(), expired);
+    }
+    failExpired(expired);
+}
+
+/**
+ * @brief 队列按入队时间有序，超时的查询总在队首
+ */
+void asyncSQLConnection::takeExpired(std::chrono::steady_clock::time_point now, std::vector<pendingQuery>& expired) {
+    while (!_pending.empty() && now - _pending.front().queued_at > _options.acquire_timeout) {
+        expired.push_back(std::move(_pending.front()));
+        _pending.pop_front();
+    }
+    _stats.queries += expired.size();
+    _stats.failures += expired.size();
+}
+
+void asyncSQLConnection::failExpired(std::vector<pendingQuery>& expired) {
+    if (expired.empty()) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+
+    LOG_ERROR(std::to_string(expired.size()) + " queries timed out waiting for an async MySQL connection.");
+    for (pendingQuery& query : expired) {
+        sqlResult result;
+
+        result.message = "timed out waiting for a connection";
+        _wait_time.record(microsecondsSince(query.queued_at, now));
+        query.done(result);
+    }
+}
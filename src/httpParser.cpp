@@ -0,0 +1,462 @@
+/**
+ * @file httpParser.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief httpParser类实现
+ * @version 1.1
+ * @date 2024-11-10
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-10 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>compact回收已解析的chunk框架
+ * </table>
+ */
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include "httpParser.hpp"
+
+namespace {
+const std::size_t MAX_CHUNK_LINE = 1024;            //chunk大小行/trailer行的最大长度
+
+char lower(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+bool iequals(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        if (lower(a[i]) != lower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 不区分大小写的子串查找，用于Connection等逗号分隔的头部值
+ *
+ * @param haystack
+ * @param needle 小写
+ * @return true
+ * @return false
+ */
+bool icontains(std::string_view haystack, std::string_view needle) {
+    if (needle.size() > haystack.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i + needle.size() <= haystack.size(); ++i) {
+        if (iequals(haystack.substr(i, needle.size()), needle)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief 在[begin, end)中查找"\r\n"
+ *
+ * @return const char* 指向'\r'，找不到时为nullptr
+ */
+const char* findCRLF(const char* begin, const char* end) {
+    while (begin < end) {
+        auto cr = static_cast<const char*>(std::memchr(begin, '\r', end - begin));
+
+        if (!cr || cr + 1 >= end) {
+            return nullptr;
+        }
+        if (cr[1] == '\n') {
+            return cr;
+        }
+        begin = cr + 1;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief RFC 7230 tchar查找表
+ *
+ * @return constexpr std::array<bool, 256>
+ */
+constexpr std::array<bool, 256> makeTokenTable() {
+    std::array<bool, 256> table{};
+
+    for (int c = '!'; c < 127; ++c) {
+        table[c] = true;
+    }
+    for (char c : std::string_view("\"(),/:;<=>?@[\\]{}")) {
+        table[static_cast<unsigned char>(c)] = false;
+    }
+    return table;
+}
+
+constexpr std::array<bool, 256> TOKEN_CHARS = makeTokenTable();
+
+inline bool isTokenChar(char c) {
+    return TOKEN_CHARS[static_cast<unsigned char>(c)];
+}
+
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+}
+
+std::string_view httpRequest::header(std::string_view name) const {
+    for (std::size_t i = 0; i < header_count; ++i) {
+        if (iequals(headers[i].name, name)) {
+            return headers[i].value;
+        }
+    }
+    return std::string_view();
+}
+
+std::string_view httpRequest::param(std::string_view name) const {
+    for (std::size_t i = 0; i < param_count; ++i) {
+        if (params[i].name == name) {
+            return params[i].value;
+        }
+    }
+    return std::string_view();
+}
+
+httpParser::httpParser(const httpLimits& limits) : _limits(limits) {
+    reset();
+}
+
+void httpParser::reset() {
+    _state = state::headers;
+    // headers数组按header_count使用，无需清零
+    _request.method = _request.target = _request.path = _request.query = _request.version = _request.body = std::string_view();
+    _request.header_count = 0;
+    _request.param_count = 0;
+    _request.keep_alive = false;
+    _request.user_id = -1;
+    _scanned = 0;
+    _header_bytes = 0;
+    _content_length = 0;
+    _read_pos = 0;
+    _write_pos = 0;
+    _chunk_remaining = 0;
+    _consumed = 0;
+    _chunked = false;
+    _error_status = 0;
+}
+
+/**
+ * @brief _read_pos之前、_write_pos之后的数据都已解析且不再需要
+ */
+std::size_t httpParser::compact(char* data, std::size_t size) {
+    if (!_chunked || _error_status || _state == state::headers || _state == state::done || _read_pos == _write_pos) {
+        return 0;
+    }
+
+    std::size_t freed = _read_pos - _write_pos;
+
+    std::memmove(data + _write_pos, data + _read_pos, size - _read_pos);
+    _read_pos = _write_pos;
+    return freed;
+}
+
+httpParser::status httpParser::fail(int http_status) {
+    _error_status = http_status;
+    return status::error;
+}
+
+/**
+ * @brief 解析入口
+ *
+ * 请求头阶段只在新到达的数据中查找"\r\n\r\n"，找到后一次性解析请求行与请求头；
+ * 之后按Content-Length或chunked编码等待请求体。
+ *
+ * @param data
+ * @param size
+ * @return httpParser::status
+ */
+httpParser::status httpParser::parse(char* data, std::size_t size) {
+    if (_state == state::done) {
+        return status::complete;
+    }
+    if (_error_status) {
+        return status::error;
+    }
+
+    if (_state == state::headers) {
+        // 结束符可能跨越两次读取，回退3个字节继续查找
+        std::size_t start = _scanned >= 3 ? _scanned - 3 : 0;
+        const char* end = data + size;
+        const char* found = nullptr;
+
+        for (const char* p = data + start; (p = findCRLF(p, end)) != nullptr; p += 2) {
+            if (end - p >= 4 && p[2] == '\r' && p[3] == '\n') {
+                found = p;
+                break;
+            }
+        }
+        if (!found) {
+            _scanned = size;
+            return size > _limits.max_header_bytes ? fail(431) : status::incomplete;
+        }
+        _header_bytes = found + 4 - data;
+        if (_header_bytes > _limits.max_header_bytes) {
+            return fail(431);
+        }
+
+        status result = parseHead(data);
+
+        if (result != status::incomplete) {
+            return result;
+        }
+        if (_chunked) {
+            _read_pos = _write_pos = _header_bytes;
+            _state = state::chunkSize;
+        } else {
+            _state = state::body;
+        }
+    }
+
+    if (_state == state::body) {
+        if (size - _header_bytes < _content_length) {
+            return status::incomplete;
+        }
+        _request.body = std::string_view(data + _header_bytes, _content_length);
+        _consumed = _header_bytes + _content_length;
+    } else {
+        status result = parseChunks(data, size);
+
+        if (result != status::complete) {
+            return result;
+        }
+        _request.body = std::string_view(data + _header_bytes, _write_pos - _header_bytes);
+    }
+
+    // 请求头阶段之后缓冲区可能已搬移，这里按偏移量指向当前缓冲区
+    auto view = [data](const span& s) {
+        return std::string_view(data + s.offset, s.length);
+    };
+
+    _request.method = view(_method);
+    _request.target = view(_target);
+    _request.path = _request.target.substr(0, _request.target.find('?'));
+    _request.query = _request.path.size() < _request.target.size() ? _request.target.substr(_request.path.size() + 1) : std::string_view();
+    _request.version = view(_version);
+    for (std::size_t i = 0; i < _request.header_count; ++i) {
+        _request.headers[i] = httpHeader{view(_header_spans[i][0]), view(_header_spans[i][1])};
+    }
+    _state = state::done;
+    return status::complete;
+}
+
+/**
+ * @brief 解析请求行与请求头
+ *
+ * 此时只保存偏移量，请求完整后再转换为string_view，以免中途缓冲区扩容导致悬空。
+ *
+ * @param data
+ * @return httpParser::status 成功时返回incomplete表示继续等待请求体
+ */
+httpParser::status httpParser::parseHead(char* data) {
+    const char* p = data;
+    const char* end = data + _header_bytes - 2;                 //指向最后一个空行的"\r\n"
+    auto offset = [data](const char* begin, std::size_t length) {
+        return span{static_cast<std::uint32_t>(begin - data), static_cast<std::uint32_t>(length)};
+    };
+
+    // 请求行：method SP target SP version CRLF
+    const char* line_end = findCRLF(p, end + 2);
+    const char* sp1 = static_cast<const char*>(std::memchr(p, ' ', line_end - p));
+    const char* sp2 = sp1 ? static_cast<const char*>(std::memchr(sp1 + 1, ' ', line_end - sp1 - 1)) : nullptr;
+
+    if (!sp1 || !sp2 || sp1 == p || sp2 == sp1 + 1) {
+        return fail(400);
+    }
+    for (const char* c = p; c < sp1; ++c) {
+        if (!isTokenChar(*c)) {
+            return fail(400);
+        }
+    }
+
+    std::string_view version(sp2 + 1, line_end - sp2 - 1);
+
+    if (version.size() != 8 || version.substr(0, 5) != "HTTP/") {
+        return fail(400);
+    }
+    if (version != "HTTP/1.1" && version != "HTTP/1.0") {
+        return fail(505);
+    }
+    _method = offset(p, sp1 - p);
+    _target = offset(sp1 + 1, sp2 - sp1 - 1);
+    _version = offset(sp2 + 1, version.size());
+
+    bool http11 = version == "HTTP/1.1";
+    bool has_content_length = false;
+    bool close = false;
+    bool keep_alive = false;
+
+    for (p = line_end + 2; p < end; p = line_end + 2) {
+        line_end = findCRLF(p, end + 2);
+
+        // 不支持已废弃的折行写法
+        if (*p == ' ' || *p == '\t') {
+            return fail(400);
+        }
+
+        const char* colon = static_cast<const char*>(std::memchr(p, ':', line_end - p));
+
+        if (!colon || colon == p) {
+            return fail(400);
+        }
+
+        std::string_view name(p, colon - p);
+        std::string_view value = trim(std::string_view(colon + 1, line_end - colon - 1));
+
+        for (char c : name) {
+            if (!isTokenChar(c)) {
+                return fail(400);
+            }
+        }
+        if (_request.header_count == HTTP_MAX_HEADERS) {
+            return fail(431);
+        }
+        _header_spans[_request.header_count][0] = offset(name.data(), name.size());
+        _header_spans[_request.header_count][1] = offset(value.data(), value.size());
+        ++_request.header_count;
+
+        if (iequals(name, "content-length")) {
+            std::size_t length = 0;
+
+            if (value.empty()) {
+                return fail(400);
+            }
+            for (char c : value) {
+                if (c < '0' || c > '9' || length > (std::numeric_limits<std::size_t>::max() - 9) / 10) {
+                    return fail(400);
+                }
+                length = length * 10 + (c - '0');
+            }
+            if (has_content_length && length != _content_length) {
+                return fail(400);
+            }
+            has_content_length = true;
+            _content_length = length;
+        } else if (iequals(name, "transfer-encoding")) {
+            // 只支持chunked作为最后一层编码
+            if (value.size() < 7 || !iequals(value.substr(value.size() - 7), "chunked")) {
+                return fail(501);
+            }
+            _chunked = true;
+        } else if (iequals(name, "connection")) {
+            close = close || icontains(value, "close");
+            keep_alive = keep_alive || icontains(value, "keep-alive");
+        }
+    }
+
+    // 同时带有Content-Length与Transfer-Encoding的请求可被用于请求走私，直接拒绝
+    if (_chunked && has_content_length) {
+        return fail(400);
+    }
+    if (_content_length > _limits.max_body_bytes) {
+        return fail(413);
+    }
+    _request.keep_alive = http11 ? !close : keep_alive;
+    return status::incomplete;
+}
+
+/**
+ * @brief 原地解码chunked请求体
+ *
+ * 解码后的数据被搬到请求头之后连续存放(_write_pos)，_read_pos始终不小于_write_pos，
+ * 因此memmove不会覆盖尚未解析的数据。
+ *
+ * @param data
+ * @param size
+ * @return httpParser::status
+ */
+httpParser::status httpParser::parseChunks(char* data, std::size_t size) {
+    const char* end = data + size;
+
+    while (true) {
+        switch (_state) {
+        case state::chunkSize: {
+            const char* line_end = findCRLF(data + _read_pos, end);
+
+            if (!line_end) {
+                return size - _read_pos > MAX_CHUNK_LINE ? fail(400) : status::incomplete;
+            }
+
+            std::size_t chunk_size = 0;
+            const char* p = data + _read_pos;
+
+            for (; p < line_end && std::isxdigit(static_cast<unsigned char>(*p)); ++p) {
+                if (chunk_size > (std::numeric_limits<std::size_t>::max() >> 4)) {
+                    return fail(413);
+                }
+                chunk_size = (chunk_size << 4) | static_cast<std::size_t>(*p <= '9' ? *p - '0' : lower(*p) - 'a' + 10);
+            }
+            // 忽略chunk扩展
+            if (p == data + _read_pos || (p < line_end && *p != ';' && *p != ' ' && *p != '\t')) {
+                return fail(400);
+            }
+            _read_pos = line_end + 2 - data;
+            if (chunk_size == 0) {
+                _state = state::trailers;
+            } else if (_write_pos - _header_bytes + chunk_size > _limits.max_body_bytes) {
+                return fail(413);
+            } else {
+                _chunk_remaining = chunk_size;
+                _state = state::chunkData;
+            }
+            break;
+        }
+        case state::chunkData: {
+            std::size_t available = size - _read_pos;
+            std::size_t n = available < _chunk_remaining ? available : _chunk_remaining;
+
+            if (n && _write_pos != _read_pos) {
+                std::memmove(data + _write_pos, data + _read_pos, n);
+            }
+            _write_pos += n;
+            _read_pos += n;
+            _chunk_remaining -= n;
+            if (_chunk_remaining || size - _read_pos < 2) {
+                return status::incomplete;
+            }
+            if (data[_read_pos] != '\r' || data[_read_pos + 1] != '\n') {
+                return fail(400);
+            }
+            _read_pos += 2;
+            _state = state::chunkSize;
+            break;
+        }
+        case state::trailers: {
+            const char* line_end = findCRLF(data + _read_pos, end);
+
+            if (!line_end) {
+                return size - _read_pos > MAX_CHUNK_LINE ? fail(431) : status::incomplete;
+            }
+            // trailer不参与处理，空行表示请求结束
+            bool last = line_end == data + _read_pos;
+
+            _read_pos = line_end + 2 - data;
+            if (last) {
+                _consumed = _read_pos;
+                return status::complete;
+            }
+            break;
+        }
+        default:
+            return fail(500);
+        }
+    }
+}
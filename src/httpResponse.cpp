@@ -0,0 +1,221 @@
+/**
+ * @file httpResponse.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief httpResponse类实现
+ * @version 1.0
+ * @date 2024-11-25
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-25 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#include <charconv>
+#include <cstdio>
+#include "httpResponse.hpp"
+
+namespace {
+/**
+ * @brief 静态的状态行
+ *
+ */
+struct statusEntry {
+    int status;
+    std::string_view line;
+};
+
+const statusEntry STATUS_LINES[] = {
+    {200, "HTTP/1.1 200 OK\r\n"},
+    {201, "HTTP/1.1 201 Created\r\n"},
+    {204, "HTTP/1.1 204 No Content\r\n"},
+    {400, "HTTP/1.1 400 Bad Request\r\n"},
+    {401, "HTTP/1.1 401 Unauthorized\r\n"},
+    {403, "HTTP/1.1 403 Forbidden\r\n"},
+    {404, "HTTP/1.1 404 Not Found\r\n"},
+    {405, "HTTP/1.1 405 Method Not Allowed\r\n"},
+    {409, "HTTP/1.1 409 Conflict\r\n"},
+    {413, "HTTP/1.1 413 Payload Too Large\r\n"},
+    {429, "HTTP/1.1 429 Too Many Requests\r\n"},
+    {431, "HTTP/1.1 431 Request Header Fields Too Large\r\n"},
+    {500, "HTTP/1.1 500 Internal Server Error\r\n"},
+    {501, "HTTP/1.1 501 Not Implemented\r\n"},
+    {503, "HTTP/1.1 503 Service Unavailable\r\n"},
+    {505, "HTTP/1.1 505 HTTP Version Not Supported\r\n"},
+};
+
+/**
+ * @brief 静态的Content-Type头部行，按类型查找
+ *
+ */
+struct contentTypeEntry {
+    std::string_view type;
+    std::string_view line;
+};
+
+const contentTypeEntry CONTENT_TYPES[] = {
+    {"application/json", "Content-Type: application/json\r\n"},
+    {"text/plain", "Content-Type: text/plain\r\n"},
+    {"text/plain; charset=utf-8", "Content-Type: text/plain; charset=utf-8\r\n"},
+    {"text/plain; version=0.0.4", "Content-Type: text/plain; version=0.0.4\r\n"},
+    {"text/html; charset=utf-8", "Content-Type: text/html; charset=utf-8\r\n"},
+};
+
+const std::string_view KEEP_ALIVE = "Connection: keep-alive\r\n";
+const std::string_view CLOSE = "Connection: close\r\n";
+const std::string_view CONTENT_LENGTH = "Content-Length: ";
+const std::string_view HEADERS_END = "\r\n\r\n";
+const std::string_view CHUNKED = "Transfer-Encoding: chunked\r\n\r\n";
+const std::string_view EMPTY_LINE = "\r\n";
+}
+
+httpResponse::httpResponse(int status, std::pmr::memory_resource* memory)
+    : _status(status), _headers(memory), _copied(memory) {}
+
+httpResponse& httpResponse::setStatus(int status) {
+    _status = status;
+    return *this;
+}
+
+httpResponse& httpResponse::setContentType(std::string_view type) {
+    for (const contentTypeEntry& entry : CONTENT_TYPES) {
+        if (entry.type == type) {
+            _content_type = entry.line;
+            return *this;
+        }
+    }
+    _content_type = std::string_view();
+    return addHeader("Content-Type", type);
+}
+
+httpResponse& httpResponse::addHeader(std::string_view name, std::string_view value) {
+    _headers.reserve(_headers.size() + name.size() + value.size() + 4);
+    _headers.append(name).append(": ").append(value).append("\r\n");
+    return *this;
+}
+
+httpResponse& httpResponse::setBody(std::string_view body) {
+    _kind = bodyKind::copied;
+    _copied.assign(body);
+    return *this;
+}
+
+httpResponse& httpResponse::reserveBody(std::size_t size) {
+    _copied.reserve(size);
+    return *this;
+}
+
+/**
+ * @brief 之前的body不是复制进来的时先丢弃
+ *
+ */
+httpResponse& httpResponse::appendBody(std::string_view part) {
+    if (_kind != bodyKind::copied) {
+        setBody(std::string_view());
+    }
+    _copied.append(part);
+    return *this;
+}
+
+httpResponse& httpResponse::takeBody(std::string&& body) {
+    _kind = bodyKind::taken;
+    _taken = std::move(body);
+    return *this;
+}
+
+httpResponse& httpResponse::referBody(std::string_view body, std::shared_ptr<const void> owner) {
+    _kind = bodyKind::referenced;
+    _referenced = body;
+    _owner = std::move(owner);
+    return *this;
+}
+
+httpResponse& httpResponse::streamBody(chunkSource source) {
+    _source = std::move(source);
+    return *this;
+}
+
+std::string_view httpResponse::body() const {
+    if (_source) {
+        return std::string_view();
+    }
+    switch (_kind) {
+    case bodyKind::taken:
+        return _taken;
+    case bodyKind::referenced:
+        return _referenced;
+    case bodyKind::copied:
+        break;
+    }
+    return _copied;
+}
+
+/**
+ * @brief 状态行 Connection [Content-Type] [自定义头部] 长度或chunked [body]
+ *
+ */
+std::size_t httpResponse::headerParts(bool keep_alive, bool chunked, std::string_view (&parts)[MAX_PARTS]) {
+    std::size_t count = 0;
+    std::string_view status_line;
+
+    for (const statusEntry& entry : STATUS_LINES) {
+        if (entry.status == _status) {
+            status_line = entry.line;
+            break;
+        }
+    }
+    if (status_line.empty()) {
+        // 原因短语可以为空
+        int length = std::snprintf(_status_line, sizeof(_status_line), "HTTP/1.1 %03d \r\n", _status % 1000);
+
+        status_line = std::string_view(_status_line, static_cast<std::size_t>(length));
+    }
+    parts[count++] = status_line;
+    parts[count++] = keep_alive ? KEEP_ALIVE : CLOSE;
+    if (!_content_type.empty()) {
+        parts[count++] = _content_type;
+    }
+    if (!_headers.empty()) {
+        parts[count++] = _headers;
+    }
+    if (_source) {
+        parts[count++] = chunked ? CHUNKED : EMPTY_LINE;
+        return count;
+    }
+
+    std::string_view content = body();
+
+    parts[count++] = CONTENT_LENGTH;
+    parts[count++] = std::string_view(_length, std::to_chars(_length, _length + sizeof(_length), content.size()).ptr - _length);
+    parts[count++] = HEADERS_END;
+    if (!content.empty()) {
+        parts[count++] = content;
+    }
+    return count;
+}
+
+std::string httpResponse::toString(bool keep_alive) {
+    std::string_view parts[MAX_PARTS];
+    std::size_t count = headerParts(keep_alive, true, parts);
+    std::size_t size = 0;
+    std::string out;
+
+    for (std::size_t i = 0; i < count; ++i) {
+        size += parts[i].size();
+    }
+    out.reserve(size);
+    for (std::size_t i = 0; i < count; ++i) {
+        out.append(parts[i]);
+    }
+    return out;
+}
+
+std::string_view httpResponse::chunkHeader(std::size_t size, char* out) {
+    char* end = std::to_chars(out, out + 16, size, 16).ptr;
+
+    *end++ = '\r';
+    *end++ = '\n';
+    return std::string_view(out, static_cast<std::size_t>(end - out));
+}
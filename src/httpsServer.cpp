@@ -2,7 +2,7 @@
  * @file httpServer.cpp
  * @author antaresz (antaresz1026@gmail.com)
  * @brief httpServer类实现
- * @version 1.1
+ * @version 1.19
  * @date 2024-10-15
  * 
  * @copyright Copyright (c) 2024 antaresz
@@ -12,242 +12,1104 @@
  * <tr><th>Date       <th>Version <th>Author <th>Description
  * <tr><td>2024-10-15 <td>1.0     <td>antaresz    <td>desc
  * <tr><td>2024-10-26 <td>1.1     <td>antaresz    <td>fk缓冲区，fk all
+ * <tr><td>2024-11-02 <td>1.2     <td>antaresz    <td>多线程io模型：共享io_context+strand / 每核io_context+SO_REUSEPORT
+ * <tr><td>2024-11-04 <td>1.3     <td>antaresz    <td>异步路由，响应投递回连接executor
+ * <tr><td>2024-11-06 <td>1.4     <td>antaresz    <td>keep-alive、空闲超时、pipelining
+ * <tr><td>2024-11-08 <td>1.5     <td>antaresz    <td>TLS 1.3、会话缓存与会话票据
+ * <tr><td>2024-11-10 <td>1.6     <td>antaresz    <td>httpParser替换istringstream解析，去掉请求的多次拷贝
+ * <tr><td>2024-11-12 <td>1.7     <td>antaresz    <td>router替换std::map路由表
+ * <tr><td>2024-11-18 <td>1.8     <td>antaresz    <td>认证中间件
+ * <tr><td>2024-11-20 <td>1.9     <td>antaresz    <td>simulateRequest，路由分发与连接解耦
+ * <tr><td>2024-11-21 <td>1.10    <td>antaresz    <td>请求路径上的无锁指标
+ * <tr><td>2024-11-24 <td>1.11    <td>antaresz    <td>请求arena；响应复制进连接上复用的缓冲区，去掉逐请求的shared_ptr<string>
+ * <tr><td>2024-11-25 <td>1.12    <td>antaresz    <td>httpResponse分段写出，不再复制与拼接；chunked流式响应
+ * <tr><td>2024-11-28 <td>1.13    <td>antaresz    <td>准入控制：超限的连接在握手前关闭，超限的请求在路由前以429/503应答
+ * <tr><td>2024-11-30 <td>1.14    <td>antaresz    <td>协程路由；可选的协程连接循环，与回调链共用缓冲区与响应编码
+ * <tr><td>2024-12-01 <td>1.15    <td>antaresz    <td>chunked编码由协议版本决定，HTTP/1.1的Connection: close也分块
+ * <tr><td>2024-12-01 <td>1.16    <td>antaresz    <td>握手在handshake_timeout内未完成时关闭连接，不再无限占用连接数
+ * <tr><td>2024-12-01 <td>1.17    <td>antaresz    <td>流式响应写完才归还准入的在途名额，逐页查询计入max_inflight
+ * <tr><td>2024-12-01 <td>1.18    <td>antaresz    <td>缓冲区满时回收chunk框架，chunked请求只按解码后的大小受限
+ * <tr><td>2024-12-01 <td>1.19    <td>antaresz    <td>无法得知核心数时不绑定io线程
  * </table>
  */
-#include <boost/log/trivial.hpp>
 #include <boost/bind/bind.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
+#ifdef HOMETOWN_COROUTINES
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <tuple>
+#endif
 #include <nlohmann/json.hpp> 
 #include <assert.h>
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <pthread.h>
 #include <iostream>
+#include <thread>
 #include "httpsServer.hpp"
 #include "logger.hpp"
 
+namespace {
+const std::size_t INITIAL_BUFFER_SIZE = 4096;       //连接接收缓冲区初始大小
+const std::string_view LAST_CHUNK = "0\r\n\r\n";
+const std::string_view CHUNK_END = "\r\n";
+
+using reuse_port_option = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+/**
+ * @brief 将当前线程绑定到指定核心，失败时仅记录日志
+ * 
+ * hardware_concurrency在无法得知核心数时返回0，此时不绑定。
+ * 
+ * @param cpu 
+ */
+void pinThread(std::size_t cpu) {
+    unsigned int cpus = std::thread::hardware_concurrency();
+    cpu_set_t set;
+
+    if (cpus == 0) {
+        LOG_WARNING("Unknown number of cpus, io thread " + std::to_string(cpu) + " is not pinned");
+        return;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu % cpus, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        LOG_WARNING("Failed to pin io thread to cpu " + std::to_string(cpu));
+    }
+}
+
+std::uint64_t microsecondsSince(std::chrono::steady_clock::time_point start) {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+/**
+ * @brief 回调绑定到连接的strand，asio为它申请的内存取自连接的handlerMemory
+ * 
+ * @tparam Connection 
+ * @tparam Handler 
+ * @param conn 
+ * @param handler 
+ * @return auto 
+ */
+template <typename Connection, typename Handler>
+auto bindToConnection(Connection& conn, Handler&& handler) {
+    return boost::asio::bind_executor(conn.strand, allocHandler<std::decay_t<Handler>>(conn.handler_memory, std::forward<Handler>(handler)));
+}
+
+/**
+ * @brief 请求结束(写完或出错)时记录一次路由延迟
+ * 
+ * @tparam Connection 
+ * @param conn 
+ */
+template <typename Connection>
+void recordLatency(Connection& conn) {
+    if (conn.latency) {
+        conn.latency->record(microsecondsSince(conn.started));
+        conn.latency = nullptr;
+    }
+}
+
+/**
+ * @brief 解析错误对应的响应
+ * 
+ * @param status 
+ * @return httpResponse 
+ */
+httpResponse errorResponse(int status) {
+    switch (status) {
+    case 413:
+    case 431:
+    case 501:
+    case 505:
+        return httpResponse(status);
+    default:
+        return httpResponse(400);
+    }
+}
+
+/**
+ * @brief 路由未匹配或认证未通过时的响应
+ * 
+ * @param status 404/405/401
+ * @return httpResponse 
+ */
+httpResponse rejection(int status) {
+    httpResponse response(status);
+
+    if (status == 401) {
+        response.addHeader("WWW-Authenticate", "Bearer");
+    }
+    return response;
+}
+
+#ifdef HOMETOWN_COROUTINES
+using opResult = std::tuple<boost::system::error_code, std::size_t>;
+
+/**
+ * @brief 协程中发起连接上的异步操作，结果以(ec, 字节数)返回而不抛出异常
+ * 
+ * 完成回调与回调链一样经bindToConnection绑定到strand并从handlerMemory分配。
+ * asio默认的分配每个线程只缓存一块，读、写与从其他线程投递回strand交替时会被挤掉而重新申请。
+ * 
+ * @tparam Connection 
+ * @tparam Start void(handler)，以handler发起操作
+ * @param conn 
+ * @param start 
+ * @return httpsServer::task<opResult> 
+ */
+template <typename Connection, typename Start>
+httpsServer::task<opResult> connectionOp(Connection& conn, Start start) {
+    return boost::asio::async_initiate<const boost::asio::use_awaitable_t<httpsServer::executor>&, void(opResult)>(
+        [&conn, start = std::move(start)](auto handler) mutable {
+            start(bindToConnection(conn, [handler = std::move(handler)](boost::system::error_code ec, std::size_t length = 0) mutable {
+                handler(opResult(ec, length));
+            }));
+        }, httpsServer::use_task);
+}
+
+/**
+ * @brief 协程handler抛出异常时的响应
+ * 
+ * @param error 
+ * @return httpResponse 
+ */
+httpResponse handlerFailed(std::exception_ptr error) {
+    try {
+        std::rethrow_exception(error);
+    } catch (const std::exception& e) {
+        LOG_ERROR(std::string("Coroutine handler failed: ") + e.what());
+    } catch (...) {
+        LOG_ERROR("Coroutine handler failed");
+    }
+    return httpResponse(500);
+}
+#endif
+
+}
+
+/**
+ * @brief 创建io_context并在其上打开、绑定、监听acceptor
+ * 
+ * @param concurrency_hint 运行该io_context的线程数
+ * @param port 
+ * @param reuse_port 是否允许多个acceptor绑定同一端口
+ */
+httpsServer::ioWorker::ioWorker(int concurrency_hint, unsigned short port, bool reuse_port)
+    : io_context(concurrency_hint), acceptor(io_context) {
+    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address::from_string("0.0.0.0"), port);
+
+    // reuse_address / reuse_port 必须在 bind 之前设置
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(boost::asio::socket_base::reuse_address(true));
+    if (reuse_port) {
+        acceptor.set_option(reuse_port_option(true));
+    }
+    acceptor.bind(endpoint);
+    acceptor.listen();
+}
+
 /**
- * @brief httpServer运行在localhost的23030端口上
+ * @brief httpServer默认运行在localhost的23030端口上
+ * 
+ * shared模式下只有一个ioWorker，由_threads个线程共同run；
+ * perCore模式下每个线程一个ioWorker，内核通过SO_REUSEPORT在各acceptor间分发连接。
  */
-httpsServer::httpsServer()
-    : _io_service(), _acceptor(_io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("0.0.0.0"), PORT)), _ssl_context(boost::asio::ssl::context::tlsv12_server), 
-    _cert_path("/etc/letsencrypt/live/antaresz.cc/fullchain.pem"), _key_path("/etc/letsencrypt/live/antaresz.cc/privkey.pem") {
+httpsServer::httpsServer(const serverOptions& options)
+    : _threads(options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency())), _model(options.model),
+    _keep_alive_timeout(options.keep_alive_timeout), _handshake_timeout(options.handshake_timeout), _max_keep_alive_requests(options.max_keep_alive_requests), _http_limits(options.http_limits),
+    _request_arena_bytes(options.request_arena_bytes),
+#ifdef HOMETOWN_COROUTINES
+    _coroutines(options.coroutines),
+#endif
+    _ssl_context(boost::asio::ssl::context::tls_server),
+    _tls_sessions(options.tls_session_cache_size, options.tls_session_timeout, options.tls_ticket_rotation),
+    _cert_path(options.cert_path), _key_path(options.key_path), _admission(options.admission) {
+    // 允许TLS 1.2与1.3
+    _ssl_context.set_options(boost::asio::ssl::context::default_workarounds | boost::asio::ssl::context::no_sslv2
+        | boost::asio::ssl::context::no_sslv3 | boost::asio::ssl::context::no_tlsv1 | boost::asio::ssl::context::no_tlsv1_1);
     _ssl_context.use_certificate_chain_file(_cert_path);
     _ssl_context.use_private_key_file(_key_path, boost::asio::ssl::context::pem);
-    _acceptor.set_option(boost::asio::socket_base::reuse_address(true));
-    logger::getInstance().log("info", "HTTPS Server initialized.");
+    _tls_sessions.configure(_ssl_context);
+
+    if (_model == ioModel::perCore) {
+        for (std::size_t i = 0; i < _threads; ++i) {
+            _workers.push_back(std::make_unique<ioWorker>(1, options.port, true));
+        }
+    } else {
+        _workers.push_back(std::make_unique<ioWorker>(static_cast<int>(_threads), options.port, false));
+    }
+    _metrics.addCounter("hometown_http_unmatched_requests_total", "Requests answered with 404 or 405", "", _unmatched);
+    _metrics.addCounter("hometown_http_request_bytes_total", "Request bytes read after TLS decryption", "", _bytes_in);
+    _metrics.addCounter("hometown_http_response_bytes_total", "Response bytes written before TLS encryption", "", _bytes_out);
+    _metrics.addGauge("hometown_http_active_connections", "Open client connections", "", _active_connections);
+    _metrics.addHistogram("hometown_tls_handshake_seconds", "TLS handshake time from accept", "resumed=\"false\"", _handshake_full);
+    _metrics.addHistogram("hometown_tls_handshake_seconds", "TLS handshake time from accept", "resumed=\"true\"", _handshake_resumed);
+    _metrics.addCounter("hometown_tls_handshake_failures_total", "Failed TLS handshakes", "", _handshake_failures);
+    _metrics.addCounter("hometown_tls_handshakes_total", "Completed TLS handshakes", "resumed=\"false\"",
+        [this]() { return static_cast<double>(_tls_sessions.fullHandshakes()); });
+    _metrics.addCounter("hometown_tls_handshakes_total", "Completed TLS handshakes", "resumed=\"true\"",
+        [this]() { return static_cast<double>(_tls_sessions.resumedHandshakes()); });
+    _admission.registerMetrics(_metrics);
+#ifdef HOMETOWN_COROUTINES
+    LOG_INFO("HTTPS Server initialized with " + std::to_string(_threads) + " io threads ("
+        + (_model == ioModel::perCore ? "per-core" : "shared") + (_coroutines ? ", coroutine connections" : "") + ").");
+#else
+    LOG_INFO("HTTPS Server initialized with " + std::to_string(_threads) + " io threads ("
+        + (_model == ioModel::perCore ? "per-core" : "shared") + ").");
+#endif
 }
 /**
- * @brief 规定启动逻辑，先accept然后io_service.run
+ * @brief socket与定时器使用io_context的executor，回调都绑定到连接的strand上
+ * 
+ * @param socket 
+ * @param client 
+ * @param io_context socket所属的io_context
+ * @param ssl_context 
+ * @param limits 
+ * @param arena_bytes 
+ * @param active 
+ */
+httpsServer::connection::connection(boost::asio::ip::tcp::socket&& socket, const clientKey& client, boost::asio::io_context& io_context, boost::asio::ssl::context& ssl_context,
+    const httpLimits& limits, std::size_t arena_bytes, gauge& active)
+    : stream(std::move(socket), ssl_context), client(client), strand(boost::asio::make_strand(io_context)), buffer(INITIAL_BUFFER_SIZE), parser(limits),
+    arena(arena_bytes), timer(io_context), active(active)
+#ifdef HOMETOWN_COROUTINES
+    , deadline(std::chrono::steady_clock::time_point::max())
+#endif
+{
+    active.add();
+}
+
+httpsServer::connection::~connection() {
+    active.sub();
+}
+
+/**
+ * @brief 规定启动逻辑，先accept然后在所有io线程上io_context.run
  * 
  */
 void httpsServer::start() {
-    boost::asio::signal_set signals(_io_service, SIGINT, SIGTERM);
+    boost::asio::signal_set signals(_workers.front()->io_context, SIGINT, SIGTERM);
 
-    signals.async_wait([this](boost::system::error_code /*ec*/, int /*signo*/) {
-        _io_service.stop();
-        logger::getInstance().log("info", "Server stopped.");
+    signals.async_wait([this](boost::system::error_code ec, int /*signo*/) {
+        if (!ec) {
+            stop();
+        }
     });
 
-    accept();
-    _io_service.run();
+    for (auto& worker : _workers) {
+        accept(*worker);
+    }
+
+    std::vector<std::thread> threads;
+
+    threads.reserve(_threads);
+    for (std::size_t i = 0; i < _threads; ++i) {
+        auto& worker = _model == ioModel::perCore ? *_workers[i] : *_workers.front();
+
+        threads.emplace_back([this, &worker, i]() {
+            if (_model == ioModel::perCore) {
+                pinThread(i);
+            }
+            worker.io_context.run();
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void httpsServer::stop() {
+    for (auto& worker : _workers) {
+        worker->io_context.stop();
+    }
+    LOG_INFO("Server stopped.");
 }
+
 /**
- * @brief 设置_routes表的(path,handler)对
+ * @brief 请求在调用方线程上解析与分发，异步handler完成前阻塞等待
  * 
+ * 协程handler在调用方线程上临时的io_context里运行到完成。流式响应逐块拉取，按chunked编码拼进结果。
+ * 
+ * @param method 
  * @param path 
+ * @param body 
+ * @param headers 
+ * @return std::string 
+ */
+std::string httpsServer::simulateRequest(const std::string& method, const std::string& path, const std::string& body, const std::string& headers) {
+    std::string raw = method + " " + path + " HTTP/1.1\r\nHost: localhost\r\n" + headers
+        + "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    httpParser parser(_http_limits);
+
+    if (parser.parse(&raw[0], raw.size()) != httpParser::status::complete) {
+        return errorResponse(parser.errorStatus()).toString(false);
+    }
+
+    // 响应可能引用arena上的数据，arena须比响应活得久
+    requestArena arena(_request_arena_bytes);
+    std::promise<httpResponse> result;
+    auto future = result.get_future();
+    histogram* latency = nullptr;       // 不经过网络，不计入路由延迟
+
+    parser.request().memory = &arena;
+#ifdef HOMETOWN_COROUTINES
+    boost::asio::io_context io(1);
+    executor strand = boost::asio::make_strand(io);
+
+    dispatchRequest(parser.request(), [&result](httpResponse&& response) {
+        result.set_value(std::move(response));
+    }, latency, &strand);
+    io.run();
+#else
+    dispatchRequest(parser.request(), [&result](httpResponse&& response) {
+        result.set_value(std::move(response));
+    }, latency, nullptr);
+#endif
+
+    httpResponse response = future.get();
+    std::string out = response.toString(parser.request().keep_alive);
+
+    while (response.streaming()) {
+        std::promise<bool> ready;
+        std::string chunk;
+
+        response.source()([&ready, &chunk](bool ok, std::string_view data) {
+            chunk.assign(data);
+            ready.set_value(ok);
+        });
+        if (!ready.get_future().get()) {
+            break;
+        }
+        if (chunk.empty()) {
+            out.append(LAST_CHUNK);
+            break;
+        }
+
+        char header[24];
+
+        out.append(httpResponse::chunkHeader(chunk.size(), header)).append(chunk).append(CHUNK_END);
+    }
+    return out;
+}
+/**
+ * @brief 设置路由，同步handler包装为立即完成的异步handler
+ * 
+ * @param method 
+ * @param pattern 
  * @param handler 
+ * @param authenticated 
  */
-void httpsServer::setRoute(const std::string& path, std::function<void(const std::string&, std::string&)> handler) {
-    _routes[path] = handler;
-    logger::getInstance().log("debug", "Route set for: " + path);
+void httpsServer::setRoute(const std::string& method, const std::string& pattern, routeHandler handler, bool authenticated) {
+    setAsyncRoute(method, pattern, [handler = std::move(handler)](const httpRequest& request, responder done) {
+        httpResponse response(200, request.memory);
+
+        handler(request, response);
+        done(std::move(response));
+    }, authenticated);
+}
+/**
+ * @brief 设置异步路由
+ * 
+ * @param method 
+ * @param pattern 
+ * @param handler 
+ * @param authenticated 
+ */
+void httpsServer::setAsyncRoute(const std::string& method, const std::string& pattern, asyncRouteHandler handler, bool authenticated) {
+    route entry{};
+
+    entry.handler = std::move(handler);
+    entry.authenticated = authenticated;
+    addRoute(method, pattern, std::move(entry));
+}
+
+#ifdef HOMETOWN_COROUTINES
+void httpsServer::setCoroutineRoute(const std::string& method, const std::string& pattern, coroutineHandler handler, bool authenticated) {
+    route entry{};
+
+    entry.coroutine = std::move(handler);
+    entry.authenticated = authenticated;
+    addRoute(method, pattern, std::move(entry));
+}
+#endif
+
+void httpsServer::addRoute(const std::string& method, const std::string& pattern, route entry) {
+    _route_latency.push_back(std::make_unique<histogram>());
+    _metrics.addHistogram("hometown_http_request_duration_seconds", "Time from request parsed to response written",
+        metricsRegistry::label("route", method + " " + pattern), *_route_latency.back());
+    _router.add(method, pattern, static_cast<std::uint32_t>(_routes.size()));
+    entry.latency = _route_latency.back().get();
+    _routes.push_back(std::move(entry));
+    LOG_DEBUG("Route set for: " + method + " " + pattern);
+}
+
+void httpsServer::setAuthenticator(authenticator auth) {
+    _authenticator = std::move(auth);
 }
 
 /**
- * @brief accept逻辑，先创建一个socket，异步接受连接
+ * @brief accept逻辑，异步接受连接
+ * 
+ * 每个连接的回调都绑定到它自己的strand上，shared模式下保证同一连接的回调不会在多个线程上并发执行；
+ * perCore模式下io_context只由一个线程运行，strand不会发生争用。
+ * strand不作为socket的executor：any_io_executor装不下strand，每次异步操作复制executor都会分配内存，
+ * 绑定到回调上则保持具体类型，不需要分配。操作本身的内存取自连接的handlerMemory。
+ * 准入控制不通过的连接在握手之前直接关闭，不分配连接状态。
+ * 开启协程连接时，握手及之后的整个连接交给serve。
  * 
+ * @param worker 
  */
-void httpsServer::accept() {
-    // 创建一个新的 TCP socket
-    auto tcp_socket = std::make_shared<boost::asio::ip::tcp::socket>(_io_service);
+void httpsServer::accept(ioWorker& worker) {
+    auto on_accept = [this, &worker](boost::system::error_code ec, boost::asio::ip::tcp::socket tcp_socket) {
+        if (!ec) {
+            boost::system::error_code ignored;
+            auto peer = tcp_socket.remote_endpoint(ec);
 
-    // 开始异步接受连接
-    _acceptor.async_accept(*tcp_socket,
-        [this, tcp_socket](boost::system::error_code ec) {
-            if (!ec) {
-                // 将 TCP socket 封装到 SSL stream 中
-                auto ssl_socket = std::make_shared<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>(std::move(*tcp_socket), _ssl_context);
-
-                // 开始 SSL 握手
-                ssl_socket->async_handshake(boost::asio::ssl::stream_base::server,
-                    [this, ssl_socket](const boost::system::error_code& ec) {
-                        if (!ec) {
-                            logger::getInstance().log("info", "Accepted a new connection.") ;
-                            handleRequest(ssl_socket);
-                        } else {
-                            std::string msg = "Handshake failed: " + ec.message();
-
-                            logger::getInstance().log("error", msg) ;
-                        }
-                    });
-            } else {
-                std::string msg = "Handshake failed: " + ec.message();
+            if (ec) {
+                // 对端在accept之后立即断开
+                tcp_socket.close(ignored);
+                accept(worker);
+                return;
+            }
 
-                logger::getInstance().log("error", msg) ;
+            clientKey client = admissionControl::keyOf(peer.address());
+
+            if (_admission.admitConnection(client, static_cast<std::size_t>(std::max<std::int64_t>(0, _active_connections.value())))
+                != admissionVerdict::admitted) {
+                LOG_DEBUG("Connection from " + peer.address().to_string() + " rejected by admission control.");
+                tcp_socket.close(ignored);
+                accept(worker);
+                return;
             }
+            // keep-alive连接上的响应是一次次小写入，Nagle会让它们等待客户端的延迟ACK
+            tcp_socket.set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+            // 将 TCP socket 封装到 SSL stream 中
+            auto conn = std::make_shared<connection>(std::move(tcp_socket), client, worker.io_context, _ssl_context, _http_limits, _request_arena_bytes, _active_connections);
+            auto accepted_at = std::chrono::steady_clock::now();
 
-            // 准备接受下一个连接
-            accept();
-        });
+#ifdef HOMETOWN_COROUTINES
+            if (_coroutines) {
+                boost::asio::co_spawn(conn->strand, serve(conn, accepted_at), boost::asio::detached);
+                accept(worker);
+                return;
+            }
+#endif
+            // 握手超时：客户端连上后不发送或只发一半ClientHello时，到期关闭底层socket，握手以错误结束
+            conn->timer.expires_after(_handshake_timeout);
+            conn->timer.async_wait(bindToConnection(*conn, [conn](boost::system::error_code /*ec*/) {
+                if (conn->timer.expiry() <= std::chrono::steady_clock::now()) {
+                    boost::system::error_code ignored;
+
+                    conn->stream.lowest_layer().close(ignored);
+                }
+            }));
+            // 开始 SSL 握手
+            conn->stream.async_handshake(boost::asio::ssl::stream_base::server, bindToConnection(*conn,
+                [this, conn, accepted_at](const boost::system::error_code& ec) {
+                    conn->timer.expires_at(std::chrono::steady_clock::time_point::max());
+                    if (!ec) {
+                        _tls_sessions.recordHandshake(conn->stream.native_handle());
+                        (SSL_session_reused(conn->stream.native_handle()) ? _handshake_resumed : _handshake_full).record(microsecondsSince(accepted_at));
+                        LOG_DEBUG("Accepted a new connection.");
+                        handleRequest(conn);
+                    } else {
+                        std::string msg = "Handshake failed: " + ec.message();
+
+                        _handshake_failures.add();
+                        LOG_ERROR(msg);
+                    }
+                }));
+        } else {
+            std::string msg = "Accept failed: " + ec.message();
+
+            LOG_ERROR(msg);
+        }
+
+        // 准备接受下一个连接
+        accept(worker);
+    };
+
+    worker.acceptor.async_accept(worker.io_context, on_accept);
 }
 /**
- * @brief 请求头处理
+ * @brief 请求处理
  * 
- * @param socket 
+ * 先尝试解析缓冲区中已有的数据(可能是pipelining的下一个请求)，不完整时才读socket。
+ * 
+ * @param conn 
  */
-void httpsServer::handleRequest(std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> socket) {
-    auto buffer = std::make_shared<boost::asio::streambuf>();
+void httpsServer::handleRequest(std::shared_ptr<connection> conn) {
+    switch (conn->parser.parse(conn->buffer.data() + conn->begin, conn->end - conn->begin)) {
+    case httpParser::status::complete:
+        conn->keep_alive = conn->parser.request().keep_alive && ++conn->served < _max_keep_alive_requests;
+        conn->parser.request().memory = &conn->arena;
+        processRequest(conn);
+        break;
+    case httpParser::status::error:
+        LOG_ERROR("Malformed request, status " + std::to_string(conn->parser.errorStatus()));
+        conn->keep_alive = false;
+        sendResponse(conn, errorResponse(conn->parser.errorStatus()));
+        break;
+    case httpParser::status::incomplete:
+        readRequest(conn);
+        break;
+    }
+}
 
-    // 异步读取请求头，直到找到 "\r\n\r\n"
-    boost::asio::async_read_until(*socket, *buffer, "\r\n\r\n",
-        [this, socket, buffer](boost::system::error_code ec, std::size_t bytes_transferred) {
-            if (!ec) {
-                std::string msg_display(boost::asio::buffers_begin(buffer->data()), boost::asio::buffers_end(buffer->data()));
-                logger::getInstance().log("debug", "Raw request: " + msg_display);
-                // 将请求头数据转换为字符串
-                std::string raw_data(boost::asio::buffers_begin(buffer->data()), boost::asio::buffers_begin(buffer->data()) + bytes_transferred);
-                // 消费已读取的数据
-                buffer->consume(bytes_transferred);
-
-                // 解析请求头
-                std::istringstream request_stream(raw_data);
-                std::string method, path, http_version;
-                request_stream >> method >> path >> http_version;
-                
-                // 消费掉遗留的\r\n
-                request_stream.get();
-                request_stream.get();
-
-                // 查找 Content-Length
-                std::string header;
-                std::size_t content_length = 0;
-
-                while (std::getline(request_stream, header)) {
-                    std::string header_lower = header;
-                    std::transform(header_lower.begin(), header_lower.end(), header_lower.begin(), ::tolower);
-
-                    // 去除 \r 字符
-                    if (!header.empty() && header.back() == '\r') {
-                        header.pop_back();
-                        assert(header.back() != '\r');
-                    }
-                    if (header.empty()) {
-                        break;  // 如果遇到空行，说明请求头结束
-                    }
+/**
+ * @brief 缓冲区尾部没有空间时，先把当前请求搬到缓冲区开头，再回收已解析的chunk框架，仍不够再扩容
+ * 
+ * 最大不超过解析器限制所需的大小。解析器只保存相对请求起点的偏移量，搬移不影响解析状态。
+ */
+bool httpsServer::reserveSpace(connection& conn) {
+    if (conn.end == conn.buffer.size()) {
+        if (conn.begin > 0) {
+            std::memmove(conn.buffer.data(), conn.buffer.data() + conn.begin, conn.end - conn.begin);
+            conn.end -= conn.begin;
+            conn.begin = 0;
+        }
+        conn.end -= conn.parser.compact(conn.buffer.data(), conn.end);
+        if (conn.end == conn.buffer.size()) {
+            if (conn.buffer.size() >= conn.parser.maxRequestBytes()) {
+                return false;
+            }
+            conn.buffer.resize(std::min(conn.buffer.size() * 2, conn.parser.maxRequestBytes()));
+        }
+    }
+    return true;
+}
 
-                    if (header_lower.find("content-length:") != std::string::npos) {
-                        try {
-                            content_length = std::stoul(header.substr(16));
-                            logger::getInstance().log("debug", "Parsed Content-Length: " + std::to_string(content_length));         //log不支持流操作符，因此需要将content_length转换为字符串
-                        } catch (const std::exception& e) {
-                            logger::getInstance().log("error", "Invalid Content-Length: " + std::string(e.what()));
-                            sendResponse(socket, "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n");
-                            return;
-                        }
-                    }
-                }
-                std::size_t buffer_size = buffer->size();
-                bool received_body = buffer_size >= content_length ? true : false;                                           //>0代表收到了下一个包的部分，=0代表刚好收到
-                
-                if (received_body) {
-                    // 读取请求体数据
-                    std::string body(
-                        boost::asio::buffers_begin(buffer->data()),
-                        boost::asio::buffers_begin(buffer->data()) + buffer->size());
-                    logger::getInstance().log("debug", "RequestBody: " + body);
-                    processRequest(socket, path, body);
-                } else {
-                    // 读取剩余的请求体
-                    readBody(socket, buffer, content_length - buffer->size(), path);
-                }
+/**
+ * @brief 读取更多数据
+ * 
+ * @param conn 
+ */
+void httpsServer::readRequest(std::shared_ptr<connection> conn) {
+    if (!reserveSpace(*conn)) {
+        conn->keep_alive = false;
+        sendResponse(conn, errorResponse(413));
+        return;
+    }
+
+    // 空闲超时：等待数据期间超时则直接关闭底层socket，挂起的读操作以operation_aborted结束
+    conn->timer.expires_after(_keep_alive_timeout);
+    conn->timer.async_wait(bindToConnection(*conn, [conn](boost::system::error_code /*ec*/) {
+        // 到期回调可能已排队但读操作先完成，此时expiry已被重置，不能关闭连接
+        if (conn->timer.expiry() <= std::chrono::steady_clock::now()) {
+            boost::system::error_code ignored;
+
+            conn->stream.lowest_layer().close(ignored);
+        }
+    }));
+
+    conn->stream.async_read_some(boost::asio::buffer(conn->buffer.data() + conn->end, conn->buffer.size() - conn->end),
+        bindToConnection(*conn, [this, conn](boost::system::error_code ec, std::size_t bytes_transferred) {
+            conn->timer.expires_at(std::chrono::steady_clock::time_point::max());
+
+            if (!ec) {
+                _bytes_in.add(bytes_transferred);
+                conn->end += bytes_transferred;
+                handleRequest(conn);
+            } else if (ec == boost::asio::error::eof || ec == boost::asio::ssl::error::stream_truncated || ec == boost::asio::error::operation_aborted) {
+                // 客户端关闭或空闲超时，keep-alive连接的正常结束
+                closeConnection(conn);
             } else {
-                logger::getInstance().log("error", "Error reading headers: " + ec.message());
-                sendResponse(socket, "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n");
+                LOG_ERROR("Error reading request: " + ec.message());
+                closeConnection(conn);
             }
+        }));
+}
+
+/**
+ * @brief 路由匹配
+ * 
+ * handler完成后可能位于数据库线程，先在该线程上把响应移动到连接上，
+ * 再通过dispatch回到连接的strand上发送。
+ * 请求数据在响应发出前一直保留在缓冲区中，httpRequest中的string_view在此期间有效。
+ * 准入控制不通过的请求不进入路由，429保持连接，503随后关闭连接以减少负载。
+ * 
+ * @param conn 
+ */
+void httpsServer::processRequest(std::shared_ptr<connection> conn) {
+    httpRequest& request = conn->parser.request();
+
+    LOG_DEBUG("Request: " + std::string(request.method) + " " + std::string(request.target));
+
+    conn->started = std::chrono::steady_clock::now();
+    conn->latency = nullptr;
+
+    admissionVerdict verdict = _admission.admitRequest(conn->client);
+
+    if (verdict != admissionVerdict::admitted) {
+        int status = verdict == admissionVerdict::clientRate ? 429 : 503;
+
+        conn->keep_alive = conn->keep_alive && status == 429;
+        sendResponse(conn, std::move(httpResponse(status).addHeader("Retry-After", "1")));
+        return;
+    }
+    // 处理期间连接由pending持有，done只捕获裸指针，放得进std::function的内部缓冲区而不必分配
+    conn->pending = conn;
+    dispatchRequest(request, [this, raw = conn.get()](httpResponse&& response) {
+        // 流式响应的数据源还要逐页查询，写完才算处理结束
+        if (response.streaming()) {
+            raw->streaming_slot = true;
+        } else {
+            _admission.finishRequest();
+        }
+        // 请求处理期间连接上没有其他操作，可以在done所在的线程上写入
+        raw->response.emplace(std::move(response));
+        boost::asio::dispatch(bindToConnection(*raw, [this, raw]() {
+            writeResponse(std::move(raw->pending));
+        }));
+    }, conn->latency, &conn->strand);
+}
+
+const httpsServer::route* httpsServer::findRoute(httpRequest& request, int& status, histogram*& latency) {
+    std::uint32_t route_id = 0;
+
+    latency = nullptr;
+    switch (_router.match(request, route_id)) {
+    case router::result::notFound:
+        _unmatched.add();
+        status = 404;
+        return nullptr;
+    case router::result::methodNotAllowed:
+        _unmatched.add();
+        status = 405;
+        return nullptr;
+    case router::result::matched:
+        break;
+    }
+
+    const route& entry = _routes[route_id];
+
+    latency = entry.latency;
+    if (entry.authenticated && !(_authenticator && _authenticator(request))) {
+        status = 401;
+        return nullptr;
+    }
+    return &entry;
+}
+
+void httpsServer::dispatchRequest(httpRequest& request, responder done, histogram*& latency, [[maybe_unused]] const executor* strand) {
+    int status = 0;
+    const route* entry = findRoute(request, status, latency);
+
+    if (!entry) {
+        done(rejection(status));
+        return;
+    }
+#ifdef HOMETOWN_COROUTINES
+    if (entry->coroutine) {
+        boost::asio::co_spawn(*strand, entry->coroutine(request), [done = std::move(done)](std::exception_ptr error, httpResponse response) {
+            done(error ? handlerFailed(error) : std::move(response));
         });
+        return;
+    }
+#endif
+    entry->handler(request, std::move(done));
+}
+
+void httpsServer::sendResponse(std::shared_ptr<connection> conn, httpResponse&& response) {
+    conn->response.emplace(std::move(response));
+    writeResponse(conn);
 }
 
 /**
- * @brief 读取请求体，当请求头和请求体分开发送时才会触发
+ * @brief 把状态行、头部与body作为多个缓冲区一次写出
  * 
- * @param socket 
- * @param buffer 
- * @param bytes_to_read 剩余要读取的字节数
- * @param path 
+ * 流式响应先写头部，再逐块拉取body。HTTP/1.0不支持chunked，
+ * 此时body原样写出并以关闭连接结束。
+ * 
+ * @param conn 
  */
-void httpsServer::readBody(std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> socket, std::shared_ptr<boost::asio::streambuf> buffer, std::size_t bytes_to_read, const std::string& path) {
-    logger::getInstance().log("debug", "Reading body, bytes to read: " + std::to_string(bytes_to_read));
+void httpsServer::writeResponse(std::shared_ptr<connection> conn) {
+    bufferList buffers;
+    bool finished = headerBuffers(*conn, buffers);
 
-    // 异步读取剩余请求体
-    boost::asio::async_read(*socket, buffer->prepare(bytes_to_read), boost::asio::transfer_exactly(bytes_to_read),
-        [this, socket, buffer, path](boost::system::error_code ec, std::size_t length) {
-            if (!ec) {
-                buffer->commit(length);  // 提交读取的数据
+    writeBuffers(conn, buffers, finished);
+}
+
+bool httpsServer::headerBuffers(connection& conn, bufferList& buffers) {
+    httpResponse& response = *conn.response;
+    std::string_view parts[httpResponse::MAX_PARTS];
 
-                // 从缓冲区提取完整的请求体
-                std::istream body_stream(buffer.get());
-                std::string body((std::istreambuf_iterator<char>(body_stream)), std::istreambuf_iterator<char>());
+    // 分块与否取决于协议版本，与是否保持连接无关：HTTP/1.1的Connection: close仍然要求chunked
+    conn.chunked = response.streaming() && conn.parser.request().version != "HTTP/1.0";
+    if (response.streaming() && !conn.chunked) {
+        conn.keep_alive = false;
+    }
 
-                logger::getInstance().log("debug", "Received body (from async_read): " + body);
+    std::size_t count = response.headerParts(conn.keep_alive, conn.chunked, parts);
 
-                // 处理请求并发送响应
-                processRequest(socket, path, body);
+    LOG_DEBUG("Sending response: " + std::string(parts[0].substr(0, parts[0].size() - 2)));
+    for (std::size_t i = 0; i < count; ++i) {
+        buffers[i] = boost::asio::buffer(parts[i].data(), parts[i].size());
+    }
+    return !response.streaming();
+}
+
+void httpsServer::pullChunk(std::shared_ptr<connection> conn) {
+    connection* raw = conn.get();
+
+    // 与processRequest相同，数据源产生下一块期间连接由pending持有
+    raw->pending = std::move(conn);
+    raw->response->source()([this, raw](bool ok, std::string_view chunk) {
+        boost::asio::dispatch(bindToConnection(*raw, [this, raw, ok, chunk]() {
+            writeChunk(std::move(raw->pending), ok, chunk);
+        }));
+    });
+}
+
+void httpsServer::writeChunk(std::shared_ptr<connection> conn, bool ok, std::string_view chunk) {
+    bufferList buffers;
+    bool finished = false;
+
+    if (chunkBuffers(*conn, ok, chunk, buffers, finished) == 0) {
+        finishResponse(conn);
+    } else {
+        writeBuffers(conn, buffers, finished);
+    }
+}
+
+/**
+ * @brief chunk为空时写出结束块
+ * 
+ * 数据源出错时响应已无法更正，直接关闭连接，客户端据缺少结束块得知body不完整。
+ */
+std::size_t httpsServer::chunkBuffers(connection& conn, bool ok, std::string_view chunk, bufferList& buffers, bool& finished) {
+    if (!ok) {
+        LOG_ERROR("Streaming response aborted by its source");
+        conn.keep_alive = false;
+        return 0;
+    }
+    if (!conn.chunked) {
+        // 以关闭连接界定结尾的body不加分块长度
+        if (chunk.empty()) {
+            return 0;
+        }
+        buffers[0] = boost::asio::buffer(chunk.data(), chunk.size());
+        finished = false;
+        return 1;
+    }
+    if (chunk.empty()) {
+        buffers[0] = boost::asio::buffer(LAST_CHUNK.data(), LAST_CHUNK.size());
+        finished = true;
+        return 1;
+    }
+
+    std::string_view header = httpResponse::chunkHeader(chunk.size(), conn.chunk_header);
+
+    buffers[0] = boost::asio::buffer(header.data(), header.size());
+    buffers[1] = boost::asio::buffer(chunk.data(), chunk.size());
+    buffers[2] = boost::asio::buffer(CHUNK_END.data(), CHUNK_END.size());
+    finished = false;
+    return 3;
+}
+
+/**
+ * @brief 未用到的缓冲区长度为0，写操作会跳过
+ * 
+ * TLS流每次写入前会把小缓冲区合并到栈上再交给SSL_write，头部与较小的body仍在同一个TLS记录中发出。
+ * 
+ * @param conn 
+ * @param buffers 
+ * @param finished 
+ */
+void httpsServer::writeBuffers(std::shared_ptr<connection> conn, const bufferList& buffers, bool finished) {
+    boost::asio::async_write(conn->stream, buffers,
+        bindToConnection(*conn, [this, conn, finished](boost::system::error_code ec, std::size_t length) {
+            if (ec) {
+                LOG_ERROR("Error sending response: " + ec.message());
+                releaseStreamSlot(*conn);
+                recordLatency(*conn);
+                return;
+            }
+            _bytes_out.add(length);
+            if (finished) {
+                finishResponse(conn);
             } else {
-                logger::getInstance().log("error", "Error reading body: " + ec.message());
-                sendResponse(socket, "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n");
+                pullChunk(conn);
             }
-        });
+        }));
 }
 
 /**
- * @brief 路由匹配
+ * @brief 响应结束，keep-alive时继续读取同一连接上的下一个请求
  * 
- * @param socket 
- * @param path 
- * @param body 
+ * 响应可能引用请求arena上的数据，先销毁响应再reset arena。
+ * 
+ * @param conn 
  */
-void httpsServer::processRequest(std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> socket, const std::string& path, const std::string& body) {
-    std::string response;
-
-    if (_routes.find(path) != _routes.end()) {
-        _routes[path](body, response);
+void httpsServer::finishResponse(std::shared_ptr<connection> conn) {
+    releaseStreamSlot(*conn);
+    recordLatency(*conn);
+    LOG_DEBUG("Response sent successfully.");
+    conn->response.reset();
+    conn->arena.reset();
+    if (conn->keep_alive) {
+        // 丢弃已处理的请求，继续处理缓冲区中剩余的数据
+        conn->begin += conn->parser.consumed();
+        if (conn->begin == conn->end) {
+            conn->begin = conn->end = 0;
+        }
+        conn->parser.reset();
+        handleRequest(conn);
     } else {
-        response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        closeConnection(conn);
+    }
+}
+
+void httpsServer::releaseStreamSlot(connection& conn) {
+    if (conn.streaming_slot) {
+        conn.streaming_slot = false;
+        _admission.finishRequest();
     }
-    //这里要注意如果路由对应的处理函数没有设置response的情况。
-    sendResponse(socket, response);
 }
 
 /**
- * @brief 发送请求
+ * @brief 先进行TLS shutdown再关闭socket
  * 
- * @param socket 
- * @param response 
+ * @param conn 
  */
-void httpsServer::sendResponse(std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> socket, const std::string& response) {
-    logger::getInstance().log("debug", "Sending response: " + response);
+void httpsServer::closeConnection(std::shared_ptr<connection> conn) {
+    if (!conn->stream.lowest_layer().is_open()) {
+        return;
+    }
+    conn->stream.async_shutdown(bindToConnection(*conn, [conn](boost::system::error_code ec) {
+        if (ec && ec != boost::asio::error::eof && ec != boost::asio::ssl::error::stream_truncated) {
+            LOG_WARNING("Error shutting down SSL: " + ec.message());
+        }
+        boost::system::error_code ignored;
 
-    boost::asio::async_write(*socket, boost::asio::buffer(response),
-        [socket](boost::system::error_code ec, std::size_t /*length*/) {
-            if (!ec) {
-                logger::getInstance().log("info", "Response sent successfully."); 
-                socket->async_shutdown([socket](boost::system::error_code ec) {
-                    if (!ec) {
-                        socket->lowest_layer().close();
-                    } else {
-                        logger::getInstance().log("warning", "Error shutting down SSL: " + ec.message());
+        conn->stream.lowest_layer().close(ignored);
+    }));
+}
+
+#ifdef HOMETOWN_COROUTINES
+/**
+ * @brief 与回调链相同的步骤写成一个循环：解析/读取、准入、路由、写出、keep-alive
+ * 
+ * 异步handler与流式数据源仍是回调形式，回调只捕获裸指针，回到strand后wake协程；
+ * 连接此时由协程帧持有，不需要pending。写出失败时与回调链一样不做TLS shutdown，直接丢弃连接。
+ * 
+ * @param conn 
+ * @param accepted_at 
+ */
+httpsServer::task<void> httpsServer::serve(std::shared_ptr<connection> conn, std::chrono::steady_clock::time_point accepted_at) {
+    connection& c = *conn;
+    connection* raw = conn.get();
+    boost::system::error_code ec;
+    bool graceful = true;
+
+    // watch在握手期间就开始计时，到期关闭socket使握手以错误结束
+    c.deadline = accepted_at + _handshake_timeout;
+    boost::asio::co_spawn(c.strand, watch(conn), boost::asio::detached);
+    std::tie(ec, std::ignore) = co_await connectionOp(c, [&c](auto handler) {
+        c.stream.async_handshake(boost::asio::ssl::stream_base::server, std::move(handler));
+    });
+    if (ec) {
+        c.deadline = std::chrono::steady_clock::time_point::min();
+        c.timer.cancel();
+        _handshake_failures.add();
+        LOG_ERROR("Handshake failed: " + ec.message());
+        co_return;
+    }
+    c.deadline = std::chrono::steady_clock::time_point::max();
+    _tls_sessions.recordHandshake(c.stream.native_handle());
+    (SSL_session_reused(c.stream.native_handle()) ? _handshake_resumed : _handshake_full).record(microsecondsSince(accepted_at));
+    LOG_DEBUG("Accepted a new connection.");
+
+    for (;;) {
+        switch (c.parser.parse(c.buffer.data() + c.begin, c.end - c.begin)) {
+        case httpParser::status::incomplete:
+            if (reserveSpace(c)) {
+                c.deadline = std::chrono::steady_clock::now() + _keep_alive_timeout;
+
+                std::size_t bytes_transferred = 0;
+
+                std::tie(ec, bytes_transferred) = co_await connectionOp(c, [&c](auto handler) {
+                    c.stream.async_read_some(boost::asio::buffer(c.buffer.data() + c.end, c.buffer.size() - c.end), std::move(handler));
+                });
+
+                c.deadline = std::chrono::steady_clock::time_point::max();
+                if (ec) {
+                    if (ec != boost::asio::error::eof && ec != boost::asio::ssl::error::stream_truncated && ec != boost::asio::error::operation_aborted) {
+                        LOG_ERROR("Error reading request: " + ec.message());
                     }
+                    break;
+                }
+                _bytes_in.add(bytes_transferred);
+                c.end += bytes_transferred;
+                continue;
+            }
+            c.keep_alive = false;
+            c.response.emplace(errorResponse(413));
+            break;
+        case httpParser::status::error:
+            LOG_ERROR("Malformed request, status " + std::to_string(c.parser.errorStatus()));
+            c.keep_alive = false;
+            c.response.emplace(errorResponse(c.parser.errorStatus()));
+            break;
+        case httpParser::status::complete: {
+            httpRequest& request = c.parser.request();
+
+            c.keep_alive = request.keep_alive && ++c.served < _max_keep_alive_requests;
+            request.memory = &c.arena;
+            LOG_DEBUG("Request: " + std::string(request.method) + " " + std::string(request.target));
+            c.started = std::chrono::steady_clock::now();
+            c.latency = nullptr;
+
+            admissionVerdict verdict = _admission.admitRequest(c.client);
+
+            if (verdict != admissionVerdict::admitted) {
+                int status = verdict == admissionVerdict::clientRate ? 429 : 503;
+
+                c.keep_alive = c.keep_alive && status == 429;
+                c.response.emplace(std::move(httpResponse(status).addHeader("Retry-After", "1")));
+                break;
+            }
+
+            int status = 0;
+            const route* entry = findRoute(request, status, c.latency);
+
+            if (!entry) {
+                c.response.emplace(rejection(status));
+            } else if (entry->coroutine) {
+                try {
+                    c.response.emplace(co_await entry->coroutine(request));
+                } catch (...) {
+                    c.response.emplace(handlerFailed(std::current_exception()));
+                }
+            } else {
+                c.woken = false;
+                entry->handler(request, [raw](httpResponse&& response) {
+                    raw->response.emplace(std::move(response));
+                    boost::asio::dispatch(bindToConnection(*raw, [raw]() {
+                        wake(*raw);
+                    }));
                 });
+                if (!c.woken) {
+                    co_await suspend(c);
+                }
+            }
+            if (c.response->streaming()) {
+                c.streaming_slot = true;
             } else {
-                logger::getInstance().log("error", "Error sending response: " + ec.message());
+                _admission.finishRequest();
+            }
+            break;
+        }
+        }
+        if (!c.response) {
+            // 读取结束：客户端关闭、空闲超时或读出错
+            break;
+        }
+
+        bufferList buffers;
+        bool finished = headerBuffers(c, buffers);
+        bool written = true;
+
+        for (;;) {
+            std::size_t length = 0;
+
+            std::tie(ec, length) = co_await connectionOp(c, [&c, &buffers](auto handler) {
+                boost::asio::async_write(c.stream, buffers, std::move(handler));
+            });
+
+            if (ec) {
+                LOG_ERROR("Error sending response: " + ec.message());
+                written = false;
+                break;
+            }
+            _bytes_out.add(length);
+            if (finished) {
+                break;
+            }
+            c.woken = false;
+            c.response->source()([raw](bool ok, std::string_view chunk) {
+                boost::asio::dispatch(bindToConnection(*raw, [raw, ok, chunk]() {
+                    raw->chunk_ok = ok;
+                    raw->chunk = chunk;
+                    wake(*raw);
+                }));
+            });
+            if (!c.woken) {
+                co_await suspend(c);
+            }
+            buffers = bufferList();
+            if (chunkBuffers(c, c.chunk_ok, c.chunk, buffers, finished) == 0) {
+                break;
             }
+        }
+
+        releaseStreamSlot(c);
+        recordLatency(c);
+        if (!written) {
+            graceful = false;
+            break;
+        }
+        LOG_DEBUG("Response sent successfully.");
+        c.response.reset();
+        c.arena.reset();
+        if (!c.keep_alive) {
+            break;
+        }
+        c.begin += c.parser.consumed();
+        if (c.begin == c.end) {
+            c.begin = c.end = 0;
+        }
+        c.parser.reset();
+    }
+
+    c.deadline = std::chrono::steady_clock::time_point::min();
+    c.timer.cancel();
+    if (graceful && c.stream.lowest_layer().is_open()) {
+        std::tie(ec, std::ignore) = co_await connectionOp(c, [&c](auto handler) {
+            c.stream.async_shutdown(std::move(handler));
         });
-}
\ No newline at end of file
+        if (ec && ec != boost::asio::error::eof && ec != boost::asio::ssl::error::stream_truncated) {
+            LOG_WARNING("Error shutting down SSL: " + ec.message());
+        }
+        c.stream.lowest_layer().close(ec);
+    }
+}
+
+httpsServer::task<void> httpsServer::suspend(connection& conn) {
+    return boost::asio::async_initiate<const boost::asio::use_awaitable_t<executor>&, void()>([&conn](auto handler) {
+        conn.suspended.emplace(std::move(handler));
+    }, use_task);
+}
+
+void httpsServer::wake(connection& conn) {
+    conn.woken = true;
+    if (conn.suspended) {
+        auto handler = std::move(*conn.suspended);
+
+        conn.suspended.reset();
+        handler();
+    }
+}
+
+httpsServer::task<void> httpsServer::watch(std::shared_ptr<connection> conn) {
+    connection& c = *conn;
+    boost::system::error_code ec;
+
+    while (c.deadline != std::chrono::steady_clock::time_point::min()) {
+        auto now = std::chrono::steady_clock::now();
+
+        if (c.deadline <= now) {
+            c.stream.lowest_layer().close(ec);
+            co_return;
+        }
+        c.timer.expires_at(c.deadline == std::chrono::steady_clock::time_point::max() ? now + _keep_alive_timeout : c.deadline);
+        co_await connectionOp(c, [&c](auto handler) {
+            c.timer.async_wait(std::move(handler));
+        });
+    }
+}
+#endif
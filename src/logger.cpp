@@ -1,72 +1,349 @@
 /**
  * @file log.cpp
  * @author antaresz (antaresz1026@gmail.com)
- * @brief log的初始化
- * @version 1.0
+ * @brief 异步日志实现
+ * @version 2.1
  * @date 2024-10-15
- * 
+ *
  * @copyright Copyright (c) 2024 antaresz
- * 
+ *
  * @par 修改日志:
  * <table>
  * <tr><th>Date       <th>Version <th>Author <th>Description
  * <tr><td>2024-10-15 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-17 <td>2.0     <td>antaresz    <td>异步日志：每线程无锁环形缓冲+后台写线程，批量fsync
+ * <tr><td>2024-11-21 <td>2.1     <td>antaresz    <td>队列深度
  * </table>
  */
-#include <boost/log/core.hpp>
-#include <boost/log/expressions.hpp>
-#include <boost/log/utility/setup/file.hpp>
-#include <boost/log/utility/setup/console.hpp>
-#include <boost/log/sources/logger.hpp>
-#include <boost/log/utility/setup/common_attributes.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <unistd.h>
 #include "logger.hpp"
 
-bool logger::initialized = false;
-
-void logger::log(const std::string& level, const std::string& message) {
-    auto log = [](const std::string& lvl, const std::string& msg) {
-        if (lvl == "info") {
-            BOOST_LOG_TRIVIAL(info) << msg;
-        } else if (lvl == "warning") {
-            BOOST_LOG_TRIVIAL(warning) << msg;
-        } else if (lvl == "error") {
-            BOOST_LOG_TRIVIAL(error) << msg;
-        } else if (lvl == "debug") {
-            BOOST_LOG_TRIVIAL(debug) << msg;
-        } else {
-            BOOST_LOG_TRIVIAL(error) << "Unknown log level " << msg;
+namespace {
+constexpr std::size_t RING_CAPACITY = 4096;                                 //每个线程缓冲的日志条数，须为2的幂
+constexpr std::size_t MAX_BATCH = 512;                                      //每轮从单个缓冲区最多取出的条数
+constexpr std::size_t ROTATION_SIZE = 10 * 1024 * 1024;                     //单个日志文件10MB后轮转
+constexpr auto IDLE_WAIT = std::chrono::milliseconds(5);                    //没有日志时写线程的休眠时间
+constexpr auto SYNC_INTERVAL = std::chrono::seconds(1);                     //两次fsync的最小间隔
+const char* const LOG_DIR = "../logs";
+
+const char* levelName(logLevel level) {
+    switch (level) {
+    case logLevel::debug:   return "debug";
+    case logLevel::info:    return "info";
+    case logLevel::warning: return "warning";
+    case logLevel::error:   return "error";
+    }
+    return "unknown";
+}
+}
+
+/**
+ * @brief 单生产者单消费者环形缓冲区
+ *
+ * 生产者是写日志的线程，消费者是后台写线程；两端各自缓存对方的下标，
+ * 只有缓存的下标表明已满/已空时才读取对方的原子变量。
+ */
+class logger::ringBuffer {
+public:
+    explicit ringBuffer(std::size_t capacity) : _slots(capacity), _mask(capacity - 1) {}
+
+    bool push(record&& rec) {
+        std::size_t tail = _tail.load(std::memory_order_relaxed);
+
+        if (tail - _head_cache == _slots.size()) {
+            _head_cache = _head.load(std::memory_order_acquire);
+            if (tail - _head_cache == _slots.size()) {
+                return false;
+            }
+        }
+        _slots[tail & _mask] = std::move(rec);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(record& rec) {
+        std::size_t head = _head.load(std::memory_order_relaxed);
+
+        if (head == _tail_cache) {
+            _tail_cache = _tail.load(std::memory_order_acquire);
+            if (head == _tail_cache) {
+                return false;
+            }
+        }
+        rec = std::move(_slots[head & _mask]);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+    }
+
+    std::size_t size() const {
+        std::size_t head = _head.load(std::memory_order_acquire);
+
+        return _tail.load(std::memory_order_acquire) - head;
+    }
+
+    std::atomic<bool> orphaned{false};                      //所属线程已退出
+
+private:
+    std::vector<record> _slots;
+    std::size_t _mask;
+    alignas(64) std::atomic<std::size_t> _head{0};          //消费者写
+    std::size_t _tail_cache = 0;                            //消费者缓存的_tail
+    alignas(64) std::atomic<std::size_t> _tail{0};          //生产者写
+    std::size_t _head_cache = 0;                            //生产者缓存的_head
+};
+
+/**
+ * @brief 线程退出时标记缓冲区，写线程取空后将其移除
+ *
+ */
+struct logger::threadRing {
+    std::shared_ptr<ringBuffer> ring;
+
+    ~threadRing() {
+        if (ring) {
+            ring->orphaned.store(true, std::memory_order_release);
+        }
+    }
+};
+
+#ifdef NDEBUG
+logger::logger() : _level(static_cast<int>(logLevel::info)) {
+#else
+logger::logger() : _level(static_cast<int>(logLevel::debug)) {
+#endif
+    _last_sync = std::chrono::steady_clock::now();
+    _writer = std::thread([this]() { run(); });
+}
+
+logger::~logger() {
+    {
+        std::lock_guard<std::mutex> lock(_wake_mtx);
+
+        _stopping = true;
+    }
+    _wake.notify_one();
+    if (_writer.joinable()) {
+        _writer.join();
+    }
+    if (_file) {
+        std::fclose(_file);
+    }
+}
+
+std::size_t logger::queued() const {
+    std::lock_guard<std::mutex> lock(_rings_mtx);
+    std::size_t total = 0;
+
+    for (const auto& ring : _rings) {
+        total += ring->size();
+    }
+    return total;
+}
+
+bool logger::parseLevel(const std::string& name, logLevel& level) {
+    for (logLevel candidate : {logLevel::debug, logLevel::info, logLevel::warning, logLevel::error}) {
+        if (name == levelName(candidate)) {
+            level = candidate;
+            return true;
         }
-    };
-    log(level, message);
+    }
+    return false;
+}
+
+/**
+ * @brief 记录一条日志
+ *
+ * 只做一次时间戳读取和一次move，缓冲区满时丢弃；error级别唤醒写线程尽快落盘。
+ *
+ * @param level
+ * @param message
+ */
+void logger::log(logLevel level, std::string message) {
+    if (!localRing().push(record{std::chrono::system_clock::now(), level, std::move(message)})) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (level == logLevel::error) {
+        _wake.notify_one();
+    }
+}
+
+logger::ringBuffer& logger::localRing() {
+    thread_local threadRing local;
+
+    if (!local.ring) {
+        local.ring = std::make_shared<ringBuffer>(RING_CAPACITY);
+
+        std::lock_guard<std::mutex> lock(_rings_mtx);
+
+        _rings.push_back(local.ring);
+    }
+    return *local.ring;
 }
 
-void logger::init() {
-    if (!initialized) {
-        // ---- 控制台输出 ----
-        auto console_sink = boost::log::add_console_log(
-            std::cout,
-            boost::log::keywords::format = "[%TimeStamp%][%Severity%]: %Message%"
-        );
-
-        console_sink->set_filter(
-            boost::log::trivial::severity >= boost::log::trivial::debug
-        );
-
-        // 设置文件输出，确保每次运行创建新的日志文件
-        auto file_sink = boost::log::add_file_log(
-            boost::log::keywords::file_name = "../logs/log_%Y-%m-%d_%N.log",
-            boost::log::keywords::rotation_size = 10 * 1024 * 1024, // 10MB的文件轮转
-            boost::log::keywords::time_based_rotation = boost::log::sinks::file::rotation_at_time_point(0, 0, 0), // 每天轮转
-            boost::log::keywords::format = "[%TimeStamp%][%Severity%]: %Message%\n",
-            boost::log::keywords::auto_flush = true
-        );
-
-        file_sink->set_filter(
-            boost::log::trivial::severity >= boost::log::trivial::info
-        );
-        // 添加常用属性，如时间戳
-        boost::log::add_common_attributes();
-        // 标记为已初始化
-        initialized = true;
-    }
-}
\ No newline at end of file
+void logger::run() {
+    std::unique_lock<std::mutex> lock(_wake_mtx);
+
+    while (!_stopping) {
+        lock.unlock();
+
+        std::size_t written = drain();
+
+        flush(false);
+        lock.lock();
+        if (written == 0 && !_stopping) {
+            _wake.wait_for(lock, IDLE_WAIT);
+        }
+    }
+    lock.unlock();
+    while (drain() > 0) {
+    }
+    flush(true);
+}
+
+/**
+ * @brief 轮流从各线程缓冲区取日志
+ *
+ * 不同线程的日志之间不保证严格按时间排序，同一线程内保持顺序。
+ *
+ * @return std::size_t
+ */
+std::size_t logger::drain() {
+    std::vector<std::shared_ptr<ringBuffer>> rings;
+
+    {
+        std::lock_guard<std::mutex> lock(_rings_mtx);
+
+        rings = _rings;
+    }
+
+    std::size_t written = 0;
+    record rec;
+
+    for (auto& ring : rings) {
+        for (std::size_t i = 0; i < MAX_BATCH && ring->pop(rec); ++i) {
+            write(rec);
+            ++written;
+        }
+    }
+
+    std::uint64_t dropped = _dropped.load(std::memory_order_relaxed);
+
+    if (dropped != _reported_dropped) {
+        write(record{std::chrono::system_clock::now(), logLevel::warning,
+            std::to_string(dropped - _reported_dropped) + " log messages dropped, buffer full"});
+        _reported_dropped = dropped;
+    }
+
+    // 先读orphaned再判空，保证线程退出前写入的日志都已被取走
+    std::lock_guard<std::mutex> lock(_rings_mtx);
+
+    _rings.erase(std::remove_if(_rings.begin(), _rings.end(), [](const std::shared_ptr<ringBuffer>& ring) {
+        return ring->orphaned.load(std::memory_order_acquire) && ring->empty();
+    }), _rings.end());
+    return written;
+}
+
+/**
+ * @brief 格式化为"[时间][级别]: 消息"并追加到本批次
+ *
+ * @param rec
+ */
+void logger::write(const record& rec) {
+    std::time_t seconds = std::chrono::system_clock::to_time_t(rec.time);
+
+    if (seconds != _cached_second) {
+        std::tm tm;
+
+        localtime_r(&seconds, &tm);
+        std::strftime(_cached_time, sizeof(_cached_time), "%Y-%m-%d %H:%M:%S", &tm);
+        _cached_second = seconds;
+        _cached_day = tm.tm_yday;
+    }
+
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(rec.time.time_since_epoch()).count() % 1000000;
+    char prefix[64];
+    int length = std::snprintf(prefix, sizeof(prefix), "[%s.%06lld][%s]: ", _cached_time, static_cast<long long>(micros), levelName(rec.level));
+
+    _console_batch.append(prefix, length);
+    _console_batch += rec.message;
+    _console_batch += '\n';
+
+    if (rec.level < logLevel::info) {
+        return;
+    }
+    // 打开失败时当天不再重试，本批次文件内容直接丢弃
+    if (_cached_day != _file_day || (_file && _file_size + _file_batch.size() >= ROTATION_SIZE)) {
+        flush(true);
+        openFile(rec.time);
+    }
+    _file_batch.append(prefix, length);
+    _file_batch += rec.message;
+    _file_batch += '\n';
+}
+
+/**
+ * @brief 打开../logs/log_YYYY-MM-DD_N.log，以追加方式写入
+ *
+ * @param now
+ */
+void logger::openFile(std::chrono::system_clock::time_point now) {
+    std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+    std::tm tm;
+    char date[16];
+    std::error_code ec;
+
+    if (_file) {
+        std::fclose(_file);
+        _file = nullptr;
+    }
+    localtime_r(&seconds, &tm);
+    std::strftime(date, sizeof(date), "%Y-%m-%d", &tm);
+    std::filesystem::create_directories(LOG_DIR, ec);
+
+    std::string path = std::string(LOG_DIR) + "/log_" + date + "_" + std::to_string(_file_index++) + ".log";
+
+    _file = std::fopen(path.c_str(), "a");
+    _file_day = tm.tm_yday;
+    _file_size = 0;
+    if (!_file) {
+        std::fprintf(stderr, "Could not open log file %s\n", path.c_str());
+        return;
+    }
+    std::fseek(_file, 0, SEEK_END);
+    _file_size = static_cast<std::size_t>(std::ftell(_file));
+}
+
+/**
+ * @brief 写出本批次；文件在距上次fsync超过SYNC_INTERVAL或force_sync时才fsync
+ *
+ * @param force_sync
+ */
+void logger::flush(bool force_sync) {
+    if (!_console_batch.empty()) {
+        std::fwrite(_console_batch.data(), 1, _console_batch.size(), stdout);
+        std::fflush(stdout);
+        _console_batch.clear();
+    }
+    if (!_file_batch.empty() && _file) {
+        std::fwrite(_file_batch.data(), 1, _file_batch.size(), _file);
+        std::fflush(_file);
+        _file_size += _file_batch.size();
+        _unsynced = true;
+    }
+    _file_batch.clear();
+
+    auto now = std::chrono::steady_clock::now();
+
+    if (_unsynced && _file && (force_sync || now - _last_sync >= SYNC_INTERVAL)) {
+        ::fsync(fileno(_file));
+        _last_sync = now;
+        _unsynced = false;
+    }
+}
@@ -8,78 +8,294 @@
  * @copyright Copyright (c) 2024
  * 
  */
-#include <nlohmann/json.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
 #include "httpsServer.hpp"
 #include "userHandler.hpp"
 #include "SQLConnection.hpp"
+#include "mysqlStore.hpp"
+#include "memoryStore.hpp"
 #include "logger.hpp"
 #include "postManage.hpp"
+#include "workerPool.hpp"
+#include "tokenSigner.hpp"
+#include "apiRoutes.hpp"
+#include "metrics.hpp"
+#ifdef HOMETOWN_ASYNC_MYSQL
+#include "asyncMysqlStore.hpp"
+#endif
 
-int main() {
-    SQLConnection sql_connection("localhost", "antaresz", "antaresz.cc", "hometown");
-    httpsServer server;
-    userHandler user_handler(sql_connection);
-    postManage post_manager(sql_connection);
-
-    server.setRoute("/register", [&user_handler](const std::string& request, std::string& response) {
-        // 从 request 提取用户名和密码，调用 userHandler.registerUser 处理注册逻辑。
-        try {
-            auto json_body = nlohmann::json::parse(request);
-            std::string username = json_body["username"];
-            std::string password = json_body["password"];
-            std::string user_type = json_body["user_type"];
-            std::string id_type = json_body["id_type"];
-            std::string id_number = json_body["id_number"];
-            std::string phone = json_body["phone"];
-
-            if(user_handler.registerUser(username, password, user_type, id_type, id_number, phone)) {
-                response = "HTTP/1.1 200 OK\r\n\r\n";
-                response += "Welcome, " + username + "!";
-            } else {
-                response = "HTTP/1.1 200 OK\r\n\r\n";
-                response += "Sorry, something wrong happend when registing.";
-            }
-        } catch (const nlohmann::json::exception& e) {
-            // 构造错误响应
-            response = "HTTP/1.1 400 Bad Request\r\n\r\nInvalid JSON: ";
-            response += e.what();
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[]) {
+    serverOptions options;
+    poolOptions pool_options;
+#ifdef HOMETOWN_ASYNC_MYSQL
+    asyncPoolOptions async_pool_options;
+#endif
+    std::string io_model;
+    long keep_alive_timeout = 0;
+    long handshake_timeout = 0;
+    long acquire_timeout_ms = 0;
+    std::string log_level;
+    long token_ttl = 0;
+    kdfParams kdf_params;
+    std::string kdf;
+    std::uint32_t kdf_cost = 0;
+    std::size_t hash_threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+    std::size_t hash_queue = 0;
+    std::string store_type;
+    std::string db_host;
+    std::string db_user;
+    std::string db_password;
+    std::string db_name;
+    long store_latency_us = 0;
+    std::size_t db_threads = 0;
+    batchOptions batch_options;
+    long batch_delay_us = 0;
+    long queue_target_ms = 0;
+    long queue_interval_ms = 0;
+    po::options_description desc("Hometown options");
+
+    desc.add_options()
+        ("help,h", "show help")
+        ("threads,t", po::value<std::size_t>(&options.threads)->default_value(0), "io threads, 0 = hardware concurrency")
+        ("io-model,m", po::value<std::string>(&io_model)->default_value("shared"), "shared: threads share one io_context; per-core: one io_context per thread with SO_REUSEPORT")
+        ("keep-alive-timeout", po::value<long>(&keep_alive_timeout)->default_value(options.keep_alive_timeout.count()), "idle seconds before a keep-alive connection is closed")
+        ("handshake-timeout", po::value<long>(&handshake_timeout)->default_value(options.handshake_timeout.count()), "seconds a new connection has to complete the TLS handshake")
+        ("max-requests", po::value<std::size_t>(&options.max_keep_alive_requests)->default_value(options.max_keep_alive_requests), "max requests served per connection")
+        ("request-arena-bytes", po::value<std::size_t>(&options.request_arena_bytes)->default_value(options.request_arena_bytes), "initial per-connection arena for request JSON and responses, 0 = allocate from the global heap and free after each response")
+#ifdef HOMETOWN_COROUTINES
+        ("coroutines", po::bool_switch(&options.coroutines), "drive each connection with one coroutine instead of the callback chain")
+#endif
+        ("client-rate", po::value<double>(&options.admission.client_rate)->default_value(options.admission.client_rate), "connections plus requests per second allowed per client IP, 0 = unlimited")
+        ("client-burst", po::value<double>(&options.admission.client_burst)->default_value(options.admission.client_burst), "token bucket size per client IP")
+        ("max-connections", po::value<std::size_t>(&options.admission.max_connections)->default_value(options.admission.max_connections), "open connections above which new ones are closed before the TLS handshake, 0 = unlimited")
+        ("max-inflight", po::value<std::size_t>(&options.admission.max_inflight)->default_value(options.admission.max_inflight), "requests in progress above which new ones get 503, 0 = unlimited")
+        ("queue-target-ms", po::value<long>(&queue_target_ms)->default_value(std::chrono::duration_cast<std::chrono::milliseconds>(options.admission.queue_target).count()), "db queue delay that starts load shedding once exceeded for a whole interval, 0 = disabled")
+        ("queue-interval-ms", po::value<long>(&queue_interval_ms)->default_value(std::chrono::duration_cast<std::chrono::milliseconds>(options.admission.queue_interval).count()), "interval of the queue delay shedding")
+#ifdef HOMETOWN_ASYNC_MYSQL
+        ("store", po::value<std::string>(&store_type)->default_value("mysql"), "mysql, async-mysql (non-blocking connections on an event loop), or memory to run without a database (data is lost on exit)")
+        ("db-async-connections", po::value<std::size_t>(&async_pool_options.connections)->default_value(async_pool_options.connections), "connections of the async-mysql store")
+        ("db-async-threads", po::value<std::size_t>(&async_pool_options.threads)->default_value(async_pool_options.threads), "event loop threads of the async-mysql store")
+        ("db-async-queue", po::value<std::size_t>(&async_pool_options.max_pending)->default_value(async_pool_options.max_pending), "queries waiting for a free async-mysql connection before requests get 503")
+#else
+        ("store", po::value<std::string>(&store_type)->default_value("mysql"), "mysql, or memory to run without a database (data is lost on exit)")
+#endif
+        ("db-host", po::value<std::string>(&db_host)->default_value("localhost"), "MySQL host")
+        ("db-user", po::value<std::string>(&db_user), "MySQL user, defaults to $HOMETOWN_DB_USER")
+        ("db-password", po::value<std::string>(&db_password), "MySQL password, defaults to $HOMETOWN_DB_PASSWORD (preferred: not visible in the process list)")
+        ("db-name", po::value<std::string>(&db_name)->default_value("hometown"), "MySQL database")
+        ("db-threads", po::value<std::size_t>(&db_threads)->default_value(0), "threads running storage calls, 0 = db-pool-max for mysql, hardware concurrency for memory")
+        ("store-latency-us", po::value<long>(&store_latency_us)->default_value(0), "simulated round trip added to every memory store call")
+        ("batch-writes", po::bool_switch(), "group-commit /createPost and /register inserts: one multi-row INSERT per batch")
+        ("batch-max-rows", po::value<std::size_t>(&batch_options.max_rows)->default_value(batch_options.max_rows), "rows that trigger an immediate commit")
+        ("batch-max-delay-us", po::value<long>(&batch_delay_us)->default_value(batch_options.max_delay.count()), "longest time the first row of a batch waits")
+        ("db-pool-min", po::value<std::size_t>(&pool_options.min_size)->default_value(pool_options.min_size), "database connections kept open")
+        ("db-pool-max", po::value<std::size_t>(&pool_options.max_size)->default_value(pool_options.max_size), "upper bound of database connections")
+        ("token-ttl", po::value<long>(&token_ttl)->default_value(24 * 3600), "lifetime of session tokens in seconds")
+        ("log-level", po::value<std::string>(&log_level), "debug, info, warning or error")
+        ("kdf", po::value<std::string>(&kdf)->default_value("scrypt"), "password hashing: scrypt or pbkdf2")
+        ("kdf-cost", po::value<std::uint32_t>(&kdf_cost), "log2(N) for scrypt, iterations for pbkdf2")
+        ("hash-threads", po::value<std::size_t>(&hash_threads)->default_value(hash_threads), "threads dedicated to password hashing")
+        ("hash-queue", po::value<std::size_t>(&hash_queue)->default_value(0), "max pending password hashes, 0 = 16 per hash thread")
+        ("db-acquire-timeout", po::value<long>(&acquire_timeout_ms)->default_value(pool_options.acquire_timeout.count()), "milliseconds to wait for a free database connection");
+
+    po::variables_map vm;
+
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch (const po::error& e) {
+        std::cerr << e.what() << std::endl << desc << std::endl;
+        return 1;
+    }
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    options.keep_alive_timeout = std::chrono::seconds(keep_alive_timeout);
+    options.handshake_timeout = std::chrono::seconds(handshake_timeout);
+    batch_options.max_delay = std::chrono::microseconds(batch_delay_us);
+    pool_options.acquire_timeout = std::chrono::milliseconds(acquire_timeout_ms);
+#ifdef HOMETOWN_ASYNC_MYSQL
+    async_pool_options.acquire_timeout = pool_options.acquire_timeout;
+#endif
+    options.admission.queue_target = std::chrono::milliseconds(queue_target_ms);
+    options.admission.queue_interval = std::chrono::milliseconds(queue_interval_ms);
+    if (!log_level.empty()) {
+        logLevel level;
+
+        if (!logger::parseLevel(log_level, level)) {
+            std::cerr << "Unknown log level: " << log_level << std::endl << desc << std::endl;
+            return 1;
         }
-    });
-    server.setRoute("/createPost", [&post_manager](const std::string& request, std::string& response) {
-        try {
-            auto json_body = nlohmann::json::parse(request);
-            std::string upid = json_body["upid"];
-            std::string title = json_body["title"];
-            std::string content = json_body["content"];
-            std::string post_type = json_body["post_type"];
-
-            if(post_manager.createPost(std::stoi(upid), title, content, post_type)) {
-                response = "HTTP/1.1 200 OK\r\n\r\nPost create successfully";
-            } else {
-                response = "HTTP/1.1 401 Unauthorized\r\n\r\nPost create failed";
-            }
-        } catch (const nlohmann::json::exception& e) {
-            // 构造错误响应
-            response = "HTTP/1.1 400 Bad Request\r\n\r\nInvalid JSON: ";
-            response += e.what();
+        logger::getInstance().setLevel(level);
+    }
+    if (!passwordHasher::parseType(kdf, kdf_params.type)) {
+        std::cerr << "Unknown kdf: " << kdf << std::endl << desc << std::endl;
+        return 1;
+    }
+    if (vm.count("kdf-cost")) {
+        if (kdf_params.type == kdfType::scrypt) {
+            kdf_params.scrypt_log2_n = kdf_cost;
+        } else {
+            kdf_params.pbkdf2_iterations = kdf_cost;
         }
-    });
-    server.setRoute("/login", [&user_handler](const std::string& request, std::string& response) {
-        try {
-            auto json_body = nlohmann::json::parse(request);
-            std::string username = json_body["username"];
-            std::string password = json_body["password"];
-
-            if(user_handler.loginUser(username, password)) {
-                response = "HTTP/1.1 200 OK\r\n\r\nLogin successful";
-            } else {
-                response = "HTTP/1.1 401 Unauthorized\r\n\r\nLogin failed";
-            }
-        } catch (const nlohmann::json::exception& e) {
-            // 构造错误响应
-            response = "HTTP/1.1 400 Bad Request\r\n\r\nInvalid JSON: ";
-            response += e.what();
+    }
+    if (!passwordHasher::validParams(kdf_params)) {
+        std::cerr << "Invalid --kdf-cost for " << kdf << ": " << kdf_cost << std::endl;
+        return 1;
+    }
+#ifdef HOMETOWN_ASYNC_MYSQL
+    if (store_type != "mysql" && store_type != "async-mysql" && store_type != "memory") {
+#else
+    if (store_type != "mysql" && store_type != "memory") {
+#endif
+        std::cerr << "Unknown store: " << store_type << std::endl << desc << std::endl;
+        return 1;
+    }
+    // 数据库账号不设默认值，未在命令行给出时从环境变量读取
+    if (store_type != "memory") {
+        const char* env_user = std::getenv("HOMETOWN_DB_USER");
+        const char* env_password = std::getenv("HOMETOWN_DB_PASSWORD");
+
+        if (!vm.count("db-user") && env_user) {
+            db_user = env_user;
+        }
+        if (!vm.count("db-password") && env_password) {
+            db_password = env_password;
+        }
+        if ((!vm.count("db-user") && !env_user) || (!vm.count("db-password") && !env_password)) {
+            std::cerr << "The " << store_type << " store needs --db-user/--db-password or HOMETOWN_DB_USER/HOMETOWN_DB_PASSWORD" << std::endl;
+            return 1;
         }
+    }
+    if (io_model == "per-core") {
+        options.model = ioModel::perCore;
+    } else if (io_model != "shared") {
+        std::cerr << "Unknown io model: " << io_model << std::endl << desc << std::endl;
+        return 1;
+    }
+
+    // 只有mysql存储才建立连接池，memory存储可以在没有数据库的机器上运行
+    std::unique_ptr<SQLConnection> sql_connection;
+#ifdef HOMETOWN_ASYNC_MYSQL
+    std::unique_ptr<asyncSQLConnection> async_connection;
+#endif
+    std::unique_ptr<dataStore> store;
+
+    if (store_type == "mysql") {
+        sql_connection = std::make_unique<SQLConnection>(db_host, db_user, db_password, db_name, pool_options);
+        store = std::make_unique<mysqlStore>(*sql_connection);
+        // 数据库线程数与连接池容量一致
+        db_threads = db_threads ? db_threads : sql_connection->size();
+#ifdef HOMETOWN_ASYNC_MYSQL
+    } else if (store_type == "async-mysql") {
+        async_connection = std::make_unique<asyncSQLConnection>(db_host, db_user, db_password, db_name, async_pool_options);
+        store = std::make_unique<asyncMysqlStore>(*async_connection);
+        // 热点操作不经过db线程池，剩下的管理操作与列表查询用少量线程即可
+        db_threads = db_threads ? db_threads : std::max(1u, std::thread::hardware_concurrency());
+#endif
+    } else {
+        store = std::make_unique<memoryStore>(std::chrono::microseconds(store_latency_us));
+        db_threads = db_threads ? db_threads : std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    httpsServer server(options);
+    // 排队任务数限制为线程数的若干倍
+    workerPool db_pool("db", db_threads, db_threads * 64);
+    // handler的工作都在db线程池上排队，按它的排队延迟决定是否拒绝请求
+    db_pool.setDelayObserver([&server](std::chrono::steady_clock::duration delay) { server.admission().recordQueueDelay(delay); });
+    // 工作线程全被占住时没有任务开始，改查队首任务已等待的时间
+    server.admission().setQueueAgeProbe([&db_pool]() { return db_pool.oldestWait(); });
+    // 密码哈希占满CPU且耗时长，单独限流，不挤占db线程与io线程
+    workerPool hash_pool("hash", hash_threads, hash_queue ? hash_queue : hash_threads * 16);
+    userHandler user_handler(*store, db_pool, hash_pool, kdf_params);
+    tokenSigner token_signer{std::chrono::seconds(token_ttl)};
+    postManage post_manager(*store);
+    metricsRegistry& metrics = server.metrics();
+
+    // 全文索引与最新帖子列表在接受请求前建好，之后随增删改增量更新
+    if (post_manager.buildIndexes()) {
+        LOG_INFO("Search index and feeds built over " + std::to_string(post_manager.searchIndexStats().documents) + " posts.");
+    } else {
+        LOG_ERROR("Failed to build the search index and feeds, results will be incomplete.");
+    }
+
+    if (vm["batch-writes"].as<bool>()) {
+        user_handler.enableBatching(batch_options);
+        post_manager.enableBatching(batch_options);
+        metrics.addHistogram("hometown_write_batch_rows", "Rows committed per group commit", "table=\"users\"", *user_handler.userBatchSizes(), 1);
+        metrics.addHistogram("hometown_write_batch_rows", "Rows committed per group commit", "table=\"posts\"", *post_manager.postBatchSizes(), 1);
+    }
+
+    // 以下取值函数只在抓取/metrics时调用
+    if (sql_connection) {
+        SQLConnection& pool = *sql_connection;
+
+        metrics.addHistogram("hometown_db_pool_wait_seconds", "Time spent waiting for a pooled MySQL connection", "", pool.waitTime());
+        metrics.addGauge("hometown_db_pool_connections", "Pooled MySQL connections", "state=\"in_use\"",
+            [&pool]() { return static_cast<double>(pool.stats().in_use); });
+        metrics.addGauge("hometown_db_pool_connections", "Pooled MySQL connections", "state=\"idle\"",
+            [&pool]() { return static_cast<double>(pool.stats().idle); });
+        metrics.addGauge("hometown_db_pool_waiters", "Threads waiting for a MySQL connection", "",
+            [&pool]() { return static_cast<double>(pool.stats().waiting); });
+        metrics.addCounter("hometown_db_pool_timeouts_total", "Timed out connection acquisitions", "",
+            [&pool]() { return static_cast<double>(pool.stats().timeouts); });
+    }
+#ifdef HOMETOWN_ASYNC_MYSQL
+    // 与阻塞连接池同名，两种存储在同一面板上对比
+    if (async_connection) {
+        asyncSQLConnection& pool = *async_connection;
+
+        metrics.addHistogram("hometown_db_pool_wait_seconds", "Time spent waiting for a pooled MySQL connection", "", pool.waitTime());
+        metrics.addGauge("hometown_db_pool_connections", "Pooled MySQL connections", "state=\"in_use\"",
+            [&pool]() { asyncPoolStats stats = pool.stats(); return static_cast<double>(stats.connected - stats.idle); });
+        metrics.addGauge("hometown_db_pool_connections", "Pooled MySQL connections", "state=\"idle\"",
+            [&pool]() { return static_cast<double>(pool.stats().idle); });
+        metrics.addGauge("hometown_db_pool_waiters", "Queries waiting for a MySQL connection", "",
+            [&pool]() { return static_cast<double>(pool.stats().pending); });
+        metrics.addCounter("hometown_db_async_queries_total", "Statements run on the async MySQL connections", "result=\"ok\"",
+            [&pool]() { asyncPoolStats stats = pool.stats(); return static_cast<double>(stats.queries - stats.failures); });
+        metrics.addCounter("hometown_db_async_queries_total", "Statements run on the async MySQL connections", "result=\"error\"",
+            [&pool]() { return static_cast<double>(pool.stats().failures); });
+        metrics.addCounter("hometown_db_async_reconnects_total", "Reconnections of async MySQL connections", "",
+            [&pool]() { return static_cast<double>(pool.stats().reconnects); });
+    }
+#endif
+    metrics.addGauge("hometown_worker_pool_pending", "Queued and running tasks", "pool=\"db\"",
+        [&db_pool]() { return static_cast<double>(db_pool.pending()); });
+    metrics.addGauge("hometown_worker_pool_pending", "Queued and running tasks", "pool=\"hash\"",
+        [&hash_pool]() { return static_cast<double>(hash_pool.pending()); });
+    metrics.addCounter("hometown_post_cache_requests_total", "Post cache lookups", "result=\"hit\"",
+        [&post_manager]() { return static_cast<double>(post_manager.postCacheStats().hits); });
+    metrics.addCounter("hometown_post_cache_requests_total", "Post cache lookups", "result=\"miss\"",
+        [&post_manager]() { return static_cast<double>(post_manager.postCacheStats().misses); });
+    metrics.addGauge("hometown_post_cache_bytes", "Bytes held by the post cache", "",
+        [&post_manager]() { return static_cast<double>(post_manager.postCacheStats().bytes); });
+    metrics.addGauge("hometown_search_index_documents", "Posts in the search index", "",
+        [&post_manager]() { return static_cast<double>(post_manager.searchIndexStats().documents); });
+    metrics.addGauge("hometown_search_index_terms", "Distinct terms in the search index", "",
+        [&post_manager]() { return static_cast<double>(post_manager.searchIndexStats().terms); });
+    metrics.addGauge("hometown_search_index_bytes", "Compressed posting list bytes in the search index", "",
+        [&post_manager]() { return static_cast<double>(post_manager.searchIndexStats().posting_bytes); });
+    metrics.addGauge("hometown_feeds", "Materialized latest-post feeds", "kind=\"type\"",
+        [&post_manager]() { return static_cast<double>(post_manager.postFeedStats().type_feeds); });
+    metrics.addGauge("hometown_feeds", "Materialized latest-post feeds", "kind=\"author\"",
+        [&post_manager]() { return static_cast<double>(post_manager.postFeedStats().author_feeds); });
+    metrics.addGauge("hometown_log_queue_depth", "Log records waiting for the writer thread", "",
+        []() { return static_cast<double>(logger::getInstance().queued()); });
+    metrics.addCounter("hometown_log_dropped_total", "Log records dropped because a ring buffer was full", "",
+        []() { return static_cast<double>(logger::getInstance().dropped()); });
+
+    installApiRoutes(server, apiServices{user_handler, post_manager, token_signer, db_pool});
+    server.setRoute("GET", "/metrics", [&metrics](const httpRequest& /*request*/, httpResponse& response) {
+        response.setContentType("text/plain; version=0.0.4").takeBody(metrics.render());
     });
     server.start();
     return 0;
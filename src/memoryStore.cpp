@@ -0,0 +1,253 @@
+/**
+ * @file memoryStore.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief 进程内存储实现
+ * @version 1.3
+ * @date 2024-11-22
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-22 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-23 <td>1.1     <td>antaresz    <td>批量插入只计一次往返
+ * <tr><td>2024-11-26 <td>1.2     <td>antaresz    <td>插入帖子返回新帖子的id
+ * <tr><td>2024-11-29 <td>1.3     <td>antaresz    <td>异步接口，往返延迟由定时器等待
+ * </table>
+ */
+#include <boost/asio/steady_timer.hpp>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "memoryStore.hpp"
+
+namespace {
+/**
+ * @brief 当前本地时间，格式与MySQL的DATETIME相同
+ *
+ * @return std::string
+ */
+std::string currentTimestamp() {
+    std::time_t now = std::time(nullptr);
+    std::tm local{};
+    char buffer[32];
+
+    localtime_r(&now, &local);
+    return std::string(buffer, std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &local));
+}
+}
+
+void memoryStore::roundTrip() const {
+    if (_latency.count() > 0) {
+        std::this_thread::sleep_for(_latency);
+    }
+}
+
+bool memoryStore::addUser(const userRegistration& registration, const std::string& password_hash) {
+    auto [it, inserted] = _users.try_emplace(registration.username);
+
+    if (!inserted) {
+        return false;
+    }
+    it->second.registration = registration;
+    it->second.registration.password.clear();
+    it->second.credentials.id = _next_user_id++;
+    it->second.credentials.password = password_hash;
+    _usernames.emplace(it->second.credentials.id, registration.username);
+    return true;
+}
+
+/**
+ * @brief 定时器到期后在运行io的线程上执行，latency为0时也经由io，回调所在的线程与有延迟时一致
+ */
+template <typename Operation>
+bool memoryStore::afterRoundTrip(Operation operation) {
+    auto timer = std::make_shared<boost::asio::steady_timer>(*_io, _latency);
+
+    timer->async_wait([timer, operation = std::move(operation)](const boost::system::error_code&) mutable { operation(); });
+    return true;
+}
+
+bool memoryStore::storeUser(const userRegistration& registration, const std::string& password_hash) {
+    std::unique_lock<std::shared_mutex> lock(_users_mtx);
+
+    return addUser(registration, password_hash);
+}
+
+bool memoryStore::lookupCredentials(const std::string& username, userCredentials& found) const {
+    std::shared_lock<std::shared_mutex> lock(_users_mtx);
+    auto it = _users.find(username);
+
+    if (it == _users.end()) {
+        return false;
+    }
+    found = it->second.credentials;
+    return true;
+}
+
+bool memoryStore::replacePassword(std::int64_t user_id, const std::string& password_hash) {
+    std::unique_lock<std::shared_mutex> lock(_users_mtx);
+    auto name = _usernames.find(user_id);
+
+    if (name == _usernames.end()) {
+        return false;
+    }
+
+    userCredentials& credentials = _users.at(name->second).credentials;
+
+    credentials.salt.clear();
+    credentials.password = password_hash;
+    return true;
+}
+
+int memoryStore::storePost(int upid, const std::string& title, const std::string& content, const std::string& post_type) {
+    std::string created_at = currentTimestamp();
+    std::unique_lock<std::shared_mutex> lock(_posts_mtx);
+
+    return addPost(upid, title, content, post_type, created_at);
+}
+
+bool memoryStore::lookupPost(int id, Post& found) const {
+    std::shared_lock<std::shared_mutex> lock(_posts_mtx);
+    auto it = _post_times.find(id);
+
+    if (it == _post_times.end()) {
+        return false;
+    }
+    found = _posts.at(postKey(it->second, id));
+    return true;
+}
+
+bool memoryStore::insertUser(const userRegistration& registration, const std::string& password_hash) {
+    roundTrip();
+    return storeUser(registration, password_hash);
+}
+
+bool memoryStore::insertUser(const userRegistration& registration, const std::string& password_hash, doneCallback done) {
+    return afterRoundTrip([this, registration, password_hash, done = std::move(done)]() { done(storeUser(registration, password_hash)); });
+}
+
+void memoryStore::insertUsers(const std::vector<newUser>& users, std::vector<bool>& inserted) {
+    roundTrip();
+
+    std::unique_lock<std::shared_mutex> lock(_users_mtx);
+
+    inserted.resize(users.size());
+    for (std::size_t i = 0; i < users.size(); ++i) {
+        inserted[i] = addUser(users[i].registration, users[i].password_hash);
+    }
+}
+
+bool memoryStore::findCredentials(const std::string& username, userCredentials& found) {
+    roundTrip();
+    return lookupCredentials(username, found);
+}
+
+bool memoryStore::findCredentials(const std::string& username, credentialsCallback done) {
+    return afterRoundTrip([this, username, done = std::move(done)]() {
+        userCredentials found;
+        bool ok = lookupCredentials(username, found);
+
+        done(ok, found);
+    });
+}
+
+bool memoryStore::updatePassword(std::int64_t user_id, const std::string& password_hash) {
+    roundTrip();
+    return replacePassword(user_id, password_hash);
+}
+
+bool memoryStore::updatePassword(std::int64_t user_id, const std::string& password_hash, doneCallback done) {
+    return afterRoundTrip([this, user_id, password_hash, done = std::move(done)]() { done(replacePassword(user_id, password_hash)); });
+}
+
+int memoryStore::addPost(int upid, const std::string& title, const std::string& content, const std::string& post_type, const std::string& created_at) {
+    int id = _next_post_id++;
+
+    _posts.emplace(postKey(created_at, id), Post{id, upid, title, content, post_type, created_at});
+    _post_times.emplace(id, created_at);
+    return id;
+}
+
+int memoryStore::insertPost(int upid, const std::string& title, const std::string& content, const std::string& post_type) {
+    roundTrip();
+    return storePost(upid, title, content, post_type);
+}
+
+bool memoryStore::insertPost(const newPost& post, insertCallback done) {
+    return afterRoundTrip([this, post, done = std::move(done)]() { done(storePost(post.upid, post.title, post.content, post.post_type)); });
+}
+
+void memoryStore::insertPosts(const std::vector<newPost>& posts, std::vector<int>& ids) {
+    roundTrip();
+
+    std::string created_at = currentTimestamp();
+    std::unique_lock<std::shared_mutex> lock(_posts_mtx);
+
+    ids.clear();
+    for (const newPost& post : posts) {
+        ids.push_back(addPost(post.upid, post.title, post.content, post.post_type, created_at));
+    }
+}
+
+bool memoryStore::deletePost(int id) {
+    roundTrip();
+
+    std::unique_lock<std::shared_mutex> lock(_posts_mtx);
+    auto it = _post_times.find(id);
+
+    // 与DELETE一致，删除不存在的行不算失败
+    if (it != _post_times.end()) {
+        _posts.erase(postKey(it->second, id));
+        _post_times.erase(it);
+    }
+    return true;
+}
+
+bool memoryStore::updatePost(int id, const std::string& title, const std::string& content) {
+    roundTrip();
+
+    std::unique_lock<std::shared_mutex> lock(_posts_mtx);
+    auto it = _post_times.find(id);
+
+    if (it != _post_times.end()) {
+        Post& post = _posts.at(postKey(it->second, id));
+
+        post.title = title;
+        post.content = content;
+    }
+    return true;
+}
+
+bool memoryStore::findPost(int id, Post& found) {
+    roundTrip();
+    return lookupPost(id, found);
+}
+
+bool memoryStore::findPost(int id, postCallback done) {
+    return afterRoundTrip([this, id, done = std::move(done)]() {
+        Post post{};
+        bool found = lookupPost(id, post);
+
+        done(found, post);
+    });
+}
+
+/**
+ * @brief 在读锁下直接访问map中的帖子，不复制
+ *
+ * map按倒序排列，upper_bound(after)即第一个严格排在游标之后的帖子。
+ */
+bool memoryStore::scanPosts(const postQuery& query, std::size_t limit, const postVisitor& visit) {
+    roundTrip();
+
+    std::shared_lock<std::shared_mutex> lock(_posts_mtx);
+    auto it = query.after ? _posts.upper_bound(postKey(query.after->created_at, query.after->id)) : _posts.begin();
+
+    for (std::size_t row = 0; row < limit && it != _posts.end(); ++row, ++it) {
+        visit(it->second);
+    }
+    return true;
+}
@@ -0,0 +1,236 @@
+/**
+ * @file metrics.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief 指标与注册表实现
+ * @version 1.1
+ * @date 2024-11-21
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-21 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>countBelow按小于bound计数，导出的le为bound-1
+ * </table>
+ */
+#include <cmath>
+#include <cstdio>
+#include "metrics.hpp"
+
+namespace {
+constexpr unsigned EXPORT_FIRST_BIT = 2;        //导出的第一个桶边界为2^2
+constexpr unsigned EXPORT_STEP_BITS = 2;        //相邻边界相差4倍
+constexpr unsigned EXPORT_LAST_BIT = 32;        //最后一个桶边界为2^32
+constexpr double QUANTILES[] = {0.5, 0.99, 0.999};
+
+/**
+ * @brief 整数按整数输出，其余保留12位有效数字，避免4e-06输出成3.9999999999999998e-06
+ *
+ */
+void appendNumber(std::string& out, double value) {
+    char buffer[32];
+    bool integral = std::fabs(value) < 9007199254740992.0 && value == std::floor(value);
+    int length = std::snprintf(buffer, sizeof(buffer), integral ? "%.0f" : "%.12g", value);
+
+    out.append(buffer, static_cast<std::size_t>(length));
+}
+
+/**
+ * @brief 追加一行"name{labels,extra} value"
+ *
+ */
+void appendSample(std::string& out, const std::string& name, const std::string& labels, const std::string& extra, double value) {
+    out += name;
+    if (!labels.empty() || !extra.empty()) {
+        out += '{';
+        out += labels;
+        if (!labels.empty() && !extra.empty()) {
+            out += ',';
+        }
+        out += extra;
+        out += '}';
+    }
+    out += ' ';
+    appendNumber(out, value);
+    out += '\n';
+}
+}
+
+std::uint64_t counter::value() const {
+    std::uint64_t total = 0;
+
+    for (const cell& c : _cells) {
+        total += c.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+std::int64_t gauge::value() const {
+    std::int64_t total = 0;
+
+    for (const cell& c : _cells) {
+        total += c.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+histogram::histogram() : _shards(new shard[metricsDetail::SHARDS]) {
+    for (std::size_t i = 0; i < metricsDetail::SHARDS; ++i) {
+        for (auto& bucket : _shards[i].buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief 各分片求和，读取期间仍在写入，count与sum之间可能相差几个样本
+ *
+ * @return histogramSnapshot
+ */
+histogramSnapshot histogram::snapshot() const {
+    histogramSnapshot result;
+
+    result.buckets.assign(BUCKETS, 0);
+    for (std::size_t i = 0; i < metricsDetail::SHARDS; ++i) {
+        const shard& s = _shards[i];
+
+        result.sum += s.sum.load(std::memory_order_relaxed);
+        for (std::size_t b = 0; b < BUCKETS; ++b) {
+            result.buckets[b] += s.buckets[b].load(std::memory_order_relaxed);
+        }
+    }
+    for (std::uint64_t n : result.buckets) {
+        result.count += n;
+    }
+    return result;
+}
+
+std::uint64_t histogramSnapshot::percentile(double quantile) const {
+    if (count == 0) {
+        return 0;
+    }
+
+    auto rank = static_cast<std::uint64_t>(std::ceil(quantile * static_cast<double>(count)));
+    std::uint64_t seen = 0;
+
+    rank = rank == 0 ? 1 : rank;
+    for (std::size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return histogram::bucketUpper(i);
+        }
+    }
+    return histogram::bucketUpper(buckets.size() - 1);
+}
+
+std::uint64_t histogramSnapshot::countBelow(std::uint64_t bound) const {
+    std::uint64_t total = 0;
+
+    for (std::size_t i = 0; i < buckets.size() && histogram::bucketUpper(i) <= bound; ++i) {
+        total += buckets[i];
+    }
+    return total;
+}
+
+void metricsRegistry::addCounter(const std::string& name, const std::string& help, const std::string& labels, const counter& metric) {
+    addCounter(name, help, labels, [&metric]() { return static_cast<double>(metric.value()); });
+}
+
+void metricsRegistry::addCounter(const std::string& name, const std::string& help, const std::string& labels, valueFunction value) {
+    _entries.push_back(entry{name, help, labels, metricType::counter, std::move(value)});
+}
+
+void metricsRegistry::addGauge(const std::string& name, const std::string& help, const std::string& labels, const gauge& metric) {
+    addGauge(name, help, labels, [&metric]() { return static_cast<double>(metric.value()); });
+}
+
+void metricsRegistry::addGauge(const std::string& name, const std::string& help, const std::string& labels, valueFunction value) {
+    _entries.push_back(entry{name, help, labels, metricType::gauge, std::move(value)});
+}
+
+void metricsRegistry::addHistogram(const std::string& name, const std::string& help, const std::string& labels, const histogram& metric, double unit) {
+    _entries.push_back(entry{name, help, labels, metricType::histogram, nullptr, &metric, unit});
+}
+
+/**
+ * @brief 同名指标合并为一族，HELP/TYPE只输出一次
+ *
+ * 直方图导出4倍间隔的桶边界(按微秒为4us~72min)，边界都是内部分桶的边界，累计计数是精确的；
+ * 累计的是小于边界的样本，le按Prometheus的"不大于"写作边界减一。分位数另以name_quantile族导出。
+ *
+ * @return std::string
+ */
+std::string metricsRegistry::render() const {
+    std::string out;
+    std::vector<bool> done(_entries.size(), false);
+
+    out.reserve(_entries.size() * 512);
+    for (std::size_t i = 0; i < _entries.size(); ++i) {
+        if (done[i]) {
+            continue;
+        }
+
+        const entry& family = _entries[i];
+        std::string quantiles;
+
+        out += "# HELP " + family.name + " " + family.help + "\n";
+        out += "# TYPE " + family.name + (family.type == metricType::counter ? " counter\n" : family.type == metricType::gauge ? " gauge\n" : " histogram\n");
+        for (std::size_t j = i; j < _entries.size(); ++j) {
+            const entry& e = _entries[j];
+
+            if (done[j] || e.name != family.name) {
+                continue;
+            }
+            done[j] = true;
+            if (e.type != metricType::histogram) {
+                appendSample(out, e.name, e.labels, "", e.value());
+                continue;
+            }
+
+            histogramSnapshot snapshot = e.hist->snapshot();
+
+            for (unsigned bit = EXPORT_FIRST_BIT; bit <= EXPORT_LAST_BIT; bit += EXPORT_STEP_BITS) {
+                std::uint64_t bound = std::uint64_t(1) << bit;
+                std::string le = "le=\"";
+
+                appendNumber(le, static_cast<double>(bound - 1) * e.unit);
+                le += '"';
+                appendSample(out, e.name + "_bucket", e.labels, le, static_cast<double>(snapshot.countBelow(bound)));
+            }
+            appendSample(out, e.name + "_bucket", e.labels, "le=\"+Inf\"", static_cast<double>(snapshot.count));
+            appendSample(out, e.name + "_sum", e.labels, "", static_cast<double>(snapshot.sum) * e.unit);
+            appendSample(out, e.name + "_count", e.labels, "", static_cast<double>(snapshot.count));
+            for (double q : QUANTILES) {
+                std::string extra = "quantile=\"";
+
+                appendNumber(extra, q);
+                extra += '"';
+                appendSample(quantiles, e.name + "_quantile", e.labels, extra, static_cast<double>(snapshot.percentile(q)) * e.unit);
+            }
+        }
+        if (!quantiles.empty()) {
+            out += "# HELP " + family.name + "_quantile " + family.help + " (quantiles since start)\n";
+            out += "# TYPE " + family.name + "_quantile gauge\n";
+            out += quantiles;
+        }
+    }
+    return out;
+}
+
+std::string metricsRegistry::label(const std::string& name, const std::string& value) {
+    std::string out = name + "=\"";
+
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+    return out;
+}
@@ -0,0 +1,465 @@
+/**
+ * @file mysqlStore.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief 基于MySQL连接池的存储实现，SQL自userHandler与postManage迁移而来
+ * @version 1.6
+ * @date 2024-11-22
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-22 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-23 <td>1.1     <td>antaresz    <td>批量插入使用多行INSERT与单个事务
+ * <tr><td>2024-11-26 <td>1.2     <td>antaresz    <td>插入帖子返回新帖子的id
+ * <tr><td>2024-12-01 <td>1.3     <td>antaresz    <td>客户端错误后作废连接，不再归还到池中
+ * <tr><td>2024-12-01 <td>1.4     <td>antaresz    <td>批量插入的id按auto_increment_increment递增
+ * <tr><td>2024-12-01 <td>1.5     <td>antaresz    <td>只有2000-2999的客户端错误码作废连接
+ * <tr><td>2024-12-01 <td>1.6     <td>antaresz    <td>提交时连接断开按结果未知处理，不再逐行重试
+ * </table>
+ */
+#include <cppconn/prepared_statement.h>
+#include <cppconn/resultset.h>
+#include <algorithm>
+#include <utility>
+#include "mysqlStore.hpp"
+#include "logger.hpp"
+
+namespace {
+constexpr std::size_t MAX_CHUNK_ROWS = 64;      //单条INSERT的最大行数
+// CR_MIN_ERROR..CR_MAX_ERROR由客户端库产生；3000以上是新版本服务端的错误码(如锁等待超时3024)
+constexpr int MIN_CLIENT_ERROR = 2000;
+constexpr int MAX_CLIENT_ERROR = 2999;
+
+/**
+ * @brief 客户端库产生的错误(连接断开、协议错乱等)之后连接不能再回到池中
+ *
+ * 服务端返回的错误(如唯一键冲突)不影响连接本身，连接照常归还。
+ *
+ * @param conn
+ * @param e
+ * @return true 连接已作废
+ */
+bool invalidateOnClientError(SQLConnection::lease& conn, const sql::SQLException& e) {
+    if (e.getErrorCode() < MIN_CLIENT_ERROR || e.getErrorCode() > MAX_CLIENT_ERROR) {
+        return false;
+    }
+    conn.invalidate();
+    return true;
+}
+
+/**
+ * @brief 批量插入的结果
+ *
+ */
+enum class batchResult {
+    committed,                  //全部行已提交
+    rolledBack,                 //语句出错已回滚，可以逐行重试
+    unavailable                 //没有拿到连接，重试也只会继续等待；或提交时连接断开，结果未知，重试可能重复插入
+};
+
+/**
+ * @brief 拼接rows行、每行columns个占位符的多行INSERT
+ *
+ * @param head "INSERT INTO t (a, b) VALUES "
+ * @param columns
+ * @param rows
+ * @return std::string
+ */
+std::string multiRowSql(const char* head, std::size_t columns, std::size_t rows) {
+    std::string tuple = "(?";
+    std::string sql = head;
+
+    for (std::size_t i = 1; i < columns; ++i) {
+        tuple += ", ?";
+    }
+    tuple += ')';
+    sql.reserve(sql.size() + rows * (tuple.size() + 2));
+    for (std::size_t i = 0; i < rows; ++i) {
+        if (i > 0) {
+            sql += ", ";
+        }
+        sql += tuple;
+    }
+    return sql;
+}
+
+/**
+ * @brief 同一连接上最近一条INSERT分配的第一个自增id
+ *
+ * @param conn
+ * @return int
+ */
+int lastInsertId(SQLConnection::lease& conn) {
+    std::unique_ptr<sql::ResultSet> res(conn.prepare("SELECT LAST_INSERT_ID()")->executeQuery());
+
+    return res->next() ? res->getInt(1) : 0;
+}
+
+/**
+ * @brief 最近一条多行INSERT分配的第一个自增id与相邻两行id的差
+ *
+ * 行数事先已知的INSERT一次分配全部id，相邻两行相差auto_increment_increment，
+ * 多主复制等配置下它不为1。
+ *
+ * @param conn
+ * @return std::pair<int, int> 第一个id与步长
+ */
+std::pair<int, int> insertedIds(SQLConnection::lease& conn) {
+    std::unique_ptr<sql::ResultSet> res(conn.prepare("SELECT LAST_INSERT_ID(), @@auto_increment_increment")->executeQuery());
+
+    if (!res->next()) {
+        return {0, 1};
+    }
+    return {res->getInt(1), std::max(1, res->getInt(2))};
+}
+
+/**
+ * @brief 在一个事务内插入全部行
+ *
+ * 行数按2的幂拆成若干条INSERT，每个连接上每张表最多缓存log2(MAX_CHUNK_ROWS)+1条预编译语句，
+ * 不会因为批次大小各不相同而冲掉语句缓存。
+ *
+ * @tparam Row
+ * @tparam Bind void(sql::PreparedStatement*, unsigned first_index, const Row&)
+ * @param pool
+ * @param rows
+ * @param head
+ * @param columns
+ * @param bind
+ * @param what 日志中的行类型
+ * @param ids 非空时逐行填入自增id，只在返回committed时有效
+ * @return batchResult
+ */
+template <typename Row, typename Bind>
+batchResult insertInTransaction(SQLConnection& pool, const std::vector<Row>& rows, const char* head, std::size_t columns, Bind bind, const char* what,
+                                std::vector<int>* ids = nullptr) {
+    SQLConnection::lease conn;
+
+    try {
+        conn = pool.getConnection();
+    } catch (sql::SQLException& e) {
+        LOG_ERROR("Batched insert of " + std::to_string(rows.size()) + " " + what + " failed. Error: " + std::string(e.what()));
+        return batchResult::unavailable;
+    }
+    bool committing = false;
+
+    try {
+        conn->setAutoCommit(false);
+        for (std::size_t offset = 0; offset < rows.size();) {
+            std::size_t chunk = MAX_CHUNK_ROWS;
+
+            while (chunk > rows.size() - offset) {
+                chunk >>= 1;
+            }
+
+            sql::PreparedStatement* stmt = conn.prepare(multiRowSql(head, columns, chunk));
+
+            for (std::size_t i = 0; i < chunk; ++i) {
+                bind(stmt, static_cast<unsigned>(i * columns + 1), rows[offset + i]);
+            }
+            stmt->executeUpdate();
+            if (ids) {
+                auto [first, step] = insertedIds(conn);
+
+                ids->resize(rows.size());
+                for (std::size_t i = 0; i < chunk; ++i) {
+                    (*ids)[offset + i] = first + static_cast<int>(i) * step;
+                }
+            }
+            offset += chunk;
+        }
+        committing = true;
+        conn->commit();
+    } catch (sql::SQLException& e) {
+        if (invalidateOnClientError(conn, e)) {
+            if (committing) {
+                // COMMIT可能已在服务端完成，只是应答丢失
+                LOG_ERROR("Batched insert of " + std::to_string(rows.size()) + " " + what + " lost its connection while committing, outcome unknown. Error: "
+                    + std::string(e.what()));
+                return batchResult::unavailable;
+            }
+            // 连接已断开，服务端会回滚未提交的事务
+            LOG_WARNING("Batched insert of " + std::to_string(rows.size()) + " " + what + " failed, retrying row by row. Error: " + std::string(e.what()));
+            return batchResult::rolledBack;
+        }
+        // 服务端返回的错误(包括COMMIT时的死锁等)表示事务没有提交
+        LOG_WARNING("Batched insert of " + std::to_string(rows.size()) + " " + what + " failed, retrying row by row. Error: " + std::string(e.what()));
+        try {
+            conn->rollback();
+            conn->setAutoCommit(true);
+        } catch (sql::SQLException&) {
+            conn.invalidate();
+        }
+        return batchResult::rolledBack;
+    }
+    try {
+        conn->setAutoCommit(true);
+    } catch (sql::SQLException&) {
+        // 已经提交，连接不能按自动提交归还，作废即可
+        conn.invalidate();
+    }
+    return batchResult::committed;
+}
+
+/**
+ * @brief 列表查询的SQL，按[with_content][has_cursor]选择
+ *
+ * 按索引倒序扫描LIMIT行即可结束，不随偏移量增长。
+ */
+const std::string& pageSql(bool with_content, bool has_cursor) {
+    static const std::string SQL[2][2] = {
+        {
+            "SELECT id, upid, title, post_type, created_at FROM posts "
+            "ORDER BY created_at DESC, id DESC LIMIT ?",
+            "SELECT id, upid, title, post_type, created_at FROM posts "
+            "WHERE created_at < ? OR (created_at = ? AND id < ?) "
+            "ORDER BY created_at DESC, id DESC LIMIT ?"
+        },
+        {
+            "SELECT id, upid, title, post_type, created_at, content FROM posts "
+            "ORDER BY created_at DESC, id DESC LIMIT ?",
+            "SELECT id, upid, title, post_type, created_at, content FROM posts "
+            "WHERE created_at < ? OR (created_at = ? AND id < ?) "
+            "ORDER BY created_at DESC, id DESC LIMIT ?"
+        }
+    };
+
+    return SQL[with_content][has_cursor];
+}
+}
+
+bool mysqlStore::insertUser(const userRegistration& registration, const std::string& password_hash) {
+    SQLConnection::lease conn;
+
+    try {
+        conn = _connection_pool.getConnection();
+        sql::PreparedStatement* pstmt = conn.prepare("INSERT INTO users (username, salt, password, user_type, id_type, id_number, phone) VALUES (?, ?, ?, ?, ?, ?, ?)");
+        pstmt->setString(1, registration.username);
+        pstmt->setString(2, "");    // 新格式的盐保存在password中
+        pstmt->setString(3, password_hash);
+        pstmt->setString(4, registration.user_type);
+        pstmt->setString(5, registration.id_type);
+        pstmt->setString(6, registration.id_number);
+        pstmt->setString(7, registration.phone);
+        pstmt->executeUpdate();
+        return true;
+    } catch (sql::SQLException& e) {
+        invalidateOnClientError(conn, e);
+        LOG_ERROR("Registration failed. Error: " + std::string(e.what()));
+        return false;
+    }
+}
+
+bool mysqlStore::findCredentials(const std::string& username, userCredentials& found) {
+    SQLConnection::lease conn;
+
+    try {
+        conn = _connection_pool.getConnection();
+        sql::PreparedStatement* pstmt = conn.prepare("SELECT id, salt, password FROM users WHERE username = ?");
+        pstmt->setString(1, username);
+        std::unique_ptr<sql::ResultSet> res(pstmt->executeQuery());
+
+        if (!res->next()) {  // 没有匹配的用户
+            return false;
+        }
+        found.id = res->getInt64("id");
+        found.salt = res->getString("salt");
+        found.password = res->getString("password");
+        return true;
+    } catch (sql::SQLException& e) {
+        invalidateOnClientError(conn, e);
+        LOG_ERROR("Login failed. Error: " + std::string(e.what()));
+        return false;
+    }
+}
+
+bool mysqlStore::updatePassword(std::int64_t user_id, const std::string& password_hash) {
+    SQLConnection::lease conn;
+
+    try {
+        conn = _connection_pool.getConnection();
+        sql::PreparedStatement* pstmt = conn.prepare("UPDATE users SET salt = ?, password = ? WHERE id = ?");
+        pstmt->setString(1, "");
+        pstmt->setString(2, password_hash);
+        pstmt->setInt64(3, user_id);
+        pstmt->executeUpdate();
+        return true;
+    } catch (sql::SQLException& e) {
+        invalidateOnClientError(conn, e);
+        LOG_WARNING("Password hash upgrade failed. Error: " + std::string(e.what()));
+        return false;
+    }
+}
+
+void mysqlStore::insertUsers(const std::vector<newUser>& users, std::vector<bool>& inserted) {
+    if (users.size() <= 1) {
+        dataStore::insertUsers(users, inserted);
+        return;
+    }
+
+    auto bind = [](sql::PreparedStatement* stmt, unsigned index, const newUser& user) {
+        stmt->setString(index, user.registration.username);
+        stmt->setString(index + 1, "");
+        stmt->setString(index + 2, user.password_hash);
+        stmt->setString(index + 3, user.registration.user_type);
+        stmt->setString(index + 4, user.registration.id_type);
+        stmt->setString(index + 5, user.registration.id_number);
+        stmt->setString(index + 6, user.registration.phone);
+    };
+    batchResult result = insertInTransaction(_connection_pool, users,
+        "INSERT INTO users (username, salt, password, user_type, id_type, id_number, phone) VALUES ", 7, bind, "users");
+
+    if (result == batchResult::rolledBack) {
+        // 通常是批内有重复的用户名，逐行插入使其余用户仍能注册成功
+        dataStore::insertUsers(users, inserted);
+    } else {
+        inserted.assign(users.size(), result == batchResult::committed);
+    }
+}
+
+int mysqlStore::insertPost(int upid, const std::string& title, const std::string& content, const std::string& post_type) {
+    SQLConnection::lease conn;
+
+    try {
+        conn = _connection_pool.getConnection();
+        sql::PreparedStatement* stmt = conn.prepare("INSERT INTO posts (upid, title, content, post_type) VALUES (?, ?, ?, ?)");
+        stmt->setInt(1, upid);
+        stmt->setString(2, title);
+        stmt->setString(3, content);
+        stmt->setString(4, post_type);
+        stmt->executeUpdate();
+        return lastInsertId(conn);
+    } catch (sql::SQLException& e) {
+        invalidateOnClientError(conn, e);
+        LOG_ERROR("Failed to create post: " + std::string(e.what()));
+        return 0;
+    }
+}
+
+void mysqlStore::insertPosts(const std::vector<newPost>& posts, std::vector<int>& ids) {
+    if (posts.size() <= 1) {
+        dataStore::insertPosts(posts, ids);
+        return;
+    }
+
+    auto bind = [](sql::PreparedStatement* stmt, unsigned index, const newPost& post) {
+        stmt->setInt(index, post.upid);
+        stmt->setString(index + 1, post.title);
+        stmt->setString(index + 2, post.content);
+        stmt->setString(index + 3, post.post_type);
+    };
+    batchResult result = insertInTransaction(_connection_pool, posts,
+        "INSERT INTO posts (upid, title, content, post_type) VALUES ", 4, bind, "posts", &ids);
+
+    if (result == batchResult::rolledBack) {
+        dataStore::insertPosts(posts, ids);
+    } else if (result == batchResult::unavailable) {
+        ids.assign(posts.size(), 0);
+    }
+}
+
+bool mysqlStore::deletePost(int id) {
+    SQLConnection::lease conn;
+
+    try {
+        conn = _connection_pool.getConnection();
+        sql::PreparedStatement* stmt = conn.prepare("DELETE FROM posts WHERE id = ?");
+        stmt->setInt(1, id);
+        stmt->executeUpdate();
+        return true;
+    } catch (sql::SQLException& e) {
+        invalidateOnClientError(conn, e);
+        LOG_ERROR("Failed to delete post: " + std::string(e.what()));
+        return false;
+    }
+}
+
+bool mysqlStore::updatePost(int id, const std::string& title, const std::string& content) {
+    SQLConnection::lease conn;
+
+    try {
+        conn = _connection_pool.getConnection();
+        sql::PreparedStatement* stmt = conn.prepare("UPDATE posts SET title = ?, content = ? WHERE id = ?");
+        stmt->setString(1, title);
+        stmt->setString(2, content);
+        stmt->setInt(3, id);
+        stmt->executeUpdate();
+        return true;
+    } catch (sql::SQLException& e) {
+        invalidateOnClientError(conn, e);
+        LOG_ERROR("Failed to update post: " + std::string(e.what()));
+        return false;
+    }
+}
+
+bool mysqlStore::findPost(int id, Post& found) {
+    SQLConnection::lease conn;
+
+    try {
+        conn = _connection_pool.getConnection();
+        sql::PreparedStatement* stmt = conn.prepare("SELECT id, upid, title, post_type, created_at, content FROM posts WHERE id = ?");
+        stmt->setInt(1, id);
+        std::unique_ptr<sql::ResultSet> res(stmt->executeQuery());
+
+        if (!res->next()) {
+            return false;
+        }
+        found = Post{
+            res->getInt(1),
+            res->getInt(2),
+            res->getString(3),
+            res->getString(6),
+            res->getString(4),
+            res->getString(5)
+        };
+        return true;
+    } catch (sql::SQLException& e) {
+        invalidateOnClientError(conn, e);
+        LOG_ERROR("Failed to get post: " + std::string(e.what()));
+        return false;
+    }
+}
+
+/**
+ * @brief 逐行读取ResultSet，同一个Post对象在各行之间复用
+ *
+ * 列顺序为id, upid, title, post_type, created_at[, content]。
+ */
+bool mysqlStore::scanPosts(const postQuery& query, std::size_t limit, const postVisitor& visit) {
+    SQLConnection::lease conn;
+
+    try {
+        conn = _connection_pool.getConnection();
+        sql::PreparedStatement* stmt = conn.prepare(pageSql(query.with_content, query.after.has_value()));
+        unsigned index = 1;
+        Post row{};
+
+        if (query.after) {
+            stmt->setString(index++, query.after->created_at);
+            stmt->setString(index++, query.after->created_at);
+            stmt->setInt(index++, query.after->id);
+        }
+        stmt->setInt(index, static_cast<int>(limit));
+
+        std::unique_ptr<sql::ResultSet> res(stmt->executeQuery());
+
+        while (res->next()) {
+            row.postid = res->getInt(1);
+            row.upid = res->getInt(2);
+            row.title = res->getString(3);
+            row.post_type = res->getString(4);
+            row.created_at = res->getString(5);
+            if (query.with_content) {
+                row.content = res->getString(6);
+            }
+            visit(row);
+        }
+        return true;
+    } catch (sql::SQLException& e) {
+        invalidateOnClientError(conn, e);
+        LOG_ERROR("Failed to list posts: " + std::string(e.what()));
+        return false;
+    }
+}
@@ -0,0 +1,252 @@
+/**
+ * @file passwordHasher.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief passwordHasher类实现
+ * @version 1.1
+ * @date 2024-11-19
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-19 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>validParams限制scrypt的r、p与内存及PBKDF2迭代次数
+ * </table>
+ */
+#include <cryptopp/filters.h>
+#include <cryptopp/hex.h>
+#include <cryptopp/hmac.h>
+#include <cryptopp/misc.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/pwdbased.h>
+#include <cryptopp/scrypt.h>
+#include <cryptopp/sha.h>
+#include <charconv>
+#include "passwordHasher.hpp"
+
+namespace {
+constexpr std::string_view SCRYPT_ID = "$scrypt$";
+constexpr std::string_view PBKDF2_ID = "$pbkdf2-sha256$";
+// 拒绝解析出的过大参数，避免一次校验耗尽内存或长时间占用hash线程
+constexpr std::uint32_t MAX_SCRYPT_LOG2_N = 24;
+constexpr std::uint32_t MAX_SCRYPT_R = 32;
+constexpr std::uint32_t MAX_SCRYPT_P = 16;
+constexpr std::uint64_t MAX_SCRYPT_BYTES = std::uint64_t(1) << 30;     //128*r*N，单次计算最多1GB
+constexpr std::uint32_t MAX_PBKDF2_ITERATIONS = 10000000;
+
+std::string toHex(const std::string& bytes) {
+    static const char HEX[] = "0123456789abcdef";
+    std::string out;
+
+    out.reserve(bytes.size() * 2);
+    for (unsigned char c : bytes) {
+        out += HEX[c >> 4];
+        out += HEX[c & 0xF];
+    }
+    return out;
+}
+
+bool fromHex(std::string_view hex, std::string& bytes) {
+    auto digit = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+
+    if (hex.size() % 2 != 0) {
+        return false;
+    }
+    bytes.resize(hex.size() / 2);
+    for (std::size_t i = 0; i < bytes.size(); ++i) {
+        int high = digit(hex[2 * i]);
+        int low = digit(hex[2 * i + 1]);
+
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        bytes[i] = static_cast<char>(high << 4 | low);
+    }
+    return true;
+}
+
+/**
+ * @brief 解析"name=value"形式的参数
+ *
+ * @param field
+ * @param name
+ * @param value
+ * @return true
+ */
+bool parseParam(std::string_view field, std::string_view name, std::uint32_t& value) {
+    if (field.size() <= name.size() + 1 || field.substr(0, name.size()) != name || field[name.size()] != '=') {
+        return false;
+    }
+    field.remove_prefix(name.size() + 1);
+
+    auto [ptr, ec] = std::from_chars(field.data(), field.data() + field.size(), value);
+
+    return ec == std::errc() && ptr == field.data() + field.size();
+}
+
+/**
+ * @brief 按分隔符切出下一段
+ *
+ * @param text
+ * @param separator
+ * @return std::string_view
+ */
+std::string_view nextToken(std::string_view& text, char separator) {
+    std::size_t pos = text.find(separator);
+    std::string_view token = text.substr(0, pos);
+
+    text.remove_prefix(pos == std::string_view::npos ? text.size() : pos + 1);
+    return token;
+}
+
+bool constantTimeEqual(const std::string& a, const std::string& b) {
+    return a.size() == b.size()
+        && CryptoPP::VerifyBufsEqual(reinterpret_cast<const CryptoPP::byte*>(a.data()), reinterpret_cast<const CryptoPP::byte*>(b.data()), a.size());
+}
+}
+
+passwordHasher::passwordHasher(const kdfParams& params) : _params(params) {}
+
+std::string passwordHasher::hash(std::string_view password) const {
+    CryptoPP::AutoSeededRandomPool rng;
+    std::string salt(SALT_BYTES, '\0');
+
+    rng.GenerateBlock(reinterpret_cast<CryptoPP::byte*>(&salt[0]), salt.size());
+    return encode(_params, salt, derive(_params, password, salt));
+}
+
+/**
+ * @brief 校验密码
+ *
+ * 按存储的算法与参数重新计算，与当前配置无关；旧版哈希校验通过后总是需要升级。
+ */
+bool passwordHasher::verify(std::string_view password, std::string_view stored, std::string_view legacy_salt, bool& needs_rehash) const {
+    needs_rehash = false;
+    if (stored.empty() || stored.front() != '$') {
+        if (!constantTimeEqual(legacyHash(password, legacy_salt), std::string(stored))) {
+            return false;
+        }
+        needs_rehash = true;
+        return true;
+    }
+
+    kdfParams params;
+    std::string salt;
+    std::string derived;
+
+    if (!decode(stored, params, salt, derived)) {
+        return false;
+    }
+    if (!constantTimeEqual(derive(params, password, salt), derived)) {
+        return false;
+    }
+    if (params.type != _params.type) {
+        needs_rehash = true;
+    } else if (params.type == kdfType::scrypt) {
+        needs_rehash = params.scrypt_log2_n != _params.scrypt_log2_n || params.scrypt_r != _params.scrypt_r || params.scrypt_p != _params.scrypt_p;
+    } else {
+        needs_rehash = params.pbkdf2_iterations != _params.pbkdf2_iterations;
+    }
+    return true;
+}
+
+bool passwordHasher::validParams(const kdfParams& params) {
+    if (params.type == kdfType::pbkdf2) {
+        return params.pbkdf2_iterations > 0 && params.pbkdf2_iterations <= MAX_PBKDF2_ITERATIONS;
+    }
+    return params.scrypt_log2_n > 0 && params.scrypt_log2_n <= MAX_SCRYPT_LOG2_N
+        && params.scrypt_r > 0 && params.scrypt_r <= MAX_SCRYPT_R && params.scrypt_p > 0 && params.scrypt_p <= MAX_SCRYPT_P
+        && (std::uint64_t(128) * params.scrypt_r << params.scrypt_log2_n) <= MAX_SCRYPT_BYTES;
+}
+
+bool passwordHasher::parseType(const std::string& name, kdfType& type) {
+    if (name == "scrypt") {
+        type = kdfType::scrypt;
+    } else if (name == "pbkdf2") {
+        type = kdfType::pbkdf2;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string passwordHasher::derive(const kdfParams& params, std::string_view password, const std::string& salt) {
+    std::string derived(HASH_BYTES, '\0');
+    auto* out = reinterpret_cast<CryptoPP::byte*>(&derived[0]);
+    auto* secret = reinterpret_cast<const CryptoPP::byte*>(password.data());
+    auto* salt_bytes = reinterpret_cast<const CryptoPP::byte*>(salt.data());
+
+    if (params.type == kdfType::scrypt) {
+        CryptoPP::Scrypt scrypt;
+
+        scrypt.DeriveKey(out, derived.size(), secret, password.size(), salt_bytes, salt.size(),
+            CryptoPP::word64(1) << params.scrypt_log2_n, params.scrypt_r, params.scrypt_p);
+    } else {
+        CryptoPP::PKCS5_PBKDF2_HMAC<CryptoPP::SHA256> pbkdf2;
+
+        pbkdf2.DeriveKey(out, derived.size(), 0, secret, password.size(), salt_bytes, salt.size(), params.pbkdf2_iterations);
+    }
+    return derived;
+}
+
+std::string passwordHasher::encode(const kdfParams& params, const std::string& salt, const std::string& derived) {
+    std::string encoded;
+
+    if (params.type == kdfType::scrypt) {
+        encoded = std::string(SCRYPT_ID) + "ln=" + std::to_string(params.scrypt_log2_n) + ",r=" + std::to_string(params.scrypt_r)
+            + ",p=" + std::to_string(params.scrypt_p);
+    } else {
+        encoded = std::string(PBKDF2_ID) + "i=" + std::to_string(params.pbkdf2_iterations);
+    }
+    return encoded + "$" + toHex(salt) + "$" + toHex(derived);
+}
+
+bool passwordHasher::decode(std::string_view stored, kdfParams& params, std::string& salt, std::string& derived) {
+    std::string_view rest;
+
+    if (stored.substr(0, SCRYPT_ID.size()) == SCRYPT_ID) {
+        rest = stored.substr(SCRYPT_ID.size());
+
+        std::string_view fields = nextToken(rest, '$');
+
+        params.type = kdfType::scrypt;
+        if (!parseParam(nextToken(fields, ','), "ln", params.scrypt_log2_n) || !parseParam(nextToken(fields, ','), "r", params.scrypt_r)
+            || !parseParam(nextToken(fields, ','), "p", params.scrypt_p) || !fields.empty() || !validParams(params)) {
+            return false;
+        }
+    } else if (stored.substr(0, PBKDF2_ID.size()) == PBKDF2_ID) {
+        rest = stored.substr(PBKDF2_ID.size());
+        params.type = kdfType::pbkdf2;
+        if (!parseParam(nextToken(rest, '$'), "i", params.pbkdf2_iterations) || !validParams(params)) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    return fromHex(nextToken(rest, '$'), salt) && fromHex(rest, derived) && !salt.empty() && derived.size() == HASH_BYTES;
+}
+
+/**
+ * @brief 旧版哈希：以users.salt为密钥的HMAC-SHA256，大写十六进制
+ *
+ * @param password
+ * @param salt
+ * @return std::string
+ */
+std::string passwordHasher::legacyHash(std::string_view password, std::string_view salt) {
+    using namespace CryptoPP;
+
+    std::string digest;
+    HMAC<SHA256> hmac(reinterpret_cast<const byte*>(salt.data()), salt.size());
+
+    StringSource(reinterpret_cast<const byte*>(password.data()), password.size(), true,
+                 new HashFilter(hmac,
+                                new HexEncoder(new StringSink(digest))));
+    return digest;
+}
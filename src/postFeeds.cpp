@@ -0,0 +1,174 @@
+/**
+ * @file postFeeds.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief postFeeds类实现
+ * @version 1.1
+ * @date 2024-11-27
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-27 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>新帖子按id插入，并发创建时列表仍从新到旧
+ * </table>
+ */
+#include <algorithm>
+#include <mutex>
+#include "postFeeds.hpp"
+
+/**
+ * @brief 乱序只发生在并发提交的少数几个帖子之间，通常不挪动或只挪动几格
+ */
+int postFeeds::ring::insert(int post_id) {
+    int evicted = 0;
+
+    if (_size == FEED_LENGTH) {
+        // 已满：先挤掉最旧的一格，环头后移
+        evicted = _ids[_head];
+        if (post_id < evicted) {
+            return post_id;
+        }
+        _head = static_cast<std::uint32_t>((_head + 1) % FEED_LENGTH);
+        --_size;
+    }
+
+    std::size_t i = _size;
+
+    for (; i > 0 && _ids[(_head + i - 1) % FEED_LENGTH] > post_id; --i) {
+        _ids[(_head + i) % FEED_LENGTH] = _ids[(_head + i - 1) % FEED_LENGTH];
+    }
+    _ids[(_head + i) % FEED_LENGTH] = post_id;
+    ++_size;
+    return evicted;
+}
+
+bool postFeeds::ring::pushOldest(int post_id) {
+    if (_size == FEED_LENGTH) {
+        return false;
+    }
+    _head = static_cast<std::uint32_t>((_head + FEED_LENGTH - 1) % FEED_LENGTH);
+    _ids[_head] = post_id;
+    ++_size;
+    return true;
+}
+
+void postFeeds::ring::erase(int post_id) {
+    for (std::size_t i = 0; i < _size; ++i) {
+        if (_ids[(_head + i) % FEED_LENGTH] != post_id) {
+            continue;
+        }
+        for (std::size_t j = i + 1; j < _size; ++j) {
+            _ids[(_head + j - 1) % FEED_LENGTH] = _ids[(_head + j) % FEED_LENGTH];
+        }
+        --_size;
+        return;
+    }
+}
+
+std::size_t postFeeds::ring::copyNewest(std::size_t limit, int* ids) const {
+    std::size_t count = std::min<std::size_t>(limit, _size);
+
+    for (std::size_t i = 0; i < count; ++i) {
+        ids[i] = _ids[(_head + _size - 1 - i) % FEED_LENGTH];
+    }
+    return count;
+}
+
+void postFeeds::append(int post_id, int upid, const std::string& post_type) {
+    std::unique_lock<std::shared_mutex> lock(_mtx);
+    ring& type = _types[post_type];
+    ring& author = _authors[upid];
+    membership entry{&type, &author};
+
+    if (int evicted = type.insert(post_id)) {
+        if (evicted == post_id) {
+            entry.type = nullptr;
+        } else {
+            evict(evicted, &membership::type);
+        }
+    }
+    if (int evicted = author.insert(post_id)) {
+        if (evicted == post_id) {
+            entry.author = nullptr;
+        } else {
+            evict(evicted, &membership::author);
+        }
+    }
+    if (entry.type || entry.author) {
+        _posts[post_id] = entry;
+    }
+}
+
+void postFeeds::appendOlder(int post_id, int upid, const std::string& post_type) {
+    std::unique_lock<std::shared_mutex> lock(_mtx);
+    ring& type = _types[post_type];
+    ring& author = _authors[upid];
+    membership entry;
+
+    if (type.pushOldest(post_id)) {
+        entry.type = &type;
+    }
+    if (author.pushOldest(post_id)) {
+        entry.author = &author;
+    }
+    if (entry.type || entry.author) {
+        _posts[post_id] = entry;
+    }
+}
+
+void postFeeds::evict(int post_id, ring* membership::*slot) {
+    auto it = _posts.find(post_id);
+
+    if (it == _posts.end()) {
+        return;
+    }
+    it->second.*slot = nullptr;
+    if (!it->second.type && !it->second.author) {
+        _posts.erase(it);
+    }
+}
+
+/**
+ * @brief 变空的列表保留，数量以出现过的类型与作者数为上限
+ */
+void postFeeds::remove(int post_id) {
+    std::unique_lock<std::shared_mutex> lock(_mtx);
+    auto it = _posts.find(post_id);
+
+    if (it == _posts.end()) {
+        return;
+    }
+    if (it->second.type) {
+        it->second.type->erase(post_id);
+    }
+    if (it->second.author) {
+        it->second.author->erase(post_id);
+    }
+    _posts.erase(it);
+}
+
+std::size_t postFeeds::byType(const std::string& post_type, std::size_t limit, int* ids) const {
+    std::shared_lock<std::shared_mutex> lock(_mtx);
+    auto it = _types.find(post_type);
+
+    return it == _types.end() ? 0 : it->second.copyNewest(limit, ids);
+}
+
+std::size_t postFeeds::byAuthor(int upid, std::size_t limit, int* ids) const {
+    std::shared_lock<std::shared_mutex> lock(_mtx);
+    auto it = _authors.find(upid);
+
+    return it == _authors.end() ? 0 : it->second.copyNewest(limit, ids);
+}
+
+feedStats postFeeds::stats() const {
+    std::shared_lock<std::shared_mutex> lock(_mtx);
+    feedStats result;
+
+    result.type_feeds = _types.size();
+    result.author_feeds = _authors.size();
+    result.posts = _posts.size();
+    return result;
+}
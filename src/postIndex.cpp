@@ -0,0 +1,562 @@
+/**
+ * @file postIndex.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief postIndex类实现
+ * @version 1.0
+ * @date 2024-11-26
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-26 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <utility>
+#include "postIndex.hpp"
+
+namespace {
+const float BM25_K1 = 1.2f;
+const float BM25_B = 0.75f;
+const std::size_t COMPACT_MIN_DELETED = 64;         //删除的文档少于此数时不压缩
+
+void writeVarint(std::string& out, std::uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+std::uint32_t readVarint(const std::string& in, std::size_t& pos) {
+    std::uint32_t value = static_cast<std::uint8_t>(in[pos++]);
+    int shift = 7;
+
+    if (value < 0x80) {
+        return value;
+    }
+    value &= 0x7f;
+    while (true) {
+        std::uint8_t byte = static_cast<std::uint8_t>(in[pos++]);
+
+        value |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+        shift += 7;
+    }
+}
+
+/**
+ * @brief 解码一个UTF-8字符
+ *
+ * @param text
+ * @param pos 输入为起始位置，输出为下一个字符的位置
+ * @return char32_t 非法序列返回0，只前进一个字节
+ */
+char32_t decodeUtf8(std::string_view text, std::size_t& pos) {
+    std::uint8_t lead = static_cast<std::uint8_t>(text[pos]);
+    std::size_t length;
+    char32_t cp;
+
+    if (lead < 0x80) {
+        ++pos;
+        return lead;
+    }
+    if ((lead & 0xe0) == 0xc0) {
+        length = 2;
+        cp = lead & 0x1f;
+    } else if ((lead & 0xf0) == 0xe0) {
+        length = 3;
+        cp = lead & 0x0f;
+    } else if ((lead & 0xf8) == 0xf0) {
+        length = 4;
+        cp = lead & 0x07;
+    } else {
+        ++pos;
+        return 0;
+    }
+    if (pos + length > text.size()) {
+        ++pos;
+        return 0;
+    }
+    for (std::size_t i = 1; i < length; ++i) {
+        std::uint8_t byte = static_cast<std::uint8_t>(text[pos + i]);
+
+        if ((byte & 0xc0) != 0x80) {
+            ++pos;
+            return 0;
+        }
+        cp = (cp << 6) | (byte & 0x3f);
+    }
+    pos += length;
+    return cp;
+}
+
+bool isCjk(char32_t cp) {
+    return (cp >= 0x3040 && cp <= 0x30ff)           // 平假名、片假名
+        || (cp >= 0x3400 && cp <= 0x4dbf)
+        || (cp >= 0x4e00 && cp <= 0x9fff)
+        || (cp >= 0xac00 && cp <= 0xd7af)           // 谚文音节
+        || (cp >= 0xf900 && cp <= 0xfaff)
+        || (cp >= 0x20000 && cp <= 0x2fa1f);
+}
+
+/**
+ * @brief 非ASCII、非CJK字符中作为分隔符的部分：Latin-1符号、通用标点与符号、CJK标点、全角符号
+ *
+ * @param cp
+ * @return true
+ * @return false
+ */
+bool isSeparator(char32_t cp) {
+    return cp < 0xc0
+        || cp == 0xd7 || cp == 0xf7
+        || (cp >= 0x2000 && cp <= 0x2bff)
+        || (cp >= 0x3000 && cp <= 0x303f)
+        || (cp >= 0xfe30 && cp <= 0xfe4f)
+        || (cp >= 0xff00 && cp <= 0xffef)
+        || (cp >= 0xd800 && cp <= 0xdfff);
+}
+
+/**
+ * @brief 全角字母数字转为ASCII
+ *
+ * @param cp
+ * @return char 不是全角字母数字时返回0
+ */
+char fromFullwidth(char32_t cp) {
+    if ((cp >= 0xff10 && cp <= 0xff19) || (cp >= 0xff21 && cp <= 0xff3a) || (cp >= 0xff41 && cp <= 0xff5a)) {
+        return static_cast<char>(cp - 0xfee0);
+    }
+    return 0;
+}
+
+char lowerAscii(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+bool isAlnumAscii(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+/**
+ * @brief 分词
+ *
+ * @param text
+ * @param terms
+ * @param query 为true时CJK只在单字成段时产生单字，多字时二元词已经蕴含了单字
+ */
+void splitTerms(std::string_view text, std::vector<std::string>& terms, bool query) {
+    std::string word;
+    std::string_view previous;                      //CJK段中上一个字的字节
+    std::size_t run = 0;                            //CJK段的长度
+    std::size_t pos = 0;
+
+    auto endWord = [&]() {
+        if (!word.empty()) {
+            terms.push_back(std::move(word));
+            word.clear();
+        }
+    };
+    auto endRun = [&]() {
+        if (query && run == 1) {
+            terms.emplace_back(previous);
+        }
+        run = 0;
+    };
+
+    while (pos < text.size()) {
+        std::size_t start = pos;
+        char32_t cp = decodeUtf8(text, pos);
+        std::string_view bytes = text.substr(start, pos - start);
+
+        if (cp < 0x80) {
+            endRun();
+            if (isAlnumAscii(static_cast<char>(cp))) {
+                word.push_back(lowerAscii(static_cast<char>(cp)));
+            } else {
+                endWord();
+            }
+        } else if (isCjk(cp)) {
+            endWord();
+            if (run > 0) {
+                std::string bigram;
+
+                bigram.reserve(previous.size() + bytes.size());
+                bigram.append(previous).append(bytes);
+                terms.push_back(std::move(bigram));
+            }
+            if (!query) {
+                terms.emplace_back(bytes);
+            }
+            previous = bytes;
+            ++run;
+        } else if (char ascii = fromFullwidth(cp)) {
+            endRun();
+            word.push_back(lowerAscii(ascii));
+        } else if (isSeparator(cp)) {
+            endRun();
+            endWord();
+        } else {
+            endRun();
+            word.append(bytes);
+        }
+    }
+    endRun();
+    endWord();
+}
+
+/**
+ * @brief 候选结果，better表示a排在b之前
+ *
+ */
+struct candidate {
+    float score;
+    std::uint32_t doc;
+};
+
+bool better(const candidate& a, const candidate& b) {
+    return a.score > b.score || (a.score == b.score && a.doc > b.doc);
+}
+}
+
+/**
+ * @brief 按文档号升序遍历一个倒排表
+ *
+ */
+class postIndex::cursor {
+public:
+    explicit cursor(const postingList& list) : _list(&list) {}
+
+    std::uint32_t count() const { return _list->count; }
+    std::uint32_t doc() const { return _doc; }
+    std::uint32_t frequency() const { return _frequency; }
+
+    /**
+     * @brief 读下一条记录
+     *
+     * @return true
+     * @return false 已读完
+     */
+    bool next() {
+        if (_index >= _list->count) {
+            return false;
+        }
+        _doc += readVarint(_list->bytes, _pos);
+        _frequency = readVarint(_list->bytes, _pos);
+        ++_index;
+        return true;
+    }
+
+    /**
+     * @brief 前进到第一条文档号不小于target的记录，当前记录已满足时不动
+     *
+     * @param target
+     * @return true
+     * @return false 已读完
+     */
+    bool advance(std::uint32_t target) {
+        if (_index > 0 && _doc >= target) {
+            return true;
+        }
+
+        const std::vector<skipEntry>& skips = _list->skips;
+        std::size_t block = _index / BLOCK_POSTINGS;
+
+        // 目标在下一块之前时顺序读即可，多数前进都落在这里
+        if (block + 1 < skips.size() && skips[block + 1].base < target) {
+            // 第b块之前的记录都不大于skips[b].base
+            auto it = std::partition_point(skips.begin() + block + 1, skips.end(),
+                                           [target](const skipEntry& skip) { return skip.base < target; });
+            std::size_t jump = static_cast<std::size_t>(it - skips.begin()) - 1;
+
+            if (jump > block) {
+                _index = static_cast<std::uint32_t>(jump * BLOCK_POSTINGS);
+                _pos = skips[jump].offset;
+                _doc = skips[jump].base;
+            }
+        }
+        while (next()) {
+            if (_doc >= target) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    const postingList* _list;
+    std::size_t _pos = 0;
+    std::uint32_t _index = 0;                       //已读的记录数
+    std::uint32_t _doc = 0;
+    std::uint32_t _frequency = 0;
+};
+
+void postIndex::postingList::append(std::uint32_t doc, std::uint32_t frequency) {
+    if (count % BLOCK_POSTINGS == 0) {
+        skips.push_back({last, static_cast<std::uint32_t>(bytes.size())});
+    }
+    writeVarint(bytes, doc - last);
+    writeVarint(bytes, frequency);
+    last = doc;
+    ++count;
+}
+
+void postIndex::tokenize(std::string_view text, std::vector<std::string>& terms) {
+    splitTerms(text, terms, false);
+}
+
+void postIndex::add(int post_id, std::string_view title, std::string_view content) {
+    std::unique_lock<std::shared_mutex> lock(_mtx);
+
+    removeLocked(post_id);
+    addLocked(post_id, title, content);
+}
+
+bool postIndex::update(int post_id, std::string_view title, std::string_view content) {
+    std::unique_lock<std::shared_mutex> lock(_mtx);
+
+    if (_documents.find(post_id) == _documents.end()) {
+        return false;
+    }
+    removeLocked(post_id);
+    addLocked(post_id, title, content);
+    return true;
+}
+
+/**
+ * @brief 标题中的词按TITLE_WEIGHT次计入，同一文档内的词项合并后追加到各自倒排表尾部
+ *
+ */
+void postIndex::addLocked(int post_id, std::string_view title, std::string_view content) {
+    std::vector<std::pair<std::string_view, std::uint32_t>> weighted;
+    std::uint32_t doc = static_cast<std::uint32_t>(_post_ids.size());
+    std::uint32_t length = 0;
+    std::size_t title_terms;
+
+    _scratch.clear();
+    tokenize(title, _scratch);
+    title_terms = _scratch.size();
+    tokenize(content, _scratch);
+    weighted.reserve(_scratch.size());
+    for (std::size_t i = 0; i < _scratch.size(); ++i) {
+        weighted.emplace_back(_scratch[i], i < title_terms ? TITLE_WEIGHT : 1);
+    }
+    std::sort(weighted.begin(), weighted.end());
+    for (std::size_t i = 0; i < weighted.size();) {
+        std::string_view term = weighted[i].first;
+        std::uint32_t frequency = 0;
+
+        for (; i < weighted.size() && weighted[i].first == term; ++i) {
+            frequency += weighted[i].second;
+        }
+
+        postingList& list = _terms[std::string(term)];
+        std::size_t before = list.bytes.size() + list.skips.size() * sizeof(skipEntry);
+
+        list.append(doc, frequency);
+        _posting_bytes += list.bytes.size() + list.skips.size() * sizeof(skipEntry) - before;
+        length += frequency;
+    }
+    _post_ids.push_back(post_id);
+    _lengths.push_back(length);
+    _live.push_back(true);
+    _documents[post_id] = doc;
+    _total_length += length;
+}
+
+void postIndex::remove(int post_id) {
+    std::unique_lock<std::shared_mutex> lock(_mtx);
+
+    removeLocked(post_id);
+}
+
+void postIndex::removeLocked(int post_id) {
+    auto it = _documents.find(post_id);
+
+    if (it == _documents.end()) {
+        return;
+    }
+    _live[it->second] = false;
+    _total_length -= _lengths[it->second];
+    _documents.erase(it);
+
+    std::size_t deleted = _post_ids.size() - _documents.size();
+
+    if (deleted >= COMPACT_MIN_DELETED && deleted * 4 > _documents.size()) {
+        compact();
+    }
+}
+
+void postIndex::compact() {
+    const std::uint32_t DROPPED = std::numeric_limits<std::uint32_t>::max();
+    std::vector<std::uint32_t> remap(_post_ids.size(), DROPPED);
+    std::vector<int> post_ids;
+    std::vector<std::uint32_t> lengths;
+
+    post_ids.reserve(_documents.size());
+    lengths.reserve(_documents.size());
+    for (std::uint32_t doc = 0; doc < _post_ids.size(); ++doc) {
+        if (_live[doc]) {
+            remap[doc] = static_cast<std::uint32_t>(post_ids.size());
+            _documents[_post_ids[doc]] = remap[doc];
+            post_ids.push_back(_post_ids[doc]);
+            lengths.push_back(_lengths[doc]);
+        }
+    }
+    _posting_bytes = 0;
+    for (auto it = _terms.begin(); it != _terms.end();) {
+        postingList compacted;
+        cursor postings(it->second);
+
+        while (postings.next()) {
+            if (remap[postings.doc()] != DROPPED) {
+                compacted.append(remap[postings.doc()], postings.frequency());
+            }
+        }
+        if (compacted.count == 0) {
+            it = _terms.erase(it);
+            continue;
+        }
+        compacted.bytes.shrink_to_fit();
+        compacted.skips.shrink_to_fit();
+        _posting_bytes += compacted.bytes.size() + compacted.skips.size() * sizeof(skipEntry);
+        it->second = std::move(compacted);
+        ++it;
+    }
+    _post_ids = std::move(post_ids);
+    _lengths = std::move(lengths);
+    _live.assign(_post_ids.size(), true);
+}
+
+/**
+ * @brief 从最短的倒排表出发，其余表用跳表前进到相同文档号；命中的文档按BM25打分，保留在大小为k的堆中
+ *
+ */
+std::size_t postIndex::search(std::string_view query, std::size_t k, std::vector<searchHit>& hits) const {
+    std::vector<std::string> terms;
+    std::vector<cursor> cursors;
+    std::vector<float> idf;
+    std::vector<candidate> heap;
+    std::size_t matched = 0;
+
+    hits.clear();
+    splitTerms(query, terms, true);
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+    if (terms.empty()) {
+        return 0;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(_mtx);
+
+    if (_documents.empty()) {
+        return 0;
+    }
+    cursors.reserve(terms.size());
+    for (const std::string& term : terms) {
+        auto it = _terms.find(term);
+
+        if (it == _terms.end()) {
+            return 0;
+        }
+        cursors.emplace_back(it->second);
+    }
+    std::sort(cursors.begin(), cursors.end(),
+              [](const cursor& a, const cursor& b) { return a.count() < b.count(); });
+
+    float documents = static_cast<float>(_documents.size());
+    float average = std::max(1.0f, static_cast<float>(_total_length) / documents);
+
+    idf.reserve(cursors.size());
+    for (const cursor& postings : cursors) {
+        // 记录数包括已删除的文档，压缩前略微偏大
+        float frequency = std::min(static_cast<float>(postings.count()), documents);
+
+        idf.push_back(std::log(1.0f + (documents - frequency + 0.5f) / (frequency + 0.5f)));
+    }
+    heap.reserve(k + 1);
+
+    cursor& lead = cursors.front();
+
+    if (!lead.next()) {
+        return 0;
+    }
+    std::uint32_t doc = lead.doc();
+    bool exhausted = false;
+
+    while (!exhausted) {
+        bool aligned = true;
+
+        for (std::size_t i = 1; i < cursors.size(); ++i) {
+            if (!cursors[i].advance(doc)) {
+                exhausted = true;
+                break;
+            }
+            if (cursors[i].doc() > doc) {
+                doc = cursors[i].doc();
+                aligned = false;
+                break;
+            }
+        }
+        if (exhausted) {
+            break;
+        }
+        if (!aligned) {
+            if (!lead.advance(doc)) {
+                break;
+            }
+            doc = lead.doc();
+            continue;
+        }
+        if (_live[doc]) {
+            ++matched;
+            if (k > 0) {
+                float norm = BM25_K1 * (1.0f - BM25_B + BM25_B * static_cast<float>(_lengths[doc]) / average);
+                candidate current{0.0f, doc};
+
+                for (std::size_t i = 0; i < cursors.size(); ++i) {
+                    float tf = static_cast<float>(cursors[i].frequency());
+
+                    current.score += idf[i] * tf * (BM25_K1 + 1.0f) / (tf + norm);
+                }
+                // 堆顶是当前保留的最差结果
+                if (heap.size() < k) {
+                    heap.push_back(current);
+                    std::push_heap(heap.begin(), heap.end(), better);
+                } else if (better(current, heap.front())) {
+                    std::pop_heap(heap.begin(), heap.end(), better);
+                    heap.back() = current;
+                    std::push_heap(heap.begin(), heap.end(), better);
+                }
+            }
+        }
+        if (!lead.next()) {
+            break;
+        }
+        doc = lead.doc();
+    }
+    std::sort_heap(heap.begin(), heap.end(), better);
+    hits.reserve(heap.size());
+    for (const candidate& entry : heap) {
+        hits.push_back({_post_ids[entry.doc], entry.score});
+    }
+    return matched;
+}
+
+indexStats postIndex::stats() const {
+    std::shared_lock<std::shared_mutex> lock(_mtx);
+    indexStats result;
+
+    result.documents = _documents.size();
+    result.deleted = _post_ids.size() - _documents.size();
+    result.terms = _terms.size();
+    result.posting_bytes = _posting_bytes;
+    return result;
+}
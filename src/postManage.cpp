@@ -1,126 +1,361 @@
 #include "postManage.hpp"
-#include "logger.hpp"
-#include <cppconn/prepared_statement.h>
+#include <algorithm>
+#include <charconv>
+
+namespace {
+std::size_t pageLimit(const postQuery& query) {
+    return std::min(std::max<std::size_t>(query.limit, 1), postQuery::MAX_LIMIT);
+}
+
+/**
+ * @brief 追加带引号与转义的JSON字符串
+ * 
+ * @param out 
+ * @param value 
+ */
+void appendJsonString(std::string& out, const std::string& value) {
+    static const char HEX[] = "0123456789abcdef";
+
+    out += '"';
+    for (unsigned char c : value) {
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                out += "\\u00";
+                out += HEX[c >> 4];
+                out += HEX[c & 0xF];
+            } else {
+                out += static_cast<char>(c);
+            }
+        }
+    }
+    out += '"';
+}
+
+/**
+ * @brief 追加帖子的JSON对象，列表与单个帖子共用同一格式
+ * 
+ * @param out 
+ * @param post 
+ * @param with_content 
+ */
+void appendPostJson(std::string& out, const Post& post, bool with_content) {
+    out += "{\"id\":";
+    out += std::to_string(post.postid);
+    out += ",\"upid\":";
+    out += std::to_string(post.upid);
+    out += ",\"title\":";
+    appendJsonString(out, post.title);
+    out += ",\"post_type\":";
+    appendJsonString(out, post.post_type);
+    out += ",\"created_at\":";
+    appendJsonString(out, post.created_at);
+    if (with_content) {
+        out += ",\"content\":";
+        appendJsonString(out, post.content);
+    }
+    out += '}';
+}
+}
+
+std::string postCursor::format() const {
+    return created_at + "," + std::to_string(id);
+}
+
+bool postCursor::parse(std::string_view text, postCursor& cursor) {
+    std::size_t comma = text.rfind(',');
+
+    if (comma == std::string_view::npos || comma == 0) {
+        return false;
+    }
+
+    const char* first = text.data() + comma + 1;
+    const char* last = text.data() + text.size();
+    auto [ptr, ec] = std::from_chars(first, last, cursor.id);
+
+    if (ec != std::errc() || ptr != last || first == last) {
+        return false;
+    }
+    cursor.created_at.assign(text.data(), comma);
+    return true;
+}
 
 /**
- * @brief 构造函数，接收连接池的引用
+ * @brief 构造函数，接收存储的引用
  */
-postManage::postManage(SQLConnection& connectionPool) : _connection_pool(connectionPool) {}
+postManage::postManage(dataStore& store, std::size_t cache_bytes) : _store(store), _async(store.async()), _cache(cache_bytes) {}
 
 /**
  * @brief 创建新帖子
  */
 bool postManage::createPost(int upid, const std::string& title, const std::string& content, const std::string& post_type) {
-    auto conn = _connection_pool.getConnection();
-    try {
-        std::shared_ptr<sql::PreparedStatement> stmt(
-            conn->prepareStatement("INSERT INTO posts (upid, title, content, post_type) VALUES (?, ?, ?, ?)")
-        );
-        std::unique_ptr<sql::PreparedStatement> pstmt(
-            conn->prepareStatement("SELECT , password FROM users WHERE username = ?")
-        );
-        stmt->setInt(1, upid);
-        stmt->setString(2, title);
-        stmt->setString(3, content);
-        stmt->setString(4, post_type);
-        stmt->executeUpdate();
-        return true;
-    } catch (sql::SQLException& e) {
-        logger::getInstance().log("error", "Failed to create post: " + std::string(e.what()));
+    int id = _store.insertPost(upid, title, content, post_type);
+
+    if (id == 0) {
         return false;
     }
+    _index.add(id, title, content);
+    _feeds.append(id, upid, post_type);
+    return true;
+}
+
+bool postManage::createPostAsync(newPost post, std::function<void(bool)> done) {
+    // 索引要用到标题与内容，帖子随回调保留到插入完成
+    auto row = std::make_shared<newPost>(std::move(post));
+
+    return _async->insertPost(*row, [this, row, done = std::move(done)](int id) {
+        if (id == 0) {
+            done(false);
+            return;
+        }
+        _index.add(id, row->title, row->content);
+        _feeds.append(id, row->upid, row->post_type);
+        done(true);
+    });
+}
+
+void postManage::enableBatching(const batchOptions& options) {
+    _post_writer = std::make_unique<writeBatcher<newPost>>("posts", [this](const std::vector<newPost>& rows, std::vector<bool>& inserted) {
+        std::vector<int> ids;
+
+        _store.insertPosts(rows, ids);
+        for (std::size_t i = 0; i < rows.size(); ++i) {
+            inserted[i] = i < ids.size() && ids[i] != 0;
+            if (inserted[i]) {
+                _index.add(ids[i], rows[i].title, rows[i].content);
+                _feeds.append(ids[i], rows[i].upid, rows[i].post_type);
+            }
+        }
+    }, options);
+}
+
+bool postManage::submitPost(newPost post, std::function<void(bool)> done) {
+    return _post_writer->submit(std::move(post), std::move(done));
 }
 
 /**
  * @brief 删除帖子
  */
 bool postManage::deletePost(int id) {
-    auto conn = _connection_pool.getConnection();
-    try {
-        std::shared_ptr<sql::PreparedStatement> stmt(
-            conn->prepareStatement("DELETE FROM posts WHERE id = ?")
-        );
-        stmt->setInt(1, id);
-        stmt->executeUpdate();
-        return true;
-    } catch (sql::SQLException& e) {
-        logger::getInstance().log("error", "Failed to delete post: " + std::string(e.what()));
+    if (!_store.deletePost(id)) {
         return false;
     }
+    _cache.invalidate(id);
+    _index.remove(id);
+    _feeds.remove(id);
+    return true;
+}
+
+/**
+ * @brief 获取单个帖子
+ * 
+ * 未命中时查询存储并回填缓存；查询期间若该分片有写操作使缓存失效，则不回填。
+ */
+std::shared_ptr<const cachedPost> postManage::getPost(int id) {
+    if (auto hit = _cache.get(id)) {
+        return hit;
+    }
+
+    std::uint64_t generation = _cache.generation(id);
+    auto entry = std::make_shared<cachedPost>();
+
+    if (!_store.findPost(id, entry->post)) {
+        return nullptr;
+    }
+    return fillCache(id, std::move(entry), generation);
+}
+
+bool postManage::loadPost(int id, std::function<void(std::shared_ptr<const cachedPost>)> done) {
+    if (auto hit = _cache.get(id)) {
+        done(std::move(hit));
+        return true;
+    }
+
+    std::uint64_t generation = _cache.generation(id);
+
+    return _async->findPost(id, [this, id, generation, done = std::move(done)](bool found, Post& post) {
+        if (!found) {
+            done(nullptr);
+            return;
+        }
+
+        auto entry = std::make_shared<cachedPost>();
+
+        entry->post = std::move(post);
+        done(fillCache(id, std::move(entry), generation));
+    });
 }
 
-// /**
-//  * @brief 获取单个帖子
-//  */
-// std::optional<Post> postManage::getPost(int id) {
-//     auto conn = _connection_pool.getConnection();
-//     try {
-//         std::shared_ptr<sql::PreparedStatement> stmt(
-//             conn->prepareStatement("SELECT * FROM posts WHERE id = ?")
-//         );
-//         stmt->setInt(1, id);
-//         std::shared_ptr<sql::ResultSet> res(stmt->executeQuery());
-
-//         if (res->next()) {
-//             Post post = {
-//                 res->getInt("id"),
-//                 res->getString("title"),
-//                 res->getString("content"),
-//                 res->getString("author"),
-//                 res->getString("created_at")
-//             };
-//             return post;
-//         }
-//     } catch (sql::SQLException& e) {
-//         BOOST_LOG_TRIVIAL(error) << "Failed to get post: " << e.what();
-//     }
-//     return std::nullopt;
-// }
+std::shared_ptr<const cachedPost> postManage::fillCache(int id, std::shared_ptr<cachedPost> entry, std::uint64_t generation) {
+    const Post& post = entry->post;
+    std::string& json = entry->json;
+
+    json.reserve(96 + post.title.size() + post.post_type.size() + post.created_at.size() + post.content.size());
+    appendPostJson(json, post, true);
+
+    // 按字符串容量估算占用，另加节点与控制块的固定开销
+    std::size_t cost = sizeof(cachedPost) + 128 + post.title.capacity() + post.content.capacity()
+        + post.post_type.capacity() + post.created_at.capacity() + json.capacity();
+
+    _cache.put(id, entry, cost, generation);
+    return entry;
+}
 
 /**
- * @brief 获取所有帖子
+ * @brief 分页查询并直接序列化为JSON
+ * 
+ * 每行从存储取出后立即写入out，内存占用只与单行大小有关。
  */
-std::vector<Post> postManage::getAllPosts() {
-    std::vector<Post> posts;
-    auto conn = _connection_pool.getConnection();
-    try {
-        std::shared_ptr<sql::PreparedStatement> stmt(
-            conn->prepareStatement("SELECT * FROM posts")
-        );
-        std::shared_ptr<sql::ResultSet> res(stmt->executeQuery());
-
-        while (res->next()) {
-            posts.emplace_back(Post{
-                res->getInt("id"),
-                res->getInt("upid"),
-                res->getString("title"),
-                res->getString("content"),
-                res->getString("post_type"),
-                res->getString("created_at")
-            });
+bool postManage::writePostsJson(const postQuery& query, std::string& out) {
+    std::size_t rollback = out.size();
+    std::optional<postCursor> next;
+
+    out += "{\"posts\":[";
+    if (!writePostsPage(query, true, out, next)) {
+        out.resize(rollback);
+        return false;
+    }
+    out += "],\"next\":";
+    if (next) {
+        appendJsonString(out, next->format());
+    } else {
+        out += "null";
+    }
+    out += '}';
+    return true;
+}
+
+/**
+ * @brief 读取一页帖子，追加逗号分隔的各行
+ */
+bool postManage::writePostsPage(const postQuery& query, bool first, std::string& out, std::optional<postCursor>& next) {
+    std::size_t rollback = out.size();
+    std::size_t limit = pageLimit(query);
+    std::size_t row = 0;
+    postCursor last;
+
+    next.reset();
+
+    bool ok = _store.scanPosts(query, limit + 1, [&](const Post& post) {
+        if (row++ == limit) {
+            return;
+        }
+        if (row > 1 || !first) {
+            out += ',';
         }
-    } catch (sql::SQLException& e) {
-        logger::getInstance().log("error", "Failed to get all posts: " + std::string(e.what()));
+        last.id = post.postid;
+        last.created_at = post.created_at;
+        appendPostJson(out, post, query.with_content);
+    });
+
+    if (!ok) {
+        out.resize(rollback);
+        return false;
+    }
+    if (row > limit) {
+        next = std::move(last);
     }
-    return posts;
+    return true;
 }
 
 /**
  * @brief 更新帖子
  */
 bool postManage::updatePost(int id, const std::string& title, const std::string& content) {
-    auto conn = _connection_pool.getConnection();
-    try {
-        std::shared_ptr<sql::PreparedStatement> stmt(
-            conn->prepareStatement("UPDATE posts SET title = ?, content = ? WHERE id = ?")
-        );
-        stmt->setString(1, title);
-        stmt->setString(2, content);
-        stmt->setInt(3, id);
-        stmt->executeUpdate();
-        return true;
-    } catch (sql::SQLException& e) {
-        logger::getInstance().log("error", "to update post: " + std::string(e.what()));
+    if (!_store.updatePost(id, title, content)) {
         return false;
     }
+    _cache.invalidate(id);
+    _index.update(id, title, content);
+    return true;
+}
+
+/**
+ * @brief 按(created_at, id)倒序逐页读取，以上一页最后一行为游标；列表从新到旧填充，满了即不再加入
+ */
+bool postManage::buildIndexes(std::size_t page_rows) {
+    postQuery query;
+    std::size_t rows;
+
+    query.with_content = true;
+    do {
+        postCursor last;
+
+        rows = 0;
+        if (!_store.scanPosts(query, page_rows, [&](const Post& post) {
+            _index.add(post.postid, post.title, post.content);
+            _feeds.appendOlder(post.postid, post.upid, post.post_type);
+            last.id = post.postid;
+            last.created_at = post.created_at;
+            ++rows;
+        })) {
+            return false;
+        }
+        query.after = std::move(last);
+    } while (rows == page_rows);
+    return true;
+}
+
+/**
+ * @brief 索引只给出帖子id，帖子本身经缓存读取；索引与存储之间短暂不一致时跳过已不存在的帖子
+ */
+void postManage::writeSearchJson(std::string_view query, std::size_t limit, bool with_content, std::string& out) {
+    std::vector<searchHit> hits;
+    std::size_t total = _index.search(query, std::min(limit, postQuery::MAX_LIMIT), hits);
+    bool first = true;
+
+    out += "{\"total\":";
+    out += std::to_string(total);
+    out += ",\"posts\":[";
+    for (const searchHit& hit : hits) {
+        std::shared_ptr<const cachedPost> post = getPost(hit.post_id);
+
+        if (!post) {
+            continue;
+        }
+        if (!first) {
+            out += ',';
+        }
+        first = false;
+        if (with_content) {
+            out += post->json;
+        } else {
+            appendPostJson(out, post->post, false);
+        }
+    }
+    out += "]}";
+}
+
+bool postManage::writeFeedJson(const int* ids, std::size_t count, bool with_content, bool cached_only, std::string& out) {
+    std::size_t rollback = out.size();
+    bool first = true;
+
+    out += "{\"posts\":[";
+    for (std::size_t i = 0; i < count; ++i) {
+        std::shared_ptr<const cachedPost> post = cached_only ? _cache.get(ids[i]) : getPost(ids[i]);
+
+        if (!post) {
+            if (cached_only) {
+                out.resize(rollback);
+                return false;
+            }
+            continue;
+        }
+        if (!first) {
+            out += ',';
+        }
+        first = false;
+        if (with_content) {
+            out += post->json;
+        } else {
+            appendPostJson(out, post->post, false);
+        }
+    }
+    out += "]}";
+    return true;
 }
@@ -0,0 +1,89 @@
+/**
+ * @file requestArena.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief requestArena类实现
+ * @version 1.0
+ * @date 2024-11-24
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-24 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#include <algorithm>
+#include <cstdint>
+#include <new>
+#include "requestArena.hpp"
+
+namespace {
+const std::size_t MIN_BLOCK_BYTES = 1024;
+}
+
+requestArena::~requestArena() {
+    release();
+}
+
+void requestArena::release() {
+    while (_head) {
+        block* next = _head->next;
+
+        ::operator delete(_head);
+        _head = next;
+    }
+    _cursor = _limit = nullptr;
+    _capacity = 0;
+}
+
+/**
+ * @brief 只剩一个块时原地复用；有多个块时换成一个总容量大小的块；初始大小为0时全部释放
+ *
+ */
+void requestArena::reset() {
+    if (_initial_bytes == 0) {
+        release();
+    } else if (_head && _head->next) {
+        std::size_t capacity = _capacity;
+
+        release();
+        if (capacity <= MAX_RETAINED_BYTES) {
+            grow(capacity);
+        }
+    } else if (_head && _capacity > MAX_RETAINED_BYTES) {
+        release();
+    }
+    if (_head) {
+        _cursor = reinterpret_cast<char*>(_head + 1);
+    }
+}
+
+void requestArena::grow(std::size_t bytes) {
+    std::size_t size = _initial_bytes == 0 ? bytes : std::max({bytes, _head ? _head->size * 2 : _initial_bytes, MIN_BLOCK_BYTES});
+    block* added = static_cast<block*>(::operator new(sizeof(block) + size));
+
+    added->next = _head;
+    added->size = size;
+    _head = added;
+    _cursor = reinterpret_cast<char*>(added + 1);
+    _limit = _cursor + size;
+    _capacity += size;
+}
+
+void* requestArena::do_allocate(std::size_t bytes, std::size_t alignment) {
+    auto aligned = [this, alignment]() {
+        auto address = reinterpret_cast<std::uintptr_t>(_cursor);
+
+        return _cursor + ((alignment - address % alignment) % alignment);
+    };
+    char* start = _cursor ? aligned() : nullptr;
+
+    if (!start || start > _limit || static_cast<std::size_t>(_limit - start) < bytes) {
+        // 新块的起点按max_align_t对齐，更大的对齐要求靠多留的alignment字节满足
+        grow(bytes + alignment);
+        start = aligned();
+    }
+    _cursor = start + bytes;
+    return start;
+}
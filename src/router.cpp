@@ -0,0 +1,226 @@
+/**
+ * @file router.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief router类实现
+ * @version 1.0
+ * @date 2024-11-12
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-12 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#include <algorithm>
+#include <stdexcept>
+#include "router.hpp"
+
+router::router() {
+    newNode();
+}
+
+int router::methodIndex(std::string_view method) {
+    static const std::string_view METHODS[METHOD_COUNT] = {"GET", "POST", "PUT", "DELETE", "PATCH", "HEAD", "OPTIONS"};
+
+    for (std::size_t i = 0; i < METHOD_COUNT; ++i) {
+        if (METHODS[i] == method) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+std::uint32_t router::newNode() {
+    node n;
+
+    n.routes.fill(NONE);
+    _nodes.push_back(std::move(n));
+    return static_cast<std::uint32_t>(_nodes.size() - 1);
+}
+
+/**
+ * @brief 添加路由
+ *
+ * 模式按'{'拆成静态片段与参数，静态片段插入基数树(必要时分裂已有节点)，
+ * 参数作为节点唯一的参数子节点，同一位置的参数名必须一致。
+ *
+ * @param method
+ * @param pattern
+ * @param id
+ */
+void router::add(std::string_view method, std::string_view pattern, std::uint32_t id) {
+    int method_index = methodIndex(method);
+    std::string where = std::string(method) + " " + std::string(pattern);
+
+    if (method_index < 0) {
+        throw std::invalid_argument("Unknown method in route " + where);
+    }
+    if (pattern.empty() || pattern.front() != '/') {
+        throw std::invalid_argument("Route must start with '/': " + where);
+    }
+
+    std::uint32_t current = 0;
+    std::size_t params = 0;
+    std::size_t i = 0;
+
+    while (i < pattern.size()) {
+        if (pattern[i] == '{') {
+            std::size_t close = pattern.find('}', i);
+
+            if (pattern[i - 1] != '/' || close == std::string_view::npos || close == i + 1
+                || (close + 1 < pattern.size() && pattern[close + 1] != '/') || ++params > HTTP_MAX_PARAMS) {
+                throw std::invalid_argument("Invalid path parameter in route " + where);
+            }
+
+            std::string name(pattern.substr(i + 1, close - i - 1));
+            std::uint32_t child = _nodes[current].param_child;
+
+            if (child == NONE) {
+                child = newNode();
+                _nodes[child].param_name = name;
+                _nodes[current].param_child = child;
+            } else if (_nodes[child].param_name != name) {
+                throw std::invalid_argument("Conflicting parameter name {" + name + "} in route " + where);
+            }
+            current = child;
+            i = close + 1;
+        } else {
+            std::size_t next = std::min(pattern.find('{', i), pattern.size());
+
+            current = insertStatic(current, pattern.substr(i, next - i));
+            i = next;
+        }
+    }
+
+    node& target = _nodes[current];
+
+    if (target.routes[method_index] != NONE) {
+        throw std::invalid_argument("Duplicate route " + where);
+    }
+    target.routes[method_index] = id;
+    target.has_route = true;
+}
+
+/**
+ * @brief 在index的子树中插入静态片段，返回片段末尾所在的节点
+ *
+ * 新建节点会使_nodes扩容，因此全程只持有下标。
+ *
+ * @param index
+ * @param segment
+ * @return std::uint32_t
+ */
+std::uint32_t router::insertStatic(std::uint32_t index, std::string_view segment) {
+    while (!segment.empty()) {
+        auto& children = _nodes[index].children;
+        auto it = std::lower_bound(children.begin(), children.end(), segment.front(),
+            [](const std::pair<char, std::uint32_t>& child, char c) { return child.first < c; });
+
+        if (it == children.end() || it->first != segment.front()) {
+            std::size_t position = it - children.begin();
+            std::uint32_t child = newNode();
+
+            _nodes[child].prefix = std::string(segment);
+            _nodes[index].children.insert(_nodes[index].children.begin() + position, {segment.front(), child});
+            return child;
+        }
+
+        std::uint32_t child = it->second;
+        std::size_t slot = it - children.begin();
+        const std::string& prefix = _nodes[child].prefix;
+        std::size_t common = 0;
+
+        while (common < prefix.size() && common < segment.size() && prefix[common] == segment[common]) {
+            ++common;
+        }
+        if (common < prefix.size()) {
+            // 分裂：child的前common个字符成为新的中间节点
+            std::uint32_t middle = newNode();
+
+            _nodes[middle].prefix = _nodes[child].prefix.substr(0, common);
+            _nodes[child].prefix.erase(0, common);
+            _nodes[middle].children.push_back({_nodes[child].prefix.front(), child});
+            _nodes[index].children[slot].second = middle;
+            child = middle;
+        }
+        segment.remove_prefix(common);
+        index = child;
+    }
+    return index;
+}
+
+/**
+ * @brief 匹配请求
+ *
+ * @param request
+ * @param id
+ * @return router::result
+ */
+router::result router::match(httpRequest& request, std::uint32_t& id) const {
+    bool method_mismatch = false;
+
+    request.param_count = 0;
+    if (matchNode(0, request.path, 0, methodIndex(request.method), request, id, method_mismatch)) {
+        return result::matched;
+    }
+    request.param_count = 0;
+    return method_mismatch ? result::methodNotAllowed : result::notFound;
+}
+
+/**
+ * @brief 从index节点开始匹配path[pos:]
+ *
+ * 静态子节点优先，失败时回退已捕获的参数再尝试参数子节点。
+ * 参数直接以string_view指向请求路径，不分配内存。
+ *
+ * @return true 找到方法匹配的路由
+ */
+bool router::matchNode(std::uint32_t index, std::string_view path, std::size_t pos, int method, httpRequest& request, std::uint32_t& id, bool& method_mismatch) const {
+    const node& n = _nodes[index];
+    bool is_param = !n.param_name.empty();
+
+    if (is_param) {
+        std::size_t end = std::min(path.find('/', pos), path.size());
+
+        if (end == pos) {
+            return false;
+        }
+        request.params[request.param_count++] = httpHeader{n.param_name, path.substr(pos, end - pos)};
+        pos = end;
+    } else {
+        if (path.compare(pos, n.prefix.size(), n.prefix) != 0) {
+            return false;
+        }
+        pos += n.prefix.size();
+    }
+
+    if (pos == path.size()) {
+        if (n.has_route) {
+            if (method >= 0 && n.routes[method] != NONE) {
+                id = n.routes[method];
+                return true;
+            }
+            method_mismatch = true;
+        }
+    } else {
+        std::size_t saved = request.param_count;
+        auto it = std::lower_bound(n.children.begin(), n.children.end(), path[pos],
+            [](const std::pair<char, std::uint32_t>& child, char c) { return child.first < c; });
+
+        if (it != n.children.end() && it->first == path[pos] && matchNode(it->second, path, pos, method, request, id, method_mismatch)) {
+            return true;
+        }
+        request.param_count = saved;
+        if (n.param_child != NONE && matchNode(n.param_child, path, pos, method, request, id, method_mismatch)) {
+            return true;
+        }
+        request.param_count = saved;
+    }
+
+    if (is_param) {
+        --request.param_count;
+    }
+    return false;
+}
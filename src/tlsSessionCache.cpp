@@ -0,0 +1,193 @@
+/**
+ * @file tlsSessionCache.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief tlsSessionCache类实现
+ * @version 1.0
+ * @date 2024-11-08
+ * 
+ * @copyright Copyright (c) 2024 antaresz
+ * 
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-08 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+#include <cstring>
+#include <stdexcept>
+#include "tlsSessionCache.hpp"
+#include "logger.hpp"
+
+namespace {
+const unsigned char SESSION_ID_CONTEXT[] = "hometown";
+const std::size_t MAX_TICKET_KEYS = 8;
+
+/**
+ * @brief SSL_CTX上保存tlsSessionCache指针的ex_data索引
+ * 
+ * asio自身占用了SSL_CTX的app_data，这里单独申请一个索引。
+ * 
+ * @return int 
+ */
+int exDataIndex() {
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+}
+
+tlsSessionCache::tlsSessionCache(std::size_t cache_size, std::chrono::seconds session_timeout, std::chrono::seconds rotation_interval)
+    : _cache_size(cache_size), _session_timeout(session_timeout), _rotation_interval(rotation_interval), _resumed(0), _full(0) {
+    std::lock_guard<std::mutex> lock(_mtx);
+
+    rotateLocked();
+}
+
+/**
+ * @brief 配置context
+ * 
+ * @param ctx 
+ */
+void tlsSessionCache::configure(boost::asio::ssl::context& ctx) {
+    SSL_CTX* handle = ctx.native_handle();
+
+    // TLS 1.2 session id 复用所需的服务端缓存
+    SSL_CTX_set_session_cache_mode(handle, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(handle, static_cast<long>(_cache_size));
+    SSL_CTX_set_timeout(handle, static_cast<long>(_session_timeout.count()));
+    SSL_CTX_set_session_id_context(handle, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+
+    // 无状态票据，密钥只存在于内存中
+    SSL_CTX_clear_options(handle, SSL_OP_NO_TICKET);
+    SSL_CTX_set_ex_data(handle, exDataIndex(), this);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(handle, &tlsSessionCache::ticketKeyCallback);
+#else
+    SSL_CTX_set_tlsext_ticket_key_cb(handle, &tlsSessionCache::ticketKeyCallback);
+#endif
+
+    // 0-RTT数据可被重放，默认关闭
+    SSL_CTX_set_max_early_data(handle, 0);
+}
+
+/**
+ * @brief 统计握手类型
+ * 
+ * @param ssl 
+ */
+void tlsSessionCache::recordHandshake(SSL* ssl) {
+    if (SSL_session_reused(ssl)) {
+        _resumed.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        _full.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief 当前密钥超过轮换周期时生成新密钥放到队首，淘汰已无有效票据的旧密钥
+ * 
+ */
+void tlsSessionCache::rotateLocked() {
+    auto now = std::chrono::steady_clock::now();
+
+    if (!_keys.empty() && now - _keys.front().created < _rotation_interval) {
+        return;
+    }
+
+    ticketKey key;
+
+    if (RAND_bytes(key.name, sizeof(key.name)) != 1 || RAND_bytes(key.aes_key, sizeof(key.aes_key)) != 1
+        || RAND_bytes(key.hmac_key, sizeof(key.hmac_key)) != 1) {
+        throw std::runtime_error("Failed to generate TLS session ticket key");
+    }
+    key.created = now;
+    _keys.push_front(key);
+
+    // 某个密钥被替换后，用它签发的票据最多再存活_session_timeout
+    while (_keys.size() > 1 && (_keys.size() > MAX_TICKET_KEYS || now - _keys[_keys.size() - 2].created > _session_timeout)) {
+        _keys.pop_back();
+    }
+    LOG_INFO("Rotated TLS session ticket key, " + std::to_string(_keys.size()) + " keys active.");
+}
+
+/**
+ * @brief 票据加解密回调
+ * 
+ * enc=1时用当前密钥加密新票据；enc=0时按密钥名查找，找不到返回0(执行完整握手)，
+ * 命中旧密钥或TLS 1.3连接返回2，让OpenSSL用当前密钥重新签发票据。
+ * 
+ * @return int 
+ */
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+int tlsSessionCache::ticketKeyCallback(SSL* ssl, unsigned char* key_name, unsigned char* iv, EVP_CIPHER_CTX* cipher_ctx, EVP_MAC_CTX* mac_ctx, int enc) {
+#else
+int tlsSessionCache::ticketKeyCallback(SSL* ssl, unsigned char* key_name, unsigned char* iv, EVP_CIPHER_CTX* cipher_ctx, HMAC_CTX* mac_ctx, int enc) {
+#endif
+    auto* self = static_cast<tlsSessionCache*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), exDataIndex()));
+
+    if (!self) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(self->_mtx);
+    const ticketKey* key = nullptr;
+    bool current = false;
+
+    if (enc) {
+        try {
+            self->rotateLocked();
+        } catch (const std::exception& e) {
+            LOG_ERROR(e.what());
+        }
+        key = &self->_keys.front();
+        current = true;
+        if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
+            return -1;
+        }
+        std::memcpy(key_name, key->name, sizeof(key->name));
+    } else {
+        for (std::size_t i = 0; i < self->_keys.size(); ++i) {
+            if (std::memcmp(key_name, self->_keys[i].name, sizeof(self->_keys[i].name)) == 0) {
+                key = &self->_keys[i];
+                current = i == 0;
+                break;
+            }
+        }
+        if (!key) {
+            return 0;
+        }
+    }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, const_cast<unsigned char*>(key->hmac_key), sizeof(key->hmac_key)),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0),
+        OSSL_PARAM_construct_end()
+    };
+
+    if (EVP_MAC_CTX_set_params(mac_ctx, params) != 1) {
+        return -1;
+    }
+#else
+    if (HMAC_Init_ex(mac_ctx, key->hmac_key, sizeof(key->hmac_key), EVP_sha256(), nullptr) != 1) {
+        return -1;
+    }
+#endif
+    if (enc) {
+        if (EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key->aes_key, iv) != 1) {
+            return -1;
+        }
+        return 1;
+    }
+    if (EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key->aes_key, iv) != 1) {
+        return -1;
+    }
+    // TLS 1.3客户端每张票据只用一次，复用后不签发新票据的话下一次重连只能完整握手
+    return current && SSL_version(ssl) < TLS1_3_VERSION ? 1 : 2;
+}
@@ -0,0 +1,257 @@
+/**
+ * @file tokenSigner.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief tokenSigner类实现
+ * @version 1.1
+ * @date 2024-11-18
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-18 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>保留的密钥数由有效期与轮换周期推出，不再提前淘汰
+ * </table>
+ */
+#include <cryptopp/base64.h>
+#include <cryptopp/filters.h>
+#include <cryptopp/hmac.h>
+#include <cryptopp/misc.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/sha.h>
+#include <algorithm>
+#include <charconv>
+#include <mutex>
+#include <stdexcept>
+#include "tokenSigner.hpp"
+
+namespace {
+/**
+ * @brief 未过期令牌的签名密钥全部保留时，同一时刻最多存在的密钥数
+ *
+ * 密钥至少签名rotation时长，其令牌在此后ttl内有效，因此除当前密钥外最多还有ceil(ttl/rotation)个旧密钥。
+ *
+ * @param ttl
+ * @param rotation
+ * @return std::size_t
+ */
+std::size_t keysNeeded(std::chrono::seconds ttl, std::chrono::seconds rotation) {
+    if (ttl.count() <= 0 || rotation.count() <= 0) {
+        throw std::invalid_argument("Token ttl and signing key rotation interval must be positive");
+    }
+    return static_cast<std::size_t>((ttl.count() + rotation.count() - 1) / rotation.count()) + 1;
+}
+
+/**
+ * @brief 从text中取出下一个'.'之前的整数
+ *
+ * @tparam T
+ * @param text 解析成功后去掉已读部分和'.'
+ * @param value
+ * @param base
+ * @return true
+ */
+template <typename T>
+bool nextField(std::string_view& text, T& value, int base = 10) {
+    std::size_t dot = text.find('.');
+
+    if (dot == std::string_view::npos || dot == 0) {
+        return false;
+    }
+
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + dot, value, base);
+
+    if (ec != std::errc() || ptr != text.data() + dot) {
+        return false;
+    }
+    text.remove_prefix(dot + 1);
+    return true;
+}
+
+std::uint64_t mix(std::uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+}
+
+tokenSigner::tokenSigner(std::chrono::seconds ttl, std::chrono::seconds rotation_interval)
+    : _ttl(ttl), _rotation_interval(rotation_interval), _max_keys(keysNeeded(ttl, rotation_interval)),
+    _revoked(BLOOM_WORDS), _revoked_previous(BLOOM_WORDS) {
+    CryptoPP::AutoSeededRandomPool rng;
+
+    rng.GenerateBlock(reinterpret_cast<CryptoPP::byte*>(&_next_key_id), sizeof(_next_key_id));
+    _revoked_since = std::chrono::system_clock::now();
+    rotateLocked(_revoked_since);
+}
+
+/**
+ * @brief 签发令牌，必要时先轮换签名密钥
+ *
+ * @param user_id
+ * @return std::string
+ */
+std::string tokenSigner::issue(std::int64_t user_id) {
+    auto now = std::chrono::system_clock::now();
+    std::uint64_t token_id = 0;
+    CryptoPP::AutoSeededRandomPool rng;
+
+    rng.GenerateBlock(reinterpret_cast<CryptoPP::byte*>(&token_id), sizeof(token_id));
+
+    std::unique_lock<std::shared_mutex> lock(_mtx);
+
+    if (now - _keys.back().created >= _rotation_interval) {
+        rotateLocked(now);
+    }
+    ageFilterLocked(now);
+
+    const signingKey& key = _keys.back();
+    char hex[17];
+    auto end = std::to_chars(hex, hex + sizeof(hex), token_id, 16).ptr;
+    std::string token = std::to_string(key.id) + "." + std::to_string(user_id) + "."
+        + std::to_string(std::chrono::duration_cast<std::chrono::seconds>((now + _ttl).time_since_epoch()).count()) + "."
+        + std::string(hex, end);
+
+    token += '.';
+    token += sign(key, token.substr(0, token.size() - 1));
+    return token;
+}
+
+/**
+ * @brief 校验令牌
+ *
+ * 先做不需要加锁的格式与过期检查，签名用定长比较，不泄露匹配长度。
+ *
+ * @param token
+ * @param claims
+ * @return true
+ */
+bool tokenSigner::verify(std::string_view token, tokenClaims& claims) const {
+    std::string_view rest = token;
+    tokenClaims parsed;
+
+    if (!nextField(rest, parsed.key_id) || !nextField(rest, parsed.user_id) || !nextField(rest, parsed.expires)
+        || !nextField(rest, parsed.token_id, 16) || rest.empty()) {
+        return false;
+    }
+
+    auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    if (parsed.expires <= now) {
+        return false;
+    }
+
+    std::string_view payload = token.substr(0, token.size() - rest.size() - 1);
+    std::shared_lock<std::shared_mutex> lock(_mtx);
+    const signingKey* key = findKeyLocked(parsed.key_id);
+
+    if (!key) {
+        return false;
+    }
+
+    std::string expected = sign(*key, payload);
+
+    if (expected.size() != rest.size()
+        || !CryptoPP::VerifyBufsEqual(reinterpret_cast<const CryptoPP::byte*>(expected.data()), reinterpret_cast<const CryptoPP::byte*>(rest.data()), expected.size())) {
+        return false;
+    }
+    if (bloomContains(_revoked, parsed.token_id) || bloomContains(_revoked_previous, parsed.token_id)) {
+        return false;
+    }
+    claims = parsed;
+    return true;
+}
+
+void tokenSigner::revoke(const tokenClaims& claims) {
+    std::unique_lock<std::shared_mutex> lock(_mtx);
+
+    ageFilterLocked(std::chrono::system_clock::now());
+    bloomInsert(_revoked, claims.token_id);
+}
+
+/**
+ * @brief 生成新的签名密钥，并淘汰签发的令牌已全部过期的旧密钥
+ *
+ * @param now
+ */
+void tokenSigner::rotateLocked(std::chrono::system_clock::time_point now) {
+    signingKey key;
+    CryptoPP::AutoSeededRandomPool rng;
+
+    key.id = _next_key_id++;
+    key.created = now;
+    rng.GenerateBlock(key.secret.data(), key.secret.size());
+    _keys.push_back(key);
+
+    // 密钥在created + rotation之前一直用于签名，其令牌最晚在此后ttl过期；_max_keys不小于同一时刻应有的密钥数，只作为上界
+    while (_keys.size() > 1 && (_keys.front().created + _rotation_interval + _ttl <= now || _keys.size() > _max_keys)) {
+        _keys.pop_front();
+    }
+    ageFilterLocked(now);
+}
+
+/**
+ * @brief 当代过滤器满一个有效期后成为上一代，上一代中的令牌此时都已过期
+ *
+ * @param now
+ */
+void tokenSigner::ageFilterLocked(std::chrono::system_clock::time_point now) {
+    if (now - _revoked_since >= _ttl) {
+        _revoked_previous.swap(_revoked);
+        std::fill(_revoked.begin(), _revoked.end(), 0);
+        _revoked_since = now;
+    }
+}
+
+const tokenSigner::signingKey* tokenSigner::findKeyLocked(std::uint32_t id) const {
+    for (auto it = _keys.rbegin(); it != _keys.rend(); ++it) {
+        if (it->id == id) {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
+
+std::string tokenSigner::sign(const signingKey& key, std::string_view payload) {
+    using namespace CryptoPP;
+
+    HMAC<SHA256> hmac(key.secret.data(), key.secret.size());
+    byte digest[HMAC<SHA256>::DIGESTSIZE];
+    std::string encoded;
+
+    hmac.Update(reinterpret_cast<const byte*>(payload.data()), payload.size());
+    hmac.Final(digest);
+    StringSource(digest, sizeof(digest), true, new Base64URLEncoder(new StringSink(encoded), false));
+    return encoded;
+}
+
+bool tokenSigner::bloomContains(const std::vector<std::uint64_t>& filter, std::uint64_t token_id) {
+    std::uint64_t h = mix(token_id);
+    std::uint64_t step = mix(h) | 1;
+    const std::uint64_t bits = filter.size() * 64;
+
+    for (int i = 0; i < BLOOM_HASHES; ++i, h += step) {
+        std::uint64_t bit = h % bits;
+
+        if (!(filter[bit / 64] & (1ULL << (bit % 64)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void tokenSigner::bloomInsert(std::vector<std::uint64_t>& filter, std::uint64_t token_id) {
+    std::uint64_t h = mix(token_id);
+    std::uint64_t step = mix(h) | 1;
+    const std::uint64_t bits = filter.size() * 64;
+
+    for (int i = 0; i < BLOOM_HASHES; ++i, h += step) {
+        std::uint64_t bit = h % bits;
+
+        filter[bit / 64] |= 1ULL << (bit % 64);
+    }
+}
@@ -2,116 +2,190 @@
  * @file userHandler.cpp
  * @author antaresz (antaresz1026@gmail.com)
  * @brief 注册/登录api实现
- * @version 1.0
+ * @version 1.8
  * @date 2024-10-11
- * 
+ *
  * @copyright Copyright (c) 2024 antaresz
- * 
+ *
  * @par 修改日志:
  * <table>
  * <tr><th>Date       <th>Version <th>Author <th>Description
  * <tr><td>2024-10-11 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-14 <td>1.1     <td>antaresz    <td>使用连接池lease，自动归还连接
+ * <tr><td>2024-11-15 <td>1.2     <td>antaresz    <td>复用连接上缓存的预编译语句
+ * <tr><td>2024-11-19 <td>1.3     <td>antaresz    <td>passwordHasher替换单次HMAC，db/hash线程池分阶段执行
+ * <tr><td>2024-11-22 <td>1.4     <td>antaresz    <td>SQL移至mysqlStore
+ * <tr><td>2024-11-23 <td>1.5     <td>antaresz    <td>注册可走批量写入
+ * <tr><td>2024-11-29 <td>1.6     <td>antaresz    <td>存储支持异步接口时数据库操作不经过db线程池
+ * <tr><td>2024-12-01 <td>1.7     <td>antaresz    <td>用户不存在时校验固定哈希，与密码错误耗时相同
+ * <tr><td>2024-12-01 <td>1.8     <td>antaresz    <td>线程池任务抛出异常时仍然应答
  * </table>
  */
-#include <cppconn/prepared_statement.h>
-#include <cryptopp/sha.h>
-#include <cryptopp/hmac.h>
-#include <cryptopp/filters.h>
-#include <cryptopp/hex.h>
-#include <cryptopp/osrng.h>
-#include <cryptopp/base64.h>
-#include <sstream>
-#include <iomanip>
+#include <exception>
 #include "userHandler.hpp"
+#include "logger.hpp"
 
-userHandler::userHandler(SQLConnection& connectionPool) : _connection_pool(connectionPool) {}
-
-// 修改后的 encryptPassword，接受盐值作为参数
-std::string userHandler::encryptPassword(const std::string& password, const std::string& salt) {
-    using namespace CryptoPP;
-
-    std::string key = salt;  // 使用给定的盐值作为密钥
-    std::string digest;
-    HMAC<SHA256> hmac((byte*)key.data(), key.size());
+namespace {
+/**
+ * @brief 记录线程池任务中捕获的异常
+ *
+ * workerPool只记录逃出任务的异常，不会调用done；任务须自己捕获后以失败应答，
+ * 否则连接一直等待响应，在途请求数也不会减少。
+ *
+ * @param what 日志中的操作
+ * @param error
+ */
+void logFailure(const char* what, std::exception_ptr error) {
+    try {
+        std::rethrow_exception(error);
+    } catch (const std::exception& e) {
+        LOG_ERROR(std::string(what) + ": " + e.what());
+    } catch (...) {
+        LOG_ERROR(what);
+    }
+}
+}
 
-    // 计算 HMAC-SHA256 的值
-    StringSource(password, true,
-                 new HashFilter(hmac,
-                                new HexEncoder(new StringSink(digest))));
+userHandler::userHandler(dataStore& store, workerPool& db_pool, workerPool& hash_pool, const kdfParams& params)
+    : _store(store), _async(store.async()), _db_pool(db_pool), _hash_pool(hash_pool), _hasher(params),
+    _unknown_user(std::make_shared<userCredentials>()) {
+    // 盐是随机的，明文是什么都无所谓；校验结果总被当作失败
+    _unknown_user->password = _hasher.hash("unknown user");
+}
 
-    return digest;
+void userHandler::enableBatching(const batchOptions& options) {
+    _user_writer = std::make_unique<writeBatcher<newUser>>("users", [this](const std::vector<newUser>& rows, std::vector<bool>& inserted) {
+        _store.insertUsers(rows, inserted);
+    }, options);
 }
 
-// 生成一个随机盐值，用于密码加密
-std::string userHandler::generateSalt() {
-    using namespace CryptoPP;
+// 注册用户
+void userHandler::registerUser(userRegistration registration, registerCallback done) {
+    auto task = [this, registration = std::move(registration), done]() mutable {
+        std::string password_hash;
+        bool accepted = false;
+
+        try {
+            password_hash = _hasher.hash(registration.password);
+        } catch (...) {
+            logFailure("Password hashing failed", std::current_exception());
+            done(authStatus::failed);
+            return;
+        }
+        registration.password.clear();     // 明文不再需要，不随任务在队列中停留
+        if (_user_writer) {
+            accepted = _user_writer->submit(newUser{std::move(registration), std::move(password_hash)}, [done](bool inserted) {
+                done(inserted ? authStatus::ok : authStatus::failed);
+            });
+        } else if (_async) {
+            accepted = _async->insertUser(registration, password_hash, [done](bool inserted) {
+                done(inserted ? authStatus::ok : authStatus::failed);
+            });
+        } else {
+            accepted = _db_pool.post([this, registration = std::move(registration), password_hash = std::move(password_hash), done]() {
+                bool inserted = false;
+
+                try {
+                    inserted = _store.insertUser(registration, password_hash);
+                } catch (...) {
+                    logFailure("Registration failed", std::current_exception());
+                }
+                done(inserted ? authStatus::ok : authStatus::failed);
+            });
+        }
 
-    AutoSeededRandomPool rng;
-    byte salt[SALT_LENGTH];
-    rng.GenerateBlock(salt, sizeof(salt));
+        if (!accepted) {
+            done(authStatus::busy);
+        }
+    };
 
-    // 将盐值转换为十六进制字符串
-    std::ostringstream oss;
-    for (size_t i = 0; i < SALT_LENGTH; ++i) {
-        oss << std::hex << std::setw(2) << std::setfill('0') << (int)salt[i];
+    if (!_hash_pool.post(std::move(task))) {
+        done(authStatus::busy);
     }
-    return oss.str();
 }
 
-// 注册用户
-bool userHandler::registerUser(const std::string& username, const std::string& password, const std::string& user_type, const std::string& id_type, const std::string& id_number, const std::string& phone) {
-    auto conn = _connection_pool.getConnection();
+// 登录用户
+void userHandler::loginUser(std::string username, std::string password, loginCallback done) {
+    if (_async) {
+        bool accepted = _async->findCredentials(username, [this, password = std::move(password), done](bool found, userCredentials& credentials) mutable {
+            verifyLogin(found ? std::make_shared<userCredentials>(std::move(credentials)) : _unknown_user, std::move(password), std::move(done));
+        });
+
+        if (!accepted) {
+            done(authStatus::busy, 0);
+        }
+        return;
+    }
 
-    std::string salt = generateSalt();
-    std::string encryptedPassword = encryptPassword(password, salt);
+    auto task = [this, username = std::move(username), password = std::move(password), done]() mutable {
+        auto found = std::make_shared<userCredentials>();
+
+        try {
+            if (!_store.findCredentials(username, *found)) {
+                found = _unknown_user;
+            }
+        } catch (...) {
+            logFailure("Login failed", std::current_exception());
+            done(authStatus::failed, 0);
+            return;
+        }
+        verifyLogin(std::move(found), std::move(password), std::move(done));
+    };
 
-    try {
-        std::unique_ptr<sql::PreparedStatement> pstmt(
-            conn->prepareStatement("INSERT INTO users (username, salt, password, user_type, id_type, id_number, phone) VALUES (?, ?, ?, ?, ?, ?, ?)")
-        );
-        pstmt->setString(1, username);
-        pstmt->setString(2, salt);
-        pstmt->setString(3, encryptedPassword);
-        pstmt->setString(4, user_type);
-        pstmt->setString(5, id_type);
-        pstmt->setString(6, id_number);
-        pstmt->setString(7, phone);
-        pstmt->executeUpdate();
-        _connection_pool.releaseConnection(conn);
-        return true;
-    } catch (sql::SQLException& e) {
-        std::cerr << "Registration failed. Error: " << e.what() << std::endl;
-        _connection_pool.releaseConnection(conn);
-        return false;
+    if (!_db_pool.post(std::move(task))) {
+        done(authStatus::busy, 0);
     }
 }
 
-// 登录用户
-bool userHandler::loginUser(const std::string& username, const std::string& password) {
-    auto conn = _connection_pool.getConnection();
-    try {
-        std::unique_ptr<sql::PreparedStatement> pstmt(
-            conn->prepareStatement("SELECT salt, password FROM users WHERE username = ?")
-        );
-        pstmt->setString(1, username);
-        std::unique_ptr<sql::ResultSet> res(pstmt->executeQuery());
-
-        if (res->next()) {  // 找到匹配的用户
-            std::string salt = res->getString("salt");
-            std::string storedPassword = res->getString("password");
-            _connection_pool.releaseConnection(conn);
-
-            // 使用数据库中的盐值加密输入的密码
-            std::string encryptedPassword = encryptPassword(password, salt);
-
-            // 比较加密后的密码和存储的密码是否一致
-            return encryptedPassword == storedPassword;
+void userHandler::verifyLogin(std::shared_ptr<userCredentials> found, std::string password, loginCallback done) {
+    bool accepted = _hash_pool.post([this, found, password = std::move(password), done]() mutable {
+        bool needs_rehash = false;
+        bool verified = false;
+
+        // 用户不存在时也完整地算一遍，再按失败应答；存储的哈希参数异常时KDF可能抛出
+        try {
+            verified = _hasher.verify(password, found->password, found->salt, needs_rehash);
+        } catch (...) {
+            logFailure("Password verification failed", std::current_exception());
+        }
+        if (!verified || found == _unknown_user) {
+            done(authStatus::failed, 0);
+            return;
         }
+        done(authStatus::ok, found->id);
+        if (needs_rehash) {
+            // 已经应答，升级失败只记录日志
+            try {
+                upgradeHash(found->id, std::move(password));
+            } catch (...) {
+                logFailure("Password hash upgrade failed", std::current_exception());
+            }
+        }
+    });
 
-        _connection_pool.releaseConnection(conn);
-    } catch (sql::SQLException& e) {
-        std::cerr << "Login failed. Error: " << e.what() << std::endl;
-        _connection_pool.releaseConnection(conn);
+    if (!accepted) {
+        done(authStatus::busy, 0);
     }
-    return false;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief 用当前KDF参数重新计算哈希并写回，在hash线程池中调用
+ *
+ * 失败只记录日志，下次登录时会再次尝试。
+ *
+ * @param user_id
+ * @param password
+ */
+void userHandler::upgradeHash(std::int64_t user_id, std::string password) {
+    std::string password_hash = _hasher.hash(password);
+    bool accepted = _async
+        ? _async->updatePassword(user_id, password_hash, [](bool) {})
+        : _db_pool.post([this, user_id, password_hash = std::move(password_hash)]() {
+            // 没有等待结果的请求，异常交给workerPool记录即可
+            _store.updatePassword(user_id, password_hash);
+        });
+
+    if (!accepted) {
+        LOG_WARNING("Password hash upgrade skipped, db pool busy");
+    }
+}
@@ -0,0 +1,88 @@
+/**
+ * @file workerPool.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief workerPool类实现
+ * @version 1.3
+ * @date 2024-11-28
+ * 
+ * @copyright Copyright (c) 2024 antaresz
+ * 
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-11-04 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-11-28 <td>1.1     <td>antaresz    <td>报告任务的排队延迟
+ * <tr><td>2024-12-01 <td>1.2     <td>antaresz    <td>任务抛出非std::exception时不终止进程
+ * <tr><td>2024-12-01 <td>1.3     <td>antaresz    <td>oldestWait返回队首任务已等待的时间
+ * </table>
+ */
+#include <boost/asio/post.hpp>
+#include <exception>
+#include "workerPool.hpp"
+#include "logger.hpp"
+
+workerPool::workerPool(const std::string& name, std::size_t threads, std::size_t max_pending)
+    : _name(name), _threads(threads ? threads : 1), _max_pending(max_pending), _pending(0), _pool(_threads) {
+    LOG_INFO("Worker pool '" + _name + "' started with " + std::to_string(_threads) + " threads.");
+}
+
+workerPool::~workerPool() {
+    join();
+}
+
+/**
+ * @brief 先占用一个名额再投递，名额在任务执行结束后归还
+ * 
+ * 线程池按入队顺序取任务，开始执行时弹出的总是最早的入队时间。
+ * 
+ * @param task 
+ * @return true 
+ * @return false 
+ */
+bool workerPool::post(std::function<void()> task) {
+    if (_pending.fetch_add(1, std::memory_order_acq_rel) >= _max_pending) {
+        _pending.fetch_sub(1, std::memory_order_acq_rel);
+        LOG_WARNING("Worker pool '" + _name + "' is saturated, rejecting task.");
+        return false;
+    }
+
+    auto queued = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(_queued_mtx);
+
+        _queued.push_back(queued);
+    }
+    boost::asio::post(_pool, [this, task = std::move(task), queued]() {
+        {
+            std::lock_guard<std::mutex> lock(_queued_mtx);
+
+            _queued.pop_front();
+        }
+        if (_delay_observer) {
+            _delay_observer(std::chrono::steady_clock::now() - queued);
+        }
+        try {
+            task();
+        } catch (const std::exception& e) {
+            LOG_ERROR("Uncaught exception in worker pool '" + _name + "': " + e.what());
+        } catch (...) {
+            LOG_ERROR("Uncaught exception in worker pool '" + _name + "'.");
+        }
+        _pending.fetch_sub(1, std::memory_order_acq_rel);
+    });
+    return true;
+}
+
+std::chrono::steady_clock::duration workerPool::oldestWait() const {
+    std::lock_guard<std::mutex> lock(_queued_mtx);
+
+    if (_queued.empty()) {
+        return std::chrono::steady_clock::duration::zero();
+    }
+    return std::chrono::steady_clock::now() - _queued.front();
+}
+
+void workerPool::join() {
+    _pool.join();
+}
@@ -0,0 +1,66 @@
+/**
+ * @file argsParserTest.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief argsParser单元测试：查询串与路径参数的解码规则
+ * @version 1.0
+ * @date 2024-12-01
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-12-01 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#define BOOST_TEST_MODULE argsParserTest
+#include <boost/test/unit_test.hpp>
+#include <string>
+#include "argsParser.hpp"
+
+namespace {
+std::string decodeQuery(std::string_view raw) {
+    std::string out(raw.size(), '\0');
+
+    out.resize(argsParser::decode(raw, &out[0]));
+    return out;
+}
+
+std::string decodePath(std::string_view raw) {
+    std::string out(raw.size(), '\0');
+
+    out.resize(argsParser::decodePath(raw, &out[0]));
+    return out;
+}
+}
+
+BOOST_AUTO_TEST_CASE(query_plus_is_space) {
+    BOOST_TEST(decodeQuery("c%2B%2B+tips") == "c++ tips");
+    BOOST_TEST(decodeQuery("a+b") == "a b");
+}
+
+BOOST_AUTO_TEST_CASE(path_plus_is_literal) {
+    BOOST_TEST(decodePath("c++") == "c++");
+    BOOST_TEST(decodePath("c%2B%2B+tips") == "c+++tips");
+    BOOST_TEST(decodePath("%E9%80%9A%E7%9F%A5") == "通知");
+    BOOST_TEST(decodePath("a%20b") == "a b");
+}
+
+BOOST_AUTO_TEST_CASE(invalid_escapes_are_kept) {
+    BOOST_TEST(decodePath("100%") == "100%");
+    BOOST_TEST(decodePath("%zz%4") == "%zz%4");
+    BOOST_TEST(decodeQuery("%g1+") == "%g1 ");
+}
+
+BOOST_AUTO_TEST_CASE(query_values_are_decoded_on_demand) {
+    argsParser parser;
+    std::string query = "type=c%2B%2B&title=a+b&limit=20";
+    queryArgs args = parser.parseQuery(query);
+    std::string arena;
+
+    arena.reserve(query.size());
+    BOOST_TEST(args.get("type", arena) == "c++");
+    BOOST_TEST(args.get("title", arena) == "a b");
+    BOOST_TEST(args.get("limit", arena) == "20");
+    BOOST_TEST(args.get("missing", arena, "x") == "x");
+}
@@ -0,0 +1,99 @@
+/**
+ * @file handshakeTimeoutTest.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief 握手超时：连上后不发送ClientHello的客户端在handshake_timeout后被断开
+ * @version 1.0
+ * @date 2024-12-01
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-12-01 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#define BOOST_TEST_MODULE handshakeTimeoutTest
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include "benchCert.hpp"
+#include "httpsServer.hpp"
+#include "logger.hpp"
+
+namespace {
+constexpr unsigned short TEST_PORT = 23043;
+
+/**
+ * @brief 连上服务端后什么也不发，返回服务端关闭连接所用的时间
+ *
+ * @param options
+ * @return std::chrono::steady_clock::duration
+ */
+std::chrono::steady_clock::duration silentClient(const serverOptions& options) {
+    httpsServer server(options);
+    std::thread server_thread([&server]() { server.start(); });
+    boost::asio::io_context io;
+    boost::asio::ip::tcp::socket socket(io);
+    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), options.port);
+    boost::system::error_code ec;
+
+    // 服务端在另一线程上启动，连接被拒绝时稍后重试
+    for (int attempt = 0; attempt < 50; ++attempt) {
+        socket.close();
+        socket.connect(endpoint, ec);
+        if (!ec) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    BOOST_TEST_REQUIRE(!ec, ec.message());
+
+    auto connected = std::chrono::steady_clock::now();
+    char byte;
+
+    // 服务端不会主动发送任何数据，读操作只会因连接关闭而结束
+    socket.read_some(boost::asio::buffer(&byte, 1), ec);
+
+    auto elapsed = std::chrono::steady_clock::now() - connected;
+
+    BOOST_TEST((ec == boost::asio::error::eof || ec == boost::asio::error::connection_reset), ec.message());
+    server.stop();
+    server_thread.join();
+    return elapsed;
+}
+
+serverOptions testOptions() {
+    serverOptions options;
+
+    options.port = TEST_PORT;
+    options.threads = 1;
+    options.handshake_timeout = std::chrono::seconds(1);
+    options.keep_alive_timeout = std::chrono::seconds(30);
+    BOOST_TEST_REQUIRE(makeTemporaryCert(options.cert_path, options.key_path));
+    logger::getInstance().setLevel(logLevel::error);
+    return options;
+}
+}
+
+BOOST_AUTO_TEST_CASE(silent_client_is_closed_after_timeout) {
+    auto elapsed = silentClient(testOptions());
+
+    BOOST_TEST((elapsed >= std::chrono::milliseconds(900)));
+    BOOST_TEST((elapsed < std::chrono::seconds(5)));
+}
+
+#ifdef HOMETOWN_COROUTINES
+BOOST_AUTO_TEST_CASE(silent_client_is_closed_after_timeout_with_coroutines) {
+    serverOptions options = testOptions();
+
+    options.coroutines = true;
+
+    auto elapsed = silentClient(options);
+
+    BOOST_TEST((elapsed >= std::chrono::milliseconds(900)));
+    BOOST_TEST((elapsed < std::chrono::seconds(5)));
+}
+#endif
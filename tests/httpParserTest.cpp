@@ -0,0 +1,221 @@
+/**
+ * @file httpParserTest.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief httpParser单元测试：拆分的请求头、请求走私、chunked与pipelining、大小限制
+ * @version 1.1
+ * @date 2024-12-01
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-12-01 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>compact后小chunk的请求体不再受框架大小限制
+ * </table>
+ */
+#define BOOST_TEST_MODULE httpParserTest
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "httpParser.hpp"
+
+namespace {
+/**
+ * @brief 整段解析，data须在request使用期间有效
+ *
+ * @param parser
+ * @param data
+ * @return httpParser::status
+ */
+httpParser::status parseAll(httpParser& parser, std::string& data) {
+    return parser.parse(&data[0], data.size());
+}
+}
+
+BOOST_AUTO_TEST_CASE(header_terminator_split_across_reads) {
+    std::string data = "GET /posts?limit=2 HTTP/1.1\r\nHost: antaresz.cc\r\n\r\n";
+    httpParser parser;
+
+    // 每次多收到一个字节，直到最后一个\n之前都不完整
+    for (std::size_t size = 1; size < data.size(); ++size) {
+        BOOST_TEST_REQUIRE((parser.parse(&data[0], size) == httpParser::status::incomplete), "size " << size);
+    }
+    BOOST_TEST_REQUIRE((parseAll(parser, data) == httpParser::status::complete));
+
+    const httpRequest& request = parser.request();
+
+    BOOST_TEST(request.method == "GET");
+    BOOST_TEST(request.path == "/posts");
+    BOOST_TEST(request.query == "limit=2");
+    BOOST_TEST(request.header("host") == "antaresz.cc");
+    BOOST_TEST(request.keep_alive);
+    BOOST_TEST(parser.consumed() == data.size());
+}
+
+BOOST_AUTO_TEST_CASE(split_between_cr_and_lf) {
+    std::string data = "GET / HTTP/1.0\r\nConnection: keep-alive\r\n\r\n";
+    httpParser parser;
+
+    BOOST_TEST_REQUIRE((parser.parse(&data[0], data.size() - 1) == httpParser::status::incomplete));
+    BOOST_TEST_REQUIRE((parseAll(parser, data) == httpParser::status::complete));
+    BOOST_TEST(parser.request().version == "HTTP/1.0");
+    BOOST_TEST(parser.request().keep_alive);
+}
+
+BOOST_AUTO_TEST_CASE(content_length_with_transfer_encoding_is_rejected) {
+    std::string data = "POST /createPost HTTP/1.1\r\nHost: a\r\nContent-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "0\r\n\r\nGET /admin HTTP/1.1\r\n\r\n";
+    httpParser parser;
+
+    BOOST_TEST_REQUIRE((parseAll(parser, data) == httpParser::status::error));
+    BOOST_TEST(parser.errorStatus() == 400);
+}
+
+BOOST_AUTO_TEST_CASE(conflicting_content_lengths_are_rejected) {
+    std::string data = "POST /createPost HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\nhello!";
+    httpParser parser;
+
+    BOOST_TEST_REQUIRE((parseAll(parser, data) == httpParser::status::error));
+    BOOST_TEST(parser.errorStatus() == 400);
+}
+
+BOOST_AUTO_TEST_CASE(chunked_body_followed_by_pipelined_request) {
+    std::string first = "POST /createPost HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "5\r\nhello\r\n6;ext=1\r\n world\r\n0\r\nX-Trailer: 1\r\n\r\n";
+    std::string second = "GET /posts/7 HTTP/1.1\r\nHost: a\r\nConnection: close\r\n\r\n";
+    std::string data = first + second;
+    httpParser parser;
+
+    // chunk数据分两次到达
+    BOOST_TEST_REQUIRE((parser.parse(&data[0], first.size() - 20) == httpParser::status::incomplete));
+    BOOST_TEST_REQUIRE((parseAll(parser, data) == httpParser::status::complete));
+    BOOST_TEST(parser.request().body == "hello world");
+    BOOST_TEST(parser.consumed() == first.size());
+
+    std::size_t begin = parser.consumed();
+
+    parser.reset();
+    BOOST_TEST_REQUIRE((parser.parse(&data[begin], data.size() - begin) == httpParser::status::complete));
+    BOOST_TEST(parser.request().method == "GET");
+    BOOST_TEST(parser.request().path == "/posts/7");
+    BOOST_TEST(!parser.request().keep_alive);
+    BOOST_TEST(parser.consumed() == second.size());
+}
+
+BOOST_AUTO_TEST_CASE(content_length_body_leaves_next_request_in_buffer) {
+    std::string data = "POST /login HTTP/1.1\r\nContent-Length: 4\r\n\r\nabcdGET / HTTP/1.1\r\n\r\n";
+    httpParser parser;
+
+    BOOST_TEST_REQUIRE((parseAll(parser, data) == httpParser::status::complete));
+    BOOST_TEST(parser.request().body == "abcd");
+    BOOST_TEST(data.substr(parser.consumed()) == "GET / HTTP/1.1\r\n\r\n");
+}
+
+BOOST_AUTO_TEST_CASE(content_length_over_limit_is_413) {
+    httpLimits limits;
+
+    limits.max_body_bytes = 16;
+
+    std::string data = "POST /createPost HTTP/1.1\r\nContent-Length: 17\r\n\r\n";
+    httpParser parser(limits);
+
+    // 请求头到达时就拒绝，不等请求体
+    BOOST_TEST_REQUIRE((parseAll(parser, data) == httpParser::status::error));
+    BOOST_TEST(parser.errorStatus() == 413);
+}
+
+BOOST_AUTO_TEST_CASE(chunked_body_over_limit_is_413) {
+    httpLimits limits;
+
+    limits.max_body_bytes = 16;
+
+    std::string data = "POST /createPost HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "a\r\n0123456789\r\na\r\n0123456789\r\n0\r\n\r\n";
+    httpParser parser(limits);
+
+    BOOST_TEST_REQUIRE((parseAll(parser, data) == httpParser::status::error));
+    BOOST_TEST(parser.errorStatus() == 413);
+}
+
+BOOST_AUTO_TEST_CASE(small_chunks_fit_after_compaction) {
+    httpLimits limits;
+
+    limits.max_header_bytes = 256;
+    limits.max_body_bytes = 1024;
+
+    httpParser parser(limits);
+    std::string raw = "POST /createPost HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+    std::string second = "GET / HTTP/1.1\r\n\r\n";
+    std::string body;
+
+    // 1字节的chunk各带5字节框架，原始数据远超maxRequestBytes，解码后恰好等于上限
+    for (std::size_t i = 0; i < limits.max_body_bytes; ++i) {
+        char c = static_cast<char>('a' + i % 26);
+
+        raw += "1\r\n";
+        raw += c;
+        raw += "\r\n";
+        body += c;
+    }
+    raw += "0\r\n\r\n" + second;
+    BOOST_TEST_REQUIRE(raw.size() > parser.maxRequestBytes());
+
+    // 与服务端相同：缓冲区不超过maxRequestBytes，满时先compact
+    std::vector<char> buffer(parser.maxRequestBytes());
+    std::size_t end = 0;
+    std::size_t sent = 0;
+    httpParser::status result = httpParser::status::incomplete;
+
+    while (result == httpParser::status::incomplete) {
+        if (end == buffer.size()) {
+            end -= parser.compact(buffer.data(), end);
+            BOOST_TEST_REQUIRE(end < buffer.size());
+        }
+
+        std::size_t n = std::min({buffer.size() - end, raw.size() - sent, std::size_t(100)});
+
+        BOOST_TEST_REQUIRE(n > 0u);
+        std::memcpy(buffer.data() + end, raw.data() + sent, n);
+        end += n;
+        sent += n;
+        result = parser.parse(buffer.data(), end);
+    }
+    BOOST_TEST_REQUIRE((result == httpParser::status::complete));
+    BOOST_TEST(parser.request().body == body);
+    BOOST_TEST(parser.request().method == "POST");
+    // pipelining的后续请求紧接在compact后的请求之后
+    BOOST_TEST(std::string(buffer.data() + parser.consumed(), end - parser.consumed()) + raw.substr(sent) == second);
+}
+
+BOOST_AUTO_TEST_CASE(headers_over_limit_are_431) {
+    httpLimits limits;
+
+    limits.max_header_bytes = 64;
+
+    std::string head = "GET / HTTP/1.1\r\nX-Padding: " + std::string(64, 'a');
+    httpParser unterminated(limits);
+
+    // 还没有收到结束符，但已超过上限
+    BOOST_TEST_REQUIRE((unterminated.parse(&head[0], head.size()) == httpParser::status::error));
+    BOOST_TEST(unterminated.errorStatus() == 431);
+
+    std::string data = head + "\r\n\r\n";
+    httpParser terminated(limits);
+
+    BOOST_TEST_REQUIRE((parseAll(terminated, data) == httpParser::status::error));
+    BOOST_TEST(terminated.errorStatus() == 431);
+}
+
+BOOST_AUTO_TEST_CASE(headers_within_limit_are_accepted) {
+    httpLimits limits;
+
+    limits.max_header_bytes = 64;
+
+    std::string data = "GET / HTTP/1.1\r\nHost: a\r\n\r\n";
+    httpParser parser(limits);
+
+    BOOST_TEST((parseAll(parser, data) == httpParser::status::complete));
+}
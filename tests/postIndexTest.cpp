@@ -0,0 +1,232 @@
+/**
+ * @file postIndexTest.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief postIndex单元测试：跳表前进、压缩重新编号、更新与删除、CJK单字与二元词检索
+ * @version 1.0
+ * @date 2024-12-01
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-12-01 <td>1.0     <td>antaresz    <td>desc
+ * </table>
+ */
+#define BOOST_TEST_MODULE postIndexTest
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <initializer_list>
+#include <string>
+#include <vector>
+#include "postIndex.hpp"
+
+namespace {
+constexpr std::size_t MAX_HITS = 10000;            //大于任一测试中的帖子数，返回全部命中
+
+/**
+ * @brief 检索并返回命中的帖子id，按id排序
+ *
+ * @param index
+ * @param query
+ * @return std::vector<int>
+ */
+std::vector<int> matchingIds(const postIndex& index, const std::string& query) {
+    std::vector<searchHit> hits;
+    std::size_t matched = index.search(query, MAX_HITS, hits);
+    std::vector<int> ids;
+
+    for (const searchHit& hit : hits) {
+        ids.push_back(hit.post_id);
+    }
+    std::sort(ids.begin(), ids.end());
+    BOOST_TEST(matched == ids.size());
+    return ids;
+}
+
+/**
+ * @brief 帖子i的正文含有m<d>当且仅当d整除i
+ *
+ * @param id
+ * @return std::string
+ */
+std::string multiplesContent(int id) {
+    std::string content = "all";
+
+    for (int divisor : {2, 3, 7, 128, 129, 300, 997}) {
+        if (id % divisor == 0) {
+            content += " m" + std::to_string(divisor);
+        }
+    }
+    return content;
+}
+
+/**
+ * @brief [first, last]中能被divisors全部整除的id
+ *
+ * @param first
+ * @param last
+ * @param divisors
+ * @return std::vector<int>
+ */
+std::vector<int> expectedMultiples(int first, int last, std::initializer_list<int> divisors) {
+    std::vector<int> ids;
+
+    for (int id = first; id <= last; ++id) {
+        if (std::all_of(divisors.begin(), divisors.end(), [id](int divisor) { return id % divisor == 0; })) {
+            ids.push_back(id);
+        }
+    }
+    return ids;
+}
+}
+
+BOOST_AUTO_TEST_CASE(intersection_skips_across_blocks) {
+    // 跨越多个BLOCK_POSTINGS块的倒排表，稀疏的表要求密集的表按跳表整块跳过
+    const int POSTS = 5000;
+    postIndex index;
+
+    for (int id = 1; id <= POSTS; ++id) {
+        index.add(id, "", multiplesContent(id));
+    }
+
+    BOOST_TEST(matchingIds(index, "all m997") == expectedMultiples(1, POSTS, {997}));
+    BOOST_TEST(matchingIds(index, "m2 m3 m7") == expectedMultiples(1, POSTS, {2, 3, 7}));
+    BOOST_TEST(matchingIds(index, "m2 m300") == expectedMultiples(1, POSTS, {300}));
+    // 128与129的倍数在块边界附近交错
+    BOOST_TEST(matchingIds(index, "m128 m3") == expectedMultiples(1, POSTS, {128, 3}));
+    BOOST_TEST(matchingIds(index, "m129 m2 all") == expectedMultiples(1, POSTS, {129, 2}));
+    BOOST_TEST(matchingIds(index, "m128 m129").empty());
+    BOOST_TEST(matchingIds(index, "m997 missing").empty());
+}
+
+BOOST_AUTO_TEST_CASE(top_k_is_ordered_by_score_then_newest) {
+    postIndex index;
+    std::vector<searchHit> hits;
+
+    index.add(1, "", "apple");
+    index.add(2, "apple", "banana");
+    index.add(3, "", "apple");
+    index.add(4, "", "banana");
+
+    BOOST_TEST(index.search("apple", 2, hits) == 3u);
+    BOOST_TEST_REQUIRE(hits.size() == 2u);
+    // 标题加权的帖子在前，其余得分相同时新帖子在前
+    BOOST_TEST(hits[0].post_id == 2);
+    BOOST_TEST(hits[1].post_id == 3);
+    BOOST_TEST(hits[0].score > hits[1].score);
+}
+
+BOOST_AUTO_TEST_CASE(update_replaces_terms) {
+    postIndex index;
+
+    index.add(1, "first", "old words");
+    index.add(2, "second", "old words");
+
+    BOOST_TEST(index.update(1, "first", "new words"));
+    BOOST_TEST(!index.update(3, "third", "anything"));
+    BOOST_TEST(matchingIds(index, "old") == std::vector<int>{2});
+    BOOST_TEST(matchingIds(index, "new") == std::vector<int>{1});
+    BOOST_TEST(matchingIds(index, "words") == (std::vector<int>{1, 2}));
+    BOOST_TEST(matchingIds(index, "third").empty());
+
+    // add对已有的帖子同样是替换
+    index.add(2, "second", "replaced");
+    BOOST_TEST(matchingIds(index, "old").empty());
+    BOOST_TEST(matchingIds(index, "words") == std::vector<int>{1});
+
+    indexStats stats = index.stats();
+
+    BOOST_TEST(stats.documents == 2u);
+    BOOST_TEST(stats.deleted == 2u);
+}
+
+BOOST_AUTO_TEST_CASE(remove_hides_post) {
+    postIndex index;
+
+    index.add(1, "hello", "world");
+    index.add(2, "hello", "there");
+    index.remove(1);
+    index.remove(42);
+
+    BOOST_TEST(matchingIds(index, "hello") == std::vector<int>{2});
+    BOOST_TEST(matchingIds(index, "world").empty());
+    BOOST_TEST(index.stats().documents == 1u);
+
+    index.remove(2);
+    BOOST_TEST(matchingIds(index, "hello").empty());
+    BOOST_TEST(index.stats().documents == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(compact_renumbers_documents) {
+    const int POSTS = 400;
+    postIndex index;
+
+    for (int id = 1; id <= POSTS; ++id) {
+        index.add(id, "", multiplesContent(id));
+    }
+    // 删除偶数帖子，删除数超过剩余的四分之一时压缩
+    for (int id = 2; id <= POSTS; id += 2) {
+        index.remove(id);
+    }
+
+    indexStats stats = index.stats();
+
+    BOOST_TEST(stats.documents == static_cast<std::size_t>(POSTS / 2));
+    BOOST_TEST(stats.deleted < 64u);
+    // 偶数帖子都已删除
+    BOOST_TEST(matchingIds(index, "m2").empty());
+
+    std::vector<int> odd_multiples_of_3;
+
+    for (int id = 3; id <= POSTS; id += 6) {
+        odd_multiples_of_3.push_back(id);
+    }
+    BOOST_TEST(matchingIds(index, "m3") == odd_multiples_of_3);
+    BOOST_TEST(matchingIds(index, "m3 m7") == std::vector<int>({21, 63, 105, 147, 189, 231, 273, 315, 357, 399}));
+
+    // 压缩后新加入、更新与删除的帖子接在重新编号的文档之后
+    index.add(POSTS + 1, "", "all m3 fresh");
+    BOOST_TEST(index.update(3, "", "all fresh"));
+    index.remove(9);
+    odd_multiples_of_3.erase(odd_multiples_of_3.begin(), odd_multiples_of_3.begin() + 2);
+    odd_multiples_of_3.push_back(POSTS + 1);
+    BOOST_TEST(matchingIds(index, "m3") == odd_multiples_of_3);
+    BOOST_TEST(matchingIds(index, "fresh") == (std::vector<int>{3, POSTS + 1}));
+    BOOST_TEST(matchingIds(index, "all").size() == static_cast<std::size_t>(POSTS / 2));
+}
+
+BOOST_AUTO_TEST_CASE(cjk_text_is_split_into_unigrams_and_bigrams) {
+    std::vector<std::string> terms;
+
+    postIndex::tokenize("北京大学", terms);
+    std::sort(terms.begin(), terms.end());
+    BOOST_TEST(terms == (std::vector<std::string>{"京", "京大", "北", "北京", "大", "大学", "学"}));
+
+    terms.clear();
+    postIndex::tokenize("Hello，世界ＡＢＣ1", terms);
+    std::sort(terms.begin(), terms.end());
+    BOOST_TEST(terms == (std::vector<std::string>{"abc1", "hello", "世", "世界", "界"}));
+}
+
+BOOST_AUTO_TEST_CASE(cjk_queries_match_unigrams_and_bigrams) {
+    postIndex index;
+
+    index.add(1, "北京大学", "");
+    index.add(2, "南京", "长江大桥");
+    index.add(3, "", "東京タワー");
+
+    // 单字查询命中单字
+    BOOST_TEST(matchingIds(index, "京") == (std::vector<int>{1, 2, 3}));
+    BOOST_TEST(matchingIds(index, "大") == (std::vector<int>{1, 2}));
+    // 多字查询按相邻二元词求交，不相邻的字不命中
+    BOOST_TEST(matchingIds(index, "北京") == std::vector<int>{1});
+    BOOST_TEST(matchingIds(index, "京大") == std::vector<int>{1});
+    BOOST_TEST(matchingIds(index, "北大").empty());
+    BOOST_TEST(matchingIds(index, "长江大桥") == std::vector<int>{2});
+    BOOST_TEST(matchingIds(index, "タワー") == std::vector<int>{3});
+    BOOST_TEST(matchingIds(index, "東タ").empty());
+    // 以分隔符分开的多段分别求交
+    BOOST_TEST(matchingIds(index, "南京 大桥") == std::vector<int>{2});
+    BOOST_TEST(matchingIds(index, "南京，北京").empty());
+}
@@ -0,0 +1,280 @@
+/**
+ * @file postStreamTest.cpp
+ * @author antaresz (antaresz1026@gmail.com)
+ * @brief /posts?all=1流式列表：逐页分块、HTTP/1.1的Connection: close仍分块、HTTP/1.0以关闭连接结束
+ * @version 1.1
+ * @date 2024-12-01
+ *
+ * @copyright Copyright (c) 2024 antaresz
+ *
+ * @par 修改日志:
+ * <table>
+ * <tr><th>Date       <th>Version <th>Author <th>Description
+ * <tr><td>2024-12-01 <td>1.0     <td>antaresz    <td>desc
+ * <tr><td>2024-12-01 <td>1.1     <td>antaresz    <td>流式响应写完前占用在途名额
+ * </table>
+ */
+#define BOOST_TEST_MODULE postStreamTest
+#include <boost/test/unit_test.hpp>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/asio/write.hpp>
+#include <nlohmann/json.hpp>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "apiRoutes.hpp"
+#include "benchCert.hpp"
+#include "logger.hpp"
+#include "memoryStore.hpp"
+
+namespace {
+constexpr int POSTS = 25;
+constexpr unsigned short TEST_PORT = 23042;
+
+/**
+ * @brief 从指标中读出处理中的请求数
+ *
+ * @param metrics
+ * @return int
+ */
+int inflightRequests(const metricsRegistry& metrics) {
+    const std::string name = "\nhometown_http_inflight_requests ";
+    std::string text = metrics.render();
+    std::size_t pos = text.find(name);
+
+    BOOST_TEST_REQUIRE(pos != std::string::npos);
+    return std::atoi(text.c_str() + pos + name.size());
+}
+
+/**
+ * @brief 带POSTS篇帖子的服务端，在后台线程上运行
+ *
+ * /inflight-probe逐块返回，每次被要求下一块时记下处理中的请求数。
+ */
+struct streamingServer {
+    memoryStore store;
+    workerPool db_pool{"db", 2, 1024};
+    workerPool hash_pool{"hash", 1, 1024};
+    kdfParams kdf_params;
+    userHandler user_handler{store, db_pool, hash_pool, kdf_params};
+    postManage post_manager{store};
+    tokenSigner signer;
+    std::unique_ptr<httpsServer> server;
+    std::thread server_thread;
+    std::vector<int> probed;
+    int probe_chunks = 0;
+
+    streamingServer() {
+        serverOptions options;
+
+        options.port = TEST_PORT;
+        options.threads = 1;
+        BOOST_TEST_REQUIRE(makeTemporaryCert(options.cert_path, options.key_path));
+        logger::getInstance().setLevel(logLevel::error);
+        for (int i = 0; i < POSTS; ++i) {
+            store.insertPost(1, "title " + std::to_string(i), "content " + std::to_string(i), "notice");
+        }
+        server = std::make_unique<httpsServer>(options);
+        installApiRoutes(*server, apiServices{user_handler, post_manager, signer, db_pool});
+        server->setAsyncRoute("GET", "/inflight-probe", [this](const httpRequest&, httpsServer::responder done) {
+            probe_chunks = 0;
+            done(std::move(httpResponse(200).streamBody([this](httpResponse::chunkSink next) {
+                probed.push_back(inflightRequests(server->metrics()));
+                next(true, ++probe_chunks <= 2 ? std::string_view("chunk") : std::string_view());
+            })));
+        });
+        server_thread = std::thread([this]() { server->start(); });
+    }
+    ~streamingServer() {
+        server->stop();
+        server_thread.join();
+    }
+};
+
+/**
+ * @brief 以TLS连接发送一个请求，读到服务端关闭连接为止
+ *
+ * @param request
+ * @return std::string 完整的原始响应
+ */
+std::string fetch(const std::string& request) {
+    boost::asio::io_context io;
+    boost::asio::ssl::context ctx(boost::asio::ssl::context::tls_client);
+    boost::asio::ssl::stream<boost::asio::ip::tcp::socket> stream(io, ctx);
+    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), TEST_PORT);
+    boost::system::error_code ec;
+
+    // 服务端在另一线程上启动，连接被拒绝时稍后重试
+    for (int attempt = 0; attempt < 50; ++attempt) {
+        stream.lowest_layer().close();
+        stream.lowest_layer().connect(endpoint, ec);
+        if (!ec) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    BOOST_TEST_REQUIRE(!ec, ec.message());
+    stream.handshake(boost::asio::ssl::stream_base::client);
+    boost::asio::write(stream, boost::asio::buffer(request));
+
+    std::string response;
+    char buffer[4096];
+
+    for (;;) {
+        std::size_t read = stream.read_some(boost::asio::buffer(buffer), ec);
+
+        response.append(buffer, read);
+        if (ec) {
+            break;
+        }
+    }
+    return response;
+}
+
+/**
+ * @brief 拆出响应头与body
+ *
+ * @param response
+ * @param body
+ * @return std::string 响应头，不含结尾的空行
+ */
+std::string splitResponse(const std::string& response, std::string& body) {
+    std::size_t end = response.find("\r\n\r\n");
+
+    BOOST_TEST_REQUIRE(end != std::string::npos);
+    body = response.substr(end + 4);
+    return response.substr(0, end);
+}
+
+/**
+ * @brief 解码chunked body，要求以0长度块结尾
+ *
+ * @param body
+ * @param chunks 非结束块的个数
+ * @return std::string
+ */
+std::string dechunk(const std::string& body, std::size_t& chunks) {
+    std::string data;
+    std::size_t pos = 0;
+
+    chunks = 0;
+    for (;;) {
+        std::size_t line_end = body.find("\r\n", pos);
+
+        BOOST_TEST_REQUIRE(line_end != std::string::npos);
+
+        std::size_t size = std::strtoul(body.c_str() + pos, nullptr, 16);
+
+        pos = line_end + 2;
+        if (size == 0) {
+            BOOST_TEST(body.substr(pos) == "\r\n");
+            return data;
+        }
+        BOOST_TEST_REQUIRE(pos + size + 2 <= body.size());
+        data.append(body, pos, size);
+        BOOST_TEST(body.substr(pos + size, 2) == "\r\n");
+        pos += size + 2;
+        ++chunks;
+    }
+}
+
+/**
+ * @brief 检查列表包含全部帖子且按从新到旧排列、没有重复
+ *
+ * @param json
+ */
+void checkAllPosts(const std::string& json) {
+    nlohmann::json listing = nlohmann::json::parse(json);
+    const nlohmann::json& posts = listing["posts"];
+    std::set<int> ids;
+
+    BOOST_TEST_REQUIRE(posts.size() == static_cast<std::size_t>(POSTS));
+    for (std::size_t i = 0; i < posts.size(); ++i) {
+        int id = posts[i]["id"];
+
+        ids.insert(id);
+        if (i > 0) {
+            BOOST_TEST(id < posts[i - 1]["id"].get<int>());
+        }
+    }
+    BOOST_TEST(ids.size() == static_cast<std::size_t>(POSTS));
+    BOOST_TEST(!listing.contains("next"));
+}
+}
+
+BOOST_FIXTURE_TEST_SUITE(post_stream, streamingServer)
+
+BOOST_AUTO_TEST_CASE(simulated_listing_is_one_chunk_per_page) {
+    std::string body;
+    std::string head = splitResponse(server->simulateRequest("GET", "/posts?all=1&limit=10"), body);
+    std::size_t chunks = 0;
+
+    BOOST_TEST(head.find("HTTP/1.1 200") == 0);
+    BOOST_TEST(head.find("Transfer-Encoding: chunked") != std::string::npos);
+
+    std::string json = dechunk(body, chunks);
+
+    checkAllPosts(json);
+    BOOST_TEST(chunks == 3u);
+}
+
+BOOST_AUTO_TEST_CASE(listing_after_cursor_skips_newer_posts) {
+    std::string first_page;
+
+    splitResponse(server->simulateRequest("GET", "/posts?limit=5"), first_page);
+
+    std::string cursor = nlohmann::json::parse(first_page)["next"];
+    std::string encoded;
+
+    // 游标中的时间带空格，作为查询参数须编码
+    for (char c : cursor) {
+        encoded += c == ' ' ? std::string("%20") : std::string(1, c);
+    }
+    std::string body;
+    std::size_t chunks = 0;
+
+    splitResponse(server->simulateRequest("GET", "/posts?all=1&limit=7&after=" + encoded), body);
+
+    nlohmann::json listing = nlohmann::json::parse(dechunk(body, chunks));
+
+    BOOST_TEST(listing["posts"].size() == static_cast<std::size_t>(POSTS - 5));
+    BOOST_TEST(chunks == 3u);
+}
+
+BOOST_AUTO_TEST_CASE(http11_connection_close_is_still_chunked) {
+    std::string body;
+    std::string head = splitResponse(fetch("GET /posts?all=1&limit=10 HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n"), body);
+    std::size_t chunks = 0;
+
+    BOOST_TEST(head.find("HTTP/1.1 200") == 0);
+    BOOST_TEST(head.find("Transfer-Encoding: chunked") != std::string::npos);
+    BOOST_TEST(head.find("Connection: close") != std::string::npos);
+    checkAllPosts(dechunk(body, chunks));
+    BOOST_TEST(chunks == 3u);
+}
+
+BOOST_AUTO_TEST_CASE(http10_body_ends_with_connection) {
+    std::string body;
+    std::string head = splitResponse(fetch("GET /posts?all=1&limit=10 HTTP/1.0\r\nHost: localhost\r\n\r\n"), body);
+
+    BOOST_TEST(head.find("200") != std::string::npos);
+    BOOST_TEST(head.find("Transfer-Encoding") == std::string::npos);
+    BOOST_TEST(head.find("Content-Length") == std::string::npos);
+    checkAllPosts(body);
+}
+
+BOOST_AUTO_TEST_CASE(streaming_response_holds_inflight_slot_until_written) {
+    std::string body;
+    std::size_t chunks = 0;
+
+    splitResponse(fetch("GET /inflight-probe HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n"), body);
+    BOOST_TEST(dechunk(body, chunks) == "chunkchunk");
+    // 数据源每次被调用时请求仍计入处理中，写完后归还
+    BOOST_TEST(probed == (std::vector<int>{1, 1, 1}));
+    BOOST_TEST(inflightRequests(server->metrics()) == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()